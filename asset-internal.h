@@ -15,34 +15,48 @@ namespace Framework
 	//      as a directory name in the .zip.  For example, source file "foo/bar/baz.obj" will
 	//      result in a directory "foo/bar/baz.obj/" with files in it for verts, indices, etc.
 	//
-	//  * Compiled data is considered out-of-date and recompiled if the mod time of the source
-	//      file is newer than the mod time of the asset pack (the .zip).
+	//  * Each asset stores a record of the source file it was compiled from: a content hash,
+	//      the compiler version, and a hash of the compile settings.  Compiled data is considered
+	//      out-of-date and recompiled if any of these change.  The source's size and mod time are
+	//      also recorded, so unchanged files can usually skip hashing.
 	//
 	//  * Version numbers for the whole pack system and each asset type are also stored in the
 	//      .zip, and mismatches will trigger recompilation.
 	//
-	//  !!!UNDONE: build the list of sources to compile by following dependencies from some root.
+	//  * Assets compile in parallel, each to its own in-memory .zip, and are then copied into
+	//      the pack in the order they were listed.
+	//
+	//  * The list of assets to compile is discovered by following dependencies from a set of
+	//      roots: an .obj references its .mtl libraries, which reference textures.  The edges
+	//      are recorded per asset in the pack, so they can still be followed when sources are
+	//      missing, and don't need rescanning for sources that haven't changed.
+	//
+	//  * Each file has a codec (see CODEC).  Bulk vertex, index and pixel data uses the one set
+	//      per asset, stored by default so memory-mapped packs can use it in place; other files,
+	//      and ones too small or incompressible to be worth it, are stored.  LZ files look stored
+	//      to zip, and are marked by their entry comment.  Encoded files are decoded in parallel
+	//      at load.
 
 	namespace AssetCompiler
 	{
 		enum PACKVER
 		{
-			PACKVER_Current = 3,
+			PACKVER_Current = 7,
 		};
 
 		enum MESHVER
 		{
-			MESHVER_Current = 5,
+			MESHVER_Current = 10,
 		};
 
 		enum MTLVER
 		{
-			MTLVER_Current = 4,
+			MTLVER_Current = 5,
 		};
 
 		enum TEXVER
 		{
-			TEXVER_Current = 1,
+			TEXVER_Current = 5,
 		};
 
 		struct VersionInfo
@@ -53,6 +67,104 @@ namespace Framework
 			TEXVER		m_texver;
 		};
 
+		// Record of the source file an asset was compiled from, stored as "<asset path>/source_info"
+		struct SourceInfo
+		{
+			u64			m_contentHash;		// HashXXH64 of the source file's contents
+			u64			m_settingsHash;		// HashCompileSettings of the AssetCompileInfo
+			i64			m_size;				// Size and mod time, to skip hashing unchanged files
+			i64			m_mtime;
+			int			m_compilerVer;		// CompilerVersionForACK at compile time
+		};
+
+		// Header of the pack's directory file, a minimal perfect hash over the paths of all the
+		// other files.  Followed by AssetPack::DirectorySlot[m_numSlots], then u32[m_numBuckets]
+		// displacements.  A path's bucket and slot are found with DirectoryBucketIndex/DirectorySlotIndex.
+		struct DirectoryHeader
+		{
+			u32			m_magic;			// s_directoryMagic
+			u32			m_numSlots;
+			u32			m_numBuckets;
+			u32			m_padding;
+			u64			m_seed;
+		};
+
+		static const u32 s_directoryMagic = 0x52494450;		// 'PDIR'
+
+		inline u64 MixDirectoryHash(u64 h)
+		{
+			// 64-bit finalizer from MurmurHash3
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ULL;
+			h ^= h >> 33;
+			return h;
+		}
+
+		inline u32 DirectoryBucketIndex(u64 pathHash, u64 seed, u32 numBuckets)
+		{
+			return u32((MixDirectoryHash(pathHash ^ seed) >> 32) % numBuckets);
+		}
+
+		inline u32 DirectorySlotIndex(u64 pathHash, u64 seed, u32 displacement, u32 numSlots)
+		{
+			return u32(MixDirectoryHash(pathHash ^ seed ^ (u64(displacement) * 0x9e3779b97f4a7c15ULL)) % numSlots);
+		}
+
+		// Build a directory file over a list of path hashes (from AssetPack::HashPath),
+		// mapping each to its position in the list
+		bool BuildDirectory(
+			std::vector<u64> const & pathHashes,
+			std::vector<byte> * pDataOut);
+
+		// Write a directory file over the given paths to the .zip, as the last entry.
+		bool WriteDirectoryToZip(
+			std::vector<std::string> const & paths,
+			mz_zip_archive * pZipOut);
+
+		// Reference from one asset to another that it needs, with hints for compiling it
+		// when it's not a root
+		struct AssetDependency
+		{
+			std::string		m_pathSrc;
+			ACK				m_ack;
+			bool			m_alphaTested;		// Texture is alpha-tested by a material (sets m_preserveAlphaCoverage)
+		};
+
+		// Set of assets discovered from some roots, and the dependency edges between them
+		struct AssetGraph
+		{
+			std::deque<std::string>			m_paths;		// Storage for m_assets[i].m_pathSrc (deque, so pointers stay put)
+			std::vector<AssetCompileInfo>	m_assets;		// In dependency order: each asset comes after the ones it references
+			std::vector<std::vector<int>>	m_deps;			// Indices into m_assets of the assets each one references
+		};
+
+		// Follow dependencies from a set of root assets to find all the assets needed.
+		// Edges come from scanning the source files; for sources that are missing or
+		// unchanged since the existing pack at packPath (if any) was built, they come
+		// from the records in the pack.
+		bool BuildAssetGraph(
+			const char * packPath,
+			const AssetCompileInfo * roots,
+			int numRoots,
+			AssetGraph * pGraphOut);
+
+		// 64-bit xxHash of a block of memory
+		u64 HashXXH64(const void * pData, size_t sizeBytes, u64 seed = 0);
+
+		// Convert to a 16-bit float, rounding to nearest even
+		u16 FloatToHalf(float f);
+
+		// Hash the settings in an AssetCompileInfo that affect the compiled output
+		u64 HashCompileSettings(const AssetCompileInfo * pACI);
+
+		// Current compiler version for a given asset type
+		int CompilerVersionForACK(ACK ack);
+
+		// Fill out a SourceInfo for an asset, by statting and hashing its source file
+		bool MakeSourceInfo(const AssetCompileInfo * pACI, SourceInfo * pInfoOut);
+
 		// Load an asset pack file from a zip stream (can be in memory or a file).
 		bool LoadAssetPackFromZip(
 			mz_zip_archive * pZip,
@@ -62,20 +174,47 @@ namespace Framework
 		// (this should really be generalized to allow UTF-8 printable chars)
 		bool NormalizePath(char * path);
 
-		// Write a memory buffer out to an asset pack .zip file.
+		// Write a memory buffer out to an asset pack .zip file, encoded with the given codec.
+		// Small files, and ones that don't shrink, are stored regardless.
+		// If pPathsWritten is given, the normalized path is appended to it.
 		bool WriteAssetDataToZip(
 			const char * assetPath,
 			const char * assetSuffix,
 			const void * pData,
 			size_t sizeBytes,
-			mz_zip_archive * pZipOut);
+			mz_zip_archive * pZipOut,
+			CODEC codec = CODEC_Stored,
+			std::vector<std::string> * pPathsWritten = nullptr);
+
+		// Work out how a file in the pack is encoded, from its zip directory entry.
+		// LZ files are stored as far as zip is concerned, with a comment giving the decoded size.
+		bool GetFileCodec(
+			const mz_zip_archive_file_stat * pFileStat,
+			CODEC * pCodecOut,
+			int * pSizeDecodedOut);
+
+		// Decode a file's encoded bytes (as read with MZ_ZIP_FLAG_COMPRESSED_DATA) to exactly dstSize bytes.
+		bool DecodeFileData(
+			CODEC codec,
+			const void * pSrc,
+			size_t srcSize,
+			void * pDst,
+			size_t dstSize);
+
+		// Name an asset goes by in the manifest: its source path, lowercase, with forward slashes
+		std::string ManifestName(const char * pathSrc);
+
+		// Add an asset to a manifest under construction.
+		void AppendToManifest(
+			const AssetCompileInfo * pACI,
+			std::string * pManifest);
 
-		// Parse an asset pack manifest (newline-delimited list of names) into a set structure.
+		// Parse an asset pack manifest (newline-delimited list of names and kinds) into a map.
 		void ParseManifest(
 			const char * manifest,
 			int manifestSize,
 			const char * path,
-			std::unordered_set<std::string> * pManifestOut);
+			std::unordered_map<std::string, ACK> * pManifestOut);
 
 		// Compile an entire asset pack from scratch, to a .zip file on disk.
 		bool CompileFullAssetPackToFile(
@@ -89,7 +228,7 @@ namespace Framework
 			int numAssets,
 			mz_zip_archive * pZipOut);
 
-		// Check if any assets in a pack are out of date by version number or mod time,
+		// Check if any assets in a pack are out of date by version number or source contents,
 		// returning a list of ones that need updating (as indices into the assets array).
 		bool FindOutOfDateAssets(
 			const char * packPath,
@@ -1,20 +1,43 @@
 #include "framework.h"
 #include "asset-internal.h"
 #include <algorithm>
-#include <deque>
+
+// Set this to 1 to check every chunked OBJ parse against a serial parse of the same file
+#define OBJ_PARSE_VERIFY 0
+
+// Set this to 1 to log vertex cache stats from before triangle order optimization, and overdraw
+// before and after when the overdraw pass runs.  Overdraw is measured by rasterizing the whole
+// mesh from several views, so this is slow for big meshes.
+#define OBJ_OPTIMIZE_STATS 0
+
+// Material ranges with more triangles than this are split into spatially coherent clusters
+// for vertex cache optimization, so a single huge range can still use all the cores.
+// Set this to 0 to always optimize whole ranges, for the best cache efficiency.
+#define OBJ_VERTEX_CACHE_CLUSTER_TRIS (64 * 1024)
 
 namespace Framework
 {
 	// Infrastructure for compiling Wavefront .obj files to vertex/index buffers.
-	//  * Currently uses hard-coded Vertex structure.
+	//  * Writes verts in a choice of layouts (see VTXFMT): plain floats, or compact quantized
+	//      attributes described by a VertexFormat in the metadata.
 	//  * Creates a single vertex buffer and index buffer, plus a material map that
 	//      identifies which faces get drawn with each material.
 	//  * Groups together all faces with the same material into a contiguous
 	//      range of indices, so they can be drawn with one draw call.
+	//  * Parses big files in parallel, split into line-aligned chunks.
 	//  * Removes degenerate triangles.
-	//  * Deduplicates verts.
+	//  * Deduplicates verts, optionally welding ones whose positions are within an epsilon.
 	//  * Generates normals if necessary.
-	//  * !!!UNDONE: Vertex cache optimization.
+	//  * Optimizes triangle order for the vertex cache, with material ranges in parallel, using
+	//      a choice of optimizers; optionally also sorts clusters of triangles to cut overdraw.
+	//  * Partitions the triangles into meshlets of up to 64 verts and 124 triangles, each with
+	//      bounds and a normal cone for culling.
+	//  * Optionally generates a chain of LODs by quadric edge-collapse simplification, stored
+	//      as extra index ranges that share the vertex buffer.
+	//  * Also writes a position-only vertex stream for depth-only passes, with verts that
+	//      differ only in other attributes welded, and its own parallel index buffer.
+	//  * Writes 16-bit indices when they fit, optionally splitting big meshes into blocks of
+	//      up to 64K verts, drawn with a base vertex each, so they always fit.
 
 	namespace OBJMeshCompiler
 	{
@@ -22,11 +45,46 @@ namespace Framework
 		static const char * s_suffixVerts		= "/verts";
 		static const char * s_suffixIndices		= "/indices";
 		static const char * s_suffixMtlMap		= "/material_map";
+		static const char * s_suffixMeshlets	= "/meshlets";
+		static const char * s_suffixLods		= "/lods";
+		static const char * s_suffixPosVerts	= "/pos_verts";
+		static const char * s_suffixPosIndices	= "/pos_indices";
+
+		static const int s_vertexCacheSizeDefault = 32;
+		static const char * s_vcoptNames[] =
+		{
+			"Forsyth",
+			"Tipsify",
+			"no reordering",
+		};
+		cassert(dim(s_vcoptNames) == VCOPT_Count);
+
+		// Meshlet size limits, as commonly used for mesh shaders
+		static const int s_meshletVertsMax = 64;
+		static const int s_meshletTrisMax = 124;
+
+		static const float s_lodRatioDefault = 0.5f;
 
 		struct MtlRange
 		{
 			std::string		m_mtlName;
 			int				m_indexStart, m_indexCount;
+			int				m_baseVertex;		// Added to the range's indices; nonzero only after SplitFor16BitIndices
+			int				m_posBaseVertex;	// Likewise for the position-only stream, from BuildPositionStream
+		};
+
+		// Run of the index buffer
+		struct IndexRun
+		{
+			int				m_indexStart, m_indexCount;
+		};
+
+		// Simplified version of the mesh, sharing its verts
+		struct Lod
+		{
+			std::vector<int>		m_indices;		// Not relative to base verts; moved to the main index buffer by AppendLodIndices
+			std::vector<IndexRun>	m_runs;			// Into m_indices, one per material range
+			float					m_error;		// Estimated RMS distance from the full mesh's surface
 		};
 
 		struct Context
@@ -34,33 +92,57 @@ namespace Framework
 			std::vector<Vertex>		m_verts;
 			std::vector<int>		m_indices;
 			std::vector<MtlRange>	m_mtlRanges;
+			std::vector<Meshlet>	m_meshlets;		// In index buffer order, once built
+			std::vector<Lod>		m_lods;			// LODs after the first, if any
 			box3					m_bounds;
 			bool					m_hasNormals;
 		};
 
 		struct Meta
 		{
-			// Later: vertex format info
-
 			box3			m_bounds;
+			VertexFormat	m_vtxFormat;
+			int				m_indexSizeBytes;	// 2 or 4
+			int				m_posStrideBytes;	// Position-only stream
+			int				m_posIndexSizeBytes;
 		};
 
 		// Prototype various helper functions
 		bool ParseOBJ(const char * path, Context * pCtxOut);
 		void RemoveDegenerateTriangles(Context * pCtx);
 		void RemoveEmptyMaterialRanges(Context * pCtx);
-		void DeduplicateVerts(Context * pCtx);
+		void DeduplicateVerts(Context * pCtx, float weldEpsilon = 0.0f);
 		void CalculateNormals(Context * pCtx);
 		void NormalizeNormals(Context * pCtx);
 #if VERTEX_TANGENT
 		void CalculateTangents(Context * pCtx);
 #endif
 		void SortMaterials(Context * pCtx);
-		void SortTrianglesForVertexCache(Context * pCtx);
+		void OptimizeForsyth(const int * pIndices, int indexCount, int numVerts, int cacheSize, int * pIndicesOut);
+		void OptimizeTipsify(const int * pIndices, int indexCount, int numVerts, int cacheSize, int * pIndicesOut);
+		void OptimizeOverdraw(const Context * pCtx, const int * localToGlobal, int * pIndices, int indexCount, int numVerts, int cacheSize);
+		void OptimizeTrianglesForVertexCache(const Context * pCtx, const int * pIndices, int indexCount, VCOPT vcopt, int cacheSize, bool optimizeOverdraw, int * pIndicesOut);
+		void SortTrianglesSpatially(const Context * pCtx, int * pIndices, int indexCount);
+		void SplitRangesIntoJobs(const Context * pCtx, std::vector<IndexRun> * pJobsOut, std::vector<int> * pRangesClusteredOut = nullptr);
+		void SortTrianglesForVertexCache(Context * pCtx, VCOPT vcopt, int cacheSize, bool optimizeOverdraw);
+		void ComputeMeshletBounds(const Context * pCtx, const int * pIndices, int indexCount, Meshlet * pMeshlet);
+		void BuildMeshletsForList(const Context * pCtx, int * pIndices, int indexCount, int indexStart, std::vector<Meshlet> * pMeshletsOut);
+		void BuildMeshlets(Context * pCtx);
+		void AssignMeshletsToMaterialRanges(Context * pCtx);
 		void SortVerticesForMemoryCache(Context * pCtx);
-		float ComputeACMR(const Context * pCtx, int cacheSize = 32);
+		float ComputeACMR(const Context * pCtx, int cacheSize = 32, float * pATVROut = nullptr);
+		float ComputeOverdraw(const Context * pCtx, int numViews = 8, int resolution = 256);
+		int SplitFor16BitIndices(Context * pCtx);
+		void SimplifyList(const Context * pCtx, const int * pIndices, int indexCount, int lodCount, float lodRatio, std::vector<int> * pLodIndicesOut, float * pLodErrorsOut);
+		void BuildLods(Context * pCtx, int lodCount, float lodRatio, VCOPT vcopt, int cacheSize, bool optimizeOverdraw);
+		void AppendLodIndices(Context * pCtx);
+		void EncodeOctahedral16(float3 v, i16 * pOut);
+		void EncodeVerts(const Context * pCtx, VTXFMT vtxfmt, VertexFormat * pFormatOut, std::vector<byte> * pDataOut);
+		void BuildPositionStream(Context * pCtx, const VertexFormat & format, const std::vector<byte> & vertData, int posStrideBytes, std::vector<byte> * pPosDataOut, std::vector<int> * pPosIndicesOut);
+		int NarrowIndices(const std::vector<int> & indices, std::vector<u16> * pIndices16, const void ** ppDataOut);
 
 		void SerializeMaterialMap(Context * pCtx, std::vector<byte> * pDataOut);
+		void SerializeLods(Context * pCtx, std::vector<byte> * pDataOut);
 	}
 
 
@@ -88,36 +170,107 @@ namespace Framework
 		SortMaterials(&ctx);
 		RemoveDegenerateTriangles(&ctx);
 		RemoveEmptyMaterialRanges(&ctx);
-		DeduplicateVerts(&ctx);
+		DeduplicateVerts(&ctx, pACI->m_weldEpsilon);
 		if (!ctx.m_hasNormals)
 			CalculateNormals(&ctx);
 		NormalizeNormals(&ctx);
 #if VERTEX_TANGENT
 		CalculateTangents(&ctx);
 #endif
-		SortTrianglesForVertexCache(&ctx);
+		int cacheSize = (pACI->m_vertexCacheSize > 0) ? max(pACI->m_vertexCacheSize, 4) : s_vertexCacheSizeDefault;
+#if OBJ_OPTIMIZE_STATS
+		float atvrBefore;
+		float acmrBefore = ComputeACMR(&ctx, cacheSize, &atvrBefore);
+		float overdrawBefore = pACI->m_optimizeOverdraw ? ComputeOverdraw(&ctx) : 0.0f;
+#endif
+		auto timeStart = std::chrono::steady_clock::now();
+		SortTrianglesForVertexCache(&ctx, pACI->m_vcopt, cacheSize, pACI->m_optimizeOverdraw);
+		float msSort = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+		timeStart = std::chrono::steady_clock::now();
+		BuildMeshlets(&ctx);
+		float msMeshlets = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
 		SortVerticesForMemoryCache(&ctx);
 
-#if 0
-		// This can take awhile on a big mesh, so it's commented out by default
-		LOG("%s ACMR: %0.2f", pACI->m_pathSrc, ComputeACMR(&ctx));
+		float atvrAfter;
+		float acmrAfter = ComputeACMR(&ctx, cacheSize, &atvrAfter);
+		LOG("Optimized %s with %s%s in %0.1fms - ACMR %0.3f, ATVR %0.3f",
+			pACI->m_pathSrc, s_vcoptNames[pACI->m_vcopt], pACI->m_optimizeOverdraw ? " + overdraw" : "", msSort,
+			acmrAfter, atvrAfter);
+#if OBJ_OPTIMIZE_STATS
+		LOG("    before: ACMR %0.3f, ATVR %0.3f", acmrBefore, atvrBefore);
+		if (pACI->m_optimizeOverdraw)
+			LOG("    overdraw %0.3f -> %0.3f", overdrawBefore, ComputeOverdraw(&ctx));
 #endif
+		LOG("Built %d meshlets for %s in %0.1fms - %0.1f triangles each on average",
+			int(ctx.m_meshlets.size()), pACI->m_pathSrc, msMeshlets,
+			float(ctx.m_indices.size() / 3) / float(max(int(ctx.m_meshlets.size()), 1)));
+
+		if (pACI->m_splitFor16BitIndices)
+		{
+			int vertCountUnsplit = int(ctx.m_verts.size());
+			int numBlocks = SplitFor16BitIndices(&ctx);
+			if (numBlocks > 1)
+			{
+				LOG("Split %s into %d blocks for 16-bit indices - %d verts duplicated",
+					pACI->m_pathSrc, numBlocks, int(ctx.m_verts.size()) - vertCountUnsplit);
+			}
+		}
+
+		AssignMeshletsToMaterialRanges(&ctx);
+
+		if (pACI->m_lodCount > 0)
+		{
+			float lodRatio = (pACI->m_lodRatio > 0.0f && pACI->m_lodRatio < 1.0f) ? pACI->m_lodRatio : s_lodRatioDefault;
+			timeStart = std::chrono::steady_clock::now();
+			BuildLods(&ctx, pACI->m_lodCount, lodRatio, pACI->m_vcopt, cacheSize, pACI->m_optimizeOverdraw);
+			float msLods = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+			LOG("Built %d LODs for %s in %0.1fms", pACI->m_lodCount, pACI->m_pathSrc, msLods);
+			for (int iLod = 0; iLod < pACI->m_lodCount; ++iLod)
+			{
+				LOG("    LOD %d: %d triangles, error %g", iLod + 1,
+					int(ctx.m_lods[iLod].m_indices.size() / 3), ctx.m_lods[iLod].m_error);
+			}
+			AppendLodIndices(&ctx);
+		}
 
-		// Fill out the metadata struct
+		// Convert the verts to the output layout, and fill out the metadata struct
 		Meta meta =
 		{
 			ctx.m_bounds,
 		};
+		std::vector<byte> vertData;
+		EncodeVerts(&ctx, pACI->m_vtxfmt, &meta.m_vtxFormat, &vertData);
+
+		// Make the position-only stream, from the encoded positions so it matches the main one
+		meta.m_posStrideBytes = (meta.m_vtxFormat.m_encodings[VATTR_Pos] == VENC_Float3) ? sizeof(float3) : 4 * sizeof(u16);
+		std::vector<byte> posVertData;
+		std::vector<int> posIndices;
+		BuildPositionStream(&ctx, meta.m_vtxFormat, vertData, meta.m_posStrideBytes, &posVertData, &posIndices);
+		LOG("Welded %d verts of %s to %d positions for the position-only stream",
+			int(ctx.m_verts.size()), pACI->m_pathSrc, int(posVertData.size()) / meta.m_posStrideBytes);
+
+		// Use 16-bit indices if they fit
+		std::vector<u16> indices16, posIndices16;
+		const void * pIndexData;
+		const void * pPosIndexData;
+		meta.m_indexSizeBytes = NarrowIndices(ctx.m_indices, &indices16, &pIndexData);
+		meta.m_posIndexSizeBytes = NarrowIndices(posIndices, &posIndices16, &pPosIndexData);
 
 		// Write the data out to the archive
 
 		std::vector<byte> serializedMaterialMap;
 		SerializeMaterialMap(&ctx, &serializedMaterialMap);
+		std::vector<byte> serializedLods;
+		SerializeLods(&ctx, &serializedLods);
 
 		if (!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMeta, &meta, sizeof(meta), pZipOut) ||
-			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixVerts, &ctx.m_verts[0], ctx.m_verts.size() * sizeof(Vertex), pZipOut) ||
-			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixIndices, &ctx.m_indices[0], ctx.m_indices.size() * sizeof(int), pZipOut) ||
-			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMtlMap, &serializedMaterialMap[0], serializedMaterialMap.size(), pZipOut))
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixVerts, &vertData[0], vertData.size(), pZipOut, pACI->m_codec) ||
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixIndices, pIndexData, ctx.m_indices.size() * meta.m_indexSizeBytes, pZipOut, pACI->m_codec) ||
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMtlMap, &serializedMaterialMap[0], serializedMaterialMap.size(), pZipOut) ||
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMeshlets, &ctx.m_meshlets[0], ctx.m_meshlets.size() * sizeof(Meshlet), pZipOut, pACI->m_codec) ||
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixLods, &serializedLods[0], serializedLods.size(), pZipOut) ||
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixPosVerts, &posVertData[0], posVertData.size(), pZipOut, pACI->m_codec) ||
+			!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixPosIndices, pPosIndexData, posIndices.size() * meta.m_posIndexSizeBytes, pZipOut, pACI->m_codec))
 		{
 			return false;
 		}
@@ -125,217 +278,672 @@ namespace Framework
 		return true;
 	}
 
+	// Dependency scanner: an .obj references material libraries via "mtllib"
+
+	bool FindOBJMeshDependencies(
+		const AssetCompileInfo * pACI,
+		std::vector<AssetCompiler::AssetDependency> * pDepsOut)
+	{
+		ASSERT_ERR(pACI);
+		ASSERT_ERR(pACI->m_pathSrc);
+		ASSERT_ERR(pACI->m_ack == ACK_OBJMesh);
+		ASSERT_ERR(pDepsOut);
+
+		std::vector<byte> data;
+		if (!LoadFile(pACI->m_pathSrc, &data, LFK_Text))
+			return false;
+
+		// Material libraries are relative to the .obj's directory
+		std::string dirBase = findDirectory(pACI->m_pathSrc);
+
+		TextParsingHelper tph((char *)&data[0], pACI->m_pathSrc);
+		while (tph.NextLine())
+		{
+			if (_stricmp(tph.NextToken(), "mtllib") != 0)
+				continue;
+
+			// There can be several libraries on one line
+			while (char * pName = tph.NextToken())
+			{
+				AssetCompiler::AssetDependency dep = { dirBase + pName, ACK_OBJMtlLib };
+				replaceChars(dep.m_pathSrc, '\\', '/');
+				pDepsOut->push_back(dep);
+			}
+		}
+
+		return true;
+	}
+
 
 
 	namespace OBJMeshCompiler
 	{
-		bool ParseOBJ(const char * path, Context * pCtxOut)
+		// Fast number scanning for the OBJ parser.  Like atof/atoi, these stop at the first
+		// character that can't continue the number; they return a pointer to it.
+
+		static inline bool IsDigit(char c)
 		{
-			ASSERT_ERR(path);
-			ASSERT_ERR(pCtxOut);
+			return unsigned(c - '0') < 10;
+		}
 
-			// Read the whole file into memory
-			std::vector<byte> data;
-			if (!LoadFile(path, &data, LFK_Text))
-				return false;
+		// Powers of 10 that are exactly representable as doubles
+		static const double s_exactPowersOf10[] =
+		{
+			1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+		};
+
+		static const char * ScanFloatSlow(const char * p, float * pOut)
+		{
+			char * pEnd;
+			*pOut = float(strtod(p, &pEnd));
+			return pEnd;
+		}
 
-			std::vector<float3> positions;
-			std::vector<float3> normals;
-			std::vector<float2> uvs;
+		static const char * ScanFloat(const char * p, float * pOut)
+		{
+			// Gives float(atof(p)), bit for bit.  Most numbers in OBJ files have few enough
+			// digits and a small enough exponent that the mantissa and the power of 10 are
+			// both exact as doubles; then one multiply or divide is correctly rounded, so gives
+			// the same double as strtod (Clinger's fast path).  Anything else - long mantissas,
+			// big exponents, inf/nan, hex - goes to strtod itself.
+
+			const char * pStart = p;
 
-			struct OBJVertex { int iPos, iNormal, iUv; };
-			std::vector<OBJVertex> OBJverts;
+			bool negative = (*p == '-');
+			if (*p == '-' || *p == '+')
+				++p;
 
-			struct OBJFace { int iVertStart, iVertEnd, iIdxStart; };
-			std::vector<OBJFace> OBJfaces;
+			// Accumulate all the digits into the mantissa.  If there are too many for it to
+			// hold, it's garbage, but then we take the slow path anyway.
+			u64 mantissa = 0;
+			int numDigits = 0;
+			int exponent = 0;
 
-			struct OBJMtlRange { std::string mtlName; int iFaceStart, iFaceEnd; };
-			std::vector<OBJMtlRange> OBJMtlRanges;
-			OBJMtlRange initialRange = { std::string(), 0, 0, };
-			OBJMtlRanges.push_back(initialRange);
+			for (; IsDigit(*p); ++p, ++numDigits)
+				mantissa = mantissa * 10 + (*p - '0');
 
-			// Parse line-by-line
-			TextParsingHelper tph((char *)&data[0], path);
-			while (tph.NextLine())
+			// Hex floats
+			if ((*p | 0x20) == 'x')
+				return ScanFloatSlow(pStart, pOut);
+
+			if (*p == '.')
 			{
-				char * pToken = tph.NextToken();
-				if (_stricmp(pToken, "v") == 0)
-				{
-					char * tokens[3] = {};
-					tph.ExpectTokens(tokens, dim(tokens), "vertex position");
-					tph.ExpectEOL();
+				const char * pFraction = ++p;
+				for (; IsDigit(*p); ++p)
+					mantissa = mantissa * 10 + (*p - '0');
+				exponent = -int(p - pFraction);
+				numDigits -= exponent;
+			}
 
-					// Add vertex
-					float3 pos;
-					pos.x = float(atof(tokens[0]));
-					pos.y = float(atof(tokens[1]));
-					pos.z = float(atof(tokens[2]));
-					positions.push_back(pos);
-				}
-				else if (_stricmp(pToken, "vn") == 0)
+			// No digits: could be inf or nan, or not a number at all
+			if (numDigits == 0)
+				return ScanFloatSlow(pStart, pOut);
+
+			// The exponent only counts if it has at least one digit
+			if ((*p | 0x20) == 'e')
+			{
+				const char * pExp = p + 1;
+				bool negativeExp = (*pExp == '-');
+				if (*pExp == '-' || *pExp == '+')
+					++pExp;
+
+				if (IsDigit(*pExp))
 				{
-					char * tokens[3] = {};
-					tph.ExpectTokens(tokens, dim(tokens), "normal vector");
-					tph.ExpectEOL();
+					int exponentExplicit = 0;
+					for (; IsDigit(*pExp); ++pExp)
+					{
+						if (exponentExplicit < 10000)
+							exponentExplicit = exponentExplicit * 10 + (*pExp - '0');
+					}
+					exponent += negativeExp ? -exponentExplicit : exponentExplicit;
+					p = pExp;
+				}
+			}
+
+			if (numDigits > 19 || mantissa > (u64(1) << 53) || exponent < -22 || exponent > 22)
+				return ScanFloatSlow(pStart, pOut);
+
+			double result = double(mantissa);
+			if (exponent < 0)
+				result /= s_exactPowersOf10[-exponent];
+			else
+				result *= s_exactPowersOf10[exponent];
+
+			*pOut = float(negative ? -result : result);
+			return p;
+		}
+
+		static const char * ScanInt(const char * p, int * pOut)
+		{
+			bool negative = (*p == '-');
+			if (*p == '-' || *p == '+')
+				++p;
+
+			int result = 0;
+			for (; IsDigit(*p); ++p)
+				result = result * 10 + (*p - '0');
+
+			*pOut = negative ? -result : result;
+			return p;
+		}
+
+		// Character classes for the tokenizer, as bitmasks over the characters up to ' '
+		static const u64 s_maskSpace		= (u64(1) << ' ') | (u64(1) << '\t') | (u64(1) << '\r');
+		static const u64 s_maskEndOfLine	= (u64(1) << '\n') | (u64(1) << 0);
+
+		static inline bool IsInClass(char c, u64 mask)
+		{
+			return byte(c) <= ' ' && ((u64(1) << byte(c)) & mask) != 0;
+		}
+
+		static inline bool IsSpace(char c)
+		{
+			return IsInClass(c, s_maskSpace);
+		}
+
+		static inline bool IsEndOfLine(char c)
+		{
+			return IsInClass(c, s_maskEndOfLine);
+		}
+
+		static inline const char * SkipSpaces(const char * p)
+		{
+			while (IsSpace(*p))
+				++p;
+			return p;
+		}
+
+		static inline const char * SkipToken(const char * p)
+		{
+			while (!IsInClass(*p, s_maskSpace | s_maskEndOfLine))
+				++p;
+			return p;
+		}
+
+		static inline const char * SkipLine(const char * p)
+		{
+			while (!IsEndOfLine(*p))
+				++p;
+			return (*p == '\n') ? p + 1 : p;
+		}
+
+		// Identify OBJ line types by their keyword, case-insensitively
+		enum OBJKEY
+		{
+			OBJKEY_Other,
+			OBJKEY_Position,		// v
+			OBJKEY_Normal,			// vn
+			OBJKEY_UV,				// vt
+			OBJKEY_Face,			// f
+			OBJKEY_UseMtl,			// usemtl
+		};
 
-					// Add normal
-					float3 normal;
-					normal.x = float(atof(tokens[0]));
-					normal.y = float(atof(tokens[1]));
-					normal.z = float(atof(tokens[2]));
-					normals.push_back(normal);
+		static inline OBJKEY ClassifyOBJKeyword(const char * pKeyword, int length)
+		{
+			switch (length)
+			{
+			case 1:
+				switch (pKeyword[0] | 0x20)
+				{
+				case 'v':	return OBJKEY_Position;
+				case 'f':	return OBJKEY_Face;
 				}
-				else if (_stricmp(pToken, "vt") == 0)
+				break;
+
+			case 2:
+				if ((pKeyword[0] | 0x20) != 'v')
+					break;
+				switch (pKeyword[1] | 0x20)
 				{
-					char * tokens[2] = {};
-					tph.ExpectTokens(tokens, dim(tokens), "UVs");
+				case 'n':	return OBJKEY_Normal;
+				case 't':	return OBJKEY_UV;
+				}
+				break;
 
-					// OBJ files can have a third texture coordinate, but
-					// currently we just throw it away if it's there
-					(void)tph.NextToken();
-					tph.ExpectEOL();
+			case 6:
+				if (_strnicmp(pKeyword, "usemtl", 6) == 0)
+					return OBJKEY_UseMtl;
+				break;
+			}
 
-					// Add UV, flipping V-axis since OBJ UVs use a bottom-up convention
-					float2 uv;
-					uv.x = float(atof(tokens[0]));
-					uv.y = 1.0f - float(atof(tokens[1]));
-					uvs.push_back(uv);
-				}
-				else if (_stricmp(pToken, "f") == 0)
+			return OBJKEY_Other;
+		}
+
+		// Read the next whitespace-separated number on the line, if there is one
+		static inline bool ScanFloatToken(const char ** ppCur, float * pOut)
+		{
+			const char * p = SkipSpaces(*ppCur);
+			if (IsEndOfLine(*p))
+				return false;
+			*ppCur = SkipToken(ScanFloat(p, pOut));
+			return true;
+		}
+
+		// The parser splits the file into line-aligned chunks and works on them in parallel:
+		//  1. Count the lines and each kind of element in each chunk.
+		//  2. Prefix-sum the counts, so each chunk knows where its elements go in the output
+		//      and what line it starts on.  Negative indices can then be resolved locally, too.
+		//  3. Parse each chunk, writing positions, normals, UVs, face verts, and triangulated
+		//      indices straight to their final places.
+		//  4. Build the Vertex for each face vert, once all the positions etc. are in place
+		//      (faces may refer ahead to ones in later chunks).
+		//  5. Stitch the usemtl commands from all the chunks into material ranges.
+		// With a single chunk, this is just the serial parser, and gives identical results.
+
+		struct OBJCounts
+		{
+			int		m_lines;
+			int		m_positions;
+			int		m_normals;
+			int		m_uvs;
+			int		m_faceVerts;
+			int		m_indices;
+		};
+
+		struct OBJVertex { int iPos, iNormal, iUv; };
+
+		struct OBJUseMtl
+		{
+			std::string		m_mtlName;
+			int				m_indexStart;
+		};
+
+		struct OBJChunk
+		{
+			const char *			m_pStart;
+			const char *			m_pEnd;
+			OBJCounts				m_counts;		// Elements in this chunk
+			OBJCounts				m_base;			// Elements in all preceding chunks
+			std::vector<OBJUseMtl>	m_useMtls;
+			bool					m_failed;
+		};
+
+		struct OBJParseOutput
+		{
+			std::vector<float3>		m_positions;
+			std::vector<float3>		m_normals;
+			std::vector<float2>		m_uvs;
+			std::vector<OBJVertex>	m_OBJverts;
+			std::vector<int> *		m_pIndices;
+		};
+
+		// Bytes of text per chunk.  Files smaller than two chunks are parsed serially.
+		static const size_t s_OBJChunkSize = 1024 * 1024;
+
+		static void CountOBJChunk(OBJChunk * pChunk)
+		{
+			OBJCounts counts = {};
+			for (const char * p = pChunk->m_pStart; p < pChunk->m_pEnd; p = SkipLine(p))
+			{
+				++counts.m_lines;
+
+				p = SkipSpaces(p);
+				const char * pKeyword = p;
+				p = SkipToken(p);
+				switch (ClassifyOBJKeyword(pKeyword, int(p - pKeyword)))
 				{
-					// Add face
-					OBJFace face = {};
-					face.iVertStart = int(OBJverts.size());
+				case OBJKEY_Position:	++counts.m_positions;	break;
+				case OBJKEY_Normal:		++counts.m_normals;		break;
+				case OBJKEY_UV:			++counts.m_uvs;			break;
 
-					while (char * pCtxVert = tph.NextToken())
+				case OBJKEY_Face:
 					{
-						// Parse vertex specification, with slashes separating position, UV, normal indices
-						// Note that some components may be missing and will be set to zero here
-						OBJVertex vert = {};
-
-						char * pIdx = pCtxVert;
-						while (*pCtxVert && *pCtxVert != '/')
-							++pCtxVert;
-						if (*pCtxVert)
-							*(pCtxVert++) = 0;
-						vert.iPos = atoi(pIdx);
-
-						pIdx = pCtxVert;
-						while (*pCtxVert && *pCtxVert != '/')
-							++pCtxVert;
-						if (*pCtxVert)
-							*(pCtxVert++) = 0;
-						vert.iUv = atoi(pIdx);
-
-						vert.iNormal = atoi(pCtxVert);
-
-						// Handle negative indices - a bizarre OBJ feature that lets you reference
-						// verts by counting backward from the most recent one
-						if (vert.iPos < 0)
-							vert.iPos += int(positions.size()) + 1;
-						if (vert.iUv < 0)
-							vert.iUv += int(uvs.size()) + 1;
-						if (vert.iNormal < 0)
-							vert.iNormal += int(normals.size()) + 1;
-
-						OBJverts.push_back(vert);
+						int numVertsInFace = 0;
+						for (p = SkipSpaces(p); !IsEndOfLine(*p); p = SkipSpaces(SkipToken(p)))
+							++numVertsInFace;
+						counts.m_faceVerts += numVertsInFace;
+						if (numVertsInFace >= 3)
+							counts.m_indices += 3 * (numVertsInFace - 2);
 					}
+					break;
+
+				default:
+					break;
+				}
+			}
+
+			pChunk->m_counts = counts;
+		}
+
+		static bool ParseOBJChunk(
+			const char * path,
+			const OBJCounts & totals,
+			OBJChunk * pChunk,
+			OBJParseOutput * pOutput)
+		{
+			// Cursors into the output arrays
+			OBJCounts cur = pChunk->m_base;
+			float3 * positions = pOutput->m_positions.data();
+			float3 * normals = pOutput->m_normals.data();
+			float2 * uvs = pOutput->m_uvs.data();
+			OBJVertex * OBJverts = pOutput->m_OBJverts.data();
+			int * indices = pOutput->m_pIndices->data();
+
+			for (const char * p = pChunk->m_pStart; p < pChunk->m_pEnd; p = SkipLine(p))
+			{
+				int iLine = ++cur.m_lines;
 
-					face.iVertEnd = int(OBJverts.size());
+				p = SkipSpaces(p);
+				const char * pKeyword = p;
+				p = SkipToken(p);
 
-					if (face.iVertEnd == face.iVertStart)
+				OBJKEY key = ClassifyOBJKeyword(pKeyword, int(p - pKeyword));
+				switch (key)
+				{
+				case OBJKEY_Position:
+				case OBJKEY_Normal:
 					{
-						WARN("%s: syntax error at line %d: missing faces", path, tph.m_iLine);
-						continue;
+						float3 v(0.0f);
+						if (!ScanFloatToken(&p, &v.x) ||
+							!ScanFloatToken(&p, &v.y) ||
+							!ScanFloatToken(&p, &v.z))
+						{
+							WARN("%s: syntax error at line %d: missing vector components", path, iLine);
+						}
+
+						// Anything else on the line (such as vertex colors) is ignored
+						if (key == OBJKEY_Normal)
+							normals[cur.m_normals++] = v;
+						else
+							positions[cur.m_positions++] = v;
 					}
+					break;
 
-					OBJfaces.push_back(face);
-				}
-				else if (_stricmp(pToken, "usemtl") == 0)
-				{
-					const char * pMtlName = tph.ExpectOneToken("material name");
-					tph.ExpectEOL();
-					if (!pMtlName)
-						continue;
+				case OBJKEY_UV:
+					{
+						// OBJ files can have a third texture coordinate, but
+						// currently we just throw it away if it's there
+						float2 uv(0.0f);
+						if (!ScanFloatToken(&p, &uv.x) ||
+							!ScanFloatToken(&p, &uv.y))
+						{
+							WARN("%s: syntax error at line %d: missing UV components", path, iLine);
+						}
 
-					// Close the previous range
-					OBJMtlRange * pRange = &OBJMtlRanges.back();
-					pRange->iFaceEnd = int(OBJfaces.size());
+						// Flip V-axis since OBJ UVs use a bottom-up convention
+						uv.y = 1.0f - uv.y;
+						uvs[cur.m_uvs++] = uv;
+					}
+					break;
 
-					// Start a new range if the previous one was nonempty, else overwrite the previous one
-					if (pRange->iFaceEnd > pRange->iFaceStart)
+				case OBJKEY_Face:
+					{
+						int iVertStart = cur.m_faceVerts;
+						int numVertsInFace = 0;
+
+						for (p = SkipSpaces(p); !IsEndOfLine(*p); p = SkipSpaces(SkipToken(p)))
+						{
+							// Parse vertex specification, with slashes separating position, UV, normal indices
+							// Note that some components may be missing and will be set to zero here
+							OBJVertex objv = {};
+							p = ScanInt(p, &objv.iPos);
+							while (*p != '/' && !IsInClass(*p, s_maskSpace | s_maskEndOfLine))
+								++p;
+							if (*p == '/')
+							{
+								p = ScanInt(p + 1, &objv.iUv);
+								while (*p != '/' && !IsInClass(*p, s_maskSpace | s_maskEndOfLine))
+									++p;
+								if (*p == '/')
+									p = ScanInt(p + 1, &objv.iNormal);
+							}
+
+							// Handle negative indices - a bizarre OBJ feature that lets you reference
+							// verts by counting backward from the most recent one.  Counting back past
+							// the first one is out of range, not a missing component.
+							bool inRange = true;
+							if (objv.iPos < 0)
+							{
+								objv.iPos += cur.m_positions + 1;
+								inRange = inRange && (objv.iPos > 0);
+							}
+							if (objv.iUv < 0)
+							{
+								objv.iUv += cur.m_uvs + 1;
+								inRange = inRange && (objv.iUv > 0);
+							}
+							if (objv.iNormal < 0)
+							{
+								objv.iNormal += cur.m_normals + 1;
+								inRange = inRange && (objv.iNormal > 0);
+							}
+
+							if (!inRange || objv.iPos > totals.m_positions || objv.iUv > totals.m_uvs || objv.iNormal > totals.m_normals)
+							{
+								WARN("%s: index out of range at line %d", path, iLine);
+								return false;
+							}
+
+							OBJverts[cur.m_faceVerts++] = objv;
+
+							// Triangulate the face as a fan
+							if (++numVertsInFace >= 3)
+							{
+								indices[cur.m_indices++] = iVertStart;
+								indices[cur.m_indices++] = cur.m_faceVerts - 2;
+								indices[cur.m_indices++] = cur.m_faceVerts - 1;
+							}
+						}
+
+						if (numVertsInFace == 0)
+						{
+							WARN("%s: syntax error at line %d: missing faces", path, iLine);
+						}
+					}
+					break;
+
+				case OBJKEY_UseMtl:
 					{
-						OBJMtlRanges.push_back(OBJMtlRange());
-						pRange = &OBJMtlRanges.back();
+						p = SkipSpaces(p);
+						const char * pMtlName = p;
+						p = SkipToken(p);
+						if (p == pMtlName)
+						{
+							WARN("%s: syntax error at line %d: missing material name", path, iLine);
+							break;
+						}
+
+						OBJUseMtl useMtl = { std::string(pMtlName, p), cur.m_indices };
+						makeLowercase(useMtl.m_mtlName);
+						pChunk->m_useMtls.push_back(std::move(useMtl));
 					}
+					break;
 
-					// Start the new range
-					pRange->mtlName = pMtlName;
-					makeLowercase(pRange->mtlName);
-					pRange->iFaceStart = int(OBJfaces.size());
-				}
-				else
-				{
+				default:
 					// Unknown command; just ignore
+					break;
 				}
 			}
 
-			// Close the last material range
-			OBJMtlRanges.back().iFaceEnd = int(OBJfaces.size());
+			return true;
+		}
 
-			// Convert OBJ verts to vertex buffer
-			pCtxOut->m_verts.reserve(OBJverts.size());
-			for (int iVert = 0, cVert = int(OBJverts.size()); iVert < cVert; ++iVert)
+		static bool ParseOBJBuffer(
+			const char * path,
+			const char * pData,
+			size_t dataSize,
+			int numChunks,
+			Context * pCtxOut)
+		{
+			ASSERT_ERR(pData[dataSize] == 0);
+			ASSERT_ERR(numChunks > 0);
+
+			// Split the text into chunks at line boundaries
+			std::vector<OBJChunk> chunks(numChunks);
+			const char * pDataEnd = pData + dataSize;
+			const char * pChunkStart = pData;
+			for (int i = 0; i < numChunks; ++i)
 			{
-				OBJVertex objv = OBJverts[iVert];
-				Vertex v = { float3(0), float3(0), float2(0) };
+				OBJChunk * pChunk = &chunks[i];
+				pChunk->m_pStart = pChunkStart;
+				pChunk->m_pEnd = pDataEnd;
+				pChunk->m_failed = false;
+
+				if (i < numChunks - 1)
+				{
+					const char * pSplit = max(pChunkStart, pData + dataSize * (i + 1) / numChunks);
+					if (const char * pNewline = (const char *)memchr(pSplit, '\n', pDataEnd - pSplit))
+						pChunk->m_pEnd = pNewline + 1;
+				}
+
+				pChunkStart = pChunk->m_pEnd;
+			}
 
-				// OBJ indices are 1-based; fix that (missing components are zeros)
-				if (objv.iPos > 0)
-					v.m_pos = positions[objv.iPos - 1];
-				if (objv.iNormal > 0)
-					v.m_normal = normals[objv.iNormal - 1];
-				if (objv.iUv > 0)
-					v.m_uv = uvs[objv.iUv - 1];
+			ParallelFor(numChunks, [&](int iChunk) { CountOBJChunk(&chunks[iChunk]); });
 
-				pCtxOut->m_verts.push_back(v);
+			// Prefix-sum the counts
+			OBJCounts totals = {};
+			for (int i = 0; i < numChunks; ++i)
+			{
+				OBJChunk * pChunk = &chunks[i];
+				pChunk->m_base = totals;
+				totals.m_lines += pChunk->m_counts.m_lines;
+				totals.m_positions += pChunk->m_counts.m_positions;
+				totals.m_normals += pChunk->m_counts.m_normals;
+				totals.m_uvs += pChunk->m_counts.m_uvs;
+				totals.m_faceVerts += pChunk->m_counts.m_faceVerts;
+				totals.m_indices += pChunk->m_counts.m_indices;
 			}
 
-			// Convert OBJ faces to index buffer
-			for (int iFace = 0, cFace = int(OBJfaces.size()); iFace < cFace; ++iFace)
+			// Now that everything's been counted, the arrays can be allocated just once
+			OBJParseOutput output;
+			output.m_positions.resize(totals.m_positions);
+			output.m_normals.resize(totals.m_normals);
+			output.m_uvs.resize(totals.m_uvs);
+			output.m_OBJverts.resize(totals.m_faceVerts);
+			output.m_pIndices = &pCtxOut->m_indices;
+			pCtxOut->m_indices.resize(totals.m_indices);
+
+			ParallelFor(numChunks, [&](int iChunk)
 			{
-				OBJFace & face = OBJfaces[iFace];
+				chunks[iChunk].m_failed = !ParseOBJChunk(path, totals, &chunks[iChunk], &output);
+			});
 
-				// Store where the face ended up in the buffer
-				face.iIdxStart = int(pCtxOut->m_indices.size());
+			for (int i = 0; i < numChunks; ++i)
+			{
+				if (chunks[i].m_failed)
+					return false;
+			}
 
-				int iVertBase = face.iVertStart;
+			// Convert OBJ verts to vertex buffer
+			pCtxOut->m_verts.resize(totals.m_faceVerts);
+			ParallelFor(numChunks, [&](int iChunk)
+			{
+				const OBJChunk & chunk = chunks[iChunk];
+				for (int iVert = chunk.m_base.m_faceVerts, iVertEnd = iVert + chunk.m_counts.m_faceVerts;
+					 iVert < iVertEnd;
+					 ++iVert)
+				{
+					OBJVertex objv = output.m_OBJverts[iVert];
+					Vertex v = { float3(0), float3(0), float2(0) };
+
+					// OBJ indices are 1-based; fix that (missing components are zeros)
+					if (objv.iPos > 0)
+						v.m_pos = output.m_positions[objv.iPos - 1];
+					if (objv.iNormal > 0)
+						v.m_normal = output.m_normals[objv.iNormal - 1];
+					if (objv.iUv > 0)
+						v.m_uv = output.m_uvs[objv.iUv - 1];
+
+					pCtxOut->m_verts[iVert] = v;
+				}
+			});
 
-				// Triangulate the face
-				for (int iVert = face.iVertStart + 2; iVert < face.iVertEnd; ++iVert)
+			// Build the material ranges from the usemtl commands, in file order
+			MtlRange initialRange = { std::string(), 0, 0, };
+			pCtxOut->m_mtlRanges.push_back(initialRange);
+			for (int i = 0; i < numChunks; ++i)
+			{
+				for (OBJUseMtl & useMtl : chunks[i].m_useMtls)
 				{
-					pCtxOut->m_indices.push_back(iVertBase);
-					pCtxOut->m_indices.push_back(iVert - 1);
-					pCtxOut->m_indices.push_back(iVert);
+					// Close the previous range
+					MtlRange * pRange = &pCtxOut->m_mtlRanges.back();
+					pRange->m_indexCount = useMtl.m_indexStart - pRange->m_indexStart;
+
+					// Start a new range if the previous one was nonempty, else overwrite the previous one
+					if (pRange->m_indexCount > 0)
+					{
+						pCtxOut->m_mtlRanges.push_back(MtlRange());
+						pRange = &pCtxOut->m_mtlRanges.back();
+					}
+
+					// Start the new range
+					pRange->m_mtlName = std::move(useMtl.m_mtlName);
+					pRange->m_indexStart = useMtl.m_indexStart;
+					pRange->m_indexCount = 0;
 				}
 			}
 
-			// Add one more OBJface as a sentinel for the next part
-			OBJFace faceSentinel = { 0, 0, int(pCtxOut->m_indices.size()) };
-			OBJfaces.push_back(faceSentinel);
+			// Close the last material range
+			MtlRange * pRangeLast = &pCtxOut->m_mtlRanges.back();
+			pRangeLast->m_indexCount = totals.m_indices - pRangeLast->m_indexStart;
+
+			pCtxOut->m_bounds = output.m_positions.empty() ?
+									box3(empty) :
+									boxAround(totals.m_positions, &output.m_positions[0]);
+			pCtxOut->m_hasNormals = (totals.m_normals > 0);
+
+			return true;
+		}
+
+		bool ParseOBJ(const char * path, Context * pCtxOut)
+		{
+			ASSERT_ERR(path);
+			ASSERT_ERR(pCtxOut);
+
+			auto timeStart = std::chrono::steady_clock::now();
+
+			// Read the whole file into memory, and make sure it's null-terminated,
+			// so the scanners can always stop at a non-matching character
+			std::vector<byte> data;
+			if (!LoadFile(path, &data, LFK_Text))
+				return false;
+			if (data.empty() || data.back() != 0)
+				data.push_back(0);
+
+			// Parse up to the first null
+			const char * pData = (const char *)&data[0];
+			size_t dataSize = strlen(pData);
+			int numChunks = int(max<size_t>(1, dataSize / s_OBJChunkSize));
+
+			if (!ParseOBJBuffer(path, pData, dataSize, numChunks, pCtxOut))
+				return false;
 
-			// Convert OBJ material ranges (in terms of faces) to ranges in terms of indices
-			for (int iRange = 0, cRange = int(OBJMtlRanges.size()); iRange < cRange; ++iRange)
+#if OBJ_PARSE_VERIFY
+			// Check the chunked parse against a serial one
+			if (numChunks > 1)
 			{
-				OBJMtlRange & objrange = OBJMtlRanges[iRange];
-				int iIdxStart = OBJfaces[objrange.iFaceStart].iIdxStart;
-				int iIdxEnd = OBJfaces[objrange.iFaceEnd].iIdxStart;
-				MtlRange range = { objrange.mtlName, iIdxStart, iIdxEnd - iIdxStart, };
-				pCtxOut->m_mtlRanges.push_back(range);
+				Context ctxSerial = {};
+				if (!ParseOBJBuffer(path, pData, dataSize, 1, &ctxSerial) ||
+					ctxSerial.m_verts.size() != pCtxOut->m_verts.size() ||
+					ctxSerial.m_indices != pCtxOut->m_indices ||
+					ctxSerial.m_mtlRanges.size() != pCtxOut->m_mtlRanges.size() ||
+					ctxSerial.m_hasNormals != pCtxOut->m_hasNormals ||
+					memcmp(ctxSerial.m_verts.data(), pCtxOut->m_verts.data(), ctxSerial.m_verts.size() * sizeof(Vertex)) != 0 ||
+					memcmp(&ctxSerial.m_bounds, &pCtxOut->m_bounds, sizeof(box3)) != 0)
+				{
+					WARN("%s: chunked OBJ parse doesn't match serial parse", path);
+				}
+				else
+				{
+					for (int i = 0, n = int(ctxSerial.m_mtlRanges.size()); i < n; ++i)
+					{
+						const MtlRange & a = ctxSerial.m_mtlRanges[i];
+						const MtlRange & b = pCtxOut->m_mtlRanges[i];
+						if (a.m_mtlName != b.m_mtlName || a.m_indexStart != b.m_indexStart || a.m_indexCount != b.m_indexCount)
+						{
+							WARN("%s: chunked OBJ parse doesn't match serial parse in material range %d", path, i);
+							break;
+						}
+					}
+				}
 			}
+#endif
 
-			pCtxOut->m_bounds = boxAround(int(positions.size()), &positions[0]);
-			pCtxOut->m_hasNormals = !normals.empty();
+			float msParse = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+			float mbParsed = float(dataSize) / 1048576.0f;
+			LOG("Parsed %s in %0.1fms - %0.1fMB at %0.0fMB/s, in %d chunks", path, msParse, mbParsed, mbParsed * 1000.0f / max(msParse, 0.001f), numChunks);
 
 			return true;
 		}
@@ -423,75 +1031,198 @@ namespace Framework
 			pCtx->m_mtlRanges.resize(iWrite);
 		}
 
-		void DeduplicateVerts(Context * pCtx)
+		// Bytes of a vertex that identify it for deduplication.  Positions are either the float bits,
+		// or when welding, the position quantized to a grid with cells weldEpsilon across.
+		// Note: m_tangent not included because it isn't part of the .obj format,
+		// and hasn't been computed yet at this stage in the compilation process
+		struct VertexKey
 		{
-			ASSERT_ERR(pCtx);
+			u32		m_pos[3];
+			float	m_normal[3];
+			float	m_uv[2];
+		};
 
-			// Set up a hash table for vertices
+		static inline float CanonicalizeZero(float f)
+		{
+			// Map -0 to +0, so they compare equal bytewise as they do with ==
+			return (f == 0.0f) ? 0.0f : f;
+		}
+
+		static inline u32 QuantizeForWeld(float f, float weldEpsilon)
+		{
+			double q = floor(double(f) / double(weldEpsilon) + 0.5);
+			if (!(q >= -2147483648.0))
+				q = -2147483648.0;			// Also catches NaN
+			else if (q > 2147483647.0)
+				q = 2147483647.0;
+			return u32(i32(q));
+		}
 
-			struct VertexHasher
+		static inline void MakeVertexKey(const Vertex & vert, float weldEpsilon, VertexKey * pKeyOut)
+		{
+			float pos[3] = { vert.m_pos.x, vert.m_pos.y, vert.m_pos.z };
+			for (int j = 0; j < 3; ++j)
 			{
-				std::hash<float> fh;
-				size_t operator () (const Vertex & v) const
+				if (weldEpsilon > 0.0f)
 				{
-					return fh(v.m_pos.x) ^ fh(v.m_pos.y) ^ fh(v.m_pos.z) ^
-						   fh(v.m_normal.x) ^ fh(v.m_normal.y) ^ fh(v.m_normal.z) ^
-						   fh(v.m_uv.x) ^ fh(v.m_uv.y);
-					// Note: m_tangent not included because it isn't part of the .obj format,
-					// and hasn't been computed yet at this stage in the compilation process
+					pKeyOut->m_pos[j] = QuantizeForWeld(pos[j], weldEpsilon);
 				}
-			};
-
-			struct VertexEqualityTester
-			{
-				bool operator () (const Vertex & u, const Vertex & v) const
+				else
 				{
-					return (all(u.m_pos == v.m_pos) &&
-							all(u.m_normal == v.m_normal) &&
-							all(u.m_uv == v.m_uv));
-					// Note: m_tangent not included because it isn't part of the .obj format,
-					// and hasn't been computed yet at this stage in the compilation process
+					float f = CanonicalizeZero(pos[j]);
+					memcpy(&pKeyOut->m_pos[j], &f, sizeof(f));
 				}
+			}
+			pKeyOut->m_normal[0] = CanonicalizeZero(vert.m_normal.x);
+			pKeyOut->m_normal[1] = CanonicalizeZero(vert.m_normal.y);
+			pKeyOut->m_normal[2] = CanonicalizeZero(vert.m_normal.z);
+			pKeyOut->m_uv[0] = CanonicalizeZero(vert.m_uv.x);
+			pKeyOut->m_uv[1] = CanonicalizeZero(vert.m_uv.y);
+		}
+
+		void DeduplicateVerts(Context * pCtx, float weldEpsilon)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(weldEpsilon >= 0.0f);
+
+			// Set up an open-addressing hash table for vertices, with linear probing.  Each slot
+			// holds the top half of the key's hash, to reject most mismatches without touching
+			// the key, and the vertex's new index, or -1 if empty.  The table is kept at most half
+			// full.  Verts straight out of the .obj parser are one per face corner, and usually
+			// only a fraction of them are unique, so it starts small and grows as needed.
+
+			struct Slot
+			{
+				u32		m_hashHi;
+				int		m_index;
 			};
 
+			int numVerts = int(pCtx->m_verts.size());
+			std::vector<Slot> slots;
+			std::vector<VertexKey> keysDeduplicated;		// Parallel to vertsDeduplicated
 			std::vector<Vertex> vertsDeduplicated;
 			std::vector<int> remappingTable;
-			std::unordered_map<Vertex, int, VertexHasher, VertexEqualityTester> mapVertToIndex;
 			std::vector<int> indicesRemapped;
 
-			vertsDeduplicated.reserve(pCtx->m_verts.size());
-			remappingTable.resize(pCtx->m_verts.size(), -1);
-			mapVertToIndex.reserve(pCtx->m_verts.size());
+			u32 numSlots = 0;
+			u32 slotMask = 0;
+			auto resizeTable = [&](u32 numSlotsNew)
+			{
+				numSlots = numSlotsNew;
+				slotMask = numSlots - 1;
+				Slot slotEmpty = { 0, -1 };
+				slots.assign(numSlots, slotEmpty);
+				for (int i = 0, n = int(keysDeduplicated.size()); i < n; ++i)
+				{
+					u64 hash = AssetCompiler::HashXXH64(&keysDeduplicated[i], sizeof(VertexKey));
+					u32 iSlot = u32(hash) & slotMask;
+					while (slots[iSlot].m_index >= 0)
+						iSlot = (iSlot + 1) & slotMask;
+					slots[iSlot].m_hashHi = u32(hash >> 32);
+					slots[iSlot].m_index = i;
+				}
+			};
+
+			u32 numSlotsInitial = 1024;
+			while (numSlotsInitial < u32(numVerts) / 2)
+				numSlotsInitial *= 2;
+			resizeTable(numSlotsInitial);
+
+			keysDeduplicated.reserve(numVerts);
+			vertsDeduplicated.reserve(numVerts);
+			remappingTable.resize(numVerts, -1);
 			indicesRemapped.resize(pCtx->m_indices.size());
 
-			// Iterate over indices, so that we automatically skip orphaned vertices
-			for (int i = 0, c = int(pCtx->m_indices.size()); i < c; ++i)
+			// Iterate over indices, so that we automatically skip orphaned vertices.
+			//
+			// This goes in batches, as the table lookups are mostly cache misses.  First the keys for
+			// a batch are hashed, then each one's first slot and the key there are checked in
+			// separate short loops, so the misses are independent and the CPU can overlap them.
+			// Filled slots never change, so a match found this way stands; the rest are looked up
+			// one after another, with the slots they start from already in cache.
+			static const int s_batchSize = 64;
+			VertexKey keys[s_batchSize];
+			u64 hashes[s_batchSize];
+			int firstSlotIndices[s_batchSize];
+			for (int iBatch = 0, c = int(pCtx->m_indices.size()); iBatch < c; iBatch += s_batchSize)
 			{
-				int index = pCtx->m_indices[i];
+				int batchSize = min(s_batchSize, c - iBatch);
 
-				// If this vertex was already remapped, update the index
-				if (remappingTable[index] >= 0)
+				// Make sure there's room for the whole batch to be new verts
+				if ((vertsDeduplicated.size() + batchSize) * 2 > numSlots)
+					resizeTable(numSlots * 2);
+
+				for (int j = 0; j < batchSize; ++j)
 				{
-					indicesRemapped[i] = remappingTable[index];
-					continue;
+					int index = pCtx->m_indices[iBatch + j];
+					if (remappingTable[index] >= 0)
+					{
+						hashes[j] = 0;
+						continue;
+					}
+
+					MakeVertexKey(pCtx->m_verts[index], weldEpsilon, &keys[j]);
+					hashes[j] = AssetCompiler::HashXXH64(&keys[j], sizeof(keys[j]));
 				}
 
-				// Search the hash table for a match for this vertex
-				const Vertex & vert = pCtx->m_verts[index];
-				auto iter = mapVertToIndex.find(vert);
-				if (iter == mapVertToIndex.end())
+				for (int j = 0; j < batchSize; ++j)
 				{
-					// Found a new vertex that's not in the table yet
-					int newIndex = int(vertsDeduplicated.size());
-					vertsDeduplicated.push_back(vert);
-					remappingTable[index] = newIndex;
-					mapVertToIndex.insert(std::make_pair(vert, newIndex));
-					indicesRemapped[i] = newIndex;
+					const Slot & slot = slots[u32(hashes[j]) & slotMask];
+					firstSlotIndices[j] = (slot.m_hashHi == u32(hashes[j] >> 32)) ? slot.m_index : -1;
 				}
-				else
+
+				for (int j = 0; j < batchSize; ++j)
 				{
-					// It's already in the map; re-use the previous index
-					int newIndex = iter->second;
+					if (firstSlotIndices[j] >= 0 &&
+						memcmp(&keysDeduplicated[firstSlotIndices[j]], &keys[j], sizeof(keys[j])) != 0)
+					{
+						firstSlotIndices[j] = -1;
+					}
+				}
+
+				for (int j = 0; j < batchSize; ++j)
+				{
+					int i = iBatch + j;
+					int index = pCtx->m_indices[i];
+
+					// If this vertex was already remapped, update the index
+					if (remappingTable[index] >= 0)
+					{
+						indicesRemapped[i] = remappingTable[index];
+						continue;
+					}
+
+					// Search the hash table for a match for this vertex, unless one was found above
+					int newIndex = firstSlotIndices[j];
+					const VertexKey & key = keys[j];
+					u32 hashHi = u32(hashes[j] >> 32);
+					u32 iSlot = u32(hashes[j]) & slotMask;
+					while (newIndex < 0)
+					{
+						const Slot & slot = slots[iSlot];
+						if (slot.m_index < 0)
+							break;
+						if (slot.m_hashHi == hashHi &&
+							memcmp(&keysDeduplicated[slot.m_index], &key, sizeof(key)) == 0)
+						{
+							// It's already in the table; re-use the previous index
+							newIndex = slot.m_index;
+							break;
+						}
+						iSlot = (iSlot + 1) & slotMask;
+					}
+
+					if (newIndex < 0)
+					{
+						// Found a new vertex that's not in the table yet; iSlot is the empty slot
+						// where the search stopped
+						newIndex = int(vertsDeduplicated.size());
+						vertsDeduplicated.push_back(pCtx->m_verts[index]);
+						keysDeduplicated.push_back(key);
+						slots[iSlot].m_hashHi = hashHi;
+						slots[iSlot].m_index = newIndex;
+					}
+
 					remappingTable[index] = newIndex;
 					indicesRemapped[i] = newIndex;
 				}
@@ -685,15 +1416,16 @@ namespace Framework
 			pCtx->m_mtlRanges.swap(mtlRangesMerged);
 		}
 
-		void SortTrianglesForVertexCache(Context * pCtx)
+		void OptimizeForsyth(const int * pIndices, int indexCount, int numVerts, int cacheSize, int * pIndicesOut)
 		{
-			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(cacheSize > 3);
+			ASSERT_ERR(pIndicesOut);
 
 			// Implementation of "Linear-Speed Vertex Cache Optimization" by Tom Forsyth
 			// https://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
 
-			static const int s_cacheSize = 32;
-
 			// Initialize ancillary data that we keep per vertex and per triangle
 
 			struct ExtraVertexData
@@ -703,7 +1435,7 @@ namespace Framework
 				int triangles;			// Count of not-yet-sorted triangles using this vertex
 				int iTriStart;			// Index into trianglesByVert where this vertex's triangles start
 
-				void RecalcScore()
+				void RecalcScore(int cacheSize)
 				{
 					// Verts with no unsorted triangles remaining are no longer in play
 					if (triangles == 0)
@@ -727,8 +1459,8 @@ namespace Framework
 					else
 					{
 						// Calculate score based on how recently it was used
-						ASSERT_ERR(cachePosition < s_cacheSize);
-						static const float scale = 1.0f / (s_cacheSize - 3);
+						ASSERT_ERR(cachePosition < cacheSize);
+						float scale = 1.0f / (cacheSize - 3);
 						cacheScore = powf(1.0f - (cachePosition - 3) * scale, 1.5f);
 					}
 
@@ -740,335 +1472,1869 @@ namespace Framework
 					score = cacheScore + valenceScore;
 				}
 			};
-			std::vector<ExtraVertexData> extraVertexDatas(pCtx->m_verts.size());
+			std::vector<ExtraVertexData> extraVertexDatas(numVerts);
 
 			struct ExtraTriData
 			{
 				float score;	// Sum of vertex scores, or set to -1 when triangle is sorted
 			};
-			std::vector<ExtraTriData> extraTriDatas;
+			std::vector<ExtraTriData> extraTriDatas(indexCount / 3);
 
-			std::vector<int> trianglesByVert;
+			std::vector<int> trianglesByVert(indexCount, -1);	// Each triangle is in exactly 3 verts' lists
 
-			// Sort each material range's triangles separately
-			for (int iRange = 0, cRange = int(pCtx->m_mtlRanges.size()); iRange < cRange; ++iRange)
+			// Build table of references from verts to triangles that use them
+
+			// Count triangles per vertex
+			for (int iIdx = 0; iIdx < indexCount; ++iIdx)
 			{
-				MtlRange range = pCtx->m_mtlRanges[iRange];
+				++extraVertexDatas[pIndices[iIdx]].triangles;
+			}
 
-				ASSERT_ERR(range.m_indexCount > 0 && range.m_indexCount % 3 == 0);
+			// Build list of triangles per vertex, also calculate initial scores for verts
+			// and triangles, and keep track of the best triangle found
+			int trianglesByVertAllocated = 0;
+			int bestTri = -1;
+			float bestTriScore = 0.0f;
+			for (int iIdx = 0; iIdx < indexCount; ++iIdx)
+			{
+				ExtraVertexData * pEvd = &extraVertexDatas[pIndices[iIdx]];
+				
+				// We reuse cachePosition as the negative index where to store the next triangle
+				// index into the vert's list of triangles.  Negative values indicate the vertex
+				// is not in cache, so this also sets up for the following section.
+				int iTriStore;
+				if (pEvd->cachePosition < 0)
+				{
+					// Find where to add the current triangle to the list
+					iTriStore = pEvd->iTriStart + (-pEvd->cachePosition);
+					--pEvd->cachePosition;
+				}
+				else
+				{
+					// Allocate space for triangle indices
+					pEvd->iTriStart = trianglesByVertAllocated;
+					iTriStore = trianglesByVertAllocated;
+					trianglesByVertAllocated += pEvd->triangles;
+					pEvd->cachePosition = -1;
+
+					// Also calculate initial vertex score
+					pEvd->RecalcScore(cacheSize);
+				}
 
-				memset(&extraVertexDatas[0], 0, sizeof(ExtraVertexData) * extraVertexDatas.size());
-				extraTriDatas.resize(range.m_indexCount / 3);
-				memset(&extraTriDatas[0], 0, sizeof(ExtraTriData) * extraTriDatas.size());
-				trianglesByVert.assign(range.m_indexCount, -1);	// Each triangle is in exactly 3 verts' lists
+				// Store the triangle to the array
+				ASSERT_ERR(iTriStore < int(trianglesByVert.size()));
+				ASSERT_ERR(iTriStore - pEvd->iTriStart < pEvd->triangles);
+				ASSERT_ERR(trianglesByVert[iTriStore] == -1);
+				int iTri = iIdx / 3;
+				trianglesByVert[iTriStore] = iTri;
 
-				// Build table of references from verts to triangles that use them
+				// Add the vertex score into the triangle score
+				ExtraTriData * pEtd = &extraTriDatas[iTri];
+				pEtd->score += pEvd->score;
 
-				// Count triangles per vertex
-				for (int iIdx = range.m_indexStart, iIdxEnd = range.m_indexStart + range.m_indexCount;
-					 iIdx < iIdxEnd; ++iIdx)
+				// Keep track of the best triangle seen
+				if (pEtd->score > bestTriScore)
 				{
-					++extraVertexDatas[pCtx->m_indices[iIdx]].triangles;
+					bestTri = iTri;
+					bestTriScore = pEtd->score;
 				}
+			}
+
+			ASSERT_ERR(trianglesByVertAllocated == int(trianglesByVert.size()));
+			ASSERT_ERR(bestTri >= 0 && bestTri < int(extraTriDatas.size()));
+
+			std::vector<int> vertexCacheStorage(2 * (cacheSize + 3), -1);
+			int * vertexCache[2] = { &vertexCacheStorage[0], &vertexCacheStorage[cacheSize + 3] };
 
-				// Build list of triangles per vertex, also calculate initial scores for verts
-				// and triangles, and keep track of the best triangle found
-				int trianglesByVertAllocated = 0;
-				int bestTri = -1;
-				float bestTriScore = 0.0f;
-				for (int iIdx = range.m_indexStart, iIdxEnd = range.m_indexStart + range.m_indexCount;
-					 iIdx < iIdxEnd; ++iIdx)
+			int * pIndexWrite = pIndicesOut;
+			
+			// Iterate through triangles, picking the one to add to indicesReordered next
+			for (int iTriAdd = 0, cTriAdd = indexCount/3;;)
+			{
+				// Add the best triangle seen so far to the new indices
+				int indicesAdd[3] =
 				{
-					ExtraVertexData * pEvd = &extraVertexDatas[pCtx->m_indices[iIdx]];
-					
-					// We reuse cachePosition as the negative index where to store the next triangle
-					// index into the vert's list of triangles.  Negative values indicate the vertex
-					// is not in cache, so this also sets up for the following section.
-					int iTriStore;
-					if (pEvd->cachePosition < 0)
-					{
-						// Find where to add the current triangle to the list
-						iTriStore = pEvd->iTriStart + (-pEvd->cachePosition);
-						--pEvd->cachePosition;
-					}
-					else
-					{
-						// Allocate space for triangle indices
-						pEvd->iTriStart = trianglesByVertAllocated;
-						iTriStore = trianglesByVertAllocated;
-						trianglesByVertAllocated += pEvd->triangles;
-						pEvd->cachePosition = -1;
-
-						// Also calculate initial vertex score
-						pEvd->RecalcScore();
-					}
+					pIndices[3*bestTri],
+					pIndices[3*bestTri + 1],
+					pIndices[3*bestTri + 2],
+				};
+				pIndexWrite[0] = indicesAdd[0];
+				pIndexWrite[1] = indicesAdd[1];
+				pIndexWrite[2] = indicesAdd[2];
+				pIndexWrite += 3;
+
+				++iTriAdd;
+				if (iTriAdd >= cTriAdd)
+					break;
 
-					// Store the triangle to the array
-					ASSERT_ERR(iTriStore < int(trianglesByVert.size()));
-					ASSERT_ERR(iTriStore - pEvd->iTriStart < pEvd->triangles);
-					ASSERT_ERR(trianglesByVert[iTriStore] == -1);
-					int iTri = (iIdx - range.m_indexStart) / 3;
-					trianglesByVert[iTriStore] = iTri;
+				// Reset the triangle's score to indicate that it's been sorted
+				extraTriDatas[bestTri].score = -1.0f;
 
-					// Add the vertex score into the triangle score
-					ExtraTriData * pEtd = &extraTriDatas[iTri];
-					pEtd->score += pEvd->score;
+				// Update the vertices
+				for (int i = 0; i < dim(indicesAdd); ++i)
+				{
+					ExtraVertexData * pEvd = &extraVertexDatas[indicesAdd[i]];
+
+					// Remove the triangle we just added from the vertex's list of triangles
+					auto it = std::find(
+								&trianglesByVert[pEvd->iTriStart], 
+								&trianglesByVert[pEvd->iTriStart] + pEvd->triangles,
+								bestTri);
+					ASSERT_ERR(it < &trianglesByVert[pEvd->iTriStart] + pEvd->triangles);
+					*it = trianglesByVert[pEvd->iTriStart + pEvd->triangles - 1];
+
+					// Decrement the not-yet-sorted-triangles count
+					--pEvd->triangles;
+				}
 
-					// Keep track of the best triangle seen
-					if (pEtd->score > bestTriScore)
+				// Update the LRU cache, putting the newly used vertices at the top
+				// (and preserving the order of the other elements)
+				int * vertexCachePrev = vertexCache[iTriAdd & 1];
+				int * vertexCacheNext = vertexCache[!(iTriAdd & 1)];
+				vertexCacheNext[0] = indicesAdd[0];
+				vertexCacheNext[1] = indicesAdd[1];
+				vertexCacheNext[2] = indicesAdd[2];
+				int iCacheWrite = 3;
+				for (int iRead = 0; iRead < cacheSize; ++iRead)
+				{
+					int cachedVal = vertexCachePrev[iRead];
+					if (cachedVal < 0)
+						break;
+					if (cachedVal != indicesAdd[0] &&
+						cachedVal != indicesAdd[1] &&
+						cachedVal != indicesAdd[2])
 					{
-						bestTri = iTri;
-						bestTriScore = pEtd->score;
+						vertexCacheNext[iCacheWrite] = cachedVal;
+						++iCacheWrite;
 					}
 				}
+				ASSERT_ERR(iCacheWrite <= cacheSize + 3);
 
-				ASSERT_ERR(trianglesByVertAllocated == int(trianglesByVert.size()));
-				ASSERT_ERR(bestTri >= 0 && bestTri < int(extraTriDatas.size()));
-
-				int vertexCache[2][s_cacheSize + 3] = {};
-				for (int i = 0; i < dim(vertexCache); ++i)
-					for (int j = 0; j < dim(vertexCache[0]); ++j)
-						vertexCache[i][j] = -1;
-
-				std::vector<int> indicesReordered;
-				indicesReordered.reserve(range.m_indexCount);
-				
-				// Iterate through triangles, picking the one to add to indicesReordered next
-				for (int iTriAdd = 0, cTriAdd = range.m_indexCount/3;;)
+				// Update the cache indices of all the verts and recompute their scores
+				for (int i = 0; i < iCacheWrite; ++i)
 				{
-					// Add the best triangle seen so far to the new indices
-					int indicesAdd[3] =
-					{
-						pCtx->m_indices[range.m_indexStart + 3*bestTri],
-						pCtx->m_indices[range.m_indexStart + 3*bestTri + 1],
-						pCtx->m_indices[range.m_indexStart + 3*bestTri + 2],
-					};
-					indicesReordered.insert(indicesReordered.end(), &indicesAdd[0], &indicesAdd[dim(indicesAdd)]);
-
-					++iTriAdd;
-					if (iTriAdd >= cTriAdd)
-						break;
+					ExtraVertexData * pEvd = &extraVertexDatas[vertexCacheNext[i]];
+					pEvd->cachePosition = (i >= cacheSize) ? -1 : i;
+					pEvd->RecalcScore(cacheSize);
+				}
 
-					// Reset the triangle's score to indicate that it's been sorted
-					extraTriDatas[bestTri].score = -1.0f;
+				// Recompute the scores of tris that use verts in the cache,
+				// and keep track of the new best tri as we go
+				bestTri = -1;
+				bestTriScore = 0.0f;
+				for (int i = 0; i < iCacheWrite; ++i)
+				{
+					ExtraVertexData * pEvd = &extraVertexDatas[vertexCacheNext[i]];
 
-					// Update the vertices
-					for (int i = 0; i < dim(indicesAdd); ++i)
+					// Update all the unsorted tris that use this vertex
+					for (int j = 0; j < pEvd->triangles; ++j)
 					{
-						ExtraVertexData * pEvd = &extraVertexDatas[indicesAdd[i]];
-
-						// Remove the triangle we just added from the vertex's list of triangles
-						auto it = std::find(
-									&trianglesByVert[pEvd->iTriStart], 
-									&trianglesByVert[pEvd->iTriStart] + pEvd->triangles,
-									bestTri);
-						ASSERT_ERR(it < &trianglesByVert[pEvd->iTriStart] + pEvd->triangles);
-						*it = trianglesByVert[pEvd->iTriStart + pEvd->triangles - 1];
-
-						// Decrement the not-yet-sorted-triangles count
-						--pEvd->triangles;
+						int iTri = trianglesByVert[pEvd->iTriStart + j];
+						int indices[3] =
+						{
+							pIndices[3*iTri],
+							pIndices[3*iTri + 1],
+							pIndices[3*iTri + 2],
+						};
+						float triScore = extraVertexDatas[indices[0]].score +
+										 extraVertexDatas[indices[1]].score +
+										 extraVertexDatas[indices[2]].score;
+						extraTriDatas[iTri].score = triScore;
+
+						if (triScore > bestTriScore)
+						{
+							bestTri = iTri;
+							bestTriScore = triScore;
+						}
 					}
+				}
 
-					// Update the LRU cache, putting the newly used vertices at the top
-					// (and preserving the order of the other elements)
-					int * vertexCachePrev = vertexCache[iTriAdd & 1];
-					int * vertexCacheNext = vertexCache[!(iTriAdd & 1)];
-					vertexCacheNext[0] = indicesAdd[0];
-					vertexCacheNext[1] = indicesAdd[1];
-					vertexCacheNext[2] = indicesAdd[2];
-					int iCacheWrite = 3;
-					for (int iRead = 0; iRead < s_cacheSize; ++iRead)
+				// If we didn't find a tri above (e.g. because all verts in the cache are
+				// out of unsorted tris) then fallback to searching the entire list of tris
+				if (bestTri < 0)
+				{
+					for (int i = 0, cTri = int(extraTriDatas.size()); i < cTri; ++i)
 					{
-						int cachedVal = vertexCachePrev[iRead];
-						if (cachedVal < 0)
-							break;
-						if (cachedVal != indicesAdd[0] &&
-							cachedVal != indicesAdd[1] &&
-							cachedVal != indicesAdd[2])
+						float triScore = extraTriDatas[i].score;
+						if (triScore > bestTriScore)
 						{
-							vertexCacheNext[iCacheWrite] = cachedVal;
-							++iCacheWrite;
+							bestTri = i;
+							bestTriScore = triScore;
 						}
 					}
-					ASSERT_ERR(iCacheWrite <= dim(vertexCache[0]));
+				}
 
-					// Update the cache indices of all the verts and recompute their scores
-					for (int i = 0; i < iCacheWrite; ++i)
-					{
-						ExtraVertexData * pEvd = &extraVertexDatas[vertexCacheNext[i]];
-						pEvd->cachePosition = (i >= s_cacheSize) ? -1 : i;
-						pEvd->RecalcScore();
-					}
+				ASSERT_ERR(bestTri >= 0 && bestTri < int(extraTriDatas.size()));
+			}
 
-					// Recompute the scores of tris that use verts in the cache,
-					// and keep track of the new best tri as we go
-					bestTri = -1;
-					bestTriScore = 0.0f;
-					for (int i = 0; i < iCacheWrite; ++i)
-					{
-						ExtraVertexData * pEvd = &extraVertexDatas[vertexCacheNext[i]];
+			ASSERT_ERR(pIndexWrite == pIndicesOut + indexCount);
+		}
 
-						// Update all the unsorted tris that use this vertex
-						for (int j = 0; j < pEvd->triangles; ++j)
-						{
-							int iTri = trianglesByVert[pEvd->iTriStart + j];
-							int indices[3] =
-							{
-								pCtx->m_indices[range.m_indexStart + 3*iTri],
-								pCtx->m_indices[range.m_indexStart + 3*iTri + 1],
-								pCtx->m_indices[range.m_indexStart + 3*iTri + 2],
-							};
-							float triScore = extraVertexDatas[indices[0]].score +
-											 extraVertexDatas[indices[1]].score +
-											 extraVertexDatas[indices[2]].score;
-							extraTriDatas[iTri].score = triScore;
-
-							if (triScore > bestTriScore)
-							{
-								bestTri = iTri;
-								bestTriScore = triScore;
-							}
-						}
-					}
+		void OptimizeTipsify(const int * pIndices, int indexCount, int numVerts, int cacheSize, int * pIndicesOut)
+		{
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(cacheSize > 0);
+			ASSERT_ERR(pIndicesOut);
+
+			// Implementation of Tipsify, from "Fast Triangle Reordering for Vertex Locality and
+			// Reduced Overdraw" by Pedro Sander, Diego Nehab, and Joshua Barczak (2007).
+			// Emits all the remaining triangles around one vertex at a time, then picks the next
+			// vertex to fan around from the ones just emitted.  There's no per-triangle scoring,
+			// so it's a good deal faster than Forsyth's, at some cost in cache efficiency.
+
+			int triCount = indexCount / 3;
+
+			// Build table of references from verts to triangles that use them
+			std::vector<int> iTriStarts(numVerts + 1, 0);		// Index into trianglesByVert per vertex
+			for (int iIdx = 0; iIdx < indexCount; ++iIdx)
+				++iTriStarts[pIndices[iIdx] + 1];
+			for (int i = 0; i < numVerts; ++i)
+				iTriStarts[i + 1] += iTriStarts[i];
+
+			std::vector<int> trianglesByVert(indexCount);
+			std::vector<int> liveTriangles(numVerts);			// Count of not-yet-emitted triangles using each vertex
+			for (int i = 0; i < numVerts; ++i)
+				liveTriangles[i] = iTriStarts[i];				// Used as the write cursor to start with
+			for (int iIdx = 0; iIdx < indexCount; ++iIdx)
+				trianglesByVert[liveTriangles[pIndices[iIdx]]++] = iIdx / 3;
+			for (int i = 0; i < numVerts; ++i)
+				liveTriangles[i] = iTriStarts[i + 1] - iTriStarts[i];
+
+			std::vector<int> cacheTimes(numVerts, 0);			// Time at which each vertex last entered the cache
+			std::vector<bool> emitted(triCount, false);
+			std::vector<int> deadEndStack;						// Recently emitted verts, to restart from at dead ends
+			std::vector<int> candidates;
+			int time = cacheSize + 1;
+			int iVertScan = 0;									// Fallback for when the dead-end stack runs out
+			int * pIndexWrite = pIndicesOut;
+
+			for (int fanVert = 0; fanVert >= 0;)
+			{
+				// Emit all the unemitted triangles around this vertex
+				candidates.clear();
+				for (int j = iTriStarts[fanVert], jEnd = iTriStarts[fanVert + 1]; j < jEnd; ++j)
+				{
+					int iTri = trianglesByVert[j];
+					if (emitted[iTri])
+						continue;
+					emitted[iTri] = true;
 
-					// If we didn't find a tri above (e.g. because all verts in the cache are
-					// out of unsorted tris) then fallback to searching the entire list of tris
-					if (bestTri < 0)
+					for (int k = 0; k < 3; ++k)
 					{
-						for (int i = 0, cTri = int(extraTriDatas.size()); i < cTri; ++i)
+						int vert = pIndices[3*iTri + k];
+						*pIndexWrite++ = vert;
+						deadEndStack.push_back(vert);
+						candidates.push_back(vert);
+						--liveTriangles[vert];
+
+						// Advance time only on a cache miss
+						if (time - cacheTimes[vert] > cacheSize)
 						{
-							float triScore = extraTriDatas[i].score;
-							if (triScore > bestTriScore)
-							{
-								bestTri = i;
-								bestTriScore = triScore;
-							}
+							cacheTimes[vert] = time;
+							++time;
 						}
 					}
-
-					ASSERT_ERR(bestTri >= 0 && bestTri < int(extraTriDatas.size()));
 				}
 
-				ASSERT_ERR(int(indicesReordered.size()) == range.m_indexCount);
+				// Pick the next vertex to fan around, out of the ones just emitted that still have
+				// triangles left.  Prefer the one that's been in the cache longest, as long as it'll
+				// still be in the cache after emitting its triangles (which may add 2 verts each).
+				fanVert = -1;
+				int bestPriority = -1;
+				for (int i = 0, c = int(candidates.size()); i < c; ++i)
+				{
+					int vert = candidates[i];
+					if (liveTriangles[vert] <= 0)
+						continue;
+
+					int priority = 0;
+					if (time - cacheTimes[vert] + 2 * liveTriangles[vert] <= cacheSize)
+						priority = time - cacheTimes[vert];
+					if (priority > bestPriority)
+					{
+						fanVert = vert;
+						bestPriority = priority;
+					}
+				}
 
-				// Replace the old indices with the new indices for this range
-				memcpy(&pCtx->m_indices[range.m_indexStart], &indicesReordered[0], sizeof(int) * range.m_indexCount);
+				// If none of them have triangles left, back up to the most recently emitted vertex
+				// that does; failing that, jump to the next vertex in order that does
+				while (fanVert < 0 && !deadEndStack.empty())
+				{
+					int vert = deadEndStack.back();
+					deadEndStack.pop_back();
+					if (liveTriangles[vert] > 0)
+						fanVert = vert;
+				}
+				if (fanVert < 0)
+				{
+					while (iVertScan < numVerts && liveTriangles[iVertScan] == 0)
+						++iVertScan;
+					if (iVertScan < numVerts)
+						fanVert = iVertScan;
+				}
 			}
+
+			ASSERT_ERR(pIndexWrite == pIndicesOut + indexCount);
 		}
 
-		void SortVerticesForMemoryCache(Context * pCtx)
+		void OptimizeOverdraw(
+			const Context * pCtx,
+			const int * localToGlobal,
+			int * pIndices,
+			int indexCount,
+			int numVerts,
+			int cacheSize)
 		{
 			ASSERT_ERR(pCtx);
+			ASSERT_ERR(localToGlobal);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(cacheSize > 0);
+
+			// The second half of Sander et al.'s algorithm (see OptimizeTipsify).  The triangles,
+			// already in cache-friendly order, are split into clusters, each ending as soon as the
+			// cluster's ACMR, starting from a cold cache, is within s_clusterThreshold of the ACMR
+			// of the whole list.  Then the clusters are sorted so that the ones facing outward from
+			// the middle of the mesh come first, as those are the most likely to occlude others
+			// from any direction.  Since each cluster starts from a cold cache, the reordering
+			// costs at most that much cache efficiency.
+
+			static const float s_clusterThreshold = 1.05f;
+
+			int triCount = indexCount / 3;
+
+			// FIFO cache simulation, as in ComputeACMR; verts pushed before clusterStart are treated
+			// as gone, to start each cluster from a cold cache
+			std::vector<int> pushCountWhenCached(numVerts, -cacheSize - 1);
+			int pushCount = 0;
+			int clusterStart = 0;
+			auto countMisses = [&](int iTri) -> int
+			{
+				int misses = 0;
+				for (int k = 0; k < 3; ++k)
+				{
+					int & pushCountVert = pushCountWhenCached[pIndices[3*iTri + k]];
+					if (pushCountVert < clusterStart || pushCount - pushCountVert > cacheSize)
+					{
+						pushCountVert = pushCount;
+						++pushCount;
+						++misses;
+					}
+				}
+				return misses;
+			};
 
-			std::vector<Vertex> vertsReordered;
-			std::vector<int> remappingTable;
-			std::vector<int> indicesRemapped;
-
-			vertsReordered.reserve(pCtx->m_verts.size());
-			remappingTable.resize(pCtx->m_verts.size(), -1);
-			indicesRemapped.resize(pCtx->m_indices.size());
+			int missesTotal = 0;
+			for (int iTri = 0; iTri < triCount; ++iTri)
+				missesTotal += countMisses(iTri);
+			float acmrThreshold = s_clusterThreshold * float(missesTotal) / float(triCount);
 
-			// Iterate over indices, so that we see vertices in the order they'll be fetched
-			for (int i = 0, c = int(pCtx->m_indices.size()); i < c; ++i)
+			// Split into clusters, and accumulate each one's area-weighted normal and centroid
+			struct Cluster
 			{
-				int index = pCtx->m_indices[i];
+				int		m_iTriStart, m_iTriEnd;
+				float3	m_normal;				// Sum of triangle normals, weighted by area (times 2)
+				float3	m_centroid;				// Sum of triangle centroids, weighted by area (times 6)
+				float	m_area;					// Times 2
+				float	m_sortKey;
+			};
+			std::vector<Cluster> clusters;
+			float3 meshCentroid = float3(0.0f);
+			float meshArea = 0.0f;
 
-				// If this vertex was already remapped, update the index
-				if (remappingTable[index] >= 0)
+			int missesCluster = 0;
+			for (int iTri = 0; iTri < triCount; ++iTri)
+			{
+				if (clusters.empty() || clusters.back().m_iTriEnd >= 0)
 				{
-					indicesRemapped[i] = remappingTable[index];
-					continue;
+					Cluster cluster = { iTri, -1, float3(0.0f), float3(0.0f), 0.0f, 0.0f };
+					clusters.push_back(cluster);
+					clusterStart = pushCount;
+					missesCluster = 0;
 				}
+				Cluster * pCluster = &clusters.back();
+
+				float3 pos0 = pCtx->m_verts[localToGlobal[pIndices[3*iTri]]].m_pos;
+				float3 pos1 = pCtx->m_verts[localToGlobal[pIndices[3*iTri + 1]]].m_pos;
+				float3 pos2 = pCtx->m_verts[localToGlobal[pIndices[3*iTri + 2]]].m_pos;
+				float3 normal = cross(pos1 - pos0, pos2 - pos0);
+				float area = length(normal);
+				pCluster->m_normal += normal;
+				pCluster->m_centroid += (pos0 + pos1 + pos2) * area;
+				pCluster->m_area += area;
+
+				missesCluster += countMisses(iTri);
+				if (float(missesCluster) <= acmrThreshold * float(iTri + 1 - pCluster->m_iTriStart))
+					pCluster->m_iTriEnd = iTri + 1;
+			}
+			clusters.back().m_iTriEnd = triCount;
 
-				// Append vertex to the reordered buffer and record its new index
-				int newIndex = int(vertsReordered.size());
-				vertsReordered.push_back(pCtx->m_verts[index]);
-				remappingTable[index] = newIndex;
-				indicesRemapped[i] = newIndex;
+			for (int i = 0, c = int(clusters.size()); i < c; ++i)
+			{
+				meshCentroid += clusters[i].m_centroid;
+				meshArea += clusters[i].m_area;
 			}
+			if (meshArea > 0.0f)
+				meshCentroid /= 3.0f * meshArea;
 
-			ASSERT_ERR(vertsReordered.size() == pCtx->m_verts.size());
+			// Sort key is how far the cluster's plane is in front of the mesh centroid
+			for (int i = 0, c = int(clusters.size()); i < c; ++i)
+			{
+				Cluster * pCluster = &clusters[i];
+				float normalLength = length(pCluster->m_normal);
+				if (pCluster->m_area > 0.0f && normalLength > 0.0f)
+				{
+					float3 centroid = pCluster->m_centroid / (3.0f * pCluster->m_area);
+					pCluster->m_sortKey = dot(centroid - meshCentroid, pCluster->m_normal) / normalLength;
+				}
+			}
 
-			pCtx->m_verts.swap(vertsReordered);
-			pCtx->m_indices.swap(indicesRemapped);
+			std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster & a, const Cluster & b)
+			{
+				return a.m_sortKey > b.m_sortKey;
+			});
+
+			std::vector<int> indicesSorted;
+			indicesSorted.reserve(indexCount);
+			for (int i = 0, c = int(clusters.size()); i < c; ++i)
+			{
+				indicesSorted.insert(indicesSorted.end(),
+									 &pIndices[3*clusters[i].m_iTriStart],
+									 &pIndices[3*clusters[i].m_iTriEnd]);
+			}
+			ASSERT_ERR(int(indicesSorted.size()) == indexCount);
+			memcpy(pIndices, &indicesSorted[0], sizeof(int) * indexCount);
 		}
 
-		float ComputeACMR(const Context * pCtx, int cacheSize /*= 32*/)
+		void OptimizeTrianglesForVertexCache(
+			const Context * pCtx,
+			const int * pIndices,
+			int indexCount,
+			VCOPT vcopt,
+			int cacheSize,
+			bool optimizeOverdraw,
+			int * pIndicesOut)
 		{
-			// Compute the average cache miss rate (ACMR) of the mesh.  This is the number of
-			// vertices per triangle that miss the cache.  Worst case is 3.0, and for typical
-			// connected meshes, values between 0.6 and 0.8 are considered very good.
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(pIndicesOut);
+
+			// Renumber the verts used by this list from zero, so the per-vertex data is
+			// proportional to the size of the list rather than the whole mesh
+			std::vector<int> localToGlobal(pIndices, pIndices + indexCount);
+			std::sort(localToGlobal.begin(), localToGlobal.end());
+			localToGlobal.erase(std::unique(localToGlobal.begin(), localToGlobal.end()), localToGlobal.end());
+			int numVerts = int(localToGlobal.size());
+
+			std::vector<int> localIndices(indexCount);
+			for (int i = 0; i < indexCount; ++i)
+			{
+				localIndices[i] = int(std::lower_bound(localToGlobal.begin(), localToGlobal.end(), pIndices[i]) -
+									  localToGlobal.begin());
+			}
 
-			// Vertex cache is a FIFO cache rather than LRU (simulates hardware better).
-			std::deque<int> vertexCache;
+			std::vector<int> localIndicesSorted(indexCount);
+			switch (vcopt)
+			{
+			case VCOPT_Forsyth:
+				OptimizeForsyth(&localIndices[0], indexCount, numVerts, cacheSize, &localIndicesSorted[0]);
+				break;
+
+			case VCOPT_Tipsify:
+				OptimizeTipsify(&localIndices[0], indexCount, numVerts, cacheSize, &localIndicesSorted[0]);
+				break;
+
+			case VCOPT_None:
+				localIndicesSorted = localIndices;
+				break;
+
+			default:
+				ERR("Missing case for VCOPT %d", vcopt);
+				localIndicesSorted = localIndices;
+				break;
+			}
+
+			if (optimizeOverdraw)
+				OptimizeOverdraw(pCtx, &localToGlobal[0], &localIndicesSorted[0], indexCount, numVerts, cacheSize);
 
-			int indexCount = int(pCtx->m_indices.size());
-			int missCount = 0;
 			for (int i = 0; i < indexCount; ++i)
+				pIndicesOut[i] = localToGlobal[localIndicesSorted[i]];
+		}
+
+		// Interleave the low 10 bits of x, y, and z, to sort points along a Z-order curve
+		static inline u32 MortonCode3(u32 x, u32 y, u32 z)
+		{
+			auto spread = [](u32 v)
 			{
-				int index = pCtx->m_indices[i];
+				v &= 0x3ff;
+				v = (v | (v << 16)) & 0x030000ff;
+				v = (v | (v << 8)) & 0x0300f00f;
+				v = (v | (v << 4)) & 0x030c30c3;
+				v = (v | (v << 2)) & 0x09249249;
+				return v;
+			};
+			return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+		}
 
-				// If we don't find it in the cache, it's a miss
-				auto it = std::find(vertexCache.begin(), vertexCache.end(), index);
-				if (it == vertexCache.end())
+		// Reorder a list of triangles along a Z-order curve through their centroids, so that
+		// consecutive runs of them form spatially coherent clusters
+		void SortTrianglesSpatially(const Context * pCtx, int * pIndices, int indexCount)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount % 3 == 0);
+
+			int triCount = indexCount / 3;
+
+			// Quantize centroids to a 1024^3 grid over the mesh bounds, scaled the same on all axes
+			// so the clusters come out roughly cubical.  This is done in parallel blocks, as it's
+			// mostly cache misses fetching the verts.
+			float3 boundsSize = pCtx->m_bounds.maxs - pCtx->m_bounds.mins;
+			float scale = 1023.0f / max(max(max(boundsSize.x, boundsSize.y), boundsSize.z), 1e-20f);
+
+			static const int s_blockSize = 16 * 1024;
+			std::vector<u32> codes(triCount);
+			ParallelFor((triCount + s_blockSize - 1) / s_blockSize, [&](int iBlock)
+			{
+				for (int iTri = iBlock * s_blockSize, iTriEnd = min(iTri + s_blockSize, triCount); iTri < iTriEnd; ++iTri)
 				{
-					// Add it to the back of the FIFO cache
-					++missCount;
-					vertexCache.push_back(index);
-					if (int(vertexCache.size()) > cacheSize)
-						vertexCache.pop_front();
+					float3 centroid = (pCtx->m_verts[pIndices[3*iTri]].m_pos +
+									   pCtx->m_verts[pIndices[3*iTri + 1]].m_pos +
+									   pCtx->m_verts[pIndices[3*iTri + 2]].m_pos) * (1.0f / 3.0f);
+					float3 posGrid = (centroid - pCtx->m_bounds.mins) * scale;
+					codes[iTri] = MortonCode3(u32(max(posGrid.x, 0.0f)), u32(max(posGrid.y, 0.0f)), u32(max(posGrid.z, 0.0f)));
+				}
+			});
+
+			// Radix sort the triangles by code, 10 bits at a time; it's stable, so triangles with
+			// equal codes keep their original order
+			std::vector<int> order(triCount), orderNext(triCount);
+			for (int iTri = 0; iTri < triCount; ++iTri)
+				order[iTri] = iTri;
+			for (int shift = 0; shift < 30; shift += 10)
+			{
+				int offsets[1024] = {};
+				for (int iTri = 0; iTri < triCount; ++iTri)
+					++offsets[(codes[iTri] >> shift) & 0x3ff];
+				for (int iBucket = 0, sum = 0; iBucket < dim(offsets); ++iBucket)
+				{
+					int count = offsets[iBucket];
+					offsets[iBucket] = sum;
+					sum += count;
+				}
+				for (int i = 0; i < triCount; ++i)
+				{
+					int iTri = order[i];
+					orderNext[offsets[(codes[iTri] >> shift) & 0x3ff]++] = iTri;
 				}
+				order.swap(orderNext);
 			}
 
-			ASSERT_ERR(int(vertexCache.size()) <= cacheSize);
-
-			return float(missCount) / float(max(indexCount / 3, 1));
+			std::vector<int> indicesSorted(indexCount);
+			for (int i = 0; i < triCount; ++i)
+			{
+				int iTri = order[i];
+				indicesSorted[3*i] = pIndices[3*iTri];
+				indicesSorted[3*i + 1] = pIndices[3*iTri + 1];
+				indicesSorted[3*i + 2] = pIndices[3*iTri + 2];
+			}
+			memcpy(pIndices, &indicesSorted[0], sizeof(int) * indexCount);
 		}
 
-		void SerializeMaterialMap(Context * pCtx, std::vector<byte> * pDataOut)
+		void SplitRangesIntoJobs(const Context * pCtx, std::vector<IndexRun> * pJobsOut, std::vector<int> * pRangesClusteredOut /*= nullptr*/)
 		{
 			ASSERT_ERR(pCtx);
-			ASSERT_ERR(pDataOut);
+			ASSERT_ERR(pJobsOut);
 
-			SerializeHelper sh(pDataOut);
-			for (int i = 0, cRange = int(pCtx->m_mtlRanges.size()); i < cRange; ++i)
+			for (int iRange = 0, cRange = int(pCtx->m_mtlRanges.size()); iRange < cRange; ++iRange)
 			{
-				const MtlRange & range = pCtx->m_mtlRanges[i];
-				sh.WriteString(range.m_mtlName);
-				sh.Write(range.m_indexStart);
-				sh.Write(range.m_indexCount);
+				const MtlRange & range = pCtx->m_mtlRanges[iRange];
+				ASSERT_ERR(range.m_indexCount > 0 && range.m_indexCount % 3 == 0);
+
+				int triCount = range.m_indexCount / 3;
+				int numClusters = 1;
+				if (OBJ_VERTEX_CACHE_CLUSTER_TRIS > 0 && triCount > OBJ_VERTEX_CACHE_CLUSTER_TRIS)
+				{
+					numClusters = (triCount + OBJ_VERTEX_CACHE_CLUSTER_TRIS - 1) / OBJ_VERTEX_CACHE_CLUSTER_TRIS;
+					if (pRangesClusteredOut)
+						pRangesClusteredOut->push_back(iRange);
+				}
+
+				// Split evenly, so there's no tiny cluster left over at the end
+				for (int iCluster = 0; iCluster < numClusters; ++iCluster)
+				{
+					int iTriStart = int(i64(triCount) * iCluster / numClusters);
+					int iTriEnd = int(i64(triCount) * (iCluster + 1) / numClusters);
+					IndexRun job = { range.m_indexStart + 3*iTriStart, 3*(iTriEnd - iTriStart) };
+					pJobsOut->push_back(job);
+				}
 			}
 		}
-	}
 
+		void SortTrianglesForVertexCache(Context * pCtx, VCOPT vcopt, int cacheSize, bool optimizeOverdraw)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(vcopt >= 0 && vcopt < VCOPT_Count);
+			ASSERT_ERR(cacheSize > 3);
 
+			// Each material range's triangles are sorted separately, so the ranges can be done in
+			// parallel.  Ranges too big to spread the work out well are split into clusters, which
+			// are then sorted separately too.  This loses a little cache efficiency at the cluster
+			// boundaries.
 
-	// Load compiled data into a runtime game object
+			std::vector<int> indicesSrc(pCtx->m_indices);
 
-	bool DeserializeMaterialMap(const byte * pMtlMap, int mtlMapSize, MaterialLib * pMtlLib, Mesh * pMeshOut);
+			std::vector<IndexRun> jobs;
+			std::vector<int> rangesToCluster;
+			SplitRangesIntoJobs(pCtx, &jobs, &rangesToCluster);
 
-	bool LoadMeshFromAssetPack(
-		AssetPack * pPack,
-		const char * path,
-		MaterialLib * pMtlLib,
-		Mesh * pMeshOut)
-	{
-		ASSERT_ERR(pPack);
-		ASSERT_ERR(path);
-		ASSERT_ERR(pMeshOut);
+			ParallelFor(int(rangesToCluster.size()), [&](int i)
+			{
+				const MtlRange & range = pCtx->m_mtlRanges[rangesToCluster[i]];
+				SortTrianglesSpatially(pCtx, &indicesSrc[range.m_indexStart], range.m_indexCount);
+			});
 
-		using namespace OBJMeshCompiler;
+			ParallelFor(int(jobs.size()), [&](int iJob)
+			{
+				const IndexRun & job = jobs[iJob];
+				OptimizeTrianglesForVertexCache(
+					pCtx, &indicesSrc[job.m_indexStart], job.m_indexCount,
+					vcopt, cacheSize, optimizeOverdraw,
+					&pCtx->m_indices[job.m_indexStart]);
+			});
+		}
 
-		pMeshOut->m_pPack = pPack;
+		void ComputeMeshletBounds(const Context * pCtx, const int * pIndices, int indexCount, Meshlet * pMeshlet)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(pMeshlet);
 
-		// Look for the data in the asset pack
+			// Bounding box, and a sphere around its center
+			pMeshlet->m_bounds = box3(empty);
+			for (int i = 0; i < indexCount; ++i)
+				pMeshlet->m_bounds = boxUnion(pMeshlet->m_bounds, pCtx->m_verts[pIndices[i]].m_pos);
+			pMeshlet->m_center = center(pMeshlet->m_bounds);
+			float radiusSq = 0.0f;
+			for (int i = 0; i < indexCount; ++i)
+				radiusSq = max(radiusSq, lengthSquared(pCtx->m_verts[pIndices[i]].m_pos - pMeshlet->m_center));
+			pMeshlet->m_radius = sqrtf(radiusSq);
+
+			// Normal cone, as in meshoptimizer's meshopt_computeClusterBounds.  The axis is the
+			// average of the triangles' facing directions, and the cutoff is the sine of the widest
+			// angle between it and any of them.  The apex is moved back along the axis until it's
+			// behind all the triangles' planes, so the test works for perspective views too.
+			int triCount = indexCount / 3;
+			std::vector<float3> normals(triCount);
+			float3 normalSum = float3(0.0f);
+			for (int iTri = 0; iTri < triCount; ++iTri)
+			{
+				float3 pos0 = pCtx->m_verts[pIndices[3*iTri]].m_pos;
+				float3 normal = cross(pCtx->m_verts[pIndices[3*iTri + 1]].m_pos - pos0,
+									  pCtx->m_verts[pIndices[3*iTri + 2]].m_pos - pos0);
+				float len = length(normal);
+				normals[iTri] = (len > 0.0f) ? normal / len : float3(0.0f);
+				normalSum += normals[iTri];
+			}
 
-		Meta * pMeta;
-		int metaSize;
-		if (!pPack->LookupFile(path, s_suffixMeta, (void **)&pMeta, &metaSize))
-		{
-			WARN("Couldn't find metadata for mesh %s in asset pack %s", path, pPack->m_path.c_str());
-			return false;
+			pMeshlet->m_coneApex = pMeshlet->m_center;
+			pMeshlet->m_coneAxis = float3(0.0f, 0.0f, 1.0f);
+			pMeshlet->m_coneCutoff = 2.0f;
+
+			float normalSumLength = length(normalSum);
+			if (normalSumLength < 1e-6f)
+				return;
+			float3 axis = normalSum / normalSumLength;
+			pMeshlet->m_coneAxis = axis;
+
+			float minDot = 1.0f;
+			for (int iTri = 0; iTri < triCount; ++iTri)
+				minDot = min(minDot, dot(normals[iTri], axis));
+
+			// If the triangles spread over more than about a hemisphere, the cone would almost
+			// never cull anything
+			if (minDot <= 0.1f)
+				return;
+
+			float maxT = 0.0f;
+			for (int iTri = 0; iTri < triCount; ++iTri)
+			{
+				float3 pos0 = pCtx->m_verts[pIndices[3*iTri]].m_pos;
+				float t = dot(pMeshlet->m_center - pos0, normals[iTri]) / dot(axis, normals[iTri]);
+				maxT = max(maxT, t);
+			}
+
+			pMeshlet->m_coneApex = pMeshlet->m_center - axis * maxT;
+			pMeshlet->m_coneCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+
+		void BuildMeshletsForList(const Context * pCtx, int * pIndices, int indexCount, int indexStart, std::vector<Meshlet> * pMeshletsOut)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(pMeshletsOut);
+
+			// Greedy, in the spirit of meshoptimizer's meshlet builder.  Each meshlet starts from
+			// the first unused triangle in vertex cache order, and grows by adding the triangle
+			// touching it that brings in the fewest new verts, breaking ties by distance from the
+			// meshlet's centroid.  When nothing touching it fits, it takes the next unused
+			// triangle in order, which is usually nearby too.  Triangles within a meshlet stay in
+			// vertex cache order, so the cache efficiency mostly carries over.
+
+			int triCount = indexCount / 3;
+
+			// Renumber the verts used by this list from zero, as for the vertex cache optimizers
+			std::vector<int> localToGlobal(pIndices, pIndices + indexCount);
+			std::sort(localToGlobal.begin(), localToGlobal.end());
+			localToGlobal.erase(std::unique(localToGlobal.begin(), localToGlobal.end()), localToGlobal.end());
+			int numVerts = int(localToGlobal.size());
+
+			std::vector<int> localIndices(indexCount);
+			for (int i = 0; i < indexCount; ++i)
+			{
+				localIndices[i] = int(std::lower_bound(localToGlobal.begin(), localToGlobal.end(), pIndices[i]) -
+									  localToGlobal.begin());
+			}
+
+			// Build table of references from verts to triangles that use them
+			std::vector<int> iTriStarts(numVerts + 1, 0);
+			for (int iIdx = 0; iIdx < indexCount; ++iIdx)
+				++iTriStarts[localIndices[iIdx] + 1];
+			for (int i = 0; i < numVerts; ++i)
+				iTriStarts[i + 1] += iTriStarts[i];
+			std::vector<int> trianglesByVert(indexCount);
+			{
+				std::vector<int> cursors(iTriStarts.begin(), iTriStarts.end() - 1);
+				for (int iIdx = 0; iIdx < indexCount; ++iIdx)
+					trianglesByVert[cursors[localIndices[iIdx]]++] = iIdx / 3;
+			}
+
+			std::vector<float3> centroids(triCount);
+			for (int iTri = 0; iTri < triCount; ++iTri)
+			{
+				centroids[iTri] = (pCtx->m_verts[pIndices[3*iTri]].m_pos +
+								   pCtx->m_verts[pIndices[3*iTri + 1]].m_pos +
+								   pCtx->m_verts[pIndices[3*iTri + 2]].m_pos) * (1.0f / 3.0f);
+			}
+
+			std::vector<bool> used(triCount, false);
+			std::vector<int> meshletOfVert(numVerts, -1);		// Last meshlet each vertex was added to
+			std::vector<int> meshletOfCandidate(triCount, -1);	// Last meshlet each triangle was a candidate for
+			std::vector<int> candidates;
+			std::vector<int> meshletTris;
+			std::vector<int> indicesOut;
+			indicesOut.reserve(indexCount);
+			int iTriScan = 0;
+
+			for (int iMeshlet = 0; ; ++iMeshlet)
+			{
+				while (iTriScan < triCount && used[iTriScan])
+					++iTriScan;
+				if (iTriScan == triCount)
+					break;
+
+				auto countNewVerts = [&](int iTri)
+				{
+					return int(meshletOfVert[localIndices[3*iTri]] != iMeshlet) +
+						   int(meshletOfVert[localIndices[3*iTri + 1]] != iMeshlet) +
+						   int(meshletOfVert[localIndices[3*iTri + 2]] != iMeshlet);
+				};
+
+				meshletTris.clear();
+				candidates.clear();
+				int vertCount = 0;
+				float3 centroidSum = float3(0.0f);
+
+				for (int iTriAdd = iTriScan; iTriAdd >= 0;)
+				{
+					// Add the triangle, and make the unused triangles around its new verts candidates
+					used[iTriAdd] = true;
+					meshletTris.push_back(iTriAdd);
+					centroidSum += centroids[iTriAdd];
+					for (int k = 0; k < 3; ++k)
+					{
+						int vert = localIndices[3*iTriAdd + k];
+						if (meshletOfVert[vert] == iMeshlet)
+							continue;
+						meshletOfVert[vert] = iMeshlet;
+						++vertCount;
+
+						for (int j = iTriStarts[vert], jEnd = iTriStarts[vert + 1]; j < jEnd; ++j)
+						{
+							int iTri = trianglesByVert[j];
+							if (!used[iTri] && meshletOfCandidate[iTri] != iMeshlet)
+							{
+								meshletOfCandidate[iTri] = iMeshlet;
+								candidates.push_back(iTri);
+							}
+						}
+					}
+
+					if (int(meshletTris.size()) == s_meshletTrisMax)
+						break;
+
+					// Pick the best candidate that fits, dropping used ones from the list as we go
+					float3 centroid = centroidSum / float(meshletTris.size());
+					iTriAdd = -1;
+					int bestNewVerts = 4;							// More than any triangle can have
+					float bestDistSq = 0.0f;
+					int iWrite = 0;
+					for (int i = 0, c = int(candidates.size()); i < c; ++i)
+					{
+						int iTri = candidates[i];
+						if (used[iTri])
+							continue;
+						candidates[iWrite++] = iTri;
+
+						int newVerts = countNewVerts(iTri);
+						if (vertCount + newVerts > s_meshletVertsMax || newVerts > bestNewVerts)
+							continue;
+						float distSq = lengthSquared(centroids[iTri] - centroid);
+						if (newVerts < bestNewVerts || distSq < bestDistSq)
+						{
+							iTriAdd = iTri;
+							bestNewVerts = newVerts;
+							bestDistSq = distSq;
+						}
+					}
+					candidates.resize(iWrite);
+
+					// Nothing touching the meshlet fits; try the next unused triangle in order
+					if (iTriAdd < 0)
+					{
+						while (iTriScan < triCount && used[iTriScan])
+							++iTriScan;
+						if (iTriScan < triCount && vertCount + countNewVerts(iTriScan) <= s_meshletVertsMax)
+							iTriAdd = iTriScan;
+					}
+				}
+
+				// Emit the meshlet, keeping its triangles in their original order
+				std::sort(meshletTris.begin(), meshletTris.end());
+				Meshlet meshlet = {};
+				meshlet.m_indexStart = indexStart + int(indicesOut.size());
+				meshlet.m_indexCount = 3 * int(meshletTris.size());
+				for (int i = 0, c = int(meshletTris.size()); i < c; ++i)
+				{
+					int iTri = meshletTris[i];
+					indicesOut.insert(indicesOut.end(), &pIndices[3*iTri], &pIndices[3*iTri + 3]);
+				}
+				ComputeMeshletBounds(pCtx, &indicesOut[meshlet.m_indexStart - indexStart], meshlet.m_indexCount, &meshlet);
+				pMeshletsOut->push_back(meshlet);
+			}
+
+			ASSERT_ERR(int(indicesOut.size()) == indexCount);
+			memcpy(pIndices, &indicesOut[0], sizeof(int) * indexCount);
+		}
+
+		void BuildMeshlets(Context * pCtx)
+		{
+			ASSERT_ERR(pCtx);
+
+			// Partition each of the same runs that the vertex cache optimizer worked on, in
+			// parallel, so meshlets don't cross material ranges or cluster boundaries
+			std::vector<IndexRun> jobs;
+			SplitRangesIntoJobs(pCtx, &jobs);
+
+			std::vector<std::vector<Meshlet>> meshletsPerJob(jobs.size());
+			ParallelFor(int(jobs.size()), [&](int iJob)
+			{
+				const IndexRun & job = jobs[iJob];
+				BuildMeshletsForList(pCtx, &pCtx->m_indices[job.m_indexStart], job.m_indexCount, job.m_indexStart, &meshletsPerJob[iJob]);
+			});
+
+			pCtx->m_meshlets.clear();
+			for (int iJob = 0, cJob = int(jobs.size()); iJob < cJob; ++iJob)
+				pCtx->m_meshlets.insert(pCtx->m_meshlets.end(), meshletsPerJob[iJob].begin(), meshletsPerJob[iJob].end());
+		}
+
+		void AssignMeshletsToMaterialRanges(Context * pCtx)
+		{
+			ASSERT_ERR(pCtx);
+
+			// Both are in index buffer order, and ranges only ever split between meshlets
+			int iRange = 0;
+			for (int i = 0, c = int(pCtx->m_meshlets.size()); i < c; ++i)
+			{
+				Meshlet & meshlet = pCtx->m_meshlets[i];
+				while (meshlet.m_indexStart >= pCtx->m_mtlRanges[iRange].m_indexStart + pCtx->m_mtlRanges[iRange].m_indexCount)
+					++iRange;
+				ASSERT_ERR(meshlet.m_indexStart + meshlet.m_indexCount <=
+						   pCtx->m_mtlRanges[iRange].m_indexStart + pCtx->m_mtlRanges[iRange].m_indexCount);
+				meshlet.m_iMtlRange = iRange;
+			}
+		}
+
+		void SortVerticesForMemoryCache(Context * pCtx)
+		{
+			ASSERT_ERR(pCtx);
+
+			std::vector<Vertex> vertsReordered;
+			std::vector<int> remappingTable;
+			std::vector<int> indicesRemapped;
+
+			vertsReordered.reserve(pCtx->m_verts.size());
+			remappingTable.resize(pCtx->m_verts.size(), -1);
+			indicesRemapped.resize(pCtx->m_indices.size());
+
+			// Iterate over indices, so that we see vertices in the order they'll be fetched
+			for (int i = 0, c = int(pCtx->m_indices.size()); i < c; ++i)
+			{
+				int index = pCtx->m_indices[i];
+
+				// If this vertex was already remapped, update the index
+				if (remappingTable[index] >= 0)
+				{
+					indicesRemapped[i] = remappingTable[index];
+					continue;
+				}
+
+				// Append vertex to the reordered buffer and record its new index
+				int newIndex = int(vertsReordered.size());
+				vertsReordered.push_back(pCtx->m_verts[index]);
+				remappingTable[index] = newIndex;
+				indicesRemapped[i] = newIndex;
+			}
+
+			ASSERT_ERR(vertsReordered.size() == pCtx->m_verts.size());
+
+			pCtx->m_verts.swap(vertsReordered);
+			pCtx->m_indices.swap(indicesRemapped);
+		}
+
+		float ComputeACMR(const Context * pCtx, int cacheSize /*= 32*/, float * pATVROut /*= nullptr*/)
+		{
+			// Compute the average cache miss rate (ACMR) of the mesh.  This is the number of
+			// vertices per triangle that miss the cache.  Worst case is 3.0, and for typical
+			// connected meshes, values between 0.6 and 0.8 are considered very good.
+			//
+			// Optionally also compute the average transform to vertex ratio (ATVR): the number of
+			// misses per vertex used.  Unlike ACMR, this doesn't depend on the mesh's topology;
+			// the best possible is 1.0, where each vertex is only transformed once.
+
+			// Vertex cache is a FIFO cache rather than LRU (simulates hardware better).
+			// Only misses push verts into the FIFO, so rather than keeping the FIFO itself, we
+			// record the miss count when each vert was pushed; it's still in the cache until
+			// cacheSize more verts have been pushed after it.
+			std::vector<int> missCountWhenCached(pCtx->m_verts.size(), -cacheSize - 1);
+
+			int indexCount = int(pCtx->m_indices.size());
+			int missCount = 0;
+			int vertsUsed = 0;
+			for (int i = 0; i < indexCount; ++i)
+			{
+				int index = pCtx->m_indices[i];
+
+				// If we don't find it in the cache, it's a miss
+				if (missCount - missCountWhenCached[index] > cacheSize)
+				{
+					// Add it to the back of the FIFO cache
+					if (missCountWhenCached[index] == -cacheSize - 1)
+						++vertsUsed;
+					missCountWhenCached[index] = missCount;
+					++missCount;
+				}
+			}
+
+			if (pATVROut)
+				*pATVROut = float(missCount) / float(max(vertsUsed, 1));
+
+			return float(missCount) / float(max(indexCount / 3, 1));
+		}
+
+		float ComputeOverdraw(const Context * pCtx, int numViews /*= 8*/, int resolution /*= 256*/)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(numViews > 0);
+			ASSERT_ERR(resolution > 0);
+
+			// Estimate the overdraw of the mesh when drawn in index order, averaged over a set of
+			// orthographic views from directions spread evenly around it.  The triangles are
+			// rasterized at low resolution with back-face culling and a depth test, as the GPU
+			// would; overdraw is the number of pixels that pass the depth test, divided by the
+			// number of pixels covered.  The best possible is 1.0.
+
+			if (pCtx->m_indices.empty())
+				return 1.0f;
+
+			float3 center = 0.5f * (pCtx->m_bounds.mins + pCtx->m_bounds.maxs);
+			float radius = max(0.5f * length(pCtx->m_bounds.maxs - pCtx->m_bounds.mins), 1e-20f);
+			float pixelsPerUnit = 0.5f * float(resolution) / radius;
+			float depthClear = 2.0f * radius;		// Farther than anything in the mesh
+
+			std::vector<i64> pixelsShaded(numViews), pixelsCovered(numViews);
+			ParallelFor(numViews, [&](int iView)
+			{
+				// Directions on a spiral, evenly spaced in area over the sphere.  The view looks
+				// along viewDir, so depth increases along it.
+				float dirZ = 1.0f - (2.0f * float(iView) + 1.0f) / float(numViews);
+				float dirR = sqrtf(max(0.0f, 1.0f - dirZ * dirZ));
+				float dirAngle = 2.39996323f * float(iView);		// Golden angle
+				float3 viewDir = float3(dirR * cosf(dirAngle), dirR * sinf(dirAngle), dirZ);
+				float3 axisX = normalize(cross((fabsf(viewDir.z) < 0.9f) ? float3(0, 0, 1) : float3(1, 0, 0), viewDir));
+				float3 axisY = cross(viewDir, axisX);
+
+				// Project all the verts to pixel coordinates and depth
+				std::vector<float3> posesProjected(pCtx->m_verts.size());
+				for (int i = 0, c = int(pCtx->m_verts.size()); i < c; ++i)
+				{
+					float3 pos = pCtx->m_verts[i].m_pos - center;
+					posesProjected[i] = float3(
+											dot(pos, axisX) * pixelsPerUnit + 0.5f * float(resolution),
+											dot(pos, axisY) * pixelsPerUnit + 0.5f * float(resolution),
+											dot(pos, viewDir));
+				}
+
+				std::vector<float> depthBuffer(resolution * resolution, depthClear);
+				i64 shaded = 0;
+				for (int iIdx = 0, cIdx = int(pCtx->m_indices.size()); iIdx < cIdx; iIdx += 3)
+				{
+					// Cull triangles facing away from the view (front faces are counterclockwise)
+					const float3 & pos0 = pCtx->m_verts[pCtx->m_indices[iIdx]].m_pos;
+					const float3 & pos1 = pCtx->m_verts[pCtx->m_indices[iIdx + 1]].m_pos;
+					const float3 & pos2 = pCtx->m_verts[pCtx->m_indices[iIdx + 2]].m_pos;
+					if (dot(cross(pos1 - pos0, pos2 - pos0), viewDir) >= 0.0f)
+						continue;
+
+					float3 v0 = posesProjected[pCtx->m_indices[iIdx]];
+					float3 v1 = posesProjected[pCtx->m_indices[iIdx + 1]];
+					float3 v2 = posesProjected[pCtx->m_indices[iIdx + 2]];
+					float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+					if (area == 0.0f)
+						continue;
+					if (area < 0.0f)
+					{
+						std::swap(v1, v2);
+						area = -area;
+					}
+
+					// Visit the pixels whose centers are in the bounding box, and test them against
+					// the edges, interpolating depth from the barycentric coordinates
+					int xMin = max(int(ceilf(min(min(v0.x, v1.x), v2.x) - 0.5f)), 0);
+					int xMax = min(int(floorf(max(max(v0.x, v1.x), v2.x) - 0.5f)), resolution - 1);
+					int yMin = max(int(ceilf(min(min(v0.y, v1.y), v2.y) - 0.5f)), 0);
+					int yMax = min(int(floorf(max(max(v0.y, v1.y), v2.y) - 0.5f)), resolution - 1);
+					for (int y = yMin; y <= yMax; ++y)
+					{
+						float py = float(y) + 0.5f;
+						for (int x = xMin; x <= xMax; ++x)
+						{
+							float px = float(x) + 0.5f;
+							float w0 = (v2.x - v1.x) * (py - v1.y) - (v2.y - v1.y) * (px - v1.x);
+							float w1 = (v0.x - v2.x) * (py - v2.y) - (v0.y - v2.y) * (px - v2.x);
+							float w2 = (v1.x - v0.x) * (py - v0.y) - (v1.y - v0.y) * (px - v0.x);
+							if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+								continue;
+
+							float depth = (w0 * v0.z + w1 * v1.z + w2 * v2.z) / area;
+							float & depthStored = depthBuffer[y * resolution + x];
+							if (depth < depthStored)
+							{
+								depthStored = depth;
+								++shaded;
+							}
+						}
+					}
+				}
+
+				i64 covered = 0;
+				for (int i = 0, c = int(depthBuffer.size()); i < c; ++i)
+				{
+					if (depthBuffer[i] < depthClear)
+						++covered;
+				}
+
+				pixelsShaded[iView] = shaded;
+				pixelsCovered[iView] = covered;
+			});
+
+			i64 shadedTotal = 0, coveredTotal = 0;
+			for (int i = 0; i < numViews; ++i)
+			{
+				shadedTotal += pixelsShaded[i];
+				coveredTotal += pixelsCovered[i];
+			}
+
+			return (coveredTotal > 0) ? float(double(shadedTotal) / double(coveredTotal)) : 1.0f;
+		}
+
+		int SplitFor16BitIndices(Context * pCtx)
+		{
+			// Split the mesh into blocks of at most 64K verts, so every index fits in 16 bits
+			// relative to its block's first vertex, which becomes the base vertex of the material
+			// ranges drawn from it.  Triangles are taken in order, so each block is a run of
+			// consecutive triangles, and material ranges are split where a block fills up.  Blocks
+			// only break between meshlets, if there are any.  Verts are copied into each block
+			// that uses them, in order of first use.  Returns the number of blocks.
+
+			ASSERT_ERR(pCtx);
+
+			static const int s_blockVertsMax = 0x10000;
+
+			int numVerts = int(pCtx->m_verts.size());
+			if (numVerts <= s_blockVertsMax)
+				return 1;
+
+			std::vector<Vertex> vertsSplit;
+			std::vector<MtlRange> mtlRangesSplit;
+			std::vector<int> blockOfVert(numVerts, -1);		// Last block each vert was copied into
+			std::vector<int> indexInBlock(numVerts);		// ...and its index relative to that block's base
+			std::vector<int> countedAt(numVerts, -1);		// Index of the last unit each vert was counted in
+			vertsSplit.reserve(numVerts);
+
+			int iBlock = 0;
+			int baseVertex = 0;
+			int iMeshlet = 0;
+			for (int iRange = 0, cRange = int(pCtx->m_mtlRanges.size()); iRange < cRange; ++iRange)
+			{
+				const MtlRange & range = pCtx->m_mtlRanges[iRange];
+				MtlRange rangeCur = { range.m_mtlName, range.m_indexStart, 0, baseVertex, };
+
+				// Go a unit at a time: a meshlet, or a triangle if there are no meshlets
+				for (int i = range.m_indexStart, iEnd = range.m_indexStart + range.m_indexCount; i < iEnd;)
+				{
+					int iUnitEnd = i + 3;
+					if (iMeshlet < int(pCtx->m_meshlets.size()) && pCtx->m_meshlets[iMeshlet].m_indexStart == i)
+						iUnitEnd = i + pCtx->m_meshlets[iMeshlet++].m_indexCount;
+					ASSERT_ERR(iUnitEnd <= iEnd);
+
+					// Start a new block if this unit's new verts won't fit in the current one
+					int numNew = 0;
+					for (int j = i; j < iUnitEnd; ++j)
+					{
+						int index = pCtx->m_indices[j];
+						if (blockOfVert[index] != iBlock && countedAt[index] != i)
+						{
+							countedAt[index] = i;
+							++numNew;
+						}
+					}
+					if (int(vertsSplit.size()) + numNew - baseVertex > s_blockVertsMax)
+					{
+						++iBlock;
+						baseVertex = int(vertsSplit.size());
+						if (rangeCur.m_indexCount > 0)
+							mtlRangesSplit.push_back(rangeCur);
+						rangeCur.m_indexStart = i;
+						rangeCur.m_indexCount = 0;
+						rangeCur.m_baseVertex = baseVertex;
+					}
+
+					for (int j = i; j < iUnitEnd; ++j)
+					{
+						int index = pCtx->m_indices[j];
+						if (blockOfVert[index] != iBlock)
+						{
+							blockOfVert[index] = iBlock;
+							indexInBlock[index] = int(vertsSplit.size()) - baseVertex;
+							vertsSplit.push_back(pCtx->m_verts[index]);
+						}
+						pCtx->m_indices[j] = indexInBlock[index];
+					}
+					rangeCur.m_indexCount += iUnitEnd - i;
+					i = iUnitEnd;
+				}
+
+				if (rangeCur.m_indexCount > 0)
+					mtlRangesSplit.push_back(rangeCur);
+			}
+
+			pCtx->m_verts.swap(vertsSplit);
+			pCtx->m_mtlRanges.swap(mtlRangesSplit);
+
+			return iBlock + 1;
+		}
+
+		// Quadric error metric (Garland and Heckbert 1997): a sum of squared distances from
+		// planes, weighted by area, stored as the upper triangle of a symmetric 4x4 matrix
+		struct Quadric
+		{
+			double	m_a00, m_a01, m_a02, m_a03;
+			double	m_a11, m_a12, m_a13;
+			double	m_a22, m_a23;
+			double	m_a33;
+			double	m_weight;		// Total area of the planes
+		};
+
+		static inline void AddPlaneToQuadric(Quadric * pQuadric, float3 normal, float d, double weight)
+		{
+			double x = normal.x, y = normal.y, z = normal.z, w = d;
+			pQuadric->m_a00 += weight * x * x;
+			pQuadric->m_a01 += weight * x * y;
+			pQuadric->m_a02 += weight * x * z;
+			pQuadric->m_a03 += weight * x * w;
+			pQuadric->m_a11 += weight * y * y;
+			pQuadric->m_a12 += weight * y * z;
+			pQuadric->m_a13 += weight * y * w;
+			pQuadric->m_a22 += weight * z * z;
+			pQuadric->m_a23 += weight * z * w;
+			pQuadric->m_a33 += weight * w * w;
+			pQuadric->m_weight += weight;
+		}
+
+		static inline void AddQuadric(Quadric * pQuadric, const Quadric & other)
+		{
+			pQuadric->m_a00 += other.m_a00;
+			pQuadric->m_a01 += other.m_a01;
+			pQuadric->m_a02 += other.m_a02;
+			pQuadric->m_a03 += other.m_a03;
+			pQuadric->m_a11 += other.m_a11;
+			pQuadric->m_a12 += other.m_a12;
+			pQuadric->m_a13 += other.m_a13;
+			pQuadric->m_a22 += other.m_a22;
+			pQuadric->m_a23 += other.m_a23;
+			pQuadric->m_a33 += other.m_a33;
+			pQuadric->m_weight += other.m_weight;
+		}
+
+		static inline double EvaluateQuadric(const Quadric & q, float3 pos)
+		{
+			double x = pos.x, y = pos.y, z = pos.z;
+			return q.m_a00 * x * x + 2.0 * q.m_a01 * x * y + 2.0 * q.m_a02 * x * z + 2.0 * q.m_a03 * x +
+				   q.m_a11 * y * y + 2.0 * q.m_a12 * y * z + 2.0 * q.m_a13 * y +
+				   q.m_a22 * z * z + 2.0 * q.m_a23 * z +
+				   q.m_a33;
+		}
+
+		void SimplifyList(
+			const Context * pCtx,
+			const int * pIndices,
+			int indexCount,
+			int lodCount,
+			float lodRatio,
+			std::vector<int> * pLodIndicesOut,
+			float * pLodErrorsOut)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pIndices);
+			ASSERT_ERR(indexCount > 0 && indexCount % 3 == 0);
+			ASSERT_ERR(lodCount > 0);
+			ASSERT_ERR(lodRatio > 0.0f && lodRatio < 1.0f);
+			ASSERT_ERR(pLodIndicesOut);
+			ASSERT_ERR(pLodErrorsOut);
+
+			// Makes a chain of LODs by repeatedly collapsing edges, each LOD starting from the
+			// one before.  Each collapse moves a vertex onto one of its neighbors, so the LODs
+			// only use verts of the original mesh and can share its vertex buffer.  Collapses are
+			// done in passes: each pass finds the cheapest collapse for every vertex, then does
+			// the cheapest of those, no two in the same neighborhood, so the adjacency built at
+			// the start of the pass stays valid throughout it.
+
+			// Renumber the verts used by this list from zero, as in OptimizeTrianglesForVertexCache
+			std::vector<int> localToGlobal(pIndices, pIndices + indexCount);
+			std::sort(localToGlobal.begin(), localToGlobal.end());
+			localToGlobal.erase(std::unique(localToGlobal.begin(), localToGlobal.end()), localToGlobal.end());
+			int numVerts = int(localToGlobal.size());
+
+			std::vector<int> tris(indexCount);
+			for (int i = 0; i < indexCount; ++i)
+			{
+				tris[i] = int(std::lower_bound(localToGlobal.begin(), localToGlobal.end(), pIndices[i]) -
+							  localToGlobal.begin());
+			}
+
+			std::vector<float3> positions(numVerts);
+			for (int i = 0; i < numVerts; ++i)
+				positions[i] = pCtx->m_verts[localToGlobal[i]].m_pos;
+
+			// Each vertex starts with the quadric of the planes of the triangles around it
+			int triCount = indexCount / 3;
+			std::vector<Quadric> quadrics(numVerts, Quadric());
+			for (int iTri = 0; iTri < triCount; ++iTri)
+			{
+				float3 pos0 = positions[tris[3*iTri]];
+				float3 normal = cross(positions[tris[3*iTri + 1]] - pos0, positions[tris[3*iTri + 2]] - pos0);
+				float area2 = length(normal);
+				if (area2 <= 0.0f)
+					continue;
+				normal /= area2;
+				for (int j = 0; j < 3; ++j)
+					AddPlaneToQuadric(&quadrics[tris[3*iTri + j]], normal, -dot(normal, pos0), 0.5 * area2);
+			}
+
+			// Lock the verts on any edge that isn't shared by exactly two triangles.  Verts are
+			// split wherever their attributes differ, so this covers UV seams and hard edges as
+			// well as open borders; and each material range is simplified on its own, so it
+			// covers material boundaries too.  Collapses can go onto locked verts, but never
+			// move them, so all those edges are kept intact.
+			std::vector<bool> locked(numVerts, false);
+			{
+				std::vector<u64> edges(indexCount);
+				for (int iTri = 0; iTri < triCount; ++iTri)
+				{
+					for (int j = 0; j < 3; ++j)
+					{
+						u32 a = tris[3*iTri + j], b = tris[3*iTri + (j + 1) % 3];
+						edges[3*iTri + j] = (u64(min(a, b)) << 32) | max(a, b);
+					}
+				}
+				std::sort(edges.begin(), edges.end());
+				for (int i = 0; i < indexCount;)
+				{
+					int iEnd = i + 1;
+					while (iEnd < indexCount && edges[iEnd] == edges[i])
+						++iEnd;
+					if (iEnd - i != 2)
+					{
+						locked[int(edges[i] >> 32)] = true;
+						locked[int(edges[i] & 0xffffffff)] = true;
+					}
+					i = iEnd;
+				}
+			}
+
+			struct Collapse
+			{
+				double	m_cost;			// Mean squared distance from the merged verts' planes
+				int		m_vertFrom;
+				int		m_vertTo;
+			};
+			std::vector<Collapse> collapses;
+			std::vector<int> vertTriStarts(numVerts + 1);
+			std::vector<int> vertTris;
+			std::vector<int> touchedInPass(numVerts, -1);
+			std::vector<int> neighborOfTo(numVerts, -1);		// Stamped with the collapse being checked
+			std::vector<int> commonNeighbors;
+			double costMax = 0.0;
+			int iPass = 0;
+			int stamp = 0;
+
+			for (int iLod = 0; iLod < lodCount; ++iLod)
+			{
+				int triCountTarget = int(float(indexCount / 3) * powf(lodRatio, float(iLod + 1)));
+
+				for (; triCount > triCountTarget; ++iPass)
+				{
+					// Build the vertex-to-triangle adjacency
+					std::fill(vertTriStarts.begin(), vertTriStarts.end(), 0);
+					for (int i = 0; i < 3 * triCount; ++i)
+						++vertTriStarts[tris[i] + 1];
+					for (int i = 0; i < numVerts; ++i)
+						vertTriStarts[i + 1] += vertTriStarts[i];
+					vertTris.resize(3 * triCount);
+					{
+						std::vector<int> fill(vertTriStarts.begin(), vertTriStarts.end() - 1);
+						for (int i = 0; i < 3 * triCount; ++i)
+							vertTris[fill[tris[i]]++] = i / 3;
+					}
+
+					// Find the cheapest collapse for each vertex that can move
+					collapses.clear();
+					for (int iVert = 0; iVert < numVerts; ++iVert)
+					{
+						if (locked[iVert] || vertTriStarts[iVert] == vertTriStarts[iVert + 1])
+							continue;
+
+						Collapse best = { -1.0, iVert, -1 };
+						for (int i = vertTriStarts[iVert]; i < vertTriStarts[iVert + 1]; ++i)
+						{
+							for (int j = 0; j < 3; ++j)
+							{
+								int iVertTo = tris[3*vertTris[i] + j];
+								if (iVertTo == iVert)
+									continue;
+								float3 pos = positions[iVertTo];
+								double weight = quadrics[iVert].m_weight + quadrics[iVertTo].m_weight;
+								double cost = max(EvaluateQuadric(quadrics[iVert], pos) + EvaluateQuadric(quadrics[iVertTo], pos), 0.0) /
+											  max(weight, 1e-30);
+								if (best.m_vertTo < 0 || cost < best.m_cost)
+								{
+									best.m_cost = cost;
+									best.m_vertTo = iVertTo;
+								}
+							}
+						}
+						if (best.m_vertTo >= 0)
+							collapses.push_back(best);
+					}
+					if (collapses.empty())
+						break;
+
+					// Only the cheapest quarter are done in each pass, so that the more expensive
+					// ones get re-evaluated after the cheap ones around them have been done; the
+					// rest are only tried if none of those can be
+					auto compareCost = [](const Collapse & a, const Collapse & b) { return a.m_cost < b.m_cost; };
+					int numConsider = max(int(collapses.size()) / 4, 1);
+					std::partial_sort(collapses.begin(), collapses.begin() + numConsider, collapses.end(), compareCost);
+
+					int numCollapsed = 0;
+					for (int iCollapse = 0, cCollapse = int(collapses.size()); iCollapse < cCollapse && triCount > triCountTarget; ++iCollapse)
+					{
+						if (iCollapse == numConsider)
+						{
+							if (numCollapsed > 0)
+								break;
+							std::sort(collapses.begin() + numConsider, collapses.end(), compareCost);
+						}
+
+						int iVertFrom = collapses[iCollapse].m_vertFrom;
+						int iVertTo = collapses[iCollapse].m_vertTo;
+						if (touchedInPass[iVertFrom] == iPass || touchedInPass[iVertTo] == iPass)
+							continue;
+
+						// Check the link condition: the two verts' only common neighbors must be
+						// the ones opposite the edge between them, else the collapse would pinch
+						// the surface
+						int numShared = 0;
+						commonNeighbors.clear();
+						++stamp;
+						for (int i = vertTriStarts[iVertTo]; i < vertTriStarts[iVertTo + 1]; ++i)
+						{
+							for (int j = 0; j < 3; ++j)
+								neighborOfTo[tris[3*vertTris[i] + j]] = stamp;
+						}
+						for (int i = vertTriStarts[iVertFrom]; i < vertTriStarts[iVertFrom + 1]; ++i)
+						{
+							const int * tri = &tris[3*vertTris[i]];
+							if (tri[0] == iVertTo || tri[1] == iVertTo || tri[2] == iVertTo)
+								++numShared;
+							for (int j = 0; j < 3; ++j)
+							{
+								if (tri[j] != iVertFrom && tri[j] != iVertTo && neighborOfTo[tri[j]] == stamp)
+									commonNeighbors.push_back(tri[j]);
+							}
+						}
+						std::sort(commonNeighbors.begin(), commonNeighbors.end());
+						if (int(std::unique(commonNeighbors.begin(), commonNeighbors.end()) - commonNeighbors.begin()) > numShared)
+							continue;
+
+						// Don't flip any triangles over
+						bool flips = false;
+						for (int i = vertTriStarts[iVertFrom]; i < vertTriStarts[iVertFrom + 1] && !flips; ++i)
+						{
+							const int * tri = &tris[3*vertTris[i]];
+							if (tri[0] == iVertTo || tri[1] == iVertTo || tri[2] == iVertTo)
+								continue;
+							float3 pos[3], posMoved[3];
+							for (int j = 0; j < 3; ++j)
+							{
+								pos[j] = positions[tri[j]];
+								posMoved[j] = positions[(tri[j] == iVertFrom) ? iVertTo : tri[j]];
+							}
+							float3 normal = cross(pos[1] - pos[0], pos[2] - pos[0]);
+							float3 normalMoved = cross(posMoved[1] - posMoved[0], posMoved[2] - posMoved[0]);
+							flips = (dot(normal, normalMoved) <= 0.0f);
+						}
+						if (flips)
+							continue;
+
+						// Do the collapse, and mark the neighborhood as touched.  The triangles
+						// on the collapsed edge become degenerate, and are dropped.
+						for (int i = vertTriStarts[iVertFrom]; i < vertTriStarts[iVertFrom + 1]; ++i)
+						{
+							int * tri = &tris[3*vertTris[i]];
+							for (int j = 0; j < 3; ++j)
+								touchedInPass[tri[j]] = iPass;
+							for (int j = 0; j < 3; ++j)
+							{
+								if (tri[j] == iVertFrom)
+									tri[j] = iVertTo;
+							}
+							if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0])
+							{
+								tri[0] = tri[1] = tri[2] = -1;
+								--triCount;
+							}
+						}
+						AddQuadric(&quadrics[iVertTo], quadrics[iVertFrom]);
+						costMax = max(costMax, collapses[iCollapse].m_cost);
+						++numCollapsed;
+					}
+
+					// Drop the degenerate triangles
+					tris.erase(std::remove(tris.begin(), tris.end(), -1), tris.end());
+					ASSERT_ERR(int(tris.size()) == 3 * triCount);
+
+					if (numCollapsed == 0)
+						break;
+				}
+
+				std::vector<int> & lodIndices = pLodIndicesOut[iLod];
+				lodIndices.resize(tris.size());
+				for (int i = 0, c = int(tris.size()); i < c; ++i)
+					lodIndices[i] = localToGlobal[tris[i]];
+				pLodErrorsOut[iLod] = float(sqrt(costMax));
+			}
+		}
+
+		void BuildLods(Context * pCtx, int lodCount, float lodRatio, VCOPT vcopt, int cacheSize, bool optimizeOverdraw)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(lodCount > 0);
+
+			// Simplify each material range separately, in parallel, then optimize the LODs'
+			// triangle order for the vertex cache the same way as the full mesh
+			int cRange = int(pCtx->m_mtlRanges.size());
+			std::vector<std::vector<int>> lodIndicesPerRange(cRange * lodCount);
+			std::vector<float> lodErrorsPerRange(cRange * lodCount);
+			ParallelFor(cRange, [&](int iRange)
+			{
+				const MtlRange & range = pCtx->m_mtlRanges[iRange];
+				std::vector<int> indices(&pCtx->m_indices[range.m_indexStart], &pCtx->m_indices[range.m_indexStart] + range.m_indexCount);
+				for (int i = 0; i < range.m_indexCount; ++i)
+					indices[i] += range.m_baseVertex;
+
+				std::vector<int> * pLodIndices = &lodIndicesPerRange[iRange * lodCount];
+				SimplifyList(pCtx, &indices[0], range.m_indexCount, lodCount, lodRatio, pLodIndices, &lodErrorsPerRange[iRange * lodCount]);
+
+				for (int iLod = 0; iLod < lodCount; ++iLod)
+				{
+					if (pLodIndices[iLod].empty())
+						continue;
+					indices.resize(pLodIndices[iLod].size());
+					OptimizeTrianglesForVertexCache(pCtx, &pLodIndices[iLod][0], int(indices.size()), vcopt, cacheSize, optimizeOverdraw, &indices[0]);
+					pLodIndices[iLod].swap(indices);
+				}
+			});
+
+			pCtx->m_lods.resize(lodCount);
+			for (int iLod = 0; iLod < lodCount; ++iLod)
+			{
+				Lod & lod = pCtx->m_lods[iLod];
+				lod.m_indices.clear();
+				lod.m_runs.resize(cRange);
+				lod.m_error = 0.0f;
+				for (int iRange = 0; iRange < cRange; ++iRange)
+				{
+					const std::vector<int> & indices = lodIndicesPerRange[iRange * lodCount + iLod];
+					IndexRun run = { int(lod.m_indices.size()), int(indices.size()) };
+					lod.m_runs[iRange] = run;
+					lod.m_indices.insert(lod.m_indices.end(), indices.begin(), indices.end());
+					lod.m_error = max(lod.m_error, lodErrorsPerRange[iRange * lodCount + iLod]);
+				}
+			}
+		}
+
+		void AppendLodIndices(Context * pCtx)
+		{
+			ASSERT_ERR(pCtx);
+
+			// Put each LOD's indices after the full mesh's, relative to the base vertex of the
+			// material range they came from, and point its runs at them
+			for (int iLod = 0, cLod = int(pCtx->m_lods.size()); iLod < cLod; ++iLod)
+			{
+				Lod & lod = pCtx->m_lods[iLod];
+				for (int iRange = 0, cRange = int(lod.m_runs.size()); iRange < cRange; ++iRange)
+				{
+					IndexRun & run = lod.m_runs[iRange];
+					int baseVertex = pCtx->m_mtlRanges[iRange].m_baseVertex;
+					int indexStart = int(pCtx->m_indices.size());
+					for (int i = run.m_indexStart, iEnd = run.m_indexStart + run.m_indexCount; i < iEnd; ++i)
+						pCtx->m_indices.push_back(lod.m_indices[i] - baseVertex);
+					run.m_indexStart = indexStart;
+				}
+				lod.m_indices.clear();
+			}
+		}
+
+		// Octahedral encoding of a unit vector, in 2x16-bit snorm (Cigolle et al. 2014).  Of the
+		// four grid points around the exact encoding, this picks the one that decodes closest
+		// to the original vector, rather than just rounding.
+		void EncodeOctahedral16(float3 v, i16 * pOut)
+		{
+			ASSERT_ERR(pOut);
+
+			if (!all(isfinite(v)))
+				v = float3(0.0f, 0.0f, 1.0f);
+
+			float invL1 = 1.0f / max(fabsf(v.x) + fabsf(v.y) + fabsf(v.z), 1e-20f);
+			float2 oct = float2(v.x * invL1, v.y * invL1);
+			if (v.z < 0.0f)
+			{
+				oct = float2((1.0f - fabsf(oct.y)) * (oct.x >= 0.0f ? 1.0f : -1.0f),
+							 (1.0f - fabsf(oct.x)) * (oct.y >= 0.0f ? 1.0f : -1.0f));
+			}
+
+			static const float s_scale = 32767.0f;
+			float2 octFloor = float2(floorf(oct.x * s_scale), floorf(oct.y * s_scale));
+			float dotBest = -2.0f;
+			for (int i = 0; i < 4; ++i)
+			{
+				float2 octTry = float2(
+									clamp(octFloor.x + float(i & 1), -s_scale, s_scale),
+									clamp(octFloor.y + float(i >> 1), -s_scale, s_scale));
+				float dotTry = dot(DecodeOctahedral(octTry * (1.0f / s_scale)), v);
+				if (dotTry > dotBest)
+				{
+					dotBest = dotTry;
+					pOut[0] = i16(octTry.x);
+					pOut[1] = i16(octTry.y);
+				}
+			}
+		}
+
+		void EncodeVerts(const Context * pCtx, VTXFMT vtxfmt, VertexFormat * pFormatOut, std::vector<byte> * pDataOut)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pFormatOut);
+			ASSERT_ERR(pDataOut);
+
+			using namespace AssetCompiler;
+
+			VertexFormat format = {};
+			auto addAttrib = [&format](VATTR vattr, VENC venc, int sizeBytes)
+			{
+				format.m_encodings[vattr] = byte(venc);
+				format.m_offsets[vattr] = byte(format.m_strideBytes);
+				format.m_strideBytes += sizeBytes;
+			};
+
+			int numVerts = int(pCtx->m_verts.size());
+
+			if (vtxfmt != VTXFMT_Compact)
+			{
+				if (vtxfmt != VTXFMT_Float)
+					ERR("Missing case for VTXFMT %d", vtxfmt);
+
+				// Same layout as struct Vertex, so it's just a copy
+				addAttrib(VATTR_Pos, VENC_Float3, sizeof(float3));
+				addAttrib(VATTR_Normal, VENC_Float3, sizeof(float3));
+				addAttrib(VATTR_UV, VENC_Float2, sizeof(float2));
+#if VERTEX_TANGENT
+				addAttrib(VATTR_Tangent, VENC_Float3, sizeof(float3));
+#endif
+				ASSERT_ERR(format.m_strideBytes == sizeof(Vertex));
+
+				pDataOut->resize(numVerts * sizeof(Vertex));
+				memcpy(pDataOut->data(), pCtx->m_verts.data(), pDataOut->size());
+				*pFormatOut = format;
+				return;
+			}
+
+			// Compact: positions quantized to 16 bits over the mesh bounds, unit vectors
+			// octahedral-encoded, and UVs as halfs.  Positions get a w of 1, so shaders that
+			// read them as a float4 see a point.
+			addAttrib(VATTR_Pos, VENC_Unorm16x4, 4 * sizeof(u16));
+			addAttrib(VATTR_Normal, VENC_Oct16, 2 * sizeof(i16));
+			addAttrib(VATTR_UV, VENC_Half2, 2 * sizeof(u16));
+#if VERTEX_TANGENT
+			addAttrib(VATTR_Tangent, VENC_Oct16, 2 * sizeof(i16));
+#endif
+
+			float3 boundsSize = pCtx->m_bounds.maxs - pCtx->m_bounds.mins;
+			float3 scale = float3(
+								65535.0f / max(boundsSize.x, 1e-20f),
+								65535.0f / max(boundsSize.y, 1e-20f),
+								65535.0f / max(boundsSize.z, 1e-20f));
+
+			pDataOut->resize(numVerts * format.m_strideBytes);
+			byte * pData = pDataOut->data();
+			int stride = format.m_strideBytes;
+
+			static const int s_blockSize = 16 * 1024;
+			ParallelFor((numVerts + s_blockSize - 1) / s_blockSize, [&](int iBlock)
+			{
+				for (int iVert = iBlock * s_blockSize, iVertEnd = min(iVert + s_blockSize, numVerts); iVert < iVertEnd; ++iVert)
+				{
+					const Vertex & vert = pCtx->m_verts[iVert];
+					byte * pVert = pData + iVert * stride;
+
+					float3 posQ = (vert.m_pos - pCtx->m_bounds.mins) * scale;
+					u16 * pPos = (u16 *)(pVert + format.m_offsets[VATTR_Pos]);
+					pPos[0] = u16(clamp(posQ.x, 0.0f, 65535.0f) + 0.5f);
+					pPos[1] = u16(clamp(posQ.y, 0.0f, 65535.0f) + 0.5f);
+					pPos[2] = u16(clamp(posQ.z, 0.0f, 65535.0f) + 0.5f);
+					pPos[3] = 65535;
+
+					EncodeOctahedral16(vert.m_normal, (i16 *)(pVert + format.m_offsets[VATTR_Normal]));
+
+					u16 * pUV = (u16 *)(pVert + format.m_offsets[VATTR_UV]);
+					pUV[0] = FloatToHalf(vert.m_uv.x);
+					pUV[1] = FloatToHalf(vert.m_uv.y);
+
+#if VERTEX_TANGENT
+					EncodeOctahedral16(vert.m_tangent, (i16 *)(pVert + format.m_offsets[VATTR_Tangent]));
+#endif
+				}
+			});
+
+			*pFormatOut = format;
+		}
+
+		void BuildPositionStream(
+			Context * pCtx,
+			const VertexFormat & format,
+			const std::vector<byte> & vertData,
+			int posStrideBytes,
+			std::vector<byte> * pPosDataOut,
+			std::vector<int> * pPosIndicesOut)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(posStrideBytes > 0 && format.m_offsets[VATTR_Pos] + posStrideBytes <= format.m_strideBytes);
+			ASSERT_ERR(pPosDataOut);
+			ASSERT_ERR(pPosIndicesOut);
+
+			// Weld verts whose encoded positions are identical.  This is done within each block
+			// of verts sharing a base vertex (just one, unless SplitFor16BitIndices made more),
+			// so the position stream splits into blocks the same way, and its indices fit in
+			// 16 bits whenever the main ones do.
+			int numVerts = int(pCtx->m_verts.size());
+			int stride = format.m_strideBytes;
+			const byte * pPos = &vertData[format.m_offsets[VATTR_Pos]];
+
+			std::vector<int> blockStarts;
+			for (int iRange = 0, cRange = int(pCtx->m_mtlRanges.size()); iRange < cRange; ++iRange)
+			{
+				int baseVertex = pCtx->m_mtlRanges[iRange].m_baseVertex;
+				if (blockStarts.empty() || baseVertex != blockStarts.back())
+					blockStarts.push_back(baseVertex);
+			}
+			blockStarts.push_back(numVerts);
+
+			// Find the first vertex in each one's block with the same position, by sorting
+			std::vector<int> firstWithPos(numVerts);
+			std::vector<int> order(numVerts);
+			for (int iVert = 0; iVert < numVerts; ++iVert)
+				order[iVert] = iVert;
+			for (int iBlock = 0, cBlock = int(blockStarts.size()) - 1; iBlock < cBlock; ++iBlock)
+			{
+				auto itStart = order.begin() + blockStarts[iBlock];
+				auto itEnd = order.begin() + blockStarts[iBlock + 1];
+				std::sort(itStart, itEnd, [&](int a, int b)
+				{
+					int cmp = memcmp(pPos + a * stride, pPos + b * stride, posStrideBytes);
+					return (cmp != 0) ? (cmp < 0) : (a < b);
+				});
+				for (auto it = itStart; it != itEnd; ++it)
+				{
+					bool samePos = (it != itStart && memcmp(pPos + *(it - 1) * stride, pPos + *it * stride, posStrideBytes) == 0);
+					firstWithPos[*it] = samePos ? firstWithPos[*(it - 1)] : *it;
+				}
+			}
+
+			// Number the positions in each block in order of first use by the full mesh, which
+			// uses all the verts, and remap the whole index buffer, LODs included
+			std::vector<int> posIndexOfVert(numVerts, -1);		// Relative to the block's position base vertex
+			pPosDataOut->clear();
+			pPosIndicesOut->resize(pCtx->m_indices.size());
+			int posBaseVertex = 0;
+			for (int iRange = 0, cRange = int(pCtx->m_mtlRanges.size()); iRange < cRange; ++iRange)
+			{
+				MtlRange & range = pCtx->m_mtlRanges[iRange];
+				if (iRange > 0 && range.m_baseVertex != pCtx->m_mtlRanges[iRange - 1].m_baseVertex)
+					posBaseVertex = int(pPosDataOut->size()) / posStrideBytes;
+				range.m_posBaseVertex = posBaseVertex;
+
+				for (int i = range.m_indexStart, iEnd = range.m_indexStart + range.m_indexCount; i < iEnd; ++i)
+				{
+					int iVert = firstWithPos[pCtx->m_indices[i] + range.m_baseVertex];
+					if (posIndexOfVert[iVert] < 0)
+					{
+						posIndexOfVert[iVert] = int(pPosDataOut->size()) / posStrideBytes - posBaseVertex;
+						pPosDataOut->insert(pPosDataOut->end(), pPos + iVert * stride, pPos + iVert * stride + posStrideBytes);
+					}
+					(*pPosIndicesOut)[i] = posIndexOfVert[iVert];
+				}
+			}
+
+			for (int iLod = 0, cLod = int(pCtx->m_lods.size()); iLod < cLod; ++iLod)
+			{
+				const Lod & lod = pCtx->m_lods[iLod];
+				for (int iRange = 0, cRange = int(lod.m_runs.size()); iRange < cRange; ++iRange)
+				{
+					const IndexRun & run = lod.m_runs[iRange];
+					int baseVertex = pCtx->m_mtlRanges[iRange].m_baseVertex;
+					for (int i = run.m_indexStart, iEnd = run.m_indexStart + run.m_indexCount; i < iEnd; ++i)
+					{
+						int iVert = firstWithPos[pCtx->m_indices[i] + baseVertex];
+						ASSERT_ERR(posIndexOfVert[iVert] >= 0);
+						(*pPosIndicesOut)[i] = posIndexOfVert[iVert];
+					}
+				}
+			}
+		}
+
+		int NarrowIndices(const std::vector<int> & indices, std::vector<u16> * pIndices16, const void ** ppDataOut)
+		{
+			ASSERT_ERR(!indices.empty());
+			ASSERT_ERR(pIndices16);
+			ASSERT_ERR(ppDataOut);
+
+			// Use 16-bit indices if they fit
+			if (*std::max_element(indices.begin(), indices.end()) <= 0xffff)
+			{
+				pIndices16->assign(indices.begin(), indices.end());
+				*ppDataOut = &(*pIndices16)[0];
+				return sizeof(u16);
+			}
+
+			*ppDataOut = &indices[0];
+			return sizeof(int);
+		}
+
+		void SerializeMaterialMap(Context * pCtx, std::vector<byte> * pDataOut)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pDataOut);
+
+			SerializeHelper sh(pDataOut);
+			for (int i = 0, cRange = int(pCtx->m_mtlRanges.size()); i < cRange; ++i)
+			{
+				const MtlRange & range = pCtx->m_mtlRanges[i];
+				sh.WriteString(range.m_mtlName);
+				sh.Write(range.m_indexStart);
+				sh.Write(range.m_indexCount);
+				sh.Write(range.m_baseVertex);
+				sh.Write(range.m_posBaseVertex);
+			}
+		}
+
+		void SerializeLods(Context * pCtx, std::vector<byte> * pDataOut)
+		{
+			ASSERT_ERR(pCtx);
+			ASSERT_ERR(pDataOut);
+
+			// LOD count, then for each LOD its error and an index run per material range
+			SerializeHelper sh(pDataOut);
+			sh.Write(int(pCtx->m_lods.size()));
+			for (int iLod = 0, cLod = int(pCtx->m_lods.size()); iLod < cLod; ++iLod)
+			{
+				const Lod & lod = pCtx->m_lods[iLod];
+				sh.Write(lod.m_error);
+				for (int iRange = 0, cRange = int(lod.m_runs.size()); iRange < cRange; ++iRange)
+				{
+					sh.Write(lod.m_runs[iRange].m_indexStart);
+					sh.Write(lod.m_runs[iRange].m_indexCount);
+				}
+			}
+		}
+	}
+
+
+
+#if !FRAMEWORK_HEADLESS
+	// Load compiled data into a runtime game object
+
+	bool DeserializeMaterialMap(const byte * pMtlMap, int mtlMapSize, MaterialLib * pMtlLib, Mesh * pMeshOut);
+	bool DeserializeLods(const byte * pLods, int lodsSize, Mesh * pMeshOut);
+
+	bool LoadMeshFromAssetPack(
+		AssetPack * pPack,
+		const char * path,
+		MaterialLib * pMtlLib,
+		Mesh * pMeshOut)
+	{
+		ASSERT_ERR(pPack);
+		ASSERT_ERR(path);
+		ASSERT_ERR(pMeshOut);
+
+		using namespace OBJMeshCompiler;
+
+		pMeshOut->m_pPack = pPack;
+
+		// Look for the data in the asset pack
+
+		const Meta * pMeta;
+		int metaSize;
+		if (!pPack->LookupFile(path, s_suffixMeta, (const void **)&pMeta, &metaSize))
+		{
+			WARN("Couldn't find metadata for mesh %s in asset pack %s", path, pPack->m_path.c_str());
+			return false;
 		}
 		if (metaSize != sizeof(Meta))
 		{
@@ -1078,25 +3344,115 @@ namespace Framework
 		}
 		pMeshOut->m_bounds = pMeta->m_bounds;
 
+		// Validate the vertex format
+		const VertexFormat & vtxFormat = pMeta->m_vtxFormat;
+		if (vtxFormat.m_strideBytes <= 0 || vtxFormat.m_strideBytes % 4 != 0)
+		{
+			WARN("Mesh %s in asset pack %s has bad vertex stride %d", path, pPack->m_path.c_str(), vtxFormat.m_strideBytes);
+			return false;
+		}
+		for (int i = 0; i < VATTR_Count; ++i)
+		{
+			if (vtxFormat.m_encodings[i] >= VENC_Count ||
+				vtxFormat.m_offsets[i] >= vtxFormat.m_strideBytes)
+			{
+				WARN("Mesh %s in asset pack %s has bad vertex format for attribute %d", path, pPack->m_path.c_str(), i);
+				return false;
+			}
+		}
+		pMeshOut->m_vtxFormat = vtxFormat;
+		pMeshOut->m_vtxStrideBytes = vtxFormat.m_strideBytes;
+
 		int vertsSize;
-		if (!pPack->LookupFile(path, s_suffixVerts, (void **)&pMeshOut->m_pVerts, &vertsSize))
+		if (!pPack->LookupFile(path, s_suffixVerts, (const void **)&pMeshOut->m_pVerts, &vertsSize))
 		{
 			WARN("Couldn't find verts for mesh %s in asset pack %s", path, pPack->m_path.c_str());
 			return false;
 		}
-		pMeshOut->m_vertCount = vertsSize / sizeof(Vertex);
+		if (vertsSize % vtxFormat.m_strideBytes != 0)
+		{
+			WARN("Verts for mesh %s in asset pack %s are wrong size, %d bytes (expected a multiple of %d)",
+				path, pPack->m_path.c_str(), vertsSize, vtxFormat.m_strideBytes);
+			return false;
+		}
+		pMeshOut->m_vertCount = vertsSize / vtxFormat.m_strideBytes;
+
+		if (pMeta->m_indexSizeBytes != sizeof(u16) && pMeta->m_indexSizeBytes != sizeof(u32))
+		{
+			WARN("Mesh %s in asset pack %s has bad index size %d", path, pPack->m_path.c_str(), pMeta->m_indexSizeBytes);
+			return false;
+		}
+		pMeshOut->m_indexSizeBytes = pMeta->m_indexSizeBytes;
 
 		int indicesSize;
-		if (!pPack->LookupFile(path, s_suffixIndices, (void **)&pMeshOut->m_pIndices, &indicesSize))
+		if (!pPack->LookupFile(path, s_suffixIndices, (const void **)&pMeshOut->m_pIndices, &indicesSize))
 		{
 			WARN("Couldn't find indices for mesh %s in asset pack %s", path, pPack->m_path.c_str());
 			return false;
 		}
-		pMeshOut->m_indexCount = indicesSize / sizeof(int);
+		pMeshOut->m_indexCount = indicesSize / pMeta->m_indexSizeBytes;
+
+		// Position-only stream, in the same encoding as the main stream's positions
+		int posStrideExpected = (vtxFormat.m_encodings[VATTR_Pos] == VENC_Float3) ? int(sizeof(float3)) :
+								(vtxFormat.m_encodings[VATTR_Pos] == VENC_Unorm16x4) ? int(4 * sizeof(u16)) : 0;
+		if (pMeta->m_posStrideBytes != posStrideExpected)
+		{
+			WARN("Mesh %s in asset pack %s has bad position stride %d", path, pPack->m_path.c_str(), pMeta->m_posStrideBytes);
+			return false;
+		}
+		pMeshOut->m_posStrideBytes = pMeta->m_posStrideBytes;
+
+		int posVertsSize;
+		if (!pPack->LookupFile(path, s_suffixPosVerts, (const void **)&pMeshOut->m_pPosVerts, &posVertsSize))
+		{
+			WARN("Couldn't find position-only verts for mesh %s in asset pack %s", path, pPack->m_path.c_str());
+			return false;
+		}
+		if (posVertsSize % pMeta->m_posStrideBytes != 0)
+		{
+			WARN("Position-only verts for mesh %s in asset pack %s are wrong size, %d bytes (expected a multiple of %d)",
+				path, pPack->m_path.c_str(), posVertsSize, pMeta->m_posStrideBytes);
+			return false;
+		}
+		pMeshOut->m_posVertCount = posVertsSize / pMeta->m_posStrideBytes;
+
+		if (pMeta->m_posIndexSizeBytes != sizeof(u16) && pMeta->m_posIndexSizeBytes != sizeof(u32))
+		{
+			WARN("Mesh %s in asset pack %s has bad position index size %d", path, pPack->m_path.c_str(), pMeta->m_posIndexSizeBytes);
+			return false;
+		}
+		pMeshOut->m_posIndexSizeBytes = pMeta->m_posIndexSizeBytes;
 
-		byte * pMtlMap;
+		int posIndicesSize;
+		if (!pPack->LookupFile(path, s_suffixPosIndices, (const void **)&pMeshOut->m_pPosIndices, &posIndicesSize))
+		{
+			WARN("Couldn't find position-only indices for mesh %s in asset pack %s", path, pPack->m_path.c_str());
+			return false;
+		}
+		if (posIndicesSize != pMeshOut->m_indexCount * pMeta->m_posIndexSizeBytes)
+		{
+			WARN("Position-only indices for mesh %s in asset pack %s are wrong size, %d bytes (expected %d)",
+				path, pPack->m_path.c_str(), posIndicesSize, pMeshOut->m_indexCount * pMeta->m_posIndexSizeBytes);
+			return false;
+		}
+
+		int meshletsSize;
+		if (!pPack->LookupFile(path, s_suffixMeshlets, (const void **)&pMeshOut->m_pMeshlets, &meshletsSize))
+		{
+			WARN("Couldn't find meshlets for mesh %s in asset pack %s", path, pPack->m_path.c_str());
+			return false;
+		}
+		if (meshletsSize % sizeof(Meshlet) != 0)
+		{
+			WARN("Meshlets for mesh %s in asset pack %s are wrong size, %d bytes (expected a multiple of %d)",
+				path, pPack->m_path.c_str(), meshletsSize, sizeof(Meshlet));
+			return false;
+		}
+		pMeshOut->m_meshletCount = meshletsSize / sizeof(Meshlet);
+
+		const byte * pMtlMap;
 		int mtlMapSize;
-		if (!pPack->LookupFile(path, s_suffixMtlMap, (void **)&pMtlMap, &mtlMapSize))
+		if (!pPack->LookupFile(path, s_suffixMtlMap, (const void **)&pMtlMap, &mtlMapSize))
 		{
 			WARN("Couldn't find material map for mesh %s in asset pack %s", path, pPack->m_path.c_str());
 			return false;
@@ -1107,8 +3463,48 @@ namespace Framework
 			return false;
 		}
 
-		LOG("Loaded %s from asset pack %s - %d verts, %d indices, %d materials",
-			path, pPack->m_path.c_str(), pMeshOut->m_vertCount, pMeshOut->m_indexCount, pMeshOut->m_mtlRanges.size());
+		const byte * pLods;
+		int lodsSize;
+		if (!pPack->LookupFile(path, s_suffixLods, (const void **)&pLods, &lodsSize))
+		{
+			WARN("Couldn't find LODs for mesh %s in asset pack %s", path, pPack->m_path.c_str());
+			return false;
+		}
+		if (!DeserializeLods(pLods, lodsSize, pMeshOut))
+		{
+			WARN("Couldn't deserialize LODs for mesh %s in asset pack %s", path, pPack->m_path.c_str());
+			return false;
+		}
+
+		// Find each material range's span of meshlets, checking that they're in order and
+		// lie within their ranges
+		for (int iRange = 0, iMeshlet = 0, cRange = int(pMeshOut->m_mtlRanges.size()); iRange < cRange; ++iRange)
+		{
+			Mesh::MtlRange * pRange = &pMeshOut->m_mtlRanges[iRange];
+			pRange->m_meshletStart = iMeshlet;
+			for (; iMeshlet < pMeshOut->m_meshletCount && pMeshOut->m_pMeshlets[iMeshlet].m_iMtlRange == iRange; ++iMeshlet)
+			{
+				const Meshlet & meshlet = pMeshOut->m_pMeshlets[iMeshlet];
+				if (meshlet.m_indexStart < pRange->m_indexStart ||
+					meshlet.m_indexCount <= 0 ||
+					meshlet.m_indexStart + meshlet.m_indexCount > pRange->m_indexStart + pRange->m_indexCount)
+				{
+					WARN("Meshlet %d of mesh %s in asset pack %s is outside its material range", iMeshlet, path, pPack->m_path.c_str());
+					return false;
+				}
+			}
+			pRange->m_meshletCount = iMeshlet - pRange->m_meshletStart;
+
+			if (iRange == cRange - 1 && iMeshlet != pMeshOut->m_meshletCount)
+			{
+				WARN("Meshlets of mesh %s in asset pack %s aren't in material range order", path, pPack->m_path.c_str());
+				return false;
+			}
+		}
+
+		LOG("Loaded %s from asset pack %s - %d verts, %d indices, %d materials, %d meshlets, %d LODs",
+			path, pPack->m_path.c_str(), pMeshOut->m_vertCount, pMeshOut->m_indexCount, pMeshOut->m_mtlRanges.size(),
+			pMeshOut->m_meshletCount, int(pMeshOut->m_lods.size()) + 1);
 
 		return true;
 	}
@@ -1128,7 +3524,9 @@ namespace Framework
 			const char * mtlName;
 			if (!dh.ReadString(&mtlName) ||
 				!dh.Read(&range.m_indexStart) ||
-				!dh.Read(&range.m_indexCount))
+				!dh.Read(&range.m_indexCount) ||
+				!dh.Read(&range.m_baseVertex) ||
+				!dh.Read(&range.m_posBaseVertex))
 			{
 				return false;
 			}
@@ -1141,6 +3539,20 @@ namespace Framework
 				WARN("Corrupt material map: invalid index start/count");
 				return false;
 			}
+			if (range.m_baseVertex < 0 ||
+				range.m_baseVertex >= pMeshOut->m_vertCount)
+			{
+				WARN("Corrupt material map: invalid base vertex");
+				return false;
+			}
+			if (range.m_posBaseVertex < 0 ||
+				range.m_posBaseVertex >= pMeshOut->m_posVertCount)
+			{
+				WARN("Corrupt material map: invalid position base vertex");
+				return false;
+			}
+			if (range.m_baseVertex != 0)
+				pMeshOut->m_split = true;
 
 			// Look up material by name
 			if (pMtlLib && *mtlName)
@@ -1156,6 +3568,60 @@ namespace Framework
 		return true;
 	}
 
+	bool DeserializeLods(const byte * pLods, int lodsSize, Mesh * pMeshOut)
+	{
+		ASSERT_ERR(pLods);
+		ASSERT_ERR(lodsSize > 0);
+		ASSERT_ERR(pMeshOut);
+
+		DeserializeHelper dh(pLods, lodsSize);
+		int lodCount;
+		if (!dh.Read(&lodCount))
+			return false;
+		if (lodCount < 0 || lodCount > lodsSize)
+		{
+			WARN("Corrupt LODs: invalid LOD count %d", lodCount);
+			return false;
+		}
+
+		// Each LOD has the same materials and base verts as the full mesh, but its own index runs
+		pMeshOut->m_lods.resize(lodCount);
+		for (int iLod = 0; iLod < lodCount; ++iLod)
+		{
+			Mesh::Lod * pLod = &pMeshOut->m_lods[iLod];
+			if (!dh.Read(&pLod->m_error))
+				return false;
+
+			pLod->m_mtlRanges = pMeshOut->m_mtlRanges;
+			for (int iRange = 0, cRange = int(pLod->m_mtlRanges.size()); iRange < cRange; ++iRange)
+			{
+				Mesh::MtlRange * pRange = &pLod->m_mtlRanges[iRange];
+				if (!dh.Read(&pRange->m_indexStart) ||
+					!dh.Read(&pRange->m_indexCount))
+				{
+					return false;
+				}
+				if (pRange->m_indexStart < 0 ||
+					pRange->m_indexCount < 0 ||
+					pRange->m_indexStart + pRange->m_indexCount > pMeshOut->m_indexCount)
+				{
+					WARN("Corrupt LODs: invalid index start/count");
+					return false;
+				}
+				pRange->m_meshletStart = 0;
+				pRange->m_meshletCount = 0;
+			}
+		}
+
+		if (!dh.AtEOF())
+		{
+			WARN("Corrupt LODs: extra data at end");
+			return false;
+		}
+
+		return true;
+	}
+
 
 
 	// Helper function for quick and dirty apps - just compile and load a mesh in one step.
@@ -1211,4 +3677,5 @@ namespace Framework
 		// And extract the mesh from it
 		return LoadMeshFromAssetPack(pPack, path, nullptr, pMeshOut);
 	}
+#endif // !FRAMEWORK_HEADLESS
 }
@@ -12,6 +12,7 @@ namespace Framework
 		struct Material
 		{
 			std::string		m_mtlName;
+			// Texture paths keep their case, to open the sources with; they're lowercased when serialized
 			std::string		m_texDiffuseColor;
 			std::string		m_texSpecColor;
 			std::string		m_texHeight;
@@ -19,6 +20,7 @@ namespace Framework
 			rgb				m_rgbSpecColor;
 			float			m_specPower;
 			float			m_bumpScale;
+			bool			m_alphaTest;		// Has a dissolve map (map_d), so it's drawn alpha-tested on diffuse alpha
 		};
 
 		struct Context
@@ -60,6 +62,62 @@ namespace Framework
 		return WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMtlLib, &serializedMtlLib[0], serializedMtlLib.size(), pZipOut);
 	}
 
+	// Dependency scanner: materials reference textures via map_Kd, map_Ks, and bump.
+	// Diffuse textures of alpha-tested materials are flagged, so their mips keep their coverage.
+
+	bool FindOBJMtlLibDependencies(
+		const AssetCompileInfo * pACI,
+		std::vector<AssetCompiler::AssetDependency> * pDepsOut)
+	{
+		ASSERT_ERR(pACI);
+		ASSERT_ERR(pACI->m_pathSrc);
+		ASSERT_ERR(pACI->m_ack == ACK_OBJMtlLib);
+		ASSERT_ERR(pDepsOut);
+
+		using namespace AssetCompiler;
+		using namespace OBJMtlLibCompiler;
+
+		Context ctx = {};
+		if (!ParseMTL(pACI->m_pathSrc, &ctx))
+			return false;
+
+		// Texture paths are relative to the .mtl's directory, as in LoadMaterialLibFromAssetPack.
+		// ParseMTL has already fixed up the slashes, but kept the case, so the sources can be
+		// found on case-sensitive filesystems.
+		std::string dirBase = findDirectory(pACI->m_pathSrc);
+		std::unordered_map<std::string, int> texIndices;	// Index of each texture's entry in pDepsOut
+		for (int i = 0, n = int(ctx.m_mtls.size()); i < n; ++i)
+		{
+			const OBJMtlLibCompiler::Material * pMtl = &ctx.m_mtls[i];
+			const std::string * texNames[] =
+			{
+				&pMtl->m_texDiffuseColor,
+				&pMtl->m_texSpecColor,
+				&pMtl->m_texHeight,
+			};
+			for (int j = 0; j < dim(texNames); ++j)
+			{
+				if (texNames[j]->empty())
+					continue;
+
+				std::string key = *texNames[j];
+				makeLowercase(key);
+				auto iterAndBool = texIndices.insert(std::make_pair(key, int(pDepsOut->size())));
+				if (iterAndBool.second)
+				{
+					AssetDependency dep = { dirBase + *texNames[j], ACK_TextureWithMips };
+					pDepsOut->push_back(dep);
+				}
+
+				// The alpha test reads diffuse alpha
+				if (j == 0 && pMtl->m_alphaTest)
+					(*pDepsOut)[iterAndBool.first->second].m_alphaTested = true;
+			}
+		}
+
+		return true;
+	}
+
 
 
 	namespace OBJMtlLibCompiler
@@ -87,6 +145,7 @@ namespace Framework
 				{ 0.0f, 0.0f, 0.0f, },	// m_rgbSpecColor
 				0.0f,					// m_specPower
 				1.0f,					// m_bumpScale
+				false,					// m_alphaTest
 			};
 
 			// Parse line-by-line
@@ -115,7 +174,6 @@ namespace Framework
 					pMtlCur->m_texDiffuseColor = tph.ExpectOneToken("texture name");
 					tph.ExpectEOL();
 
-					makeLowercase(pMtlCur->m_texDiffuseColor);
 					replaceChars(pMtlCur->m_texDiffuseColor, '\\', '/');
 				}
 				else if (_stricmp(pToken, "map_Ks") == 0)
@@ -130,7 +188,6 @@ namespace Framework
 					pMtlCur->m_texSpecColor = tph.ExpectOneToken("texture name");
 					tph.ExpectEOL();
 
-					makeLowercase(pMtlCur->m_texSpecColor);
 					replaceChars(pMtlCur->m_texSpecColor, '\\', '/');
 				}
 				else if (_stricmp(pToken, "map_bump") == 0 ||
@@ -162,9 +219,24 @@ namespace Framework
 					pMtlCur->m_texHeight = pToken;
 					tph.ExpectEOL();
 
-					makeLowercase(pMtlCur->m_texHeight);
 					replaceChars(pMtlCur->m_texHeight, '\\', '/');
 				}
+				else if (_stricmp(pToken, "map_d") == 0)
+				{
+					if (!pMtlCur)
+					{
+						WARN("%s: syntax error at line %d: material parameters specified before any \"newmtl\" command; ignoring",
+							path, tph.m_iLine);
+						continue;
+					}
+
+					// The dissolve map itself isn't used; the mask is expected in the diffuse
+					// texture's alpha, as the alpha-test shaders read it from there
+					tph.ExpectOneToken("texture name");
+					tph.ExpectEOL();
+
+					pMtlCur->m_alphaTest = true;
+				}
 				else if (_stricmp(pToken, "Kd") == 0)
 				{
 					char * tokens[3] = {};
@@ -223,20 +295,31 @@ namespace Framework
 			for (int i = 0, cMtl = int(pCtx->m_mtls.size()); i < cMtl; ++i)
 			{
 				const Material * pMtl = &pCtx->m_mtls[i];
+
+				// Texture paths are looked up in the pack, whose paths are all lowercase
+				std::string texDiffuseColor = pMtl->m_texDiffuseColor;
+				std::string texSpecColor = pMtl->m_texSpecColor;
+				std::string texHeight = pMtl->m_texHeight;
+				makeLowercase(texDiffuseColor);
+				makeLowercase(texSpecColor);
+				makeLowercase(texHeight);
+
 				sh.WriteString(pMtl->m_mtlName);
-				sh.WriteString(pMtl->m_texDiffuseColor);
-				sh.WriteString(pMtl->m_texSpecColor);
-				sh.WriteString(pMtl->m_texHeight);
+				sh.WriteString(texDiffuseColor);
+				sh.WriteString(texSpecColor);
+				sh.WriteString(texHeight);
 				sh.Write(pMtl->m_rgbDiffuseColor);
 				sh.Write(pMtl->m_rgbSpecColor);
 				sh.Write(pMtl->m_specPower);
 				sh.Write(pMtl->m_bumpScale);
+				sh.Write(int(pMtl->m_alphaTest));
 			}
 		}
 	}
 
 
 
+#if !FRAMEWORK_HEADLESS
 	// Load compiled data into a runtime game object
 
 	bool LoadMaterialLibFromAssetPack(
@@ -254,9 +337,9 @@ namespace Framework
 		pMtlLibOut->m_pPack = pPack;
 
 		// Look for the data in the asset pack
-		byte * pData;
+		const byte * pData;
 		int dataSize;
-		if (!pPack->LookupFile(path, s_suffixMtlLib, (void **)&pData, &dataSize))
+		if (!pPack->LookupFile(path, s_suffixMtlLib, (const void **)&pData, &dataSize))
 		{
 			WARN("Couldn't find data for material lib %s in asset pack %s", path, pPack->m_path.c_str());
 			return false;
@@ -275,6 +358,7 @@ namespace Framework
 			const char * texDiffuseColorName;
 			const char * texSpecColorName;
 			const char * texHeightName;
+			int alphaTest;
 			if (!dh.ReadString(&mtl.m_mtlName) ||
 				!dh.ReadString(&texDiffuseColorName) ||
 				!dh.ReadString(&texSpecColorName) ||
@@ -282,10 +366,12 @@ namespace Framework
 				!dh.Read(&mtl.m_rgbDiffuseColor) ||
 				!dh.Read(&mtl.m_rgbSpecColor) ||
 				!dh.Read(&mtl.m_specPower) ||
-				!dh.Read(&mtl.m_bumpScale))
+				!dh.Read(&mtl.m_bumpScale) ||
+				!dh.Read(&alphaTest))
 			{
 				return false;
 			}
+			mtl.m_alphaTest = (alphaTest != 0);
 
 			// Validate data
 			if (any(mtl.m_rgbDiffuseColor < 0.0f) || any(mtl.m_rgbDiffuseColor > 1.0f) ||
@@ -324,4 +410,5 @@ namespace Framework
 
 		return true;
 	}
+#endif // !FRAMEWORK_HEADLESS
 }
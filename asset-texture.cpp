@@ -10,25 +10,49 @@
 #include "stb_image_resize.h"
 #pragma warning(pop)
 
+#include <emmintrin.h>
+
 namespace Framework
 {
 	// Infrastructure for compiling textures.
-	//  * All textures are currently in RGBA8 sRGB format, top-down.
+	//  * Textures are stored top-down, in the format given by the asset's TEXFMT: RGBA8 sRGB,
+	//      R8 or RG8 for data, RGBA16F or R11G11B10F for HDR, or BCn.  Each level is compressed
+	//      on its own after the mips are built (see bcn.h).
+	//  * TEXFMT_Auto picks by the source: one- and two-channel sources (masks, heights, etc.)
+	//      go to R8 and RG8, HDR sources (.hdr, loaded as float) to R11G11B10F, or RGBA16F if
+	//      they have alpha, and others to RGBA8.  Grey sources of color need an explicit TEXFMT.
+	//  * HDR formats are built from linear float throughout; LDR sources going to them are
+	//      decoded from sRGB first.
 	//  * Textures are either stored raw, or with mips.  Textures with mips are also
 	//      resampled up to the next pow2 size if necessary.
+	//  * Each mip level is built from the one before it by a 2x2 box filter, in linear space
+	//      with alpha-weighted color.  The chain is kept in float, and only converted back
+	//      to sRGB8 for output, so rounding doesn't accumulate down the levels.
+	//  * R8, RG8, BC4 and BC5 textures hold data such as heights or normals rather than color,
+	//      so they are filtered on the raw values, with no sRGB decoding or alpha weighting.
+	//  * Alpha-tested textures can have alpha scaled in each mip so the same fraction of pixels
+	//      passes the test as in the base level; otherwise averaging thins out cutouts such as
+	//      foliage at a distance.  The scale is found per level by binary search, and applied
+	//      only to the output, so levels are still built from unscaled data.  It's enabled per
+	//      asset, and automatically for diffuse textures of materials with a map_d.
+	//  * Enable the BENCHMARK_MIPS define to also build the mips the old way, resampling
+	//      each level from the source image, and log the time taken by both.
 	//  * Enable the WRITE_BMP define to additionally write out all images as .bmps
 	//      in the archive, for debugging.
 	//  * !!!UNDONE: Premultiplied alpha
-	//  * !!!UNDONE: BCn compression
-	//  * !!!UNDONE: Other pixel formats: HDR textures, normal maps, etc.
+
 	//  * !!!UNDONE: Cubemaps, volume textures, sparse tiled textures, etc.
 
 #define WRITE_BMP 0
+#define BENCHMARK_MIPS 0
 
 	namespace TextureCompiler
 	{
 		static const char * s_suffixMeta = "/meta";
 
+		// Alpha-test threshold when the asset doesn't give one, matching the alpha-test shaders
+		static const float s_alphaCutoffDefault = 0.5f;
+
 		struct Meta
 		{
 			int2			m_dims;
@@ -36,12 +60,67 @@ namespace Framework
 			DXGI_FORMAT		m_format;
 		};
 
+		// Source image, in the form its TEXFMT is built from: linear float for the HDR formats,
+		// otherwise 8-bit, as sRGB color or as raw values for the data formats
+		struct Source
+		{
+			int2				m_dims;
+			TEXFMT				m_texfmt;		// Never TEXFMT_Auto
+			std::vector<byte4>	m_pixels;
+			std::vector<float4>	m_linear;
+		};
+
 		// Prototype various helper functions
+		bool LoadSource(
+			const AssetCompileInfo * pACI,
+			Source * pSrcOut);
+
+		DXGI_FORMAT ChooseFormat(
+			const char * assetPath,
+			TEXFMT texfmt,
+			const byte4 * pPixels,
+			int2 dims);
+
+		void BuildMips(
+			const byte4 * pPixelsBase,
+			int2 dimsBase,
+			int mipLevels,
+			bool srgb,
+			float alphaCutoff,
+			std::vector<std::vector<byte4>> * pMipsOut);
+
+		void BuildMipsLinear(
+			const float4 * pLinearBase,
+			int2 dimsBase,
+			int mipLevels,
+			std::vector<std::vector<float4>> * pMipsOut);
+
+#if BENCHMARK_MIPS
+		bool BenchmarkMips(
+			const char * assetPath,
+			const byte4 * pPixelsSrc,
+			int2 dimsSrc,
+			const byte4 * pPixelsBase,
+			int2 dimsBase,
+			int mipLevels);
+#endif
+
 		bool WriteImageToZip(
 			const char * assetPath,
 			int mipLevel,
 			const byte4 * pPixels,
 			int2 dims,
+			DXGI_FORMAT format,
+			CODEC codec,
+			mz_zip_archive * pZipOut);
+
+		bool WriteImageToZip(
+			const char * assetPath,
+			int mipLevel,
+			const float4 * pLinear,
+			int2 dims,
+			DXGI_FORMAT format,
+			CODEC codec,
 			mz_zip_archive * pZipOut);
 
 #if WRITE_BMP
@@ -52,6 +131,18 @@ namespace Framework
 			int2 dims,
 			mz_zip_archive * pZipOut);
 #endif
+
+		inline bool IsHDRTexfmt(TEXFMT texfmt)
+		{
+			return (texfmt == TEXFMT_RGBA16F || texfmt == TEXFMT_R11G11B10F);
+		}
+
+		// Formats that hold data such as heights or normals rather than color
+		inline bool IsDataTexfmt(TEXFMT texfmt)
+		{
+			return (texfmt == TEXFMT_R8 || texfmt == TEXFMT_RG8 ||
+					texfmt == TEXFMT_BC4 || texfmt == TEXFMT_BC5);
+		}
 	}
 
 
@@ -71,33 +162,29 @@ namespace Framework
 		using namespace TextureCompiler;
 
 		// Load the image
-		int2 dims;
-		int numComponents;
-		byte4 * pPixels = (byte4 *)stbi_load(pACI->m_pathSrc, &dims.x, &dims.y, &numComponents, 4);
-		if (!pPixels)
-		{
-			WARN("Couldn't load file %s: %s", pACI->m_pathSrc, stbi_failure_reason());
+		Source src;
+		if (!LoadSource(pACI, &src))
 			return false;
-		}
+
+		bool hdr = IsHDRTexfmt(src.m_texfmt);
+		const byte4 * pPixels = hdr ? nullptr : &src.m_pixels[0];
 
 		// Fill out the metadata struct
 		Meta meta =
 		{
-			dims,
+			src.m_dims,
 			1,		// mipLevels
-			DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+			ChooseFormat(pACI->m_pathSrc, src.m_texfmt, pPixels, src.m_dims),
 		};
 
 		// Write the data out to the archive
-		if (!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMeta, &meta, sizeof(meta), pZipOut) ||
-			!WriteImageToZip(pACI->m_pathSrc, 0, pPixels, dims, pZipOut))
-		{
-			stbi_image_free(pPixels);
+		if (!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMeta, &meta, sizeof(meta), pZipOut))
 			return false;
-		}
 
-		stbi_image_free(pPixels);
-		return true;
+		if (hdr)
+			return WriteImageToZip(pACI->m_pathSrc, 0, &src.m_linear[0], src.m_dims, meta.m_format, pACI->m_codec, pZipOut);
+		else
+			return WriteImageToZip(pACI->m_pathSrc, 0, pPixels, src.m_dims, meta.m_format, pACI->m_codec, pZipOut);
 	}
 
 	bool CompileTextureWithMipsAsset(
@@ -113,34 +200,52 @@ namespace Framework
 		using namespace TextureCompiler;
 
 		// Load the image
-		int2 dims;
-		int numComponents;
-		byte4 * pPixels = (byte4 *)stbi_load(pACI->m_pathSrc, &dims.x, &dims.y, &numComponents, 4);
-		if (!pPixels)
-		{
-			WARN("Couldn't load file %s: %s", pACI->m_pathSrc, stbi_failure_reason());
+		Source src;
+		if (!LoadSource(pACI, &src))
 			return false;
-		}
+
+		bool hdr = IsHDRTexfmt(src.m_texfmt);
+		bool srgb = !IsDataTexfmt(src.m_texfmt);
+		int2 dims = src.m_dims;
 
 		// Resample the base mip up to pow2 if necessary
-		int2 dimsBase;
+		int2 dimsBase = dims;
 		std::vector<byte4> pixelsBase;
-		byte4 * pPixelsBase;
+		std::vector<float4> linearBase;
+		const byte4 * pPixelsBase = hdr ? nullptr : &src.m_pixels[0];
+		const float4 * pLinearBase = hdr ? &src.m_linear[0] : nullptr;
 		if (!ispow2(dims.x) || !ispow2(dims.y))
 		{
 			dimsBase = { pow2_ceil(dims.x), pow2_ceil(dims.y) };
-			pixelsBase.resize(dimsBase.x * dimsBase.y);
-			pPixelsBase = &pixelsBase[0];
 
-			CHECK_ERR(stbir_resize_uint8_srgb(
-						(const byte *)pPixels, dims.x, dims.y, 0,
-						(byte *)pPixelsBase, dimsBase.x, dimsBase.y, 0,
-						4, 3, 0));
-		}
-		else
-		{
-			dimsBase = dims;
-			pPixelsBase = pPixels;
+			if (hdr)
+			{
+				linearBase.resize(dimsBase.x * dimsBase.y);
+				CHECK_ERR(stbir_resize_float_generic(
+							(const float *)pLinearBase, dims.x, dims.y, 0,
+							(float *)&linearBase[0], dimsBase.x, dimsBase.y, 0,
+							4, 3, 0, STBIR_EDGE_CLAMP, STBIR_FILTER_DEFAULT, STBIR_COLORSPACE_LINEAR, nullptr));
+				pLinearBase = &linearBase[0];
+			}
+			else
+			{
+				pixelsBase.resize(dimsBase.x * dimsBase.y);
+				if (srgb)
+				{
+					CHECK_ERR(stbir_resize_uint8_srgb(
+								(const byte *)pPixelsBase, dims.x, dims.y, 0,
+								(byte *)&pixelsBase[0], dimsBase.x, dimsBase.y, 0,
+								4, 3, 0));
+				}
+				else
+				{
+					CHECK_ERR(stbir_resize_uint8(
+								(const byte *)pPixelsBase, dims.x, dims.y, 0,
+								(byte *)&pixelsBase[0], dimsBase.x, dimsBase.y, 0,
+								4));
+				}
+				pPixelsBase = &pixelsBase[0];
+			}
 		}
 
 		// Fill out the metadata struct
@@ -149,38 +254,54 @@ namespace Framework
 		{
 			dimsBase,
 			mipLevels,
-			DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+			ChooseFormat(pACI->m_pathSrc, src.m_texfmt, pPixelsBase, dimsBase),
 		};
+		CODEC codec = pACI->m_codec;
 
-		// Store the metadata and the base level pixels
-		if (!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMeta, &meta, sizeof(meta), pZipOut) ||
-			!WriteImageToZip(pACI->m_pathSrc, 0, pPixelsBase, dimsBase, pZipOut))
-		{
-			stbi_image_free(pPixels);
+		if (!WriteAssetDataToZip(pACI->m_pathSrc, s_suffixMeta, &meta, sizeof(meta), pZipOut))
 			return false;
+
+		// HDR textures: store the base level, then generate and store the mips, all in float
+		if (hdr)
+		{
+			if (!WriteImageToZip(pACI->m_pathSrc, 0, pLinearBase, dimsBase, meta.m_format, codec, pZipOut))
+				return false;
+
+			std::vector<std::vector<float4>> mips;
+			BuildMipsLinear(pLinearBase, dimsBase, mipLevels, &mips);
+
+			for (int level = 1; level < mipLevels; ++level)
+			{
+				int2 dimsMip = CalculateMipDims(dimsBase, level);
+				if (!WriteImageToZip(pACI->m_pathSrc, level, &mips[level - 1][0], dimsMip, meta.m_format, codec, pZipOut))
+					return false;
+			}
+
+			return true;
 		}
 
+		// Store the base level pixels
+		if (!WriteImageToZip(pACI->m_pathSrc, 0, pPixelsBase, dimsBase, meta.m_format, codec, pZipOut))
+			return false;
+
+#if BENCHMARK_MIPS
+		BenchmarkMips(pACI->m_pathSrc, &src.m_pixels[0], dims, pPixelsBase, dimsBase, mipLevels);
+#endif
+
 		// Generate mip levels
-		std::vector<byte4> pixelsMip;
+		float alphaCutoff = 0.0f;
+		if (pACI->m_preserveAlphaCoverage)
+			alphaCutoff = (pACI->m_alphaCutoff > 0.0f) ? pACI->m_alphaCutoff : s_alphaCutoffDefault;
+		std::vector<std::vector<byte4>> mips;
+		BuildMips(pPixelsBase, dimsBase, mipLevels, srgb, alphaCutoff, &mips);
+
 		for (int level = 1; level < mipLevels; ++level)
 		{
 			int2 dimsMip = CalculateMipDims(dimsBase, level);
-			pixelsMip.resize(dimsMip.x * dimsMip.y);
-			byte4 * pPixelsMip = &pixelsMip[0];
-
-			CHECK_ERR(stbir_resize_uint8_srgb(
-						(const byte *)pPixels, dims.x, dims.y, 0,
-						(byte *)pPixelsMip, dimsMip.x, dimsMip.y, 0,
-						4, 3, 0));
-
-			if (!WriteImageToZip(pACI->m_pathSrc, level, pPixelsMip, dimsMip, pZipOut))
-			{
-				stbi_image_free(pPixels);
+			if (!WriteImageToZip(pACI->m_pathSrc, level, &mips[level - 1][0], dimsMip, meta.m_format, codec, pZipOut))
 				return false;
-			}
 		}
 
-		stbi_image_free(pPixels);
 		return true;
 	}
 
@@ -188,11 +309,515 @@ namespace Framework
 
 	namespace TextureCompiler
 	{
+		// Mip levels are kept as linear RGB premultiplied by a weight of alpha + epsilon, with
+		// the weight in the alpha channel.  The epsilon keeps the color of fully transparent
+		// areas from going black, while barely affecting the blend where alpha is nonzero.
+		static const float s_alphaWeightEpsilon = 1.0f / 4096.0f;
+
+		// Aim for this many destination pixels per job when building a mip level
+		static const int s_mipPixelsPerJob = 16384;
+
+		// Steps of binary search for a mip level's alpha scale; enough to pin the threshold
+		// down well below one 8-bit step
+		static const int s_alphaCoverageIterations = 16;
+
+		DXGI_FORMAT ChooseFormat(
+			const char * assetPath,
+			TEXFMT texfmt,
+			const byte4 * pPixels,
+			int2 dims)
+		{
+			ASSERT_ERR(assetPath);
+
+			switch (texfmt)
+			{
+			case TEXFMT_RGBA8:			return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+			case TEXFMT_R8:				return DXGI_FORMAT_R8_UNORM;
+			case TEXFMT_RG8:			return DXGI_FORMAT_R8G8_UNORM;
+			case TEXFMT_RGBA16F:		return DXGI_FORMAT_R16G16B16A16_FLOAT;
+			case TEXFMT_R11G11B10F:		return DXGI_FORMAT_R11G11B10_FLOAT;
+			default:					break;
+			}
+
+			// D3D wants the top level of a block-compressed texture to be whole blocks
+			if ((dims.x | dims.y) & 3)
+			{
+				WARN("Texture %s is %dx%d, not a multiple of 4; leaving it uncompressed", assetPath, dims.x, dims.y);
+				switch (texfmt)
+				{
+				case TEXFMT_BC4:		return DXGI_FORMAT_R8_UNORM;
+				case TEXFMT_BC5:		return DXGI_FORMAT_R8G8_UNORM;
+				default:				return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+				}
+			}
+
+			switch (texfmt)
+			{
+			case TEXFMT_BC1or3:
+				ASSERT_ERR(pPixels);
+				for (int i = 0, n = dims.x * dims.y; i < n; ++i)
+				{
+					if (pPixels[i].w < 255)
+						return DXGI_FORMAT_BC3_UNORM_SRGB;
+				}
+				return DXGI_FORMAT_BC1_UNORM_SRGB;
+
+			case TEXFMT_BC4:		return DXGI_FORMAT_BC4_UNORM;
+			case TEXFMT_BC5:		return DXGI_FORMAT_BC5_UNORM;
+			case TEXFMT_BC7:		return DXGI_FORMAT_BC7_UNORM_SRGB;
+
+			default:
+				ERR("Missing case for TEXFMT %d", texfmt);
+				return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+			}
+		}
+
+		// Plain 8-bit unorm conversions, for textures that don't hold color
+		static void ConvertUNorm8ToFloat(
+			const byte4 * pPixels,
+			int count,
+			float4 * pValuesOut)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				byte4 pixel = pPixels[i];
+				pValuesOut[i] = float4(pixel.x, pixel.y, pixel.z, pixel.w) * (1.0f / 255.0f);
+			}
+		}
+
+		static void ConvertFloatToUNorm8(
+			const float4 * pValues,
+			int count,
+			byte4 * pPixelsOut)
+		{
+			for (int i = 0; i < count; ++i)
+				pPixelsOut[i] = byte4(round(255.0f * saturate(pValues[i])));
+		}
+
+		bool LoadSource(
+			const AssetCompileInfo * pACI,
+			Source * pSrcOut)
+		{
+			ASSERT_ERR(pACI);
+			ASSERT_ERR(pACI->m_pathSrc);
+			ASSERT_ERR(pSrcOut);
+
+			// Load as RGBA, in float for HDR sources, else 8-bit
+			bool hdrSrc = (stbi_is_hdr(pACI->m_pathSrc) != 0);
+			int2 dims;
+			int numComponents;
+			if (hdrSrc)
+			{
+				float4 * pLinear = (float4 *)stbi_loadf(pACI->m_pathSrc, &dims.x, &dims.y, &numComponents, 4);
+				if (!pLinear)
+				{
+					WARN("Couldn't load file %s: %s", pACI->m_pathSrc, stbi_failure_reason());
+					return false;
+				}
+				pSrcOut->m_linear.assign(pLinear, pLinear + dims.x * dims.y);
+				stbi_image_free(pLinear);
+			}
+			else
+			{
+				byte4 * pPixels = (byte4 *)stbi_load(pACI->m_pathSrc, &dims.x, &dims.y, &numComponents, 4);
+				if (!pPixels)
+				{
+					WARN("Couldn't load file %s: %s", pACI->m_pathSrc, stbi_failure_reason());
+					return false;
+				}
+				pSrcOut->m_pixels.assign(pPixels, pPixels + dims.x * dims.y);
+				stbi_image_free(pPixels);
+			}
+			pSrcOut->m_dims = dims;
+
+			// Pick the format by the number of channels in the file, if not given
+			TEXFMT texfmt = pACI->m_texfmt;
+			if (texfmt == TEXFMT_Auto)
+			{
+				if (hdrSrc)
+					texfmt = (numComponents == 2 || numComponents == 4) ? TEXFMT_RGBA16F : TEXFMT_R11G11B10F;
+				else if (numComponents == 1)
+					texfmt = TEXFMT_R8;
+				else if (numComponents == 2)
+					texfmt = TEXFMT_RG8;
+				else
+					texfmt = TEXFMT_RGBA8;
+			}
+			pSrcOut->m_texfmt = texfmt;
+
+			// Convert between LDR and HDR if the format needs the other one, with the exact sRGB
+			// curve for color
+			int count = dims.x * dims.y;
+			if (IsHDRTexfmt(texfmt) && !hdrSrc)
+			{
+				pSrcOut->m_linear.resize(count);
+				ConvertSRGB8ToLinear(&pSrcOut->m_pixels[0], count, &pSrcOut->m_linear[0]);
+				pSrcOut->m_pixels.clear();
+			}
+			else if (!IsHDRTexfmt(texfmt) && hdrSrc)
+			{
+				pSrcOut->m_pixels.resize(count);
+				if (IsDataTexfmt(texfmt))
+					ConvertFloatToUNorm8(&pSrcOut->m_linear[0], count, &pSrcOut->m_pixels[0]);
+				else
+					ConvertLinearToSRGB8(&pSrcOut->m_linear[0], count, &pSrcOut->m_pixels[0]);
+				pSrcOut->m_linear.clear();
+			}
+
+			// Grey + alpha comes in as (L, L, L, A); two-channel formats take (L, A)
+			if (numComponents == 2 && (texfmt == TEXFMT_RG8 || texfmt == TEXFMT_BC5))
+			{
+				for (int i = 0; i < count; ++i)
+					pSrcOut->m_pixels[i].y = pSrcOut->m_pixels[i].w;
+			}
+
+			return true;
+		}
+
+		// Average 2x2 blocks from a pair of source rows.  dx is 0 when the source is only
+		// one pixel wide, so the pixel is averaged with itself.
+		static void DownsampleRowPair(
+			const float4 * pRow0,
+			const float4 * pRow1,
+			int dx,
+			int countOut,
+			float4 * pRowOut)
+		{
+			const float * pSrc0 = (const float *)pRow0;
+			const float * pSrc1 = (const float *)pRow1;
+			float * pDst = (float *)pRowOut;
+			int offset = dx * 4;
+			__m128 quarter = _mm_set1_ps(0.25f);
+			for (int x = 0; x < countOut; ++x, pSrc0 += 8, pSrc1 += 8, pDst += 4)
+			{
+				__m128 sum0 = _mm_add_ps(_mm_loadu_ps(pSrc0), _mm_loadu_ps(pSrc0 + offset));
+				__m128 sum1 = _mm_add_ps(_mm_loadu_ps(pSrc1), _mm_loadu_ps(pSrc1 + offset));
+				_mm_storeu_ps(pDst, _mm_mul_ps(_mm_add_ps(sum0, sum1), quarter));
+			}
+		}
+
+		// Count the alphas at or above a threshold, four at a time
+		static int CountAlphasAtLeast(
+			const float * pAlphas,
+			int count,
+			float threshold)
+		{
+			__m128 thresholdVec = _mm_set1_ps(threshold);
+			__m128i counts = _mm_setzero_si128();
+			int i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				// Passing lanes compare to all ones, which is -1, so subtracting them counts them
+				__m128 pass = _mm_cmpge_ps(_mm_loadu_ps(pAlphas + i), thresholdVec);
+				counts = _mm_sub_epi32(counts, _mm_castps_si128(pass));
+			}
+
+			int lanes[4];
+			_mm_storeu_si128((__m128i *)lanes, counts);
+			int result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			for (; i < count; ++i)
+			{
+				if (pAlphas[i] >= threshold)
+					++result;
+			}
+			return result;
+		}
+
+		// Find the scale for a mip level's alphas that makes the number of them passing alphaPassMin
+		// closest to countTarget.  Scaling by s passes the same alphas as testing the unscaled ones
+		// against alphaPassMin / s, so this searches on that threshold instead, which is bounded:
+		// nothing in [0, 1] passes a threshold of 2.
+		static float FindAlphaScaleForCoverage(
+			const float * pAlphas,
+			int count,
+			float alphaPassMin,
+			int countTarget)
+		{
+			ASSERT_ERR(pAlphas);
+			ASSERT_ERR(count > 0);
+			ASSERT_ERR(alphaPassMin > 0.0f);
+
+			// Leave the level alone if it already matches, such as when it's opaque
+			if (CountAlphasAtLeast(pAlphas, count, alphaPassMin) == countTarget)
+				return 1.0f;
+
+			// The count falls as the threshold rises; keep countLo >= countTarget > countHi
+			float thresholdLo = 0.0f, thresholdHi = 2.0f;
+			int countLo = count, countHi = 0;
+			for (int i = 0; i < s_alphaCoverageIterations; ++i)
+			{
+				float thresholdMid = 0.5f * (thresholdLo + thresholdHi);
+				int countMid = CountAlphasAtLeast(pAlphas, count, thresholdMid);
+				if (countMid >= countTarget)
+				{
+					thresholdLo = thresholdMid;
+					countLo = countMid;
+				}
+				else
+				{
+					thresholdHi = thresholdMid;
+					countHi = countMid;
+				}
+			}
+
+			// A threshold of zero would need an infinite scale, but the other side is always usable
+			bool useLo = (thresholdLo > 0.0f && countLo - countTarget <= countTarget - countHi);
+			return alphaPassMin / (useLo ? thresholdLo : thresholdHi);
+		}
+
+		void BuildMips(
+			const byte4 * pPixelsBase,
+			int2 dimsBase,
+			int mipLevels,
+			bool srgb,
+			float alphaCutoff,
+			std::vector<std::vector<byte4>> * pMipsOut)
+		{
+			ASSERT_ERR(pPixelsBase);
+			ASSERT_ERR(all(dimsBase > 0));
+			ASSERT_ERR(ispow2(dimsBase.x) && ispow2(dimsBase.y));
+			ASSERT_ERR(alphaCutoff >= 0.0f && alphaCutoff <= 1.0f);
+			ASSERT_ERR(pMipsOut);
+
+			pMipsOut->resize(max(mipLevels - 1, 0));
+			std::vector<float4> linearSrc, linearDst;
+
+			// To preserve alpha-test coverage, measure it on the base level.  An output alpha passes
+			// once it rounds to at least alphaByteMin, so at alphaPassMin before rounding.  Only
+			// color textures have alpha to test.
+			bool preserveCoverage = (srgb && alphaCutoff > 0.0f);
+			float coverageBase = 0.0f;
+			float alphaPassMin = 0.0f;
+			std::vector<float4> linearOut;
+			std::vector<float> alphas;
+			if (preserveCoverage)
+			{
+				int alphaByteMin = max(int(ceil(alphaCutoff * 255.0f)), 1);
+				alphaPassMin = (float(alphaByteMin) - 0.5f) / 255.0f;
+
+				int countBase = dimsBase.x * dimsBase.y;
+				int countPass = 0;
+				for (int i = 0; i < countBase; ++i)
+				{
+					if (pPixelsBase[i].w >= alphaByteMin)
+						++countPass;
+				}
+				coverageBase = float(countPass) / float(countBase);
+			}
+
+			for (int level = 1; level < mipLevels; ++level)
+			{
+				int2 dimsSrc = CalculateMipDims(dimsBase, level - 1);
+				int2 dimsDst = CalculateMipDims(dimsBase, level);
+				int dx = (dimsSrc.x > 1) ? 1 : 0;
+				int dy = (dimsSrc.y > 1) ? 1 : 0;
+
+				linearDst.resize(dimsDst.x * dimsDst.y);
+				if (preserveCoverage)
+				{
+					linearOut.resize(dimsDst.x * dimsDst.y);
+					alphas.resize(dimsDst.x * dimsDst.y);
+				}
+				std::vector<byte4> & pixelsDst = (*pMipsOut)[level - 1];
+				pixelsDst.resize(dimsDst.x * dimsDst.y);
+
+				// Work in blocks of rows; each one downsamples its rows, then converts them for output
+				int rowsPerJob = max(1, s_mipPixelsPerJob / dimsDst.x);
+				int numJobs = (dimsDst.y + rowsPerJob - 1) / rowsPerJob;
+				ParallelFor(numJobs, [&](int iJob)
+				{
+					int yStart = iJob * rowsPerJob;
+					int yEnd = min(yStart + rowsPerJob, dimsDst.y);
+
+					if (level == 1)
+					{
+						// Read the base level straight from 8-bit, converting each pixel once
+						std::vector<float4> rowsLinear(dimsSrc.x * 2);
+						for (int y = yStart; y < yEnd; ++y)
+						{
+							const byte4 * pRowSrc = pPixelsBase + (y * 2) * dimsSrc.x;
+							if (srgb)
+							{
+								ConvertSRGB8ToLinear(pRowSrc, dimsSrc.x, &rowsLinear[0]);
+								ConvertSRGB8ToLinear(pRowSrc + dy * dimsSrc.x, dimsSrc.x, &rowsLinear[dimsSrc.x]);
+								PremultiplyAlpha(&rowsLinear[0], dimsSrc.x * 2, s_alphaWeightEpsilon);
+							}
+							else
+							{
+								ConvertUNorm8ToFloat(pRowSrc, dimsSrc.x, &rowsLinear[0]);
+								ConvertUNorm8ToFloat(pRowSrc + dy * dimsSrc.x, dimsSrc.x, &rowsLinear[dimsSrc.x]);
+							}
+							DownsampleRowPair(&rowsLinear[0], &rowsLinear[dimsSrc.x], dx, dimsDst.x, &linearDst[y * dimsDst.x]);
+						}
+					}
+					else
+					{
+						for (int y = yStart; y < yEnd; ++y)
+						{
+							const float4 * pRowSrc = &linearSrc[(y * 2) * dimsSrc.x];
+							DownsampleRowPair(pRowSrc, pRowSrc + dy * dimsSrc.x, dx, dimsDst.x, &linearDst[y * dimsDst.x]);
+						}
+					}
+
+					// Unpremultiply a copy for output, as the weighted rows feed the next level
+					int offset = yStart * dimsDst.x;
+					int count = (yEnd - yStart) * dimsDst.x;
+					if (preserveCoverage)
+					{
+						// Hold on to the unpremultiplied rows until the alpha scale is known
+						std::copy(linearDst.begin() + offset, linearDst.begin() + offset + count, linearOut.begin() + offset);
+						UnpremultiplyAlpha(&linearOut[offset], count, s_alphaWeightEpsilon);
+						for (int i = offset; i < offset + count; ++i)
+							alphas[i] = linearOut[i].w;
+					}
+					else if (srgb)
+					{
+						std::vector<float4> rowsOutput(linearDst.begin() + offset, linearDst.begin() + offset + count);
+						UnpremultiplyAlpha(&rowsOutput[0], count, s_alphaWeightEpsilon);
+						ConvertLinearToSRGB8(&rowsOutput[0], count, &pixelsDst[offset]);
+					}
+					else
+					{
+						ConvertFloatToUNorm8(&linearDst[offset], count, &pixelsDst[offset]);
+					}
+				}, (numJobs > 1) ? 0 : 1);
+
+				if (preserveCoverage)
+				{
+					int countDst = dimsDst.x * dimsDst.y;
+					int countTarget = int(coverageBase * float(countDst) + 0.5f);
+					float alphaScale = FindAlphaScaleForCoverage(&alphas[0], countDst, alphaPassMin, countTarget);
+
+					// Alpha over 1 is clamped by the conversion
+					ParallelFor(numJobs, [&](int iJob)
+					{
+						int offset = iJob * rowsPerJob * dimsDst.x;
+						int count = min(rowsPerJob * dimsDst.x, countDst - offset);
+						for (int i = offset; i < offset + count; ++i)
+							linearOut[i].w *= alphaScale;
+						ConvertLinearToSRGB8(&linearOut[offset], count, &pixelsDst[offset]);
+					}, (numJobs > 1) ? 0 : 1);
+				}
+
+				linearSrc.swap(linearDst);
+			}
+		}
+
+		// Same as the color path of BuildMips, but starting and ending in linear float, for HDR
+		void BuildMipsLinear(
+			const float4 * pLinearBase,
+			int2 dimsBase,
+			int mipLevels,
+			std::vector<std::vector<float4>> * pMipsOut)
+		{
+			ASSERT_ERR(pLinearBase);
+			ASSERT_ERR(all(dimsBase > 0));
+			ASSERT_ERR(ispow2(dimsBase.x) && ispow2(dimsBase.y));
+			ASSERT_ERR(pMipsOut);
+
+			pMipsOut->resize(max(mipLevels - 1, 0));
+
+			// Weight the base level by alpha, as the levels are built from weighted data
+			std::vector<float4> linearSrc(pLinearBase, pLinearBase + dimsBase.x * dimsBase.y);
+			PremultiplyAlpha(&linearSrc[0], int(linearSrc.size()), s_alphaWeightEpsilon);
+			std::vector<float4> linearDst;
+
+			for (int level = 1; level < mipLevels; ++level)
+			{
+				int2 dimsSrc = CalculateMipDims(dimsBase, level - 1);
+				int2 dimsDst = CalculateMipDims(dimsBase, level);
+				int dx = (dimsSrc.x > 1) ? 1 : 0;
+				int dy = (dimsSrc.y > 1) ? 1 : 0;
+
+				linearDst.resize(dimsDst.x * dimsDst.y);
+				std::vector<float4> & linearOut = (*pMipsOut)[level - 1];
+				linearOut.resize(dimsDst.x * dimsDst.y);
+
+				int rowsPerJob = max(1, s_mipPixelsPerJob / dimsDst.x);
+				int numJobs = (dimsDst.y + rowsPerJob - 1) / rowsPerJob;
+				ParallelFor(numJobs, [&](int iJob)
+				{
+					int yStart = iJob * rowsPerJob;
+					int yEnd = min(yStart + rowsPerJob, dimsDst.y);
+					for (int y = yStart; y < yEnd; ++y)
+					{
+						const float4 * pRowSrc = &linearSrc[(y * 2) * dimsSrc.x];
+						DownsampleRowPair(pRowSrc, pRowSrc + dy * dimsSrc.x, dx, dimsDst.x, &linearDst[y * dimsDst.x]);
+					}
+
+					int offset = yStart * dimsDst.x;
+					int count = (yEnd - yStart) * dimsDst.x;
+					std::copy(linearDst.begin() + offset, linearDst.begin() + offset + count, linearOut.begin() + offset);
+					UnpremultiplyAlpha(&linearOut[offset], count, s_alphaWeightEpsilon);
+				}, (numJobs > 1) ? 0 : 1);
+
+				linearSrc.swap(linearDst);
+			}
+		}
+
+#if BENCHMARK_MIPS
+		bool BenchmarkMips(
+			const char * assetPath,
+			const byte4 * pPixelsSrc,
+			int2 dimsSrc,
+			const byte4 * pPixelsBase,
+			int2 dimsBase,
+			int mipLevels)
+		{
+			ASSERT_ERR(assetPath);
+			ASSERT_ERR(pPixelsSrc);
+			ASSERT_ERR(pPixelsBase);
+
+			auto timeStart = std::chrono::steady_clock::now();
+			std::vector<std::vector<byte4>> mips;
+			BuildMips(pPixelsBase, dimsBase, mipLevels, true, 0.0f, &mips);
+			float msChain = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+
+			// The old way: resample each level from the source image
+			timeStart = std::chrono::steady_clock::now();
+			std::vector<std::vector<byte4>> mipsResampled(mips.size());
+			for (int level = 1; level < mipLevels; ++level)
+			{
+				int2 dimsMip = CalculateMipDims(dimsBase, level);
+				mipsResampled[level - 1].resize(dimsMip.x * dimsMip.y);
+				CHECK_ERR(stbir_resize_uint8_srgb(
+							(const byte *)pPixelsSrc, dimsSrc.x, dimsSrc.y, 0,
+							(byte *)&mipsResampled[level - 1][0], dimsMip.x, dimsMip.y, 0,
+							4, 3, 0));
+			}
+			float msResample = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+
+			// Compare the results, just to check they're in the same ballpark
+			int diffMax = 0;
+			i64 diffTotal = 0, count = 0;
+			for (int i = 0, n = int(mips.size()); i < n; ++i)
+			{
+				const byte * pA = (const byte *)&mips[i][0];
+				const byte * pB = (const byte *)&mipsResampled[i][0];
+				for (int j = 0, m = int(mips[i].size()) * 4; j < m; ++j)
+				{
+					int diff = abs(int(pA[j]) - int(pB[j]));
+					diffMax = max(diffMax, diff);
+					diffTotal += diff;
+				}
+				count += int(mips[i].size()) * 4;
+			}
+
+			LOG("Mips for %s (%dx%d): %0.1fms from the previous level, %0.1fms resampled from the source (%0.1fx); mean difference %0.2f, max %d",
+				assetPath, dimsBase.x, dimsBase.y, msChain, msResample, msResample / max(msChain, 1e-3f),
+				(count > 0) ? float(diffTotal) / float(count) : 0.0f, diffMax);
+
+			return true;
+		}
+#endif // BENCHMARK_MIPS
+
 		bool WriteImageToZip(
 			const char * assetPath,
 			int mipLevel,
 			const byte4 * pPixels,
 			int2 dims,
+			DXGI_FORMAT format,
+			CODEC codec,
 			mz_zip_archive * pZipOut)
 		{
 			ASSERT_ERR(assetPath);
@@ -211,9 +836,116 @@ namespace Framework
 				return false;
 #endif
 
-			// Write it to the .zip archive
-			int sizeBytes = dims.x * dims.y * sizeof(byte4);
-			return AssetCompiler::WriteAssetDataToZip(assetPath, suffix, pPixels, sizeBytes, pZipOut);
+			switch (format)
+			{
+			case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+				{
+					// Write it to the .zip archive
+					int sizeBytes = dims.x * dims.y * sizeof(byte4);
+					return AssetCompiler::WriteAssetDataToZip(assetPath, suffix, pPixels, sizeBytes, pZipOut, codec);
+				}
+
+			case DXGI_FORMAT_R8_UNORM:
+			case DXGI_FORMAT_R8G8_UNORM:
+				{
+					// Keep just the leading channels
+					int channels = (format == DXGI_FORMAT_R8_UNORM) ? 1 : 2;
+					int count = dims.x * dims.y;
+					std::vector<byte> data(count * channels);
+					for (int i = 0; i < count; ++i)
+					{
+						const byte * pPixel = (const byte *)&pPixels[i];
+						for (int c = 0; c < channels; ++c)
+							data[i * channels + c] = pPixel[c];
+					}
+					return AssetCompiler::WriteAssetDataToZip(assetPath, suffix, &data[0], data.size(), pZipOut, codec);
+				}
+
+			default:
+				{
+					// Compress it into a block format
+					std::vector<byte> blocks;
+					EncodeBCImage(format, pPixels, dims, &blocks);
+					return AssetCompiler::WriteAssetDataToZip(assetPath, suffix, &blocks[0], blocks.size(), pZipOut, codec);
+				}
+			}
+		}
+
+		// Convert a non-negative float to one of the unsigned small float formats of R11G11B10_FLOAT,
+		// with a 5-bit exponent (bias 15, as for half) and the given number of mantissa bits.
+		// Negatives and NaN go to 0, and values past the largest finite one are clamped to it.
+		static u32 FloatToSmallFloat(float f, int mantissaBits)
+		{
+			float maxValue = (2.0f - 1.0f / float(1 << mantissaBits)) * 32768.0f;
+			if (!(f > 0.0f))
+				return 0;
+			f = min(f, maxValue);
+
+			// Denormal: scale so the LSB is 1 and round; rounding up to 1 << mantissaBits
+			// gives the smallest normal, so no special case is needed
+			if (f < 1.0f / 16384.0f)
+				return u32(f * float(1 << (14 + mantissaBits)) + 0.5f);
+
+			// Normal: round off the low mantissa bits to nearest even, letting a carry bump the
+			// exponent, then rebias the exponent from float's 127 to 15
+			u32 bits;
+			memcpy(&bits, &f, sizeof(bits));
+			int shift = 23 - mantissaBits;
+			bits += (1u << (shift - 1)) - 1 + ((bits >> shift) & 1);
+			return (bits >> shift) - ((127 - 15) << mantissaBits);
+		}
+
+		bool WriteImageToZip(
+			const char * assetPath,
+			int mipLevel,
+			const float4 * pLinear,
+			int2 dims,
+			DXGI_FORMAT format,
+			CODEC codec,
+			mz_zip_archive * pZipOut)
+		{
+			ASSERT_ERR(assetPath);
+			ASSERT_ERR(mipLevel >= 0);
+			ASSERT_ERR(pLinear);
+			ASSERT_ERR(all(dims > 0));
+			ASSERT_ERR(pZipOut);
+
+			using namespace AssetCompiler;
+
+			// Compose the suffix
+			char suffix[16] = {};
+			sprintf_s(suffix, "/%d", mipLevel);
+
+			int count = dims.x * dims.y;
+			switch (format)
+			{
+			case DXGI_FORMAT_R16G16B16A16_FLOAT:
+				{
+					// Clamp to the largest finite half, rather than going to infinity
+					std::vector<u16> data(count * 4);
+					const float * pValues = (const float *)pLinear;
+					for (int i = 0, n = count * 4; i < n; ++i)
+						data[i] = FloatToHalf(clamp(pValues[i], -65504.0f, 65504.0f));
+					return WriteAssetDataToZip(assetPath, suffix, &data[0], data.size() * sizeof(u16), pZipOut, codec);
+				}
+
+			case DXGI_FORMAT_R11G11B10_FLOAT:
+				{
+					// Red in the low bits; alpha is dropped
+					std::vector<u32> data(count);
+					for (int i = 0; i < count; ++i)
+					{
+						data[i] = FloatToSmallFloat(pLinear[i].x, 6) |
+								  (FloatToSmallFloat(pLinear[i].y, 6) << 11) |
+								  (FloatToSmallFloat(pLinear[i].z, 5) << 22);
+					}
+					return WriteAssetDataToZip(assetPath, suffix, &data[0], data.size() * sizeof(u32), pZipOut, codec);
+				}
+
+			default:
+				WARN("Texture %s: can't write format %d from float data", assetPath, format);
+				return false;
+			}
 		}
 
 #if WRITE_BMP
@@ -245,6 +977,7 @@ namespace Framework
 
 
 
+#if !FRAMEWORK_HEADLESS
 	// Load compiled data into a runtime game object
 
 	bool LoadTexture2DFromAssetPack(
@@ -261,9 +994,9 @@ namespace Framework
 		pTexOut->m_pPack = pPack;
 
 		// Look for the metadata in the asset pack
-		Meta * pMeta;
+		const Meta * pMeta;
 		int metaSize;
-		if (!pPack->LookupFile(path, s_suffixMeta, (void **)&pMeta, &metaSize))
+		if (!pPack->LookupFile(path, s_suffixMeta, (const void **)&pMeta, &metaSize))
 		{
 			WARN("Couldn't find metadata for texture %s in asset pack %s", path, pPack->m_path.c_str());
 			return false;
@@ -292,8 +1025,7 @@ namespace Framework
 				WARN("Couldn't find mip level %d of texture %s in asset pack %s", i, path, pPack->m_path.c_str());
 				return false;
 			}
-			int2 mipDims = CalculateMipDims(pMeta->m_dims, i);
-			int expectedPixelsSize = mipDims.x * mipDims.y * BitsPerPixel(pMeta->m_format) / 8;
+			int expectedPixelsSize = CalculateMipSizeInBytes(pMeta->m_dims, i, pMeta->m_format);
 			if (pixelsSize != expectedPixelsSize)
 			{
 				WARN("Mip level %d of texture %s in asset pack %s is wrong size, %d bytes (expected %d)",
@@ -314,6 +1046,34 @@ namespace Framework
 
 	// Create a library of all the textures in an asset pack
 
+	bool LoadTextureLibFromAssetPack(
+		AssetPack * pPack,
+		TextureLib * pTexLibOut)
+	{
+		ASSERT_ERR(pPack);
+		ASSERT_ERR(pTexLibOut);
+
+		// Find all the texture assets in the manifest
+		for (auto iter = pPack->m_manifest.begin(), iterEnd = pPack->m_manifest.end(); iter != iterEnd; ++iter)
+		{
+			if (iter->second != ACK_TextureRaw &&
+				iter->second != ACK_TextureWithMips)
+			{
+				continue;
+			}
+
+			auto iterAndBool = pTexLibOut->m_texs.insert(std::make_pair(iter->first, Texture2D()));
+
+			if (!LoadTexture2DFromAssetPack(pPack, iter->first.c_str(), &iterAndBool.first->second))
+			{
+				pTexLibOut->m_texs.erase(iterAndBool.first);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
 	bool LoadTextureLibFromAssetPack(
 		AssetPack * pPack,
 		const AssetCompileInfo * assets,
@@ -402,4 +1162,5 @@ namespace Framework
 		// And extract the mesh from it
 		return LoadTexture2DFromAssetPack(pPack, path, pTexOut);
 	}
+#endif // !FRAMEWORK_HEADLESS
 }
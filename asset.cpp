@@ -5,49 +5,232 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#if FRAMEWORK_HEADLESS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace Framework
 {
 	// AssetPack implementation
 
 	AssetPack::AssetPack()
+	:	m_pMappedView(nullptr),
+		m_mappedSize(0),
+#if !FRAMEWORK_HEADLESS
+		m_hFile(INVALID_HANDLE_VALUE),
+		m_hMapping(nullptr),
+#endif
+		m_pZip(nullptr),
+		m_pDirSlots(nullptr),
+		m_pDirDisplacements(nullptr),
+		m_dirNumSlots(0),
+		m_dirNumBuckets(0),
+		m_dirSeed(0)
+	{
+	}
+
+	AssetPack::~AssetPack()
 	{
+		Reset();
 	}
 
-	bool AssetPack::LookupFile(const char * path, const char * suffix, void ** ppDataOut, int * pSizeOut)
+	bool AssetPack::LookupFile(const char * path, const char * suffix, const void ** ppDataOut, int * pSizeOut)
 	{
 		ASSERT_ERR(path);
+		return LookupFile(HashPath(path, suffix), ppDataOut, pSizeOut);
+	}
 
-		std::string fullPath = path;
-		if (suffix)
-			fullPath += suffix;
-		CHECK_WARN(AssetCompiler::NormalizePath(const_cast<char *>(fullPath.data())));
-		auto iter = m_directory.find(fullPath);
-		if (iter == m_directory.end())
+	bool AssetPack::LookupFile(u64 pathHash, const void ** ppDataOut, int * pSizeOut)
+	{
+		int iFile = FindFile(pathHash);
+		if (iFile < 0)
 			return false;
 
-		int iFile = iter->second;
+		return GetFileData(iFile, ppDataOut, pSizeOut);
+	}
+
+	int AssetPack::FindFile(u64 pathHash) const
+	{
+		using namespace AssetCompiler;
+
+		if (m_dirNumSlots == 0)
+			return -1;
+
+		u32 iBucket = DirectoryBucketIndex(pathHash, m_dirSeed, m_dirNumBuckets);
+		u32 iSlot = DirectorySlotIndex(pathHash, m_dirSeed, m_pDirDisplacements[iBucket], m_dirNumSlots);
+		const DirectorySlot & slot = m_pDirSlots[iSlot];
+		if (slot.m_pathHash != pathHash)
+			return -1;
+
+		return int(slot.m_fileIndex);
+	}
+
+	bool AssetPack::GetFileData(int iFile, const void ** ppDataOut, int * pSizeOut)
+	{
+		ASSERT_ERR(iFile >= 0 && iFile < int(m_files.size()));
+
 		const FileInfo & fileinfo = m_files[iFile];
 
 		if (ppDataOut)
-			*ppDataOut = (fileinfo.m_size > 0) ? &m_data[fileinfo.m_offset] : nullptr;
+		{
+			if (fileinfo.m_size <= 0)
+				*ppDataOut = nullptr;
+			else if (fileinfo.m_lazy)
+			{
+				if (!ExtractFile(iFile))
+					return false;
+				*ppDataOut = &m_extractedData[iFile][0];
+			}
+			else if (fileinfo.m_mapped)
+				*ppDataOut = m_pMappedView + fileinfo.m_offset;
+			else
+				*ppDataOut = &m_data[fileinfo.m_offset];
+		}
 		if (pSizeOut)
 			*pSizeOut = fileinfo.m_size;
 
 		return true;
 	}
 
+	bool AssetPack::ExtractFile(int iFile)
+	{
+		ASSERT_ERR(iFile >= 0 && iFile < int(m_files.size()));
+		ASSERT_ERR(m_pZip);
+
+		std::atomic<int> & state = m_extractState[iFile];
+		if (state.load(std::memory_order_acquire) == EXTRACT_Done)
+			return true;
+
+		// Claim the file, or wait for whoever already has to finish with it
+		{
+			std::unique_lock<std::mutex> lock(m_lazyMutex);
+			for (;;)
+			{
+				int stateCur = state.load(std::memory_order_acquire);
+				if (stateCur == EXTRACT_Done)
+					return true;
+				if (stateCur == EXTRACT_NotStarted)
+					break;
+				m_cvExtracted.wait(lock);
+			}
+			state.store(EXTRACT_InProgress, std::memory_order_relaxed);
+		}
+
+		// Only the read from the zip needs the lock.  Encoded files are read raw, then
+		// decoded here, so lookups of other files can go ahead meanwhile.
+		const FileInfo & fileinfo = m_files[iFile];
+		std::vector<byte> & data = m_extractedData[iFile];
+		data.resize(fileinfo.m_size);
+
+		bool extracted;
+		if (fileinfo.m_codec == CODEC_Stored)
+		{
+			std::lock_guard<std::mutex> lock(m_lazyMutex);
+			extracted = mz_zip_reader_extract_to_mem(m_pZip, iFile, &data[0], data.size(), 0) != 0;
+		}
+		else
+		{
+			std::vector<byte> encoded(fileinfo.m_sizeEncoded);
+			{
+				std::lock_guard<std::mutex> lock(m_lazyMutex);
+				extracted = mz_zip_reader_extract_to_mem(
+								m_pZip, iFile, &encoded[0], encoded.size(),
+								MZ_ZIP_FLAG_COMPRESSED_DATA) != 0;
+			}
+			extracted = extracted &&
+						AssetCompiler::DecodeFileData(
+							fileinfo.m_codec, &encoded[0], encoded.size(), &data[0], data.size());
+		}
+
+		if (!extracted)
+		{
+			WARN("Couldn't extract file %s (index %d) from asset pack %s",
+				fileinfo.m_path.c_str(), iFile, m_path.c_str());
+			data.clear();
+		}
+
+		// Publish the data, or let the next lookup try again
+		{
+			std::lock_guard<std::mutex> lock(m_lazyMutex);
+			state.store(extracted ? EXTRACT_Done : EXTRACT_NotStarted, std::memory_order_release);
+		}
+		m_cvExtracted.notify_all();
+
+		return extracted;
+	}
+
+	u64 AssetPack::HashPath(const char * path, const char * suffix /* = nullptr */)
+	{
+		ASSERT_ERR(path);
+
+		// FNV-1a over the normalized characters, so no copy of the path is needed,
+		// then a finalizer to spread the bits
+		u64 h = 14695981039346656037ULL;
+		for (int iPart = 0; iPart < 2; ++iPart)
+		{
+			const char * pCh = (iPart == 0) ? path : suffix;
+			if (!pCh)
+				continue;
+			for (; *pCh; ++pCh)
+			{
+				char ch = *pCh;
+				if (ch >= 'A' && ch <= 'Z')
+					ch += 32;
+				else if (ch == '\\')
+					ch = '/';
+				h ^= byte(ch);
+				h *= 1099511628211ULL;
+			}
+		}
+
+		return AssetCompiler::MixDirectoryHash(h);
+	}
+
 	bool AssetPack::HasAsset(const char * path)
 	{
-		return (m_manifest.find(std::string(path)) != m_manifest.end());
+		return (m_manifest.find(AssetCompiler::ManifestName(path)) != m_manifest.end());
 	}
 
 	void AssetPack::Reset()
 	{
 		m_data.clear();
 		m_files.clear();
-		m_directory.clear();
 		m_manifest.clear();
 		m_path.clear();
+
+		m_pDirSlots = nullptr;
+		m_pDirDisplacements = nullptr;
+		m_dirNumSlots = 0;
+		m_dirNumBuckets = 0;
+		m_dirSeed = 0;
+		m_directoryBuilt.clear();
+
+		if (m_pZip)
+		{
+			mz_zip_reader_end(m_pZip);
+			delete m_pZip;
+			m_pZip = nullptr;
+		}
+		m_extractedData.clear();
+		m_extractState.clear();
+
+#if FRAMEWORK_HEADLESS
+		if (m_pMappedView)
+			munmap(const_cast<byte *>(m_pMappedView), m_mappedSize);
+#else
+		if (m_pMappedView)
+			UnmapViewOfFile(m_pMappedView);
+		if (m_hMapping)
+			CloseHandle(m_hMapping);
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+		m_hMapping = nullptr;
+		m_hFile = INVALID_HANDLE_VALUE;
+#endif
+		m_pMappedView = nullptr;
+		m_mappedSize = 0;
 	}
 
 
@@ -56,6 +239,108 @@ namespace Framework
 	{
 		static const char * s_pathVersionInfo = "version";
 		static const char * s_pathManifest = "manifest";
+		static const char * s_pathDirectory = "directory";
+		static const char * s_suffixSourceInfo = "/source_info";
+		static const char * s_suffixDependencies = "/dependencies";
+
+		// Map an entire asset pack file into memory, read-only
+#if FRAMEWORK_HEADLESS
+		static bool MapAssetPackFile(
+			const char * packPath,
+			AssetPack * pPack)
+		{
+			ASSERT_ERR(packPath);
+			ASSERT_ERR(pPack);
+			ASSERT_ERR(!pPack->m_pMappedView);
+
+			int fd = open(packPath, O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			// The mapping holds its own reference to the file, so the descriptor can be closed
+			struct stat fileStat;
+			void * pView = MAP_FAILED;
+			if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+				pView = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (pView == MAP_FAILED)
+				return false;
+
+			// Tell the OS not to bother reading ahead
+			madvise(pView, size_t(fileStat.st_size), MADV_RANDOM);
+
+			pPack->m_pMappedView = (const byte *)pView;
+			pPack->m_mappedSize = size_t(fileStat.st_size);
+			return true;
+		}
+#else
+		static bool MapAssetPackFile(
+			const char * packPath,
+			AssetPack * pPack)
+		{
+			ASSERT_ERR(packPath);
+			ASSERT_ERR(pPack);
+			ASSERT_ERR(!pPack->m_pMappedView);
+
+			// Access to assets is scattered, so ask for random-access caching behavior
+			pPack->m_hFile = CreateFile(
+								packPath, GENERIC_READ, FILE_SHARE_READ, nullptr,
+								OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+			if (pPack->m_hFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(pPack->m_hFile, &fileSize) || fileSize.QuadPart == 0)
+				return false;
+
+			pPack->m_hMapping = CreateFileMapping(pPack->m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!pPack->m_hMapping)
+				return false;
+
+			pPack->m_pMappedView = (const byte *)MapViewOfFile(pPack->m_hMapping, FILE_MAP_READ, 0, 0, 0);
+			if (!pPack->m_pMappedView)
+				return false;
+
+			pPack->m_mappedSize = size_t(fileSize.QuadPart);
+			return true;
+		}
+#endif // FRAMEWORK_HEADLESS
+
+		// Find where a stored (uncompressed) file's data begins in the mapped view, by
+		// following its local header.  Returns false if it can't be referenced in place.
+		static bool FindMappedFileData(
+			const AssetPack * pPack,
+			const mz_zip_archive_file_stat * pFileStat,
+			size_t * pOffsetOut)
+		{
+			ASSERT_ERR(pPack);
+			ASSERT_ERR(pPack->m_pMappedView);
+			ASSERT_ERR(pFileStat);
+			ASSERT_ERR(pOffsetOut);
+
+			if (pFileStat->m_method != 0 || pFileStat->m_comp_size != pFileStat->m_uncomp_size)
+				return false;
+
+			// Local header layout: 4-byte signature ... 2-byte filename length at 26, 2-byte extra length at 28
+			static const size_t s_localHeaderSize = 30;
+			size_t headerOffset = size_t(pFileStat->m_local_header_ofs);
+			if (headerOffset + s_localHeaderSize > pPack->m_mappedSize)
+				return false;
+
+			const byte * pHeader = pPack->m_pMappedView + headerOffset;
+			u32 signature = pHeader[0] | (pHeader[1] << 8) | (pHeader[2] << 16) | (u32(pHeader[3]) << 24);
+			if (signature != 0x04034b50)
+				return false;
+
+			size_t filenameLength = pHeader[26] | (pHeader[27] << 8);
+			size_t extraLength = pHeader[28] | (pHeader[29] << 8);
+			size_t dataOffset = headerOffset + s_localHeaderSize + filenameLength + extraLength;
+			if (dataOffset + size_t(pFileStat->m_uncomp_size) > pPack->m_mappedSize)
+				return false;
+
+			*pOffsetOut = dataOffset;
+			return true;
+		}
 	}
 
 	// Prototype individual compilation functions for different asset types
@@ -83,6 +368,25 @@ namespace Framework
 	};
 	cassert(dim(s_assetCompileFuncs) == ACK_Count);
 
+	// Prototype dependency scanners for asset types that reference other assets
+
+	bool FindOBJMeshDependencies(
+		const AssetCompileInfo * pACI,
+		std::vector<AssetCompiler::AssetDependency> * pDepsOut);
+	bool FindOBJMtlLibDependencies(
+		const AssetCompileInfo * pACI,
+		std::vector<AssetCompiler::AssetDependency> * pDepsOut);
+
+	typedef bool (*AssetDepsFunc)(const AssetCompileInfo *, std::vector<AssetCompiler::AssetDependency> *);
+	static const AssetDepsFunc s_assetDepsFuncs[] =
+	{
+		&FindOBJMeshDependencies,			// ACK_OBJMesh
+		&FindOBJMtlLibDependencies,			// ACK_OBJMtlLib
+		nullptr,							// ACK_TextureRaw
+		nullptr,							// ACK_TextureWithMips
+	};
+	cassert(dim(s_assetDepsFuncs) == ACK_Count);
+
 	static const char * s_ackNames[] =
 	{
 		"OBJ mesh",							// ACK_OBJMesh
@@ -94,31 +398,36 @@ namespace Framework
 
 
 
-	// Load an asset pack file, checking that all its assets are present and up to date,
-	// and compiling any that aren't.
-	bool LoadAssetPackOrCompileIfOutOfDate(
+	// Check that all the assets in an asset pack file are present and up to date,
+	// and compile any that aren't.
+	bool CompileAssetPackIfOutOfDate(
 		const char * packPath,
 		const AssetCompileInfo * assets,
-		int numAssets,
-		AssetPack * pPackOut)
+		int numAssets)
 	{
 		ASSERT_ERR(packPath);
 		ASSERT_ERR(assets);
 		ASSERT_ERR(numAssets > 0);
-		ASSERT_ERR(pPackOut);
 
 		using namespace AssetCompiler;
 
+		// Find everything the given assets depend on
+		AssetGraph graph;
+		if (!BuildAssetGraph(packPath, assets, numAssets, &graph))
+			return false;
+		const AssetCompileInfo * assetsAll = &graph.m_assets[0];
+		int numAssetsAll = int(graph.m_assets.size());
+
 		// Does the asset pack already exist?
 		struct _stat packStat;
 		if (_stat(packPath, &packStat) == 0)
 		{
 			// Check if any assets are out of date
 			std::vector<int> assetsToUpdate;
-			if (!FindOutOfDateAssets(packPath, assets, numAssets, &assetsToUpdate))
+			if (!FindOutOfDateAssets(packPath, assetsAll, numAssetsAll, &assetsToUpdate))
 			{
 				LOG("Asset pack %s exists but seems to be corrupt; recompiling it from sources.", packPath);
-				if (!CompileFullAssetPackToFile(packPath, assets, numAssets))
+				if (!CompileFullAssetPackToFile(packPath, assetsAll, numAssetsAll))
 					return false;
 			}
 			else if (assetsToUpdate.empty())
@@ -128,48 +437,126 @@ namespace Framework
 			else
 			{
 				LOG("Asset pack %s is out of date; updating.", packPath);
-				if (!UpdateAssetPack(packPath, assets, numAssets, assetsToUpdate))
+				if (!UpdateAssetPack(packPath, assetsAll, numAssetsAll, assetsToUpdate))
 					return false;
 			}
 		}
 		else
 		{
 			LOG("Asset pack %s doesn't exist; compiling it from sources.", packPath);
-			if (!CompileFullAssetPackToFile(packPath, assets, numAssets))
+			if (!CompileFullAssetPackToFile(packPath, assetsAll, numAssetsAll))
 				return false;
 		}
 
+		return true;
+	}
+
+	// Load an asset pack file, checking that all its assets are present and up to date,
+	// and compiling any that aren't.
+	bool LoadAssetPackOrCompileIfOutOfDate(
+		const char * packPath,
+		const AssetCompileInfo * assets,
+		int numAssets,
+		AssetPack * pPackOut,
+		int flags /* = APFLAG_Default */)
+	{
+		ASSERT_ERR(pPackOut);
+
+		if (!CompileAssetPackIfOutOfDate(packPath, assets, numAssets))
+			return false;
+
 		// It ought to exist and be up-to-date now, so load it
-		return LoadAssetPack(packPath, pPackOut);
+		return LoadAssetPack(packPath, pPackOut, flags);
 	}
 
 	// Just load an asset pack file.
 	bool LoadAssetPack(
 		const char * packPath,
-		AssetPack * pPackOut)
+		AssetPack * pPackOut,
+		int flags /* = APFLAG_Default */)
 	{
 		ASSERT_ERR(packPath);
 		ASSERT_ERR(pPackOut);
-		
-		// Load the archive directory
-		mz_zip_archive zip = {};
-		if (!mz_zip_reader_init_file(&zip, packPath, 0))
+
+		auto timeStart = std::chrono::steady_clock::now();
+
+		// For lazy loading, the pack takes ownership of the zip reader.  It's initialized in
+		// place, as miniz keeps a pointer back to the archive struct for file reads.
+		mz_zip_archive zipLocal = {};
+		mz_zip_archive * pZip = &zipLocal;
+		if (flags & APFLAG_Lazy)
+		{
+			pPackOut->m_pZip = new mz_zip_archive();
+			pZip = pPackOut->m_pZip;
+		}
+
+		// Load the archive directory - either from the mapped view, or by reading the file
+		if (flags & APFLAG_MemoryMap)
+		{
+			if (!AssetCompiler::MapAssetPackFile(packPath, pPackOut) ||
+				!mz_zip_reader_init_mem(pZip, pPackOut->m_pMappedView, pPackOut->m_mappedSize, 0))
+			{
+				WARN("Couldn't map asset pack %s", packPath);
+				pPackOut->Reset();
+				return false;
+			}
+		}
+		else if (!mz_zip_reader_init_file(pZip, packPath, 0))
 		{
 			WARN("Couldn't load asset pack %s", packPath);
+			pPackOut->Reset();
 			return false;
 		}
 
 		pPackOut->m_path = packPath;
 
-		if (!AssetCompiler::LoadAssetPackFromZip(&zip, pPackOut))
+		if (flags & APFLAG_Lazy)
 		{
-			mz_zip_reader_end(&zip);
+			if (!AssetCompiler::LoadAssetPackFromZip(pZip, pPackOut))
+			{
+				pPackOut->Reset();
+				return false;
+			}
+
+			LOG("Loaded directory of asset pack %s - %d files", packPath, int(pPackOut->m_files.size()));
+			return true;
+		}
+
+		if (!AssetCompiler::LoadAssetPackFromZip(pZip, pPackOut))
+		{
+			mz_zip_reader_end(pZip);
+			pPackOut->Reset();
 			return false;
 		}
 
-		mz_zip_reader_end(&zip);
+		mz_zip_reader_end(pZip);
+
+		float msLoad = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+
+		// Report how much the codecs saved, over files that had to be decoded
+		size_t bytesEncoded = 0, bytesDecoded = 0;
+		for (int i = 0, n = int(pPackOut->m_files.size()); i < n; ++i)
+		{
+			const AssetPack::FileInfo & fileinfo = pPackOut->m_files[i];
+			if (fileinfo.m_codec != CODEC_Stored)
+			{
+				bytesEncoded += size_t(fileinfo.m_sizeEncoded);
+				bytesDecoded += size_t(fileinfo.m_size);
+			}
+		}
 
-		LOG("Loaded asset pack %s - %dMB uncompressed", packPath, pPackOut->m_data.size() / 1048576);
+		if (pPackOut->m_pMappedView)
+		{
+			LOG("Loaded asset pack %s in %0.1fms - %dMB mapped, %dMB uncompressed (%dMB decoded from %dMB)",
+				packPath, msLoad, int(pPackOut->m_mappedSize / 1048576), int(pPackOut->m_data.size() / 1048576),
+				int(bytesDecoded / 1048576), int(bytesEncoded / 1048576));
+		}
+		else
+		{
+			LOG("Loaded asset pack %s in %0.1fms - %dMB uncompressed (%dMB decoded from %dMB)",
+				packPath, msLoad, int(pPackOut->m_data.size() / 1048576),
+				int(bytesDecoded / 1048576), int(bytesEncoded / 1048576));
+		}
 		return true;
 	}
 
@@ -177,6 +564,200 @@ namespace Framework
 
 	namespace AssetCompiler
 	{
+		bool BuildDirectory(
+			std::vector<u64> const & pathHashes,
+			std::vector<byte> * pDataOut)
+		{
+			ASSERT_ERR(pDataOut);
+
+			// A minimal perfect hash, by the "hash, displace, and compress" method (minus the
+			// compress).  Keys are split into buckets of ~4; then, largest buckets first, each
+			// bucket searches for a displacement value that puts all its keys in free slots.
+
+			u32 numSlots = u32(pathHashes.size());
+			u32 numBuckets = max(1U, (numSlots + 3) / 4);
+
+			// Duplicate hashes would make that impossible; they also mean two paths can't be told apart
+			{
+				std::vector<u64> sorted(pathHashes);
+				std::sort(sorted.begin(), sorted.end());
+				if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+				{
+					WARN("Path hash collision building asset pack directory");
+					return false;
+				}
+			}
+
+			std::vector<AssetPack::DirectorySlot> slots(numSlots);
+			std::vector<u32> displacements(numBuckets);
+			std::vector<bool> slotsUsed(numSlots);
+			std::vector<std::vector<u32>> buckets(numBuckets);
+			std::vector<u32> bucketOrder(numBuckets);
+			std::vector<u32> slotsTrial;
+
+			// Displacement searches get long as the table fills, but the expected total work is
+			// only O(n log n); if something's pathological, start over with a new seed
+			u32 maxDisplacement = max(1U << 16, numSlots * 16);
+			u64 seed = 0;
+			for (int iAttempt = 0; ; ++iAttempt)
+			{
+				if (iAttempt == 8)
+				{
+					WARN("Couldn't build perfect hash for asset pack directory with %d files", numSlots);
+					return false;
+				}
+
+				seed = MixDirectoryHash(u64(iAttempt) + 1);
+				for (u32 i = 0; i < numBuckets; ++i)
+				{
+					buckets[i].clear();
+					bucketOrder[i] = i;
+				}
+				for (u32 i = 0; i < numSlots; ++i)
+					buckets[DirectoryBucketIndex(pathHashes[i], seed, numBuckets)].push_back(i);
+				std::sort(bucketOrder.begin(), bucketOrder.end(), [&](u32 a, u32 b)
+				{
+					return buckets[a].size() > buckets[b].size();
+				});
+				std::fill(slotsUsed.begin(), slotsUsed.end(), false);
+
+				bool success = true;
+				for (u32 iOrder = 0; iOrder < numBuckets && success; ++iOrder)
+				{
+					std::vector<u32> const & bucket = buckets[bucketOrder[iOrder]];
+					if (bucket.empty())
+						break;
+
+					success = false;
+					for (u32 displacement = 0; displacement < maxDisplacement && !success; ++displacement)
+					{
+						// Try placing all the bucket's keys with this displacement
+						slotsTrial.clear();
+						success = true;
+						for (int i = 0, n = int(bucket.size()); i < n && success; ++i)
+						{
+							u32 iSlot = DirectorySlotIndex(pathHashes[bucket[i]], seed, displacement, numSlots);
+							if (slotsUsed[iSlot] || std::find(slotsTrial.begin(), slotsTrial.end(), iSlot) != slotsTrial.end())
+								success = false;
+							else
+								slotsTrial.push_back(iSlot);
+						}
+
+						if (success)
+						{
+							displacements[bucketOrder[iOrder]] = displacement;
+							for (int i = 0, n = int(bucket.size()); i < n; ++i)
+							{
+								slotsUsed[slotsTrial[i]] = true;
+								slots[slotsTrial[i]].m_pathHash = pathHashes[bucket[i]];
+								slots[slotsTrial[i]].m_fileIndex = bucket[i];
+								slots[slotsTrial[i]].m_padding = 0;
+							}
+						}
+					}
+				}
+
+				if (success)
+					break;
+			}
+
+			// Write it out
+			DirectoryHeader header = { s_directoryMagic, numSlots, numBuckets, 0, seed };
+			pDataOut->resize(sizeof(header) + numSlots * sizeof(AssetPack::DirectorySlot) + numBuckets * sizeof(u32));
+			byte * pCur = &(*pDataOut)[0];
+			memcpy(pCur, &header, sizeof(header));
+			pCur += sizeof(header);
+			if (numSlots > 0)
+				memcpy(pCur, &slots[0], numSlots * sizeof(AssetPack::DirectorySlot));
+			pCur += numSlots * sizeof(AssetPack::DirectorySlot);
+			memcpy(pCur, &displacements[0], numBuckets * sizeof(u32));
+
+			return true;
+		}
+
+		bool WriteDirectoryToZip(
+			std::vector<std::string> const & paths,
+			mz_zip_archive * pZipOut)
+		{
+			ASSERT_ERR(pZipOut);
+
+			std::vector<u64> pathHashes(paths.size());
+			for (int i = 0, n = int(paths.size()); i < n; ++i)
+				pathHashes[i] = AssetPack::HashPath(paths[i].c_str());
+
+			std::vector<byte> directory;
+			if (!BuildDirectory(pathHashes, &directory))
+				return false;
+
+			return WriteAssetDataToZip(s_pathDirectory, nullptr, &directory[0], directory.size(), pZipOut);
+		}
+
+		// Point a pack at a directory file's tables, checking that it's well-formed
+		static bool AttachDirectory(
+			AssetPack * pPack,
+			const void * pData,
+			int dataSize)
+		{
+			if (!pData || dataSize < int(sizeof(DirectoryHeader)))
+				return false;
+
+			const DirectoryHeader * pHeader = (const DirectoryHeader *)pData;
+			int numFiles = int(pPack->m_files.size());
+			if (pHeader->m_magic != s_directoryMagic ||
+				pHeader->m_numSlots > u32(numFiles) ||
+				pHeader->m_numBuckets == 0 ||
+				size_t(dataSize) != sizeof(DirectoryHeader) +
+									pHeader->m_numSlots * sizeof(AssetPack::DirectorySlot) +
+									pHeader->m_numBuckets * sizeof(u32))
+			{
+				return false;
+			}
+
+			const AssetPack::DirectorySlot * pSlots = (const AssetPack::DirectorySlot *)(pHeader + 1);
+			for (u32 i = 0; i < pHeader->m_numSlots; ++i)
+			{
+				if (pSlots[i].m_fileIndex >= u32(numFiles))
+					return false;
+			}
+
+			pPack->m_pDirSlots = pSlots;
+			pPack->m_pDirDisplacements = (const u32 *)(pSlots + pHeader->m_numSlots);
+			pPack->m_dirNumSlots = int(pHeader->m_numSlots);
+			pPack->m_dirNumBuckets = int(pHeader->m_numBuckets);
+			pPack->m_dirSeed = pHeader->m_seed;
+			return true;
+		}
+
+		// Use the pack's own directory file if it has a valid one, else build one from the file list
+		static bool SetUpDirectory(
+			mz_zip_archive * pZip,
+			AssetPack * pPack)
+		{
+			int iFileDir = mz_zip_reader_locate_file(pZip, s_pathDirectory, nullptr, 0);
+			if (iFileDir >= 0)
+			{
+				const void * pData;
+				int dataSize;
+				if (pPack->GetFileData(iFileDir, &pData, &dataSize) &&
+					AttachDirectory(pPack, pData, dataSize))
+				{
+					return true;
+				}
+
+				WARN("Directory in asset pack %s is corrupt; rebuilding it", pPack->m_path.c_str());
+			}
+
+			int numFiles = int(pPack->m_files.size());
+			std::vector<u64> pathHashes(numFiles);
+			for (int i = 0; i < numFiles; ++i)
+				pathHashes[i] = AssetPack::HashPath(pPack->m_files[i].m_path.c_str());
+
+			if (!BuildDirectory(pathHashes, &pPack->m_directoryBuilt))
+				return false;
+
+			return AttachDirectory(pPack, &pPack->m_directoryBuilt[0], int(pPack->m_directoryBuilt.size()));
+		}
+
 		// Load an asset pack file from a zip stream (can be in memory or a file).
 		bool LoadAssetPackFromZip(
 			mz_zip_archive * pZip,
@@ -186,14 +767,16 @@ namespace Framework
 			ASSERT_ERR(pPackOut);
 
 			const char * packPath = pPackOut->m_path.c_str();
+
+			// If the pack owns the zip reader, defer extraction until files are looked up
+			bool lazy = (pZip == pPackOut->m_pZip);
 		
 			int numFiles = int(mz_zip_reader_get_num_files(pZip));
 			pPackOut->m_files.resize(numFiles);
-			pPackOut->m_directory.clear();
-			pPackOut->m_directory.reserve(numFiles);
 
-			// Run through all the files, build the file list and directory and sum up their sizes
-			int bytesTotal = 0;
+			// Run through all the files, build the file list and sum up their sizes.
+			// If the pack is memory-mapped, stored files are referenced in place and take no space.
+			size_t bytesTotal = 0;
 			for (int i = 0; i < numFiles; ++i)
 			{
 				mz_zip_archive_file_stat fileStat;
@@ -205,41 +788,108 @@ namespace Framework
 
 				AssetPack::FileInfo * pFileInfo = &pPackOut->m_files[i];
 				pFileInfo->m_path = fileStat.m_filename;
-				pFileInfo->m_offset = bytesTotal;
-				pFileInfo->m_size = int(fileStat.m_uncomp_size);
-
-				pPackOut->m_directory.insert(std::make_pair(pFileInfo->m_path, i));
-
-				bytesTotal += int(fileStat.m_uncomp_size);
+				if (!GetFileCodec(&fileStat, &pFileInfo->m_codec, &pFileInfo->m_size))
+				{
+					WARN("Couldn't read directory entry %d of %d from asset pack %s", i, numFiles, packPath);
+					return false;
+				}
+				pFileInfo->m_sizeEncoded = int(fileStat.m_comp_size);
+				pFileInfo->m_mapped =
+					pPackOut->m_pMappedView &&
+					pFileInfo->m_codec == CODEC_Stored &&
+					FindMappedFileData(pPackOut, &fileStat, &pFileInfo->m_offset);
+				pFileInfo->m_lazy = lazy && !pFileInfo->m_mapped;
+
+				if (pFileInfo->m_lazy)
+				{
+					pFileInfo->m_offset = 0;
+				}
+				else if (!pFileInfo->m_mapped)
+				{
+					pFileInfo->m_offset = bytesTotal;
+					bytesTotal += size_t(pFileInfo->m_size);
+				}
 			}
 
 			// Allocate memory to store the decompressed data
 			pPackOut->m_data.resize(bytesTotal);
+			if (lazy)
+			{
+				pPackOut->m_extractedData.resize(numFiles);
+				std::vector<std::atomic<int>>(numFiles).swap(pPackOut->m_extractState);
+			}
 
-			// Decompress all the files
+			// Read all the files.  Stored ones go straight to their final place; encoded ones
+			// are read raw, back to back, to be decoded afterward.
+			std::vector<int> filesToDecode;
+			std::vector<size_t> encodedOffsets;
+			std::vector<byte> encodedData;
 			for (int i = 0; i < numFiles; ++i)
 			{
 				AssetPack::FileInfo * pFileInfo = &pPackOut->m_files[i];
 
-				// Skip zero size files (trailing ones will cause an std::vector assert)
-				if (pFileInfo->m_size == 0)
+				// Skip zero size files (trailing ones will cause an std::vector assert),
+				// ones we're referencing in place, and ones we'll extract later
+				if (pFileInfo->m_size == 0 || pFileInfo->m_mapped || pFileInfo->m_lazy)
 					continue;
 
-				if (!mz_zip_reader_extract_to_mem(
-						pZip, i,
-						&pPackOut->m_data[pFileInfo->m_offset],
-						pFileInfo->m_size, 0))
+				bool extracted;
+				if (pFileInfo->m_codec == CODEC_Stored)
 				{
-					WARN("Couldn't extract file %s (index %d of %d) from asset pack %s",
-						pFileInfo->m_path.c_str(), i, numFiles, packPath);
-					return false;
+					extracted = mz_zip_reader_extract_to_mem(
+									pZip, i,
+									&pPackOut->m_data[pFileInfo->m_offset],
+									pFileInfo->m_size, 0) != 0;
 				}
-			}
-
+				else
+				{
+					size_t offset = encodedData.size();
+					filesToDecode.push_back(i);
+					encodedOffsets.push_back(offset);
+					encodedData.resize(offset + pFileInfo->m_sizeEncoded);
+					extracted = mz_zip_reader_extract_to_mem(
+									pZip, i,
+									&encodedData[offset],
+									pFileInfo->m_sizeEncoded, MZ_ZIP_FLAG_COMPRESSED_DATA) != 0;
+				}
+
+				if (!extracted)
+				{
+					WARN("Couldn't extract file %s (index %d of %d) from asset pack %s",
+						pFileInfo->m_path.c_str(), i, numFiles, packPath);
+					return false;
+				}
+			}
+
+			// Decode in parallel; the reads above are serial, since the zip reader isn't thread-safe
+			int numFilesToDecode = int(filesToDecode.size());
+			std::vector<byte> decoded(numFilesToDecode, 0);
+			ParallelFor(numFilesToDecode, [&](int j)
+			{
+				const AssetPack::FileInfo & fileinfo = pPackOut->m_files[filesToDecode[j]];
+				decoded[j] = DecodeFileData(
+								fileinfo.m_codec,
+								&encodedData[encodedOffsets[j]], fileinfo.m_sizeEncoded,
+								&pPackOut->m_data[fileinfo.m_offset], fileinfo.m_size);
+			});
+			for (int j = 0; j < numFilesToDecode; ++j)
+			{
+				if (!decoded[j])
+				{
+					WARN("Couldn't decode file %s (index %d of %d) from asset pack %s",
+						pPackOut->m_files[filesToDecode[j]].m_path.c_str(), filesToDecode[j], numFiles, packPath);
+					return false;
+				}
+			}
+
+			// Hook up the directory, so we can look files up by path
+			if (!SetUpDirectory(pZip, pPackOut))
+				return false;
+
 			// Extract the version info
-			VersionInfo * pVerInfo;
+			const VersionInfo * pVerInfo;
 			int verInfoSize;
-			if (!pPackOut->LookupFile(s_pathVersionInfo, nullptr, (void **)&pVerInfo, &verInfoSize))
+			if (!pPackOut->LookupFile(s_pathVersionInfo, nullptr, (const void **)&pVerInfo, &verInfoSize))
 			{
 				WARN("Couldn't find version info in asset pack %s", packPath);
 				return false;
@@ -276,101 +926,765 @@ namespace Framework
 			// Extract the manifest
 			const char * pManifest;
 			int manifestSize;
-			if (!pPackOut->LookupFile(s_pathManifest, nullptr, (void **)&pManifest, &manifestSize))
+			if (!pPackOut->LookupFile(s_pathManifest, nullptr, (const void **)&pManifest, &manifestSize))
 			{
 				WARN("Couldn't find manifest in asset pack %s", packPath);
 				return false;
 			}
 			ParseManifest(pManifest, manifestSize, packPath, &pPackOut->m_manifest);
 
-			return true;
+			return true;
+		}
+
+		// xxHash64, as per the reference implementation at https://github.com/Cyan4973/xxHash
+		static const u64 s_xxhPrime1 = 11400714785074694791ULL;
+		static const u64 s_xxhPrime2 = 14029467366897019727ULL;
+		static const u64 s_xxhPrime3 =  1609587929392839161ULL;
+		static const u64 s_xxhPrime4 =  9650029242287828579ULL;
+		static const u64 s_xxhPrime5 =  2870177450012600261ULL;
+
+		static inline u64 XXHRotl(u64 x, int r)
+		{
+			return (x << r) | (x >> (64 - r));
+		}
+
+		static inline u64 XXHRead64(const byte * p)
+		{
+			u64 x;
+			memcpy(&x, p, sizeof(x));
+			return x;
+		}
+
+		static inline u32 XXHRead32(const byte * p)
+		{
+			u32 x;
+			memcpy(&x, p, sizeof(x));
+			return x;
+		}
+
+		static inline u64 XXHRound(u64 acc, u64 input)
+		{
+			acc += input * s_xxhPrime2;
+			acc = XXHRotl(acc, 31);
+			return acc * s_xxhPrime1;
+		}
+
+		static inline u64 XXHMergeRound(u64 acc, u64 val)
+		{
+			acc ^= XXHRound(0, val);
+			return acc * s_xxhPrime1 + s_xxhPrime4;
+		}
+
+		u64 HashXXH64(const void * pData, size_t sizeBytes, u64 seed /* = 0 */)
+		{
+			ASSERT_ERR(pData || sizeBytes == 0);
+
+			const byte * p = (const byte *)pData;
+			const byte * pEnd = p + sizeBytes;
+			u64 h;
+
+			if (sizeBytes >= 32)
+			{
+				// Four parallel accumulators over 32-byte stripes
+				u64 v1 = seed + s_xxhPrime1 + s_xxhPrime2;
+				u64 v2 = seed + s_xxhPrime2;
+				u64 v3 = seed;
+				u64 v4 = seed - s_xxhPrime1;
+				const byte * pLimit = pEnd - 32;
+				do
+				{
+					v1 = XXHRound(v1, XXHRead64(p)); p += 8;
+					v2 = XXHRound(v2, XXHRead64(p)); p += 8;
+					v3 = XXHRound(v3, XXHRead64(p)); p += 8;
+					v4 = XXHRound(v4, XXHRead64(p)); p += 8;
+				}
+				while (p <= pLimit);
+
+				h = XXHRotl(v1, 1) + XXHRotl(v2, 7) + XXHRotl(v3, 12) + XXHRotl(v4, 18);
+				h = XXHMergeRound(h, v1);
+				h = XXHMergeRound(h, v2);
+				h = XXHMergeRound(h, v3);
+				h = XXHMergeRound(h, v4);
+			}
+			else
+			{
+				h = seed + s_xxhPrime5;
+			}
+
+			h += u64(sizeBytes);
+
+			// Mix in the tail
+			for (; p + 8 <= pEnd; p += 8)
+			{
+				h ^= XXHRound(0, XXHRead64(p));
+				h = XXHRotl(h, 27) * s_xxhPrime1 + s_xxhPrime4;
+			}
+			if (p + 4 <= pEnd)
+			{
+				h ^= u64(XXHRead32(p)) * s_xxhPrime1;
+				h = XXHRotl(h, 23) * s_xxhPrime2 + s_xxhPrime3;
+				p += 4;
+			}
+			for (; p < pEnd; ++p)
+			{
+				h ^= u64(*p) * s_xxhPrime5;
+				h = XXHRotl(h, 11) * s_xxhPrime1;
+			}
+
+			// Final avalanche
+			h ^= h >> 33;
+			h *= s_xxhPrime2;
+			h ^= h >> 29;
+			h *= s_xxhPrime3;
+			h ^= h >> 32;
+			return h;
+		}
+
+		u16 FloatToHalf(float f)
+		{
+			// Bit manipulation, rounding to nearest even (after Fabian Giesen's float_to_half_fast3_rtne)
+			u32 bits;
+			memcpy(&bits, &f, sizeof(bits));
+			u32 sign = (bits >> 16) & 0x8000;
+			bits &= 0x7fffffff;
+
+			if (bits >= 0x7f800000)
+			{
+				// Inf stays inf; NaN stays NaN
+				return u16(sign | 0x7c00 | ((bits > 0x7f800000) ? 0x200 : 0));
+			}
+			if (bits >= 0x477ff000)
+			{
+				// 65520 and up round to inf
+				return u16(sign | 0x7c00);
+			}
+			if (bits < 0x38800000)
+			{
+				// Denormal half: adding 0.5 lines the half's LSB up with the float's, so the FPU rounds
+				float magic = 0.5f, fAbs;
+				memcpy(&fAbs, &bits, sizeof(fAbs));
+				fAbs += magic;
+				memcpy(&bits, &fAbs, sizeof(bits));
+				return u16(sign | (bits - 0x3f000000));
+			}
+
+			// Normal: rebias the exponent and round off the low 13 bits of mantissa
+			u32 mantissaOdd = (bits >> 13) & 1;
+			bits += 0xc8000fff + mantissaOdd;
+			return u16(sign | (bits >> 13));
+		}
+
+		u64 HashCompileSettings(const AssetCompileInfo * pACI)
+		{
+			ASSERT_ERR(pACI);
+
+			// Every field but the path; no padding, so it can be hashed as-is
+			struct
+			{
+				int		m_ack;
+				float	m_weldEpsilon;
+				int		m_vcopt;
+				int		m_vertexCacheSize;
+				int		m_optimizeOverdraw;
+				int		m_vtxfmt;
+				int		m_splitFor16BitIndices;
+				int		m_lodCount;
+				float	m_lodRatio;
+				int		m_texfmt;
+				int		m_preserveAlphaCoverage;
+				float	m_alphaCutoff;
+				int		m_codec;
+			} settings =
+			{
+				pACI->m_ack,
+				pACI->m_weldEpsilon,
+				pACI->m_vcopt,
+				pACI->m_vertexCacheSize,
+				pACI->m_optimizeOverdraw,
+				pACI->m_vtxfmt,
+				pACI->m_splitFor16BitIndices,
+				pACI->m_lodCount,
+				pACI->m_lodRatio,
+				pACI->m_texfmt,
+				pACI->m_preserveAlphaCoverage,
+				pACI->m_alphaCutoff,
+				pACI->m_codec,
+			};
+			return HashXXH64(&settings, sizeof(settings));
+		}
+
+		int CompilerVersionForACK(ACK ack)
+		{
+			switch (ack)
+			{
+			case ACK_OBJMesh:				return MESHVER_Current;
+			case ACK_OBJMtlLib:				return MTLVER_Current;
+			case ACK_TextureRaw:
+			case ACK_TextureWithMips:		return TEXVER_Current;
+
+			default:
+				ERR("Missing case for ACK %d", ack);
+				return 0;
+			}
+		}
+
+		bool MakeSourceInfo(const AssetCompileInfo * pACI, SourceInfo * pInfoOut)
+		{
+			ASSERT_ERR(pACI);
+			ASSERT_ERR(pInfoOut);
+
+			struct _stat srcStat;
+			if (_stat(pACI->m_pathSrc, &srcStat) != 0)
+				return false;
+
+			std::vector<byte> data;
+			if (!LoadFile(pACI->m_pathSrc, &data))
+				return false;
+
+			pInfoOut->m_contentHash = HashXXH64(data.empty() ? nullptr : &data[0], data.size());
+			pInfoOut->m_settingsHash = HashCompileSettings(pACI);
+			pInfoOut->m_size = i64(srcStat.st_size);
+			pInfoOut->m_mtime = i64(srcStat.st_mtime);
+			pInfoOut->m_compilerVer = CompilerVersionForACK(pACI->m_ack);
+			return true;
+		}
+
+		// Check that filenames are printable-ASCII-only, lowercase, and there are no backslashes
+		// (this should really be generalized to allow UTF-8 printable chars)
+		bool NormalizePath(char * path)
+		{
+			ASSERT_ERR(path);
+
+			for (char * pCh = path; *pCh; ++pCh)
+			{
+				if (*pCh < 32 || *pCh > 126)
+				{
+					WARN("Invalid character %c in path %s", *pCh, path);
+					return false;
+				}
+				else if (*pCh >= 'A' && *pCh <= 'Z')
+				{
+					*pCh += 32;		// Convert to lowercase
+				}
+				else if (*pCh == '\\')
+				{
+					*pCh = '/';		// Normalize paths to forward slashes
+				}
+			}
+
+			return true;
+		}
+
+		// Entry comment marking an LZ file, followed by the decoded size
+		static const char * s_commentLZ = "lz ";
+
+		// Files smaller than this aren't worth compressing
+		static const size_t s_minSizeToEncode = 256;
+
+		// Write a memory buffer out to an asset pack .zip file.
+		bool WriteAssetDataToZip(
+			const char * assetPath,
+			const char * assetSuffix,
+			const void * pData,
+			size_t sizeBytes,
+			mz_zip_archive * pZipOut,
+			CODEC codec /* = CODEC_Stored */,
+			std::vector<std::string> * pPathsWritten /* = nullptr */)
+		{
+			ASSERT_ERR(assetPath);
+			ASSERT_ERR(sizeBytes >= 0);
+			ASSERT_ERR(pData || sizeBytes == 0);
+			ASSERT_ERR(pZipOut);
+			ASSERT_ERR(codec >= 0 && codec < CODEC_Count);
+
+			if (!assetSuffix)
+				assetSuffix = "";
+
+			// Compose the path, but detect if it's too long
+			char zipPath[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE + 1] = {};
+			if (_snprintf_s(zipPath, _TRUNCATE, "%s%s", assetPath, assetSuffix) < 0)
+			{
+				WARN("File path %s%s is too long for .zip format", assetPath, assetSuffix);
+				return false;
+			}
+
+			CHECK_WARN(NormalizePath(zipPath));
+
+			if (sizeBytes < s_minSizeToEncode)
+				codec = CODEC_Stored;
+
+			// Encode the data, and fall back to storing it if that didn't make it smaller
+			bool added = false;
+			if (codec == CODEC_Deflate)
+			{
+				size_t sizeEncoded = 0;
+				void * pEncoded = tdefl_compress_mem_to_heap(
+									pData, sizeBytes, &sizeEncoded,
+									tdefl_create_comp_flags_from_zip_params(MZ_DEFAULT_LEVEL, -15, MZ_DEFAULT_STRATEGY));
+				if (pEncoded && sizeEncoded < sizeBytes)
+				{
+					mz_uint32 crc = mz_uint32(mz_crc32(MZ_CRC32_INIT, (const mz_uint8 *)pData, sizeBytes));
+					added = mz_zip_writer_add_mem_ex(
+								pZipOut, zipPath, pEncoded, sizeEncoded, nullptr, 0,
+								MZ_DEFAULT_LEVEL | MZ_ZIP_FLAG_COMPRESSED_DATA, sizeBytes, crc) != 0;
+					if (!added)
+					{
+						WARN("Couldn't add file %s to archive", zipPath);
+						mz_free(pEncoded);
+						return false;
+					}
+				}
+				mz_free(pEncoded);
+			}
+			else if (codec == CODEC_LZ)
+			{
+				std::vector<byte> encoded(LZCompressBound(sizeBytes));
+				size_t sizeEncoded = LZCompress(pData, sizeBytes, &encoded[0], encoded.size());
+				if (sizeEncoded > 0 && sizeEncoded < sizeBytes)
+				{
+					// Zip sees this as a stored file; the comment tells the loader to decode it
+					char comment[32];
+					sprintf_s(comment, "%s%d", s_commentLZ, int(sizeBytes));
+					added = mz_zip_writer_add_mem_ex(
+								pZipOut, zipPath, &encoded[0], sizeEncoded, comment, mz_uint16(strlen(comment)),
+								MZ_NO_COMPRESSION, 0, 0) != 0;
+					if (!added)
+					{
+						WARN("Couldn't add file %s to archive", zipPath);
+						return false;
+					}
+				}
+			}
+
+			if (!added && !mz_zip_writer_add_mem(pZipOut, zipPath, pData, sizeBytes, MZ_NO_COMPRESSION))
+			{
+				WARN("Couldn't add file %s to archive", zipPath);
+				return false;
+			}
+
+			if (pPathsWritten)
+				pPathsWritten->push_back(std::string(zipPath));
+
+			return true;
+		}
+
+		bool GetFileCodec(
+			const mz_zip_archive_file_stat * pFileStat,
+			CODEC * pCodecOut,
+			int * pSizeDecodedOut)
+		{
+			ASSERT_ERR(pFileStat);
+			ASSERT_ERR(pCodecOut);
+			ASSERT_ERR(pSizeDecodedOut);
+
+			if (pFileStat->m_method == MZ_DEFLATED)
+			{
+				*pCodecOut = CODEC_Deflate;
+				*pSizeDecodedOut = int(pFileStat->m_uncomp_size);
+				return true;
+			}
+			else if (pFileStat->m_method != 0)
+			{
+				WARN("File %s uses unsupported zip compression method %d", pFileStat->m_filename, pFileStat->m_method);
+				return false;
+			}
+
+			size_t lenCommentLZ = strlen(s_commentLZ);
+			if (strncmp(pFileStat->m_comment, s_commentLZ, lenCommentLZ) == 0)
+			{
+				int sizeDecoded = atoi(pFileStat->m_comment + lenCommentLZ);
+				if (sizeDecoded <= 0)
+				{
+					WARN("File %s has bad LZ comment \"%s\"", pFileStat->m_filename, pFileStat->m_comment);
+					return false;
+				}
+				*pCodecOut = CODEC_LZ;
+				*pSizeDecodedOut = sizeDecoded;
+				return true;
+			}
+
+			*pCodecOut = CODEC_Stored;
+			*pSizeDecodedOut = int(pFileStat->m_uncomp_size);
+			return true;
+		}
+
+		bool DecodeFileData(
+			CODEC codec,
+			const void * pSrc,
+			size_t srcSize,
+			void * pDst,
+			size_t dstSize)
+		{
+			switch (codec)
+			{
+			case CODEC_Stored:
+				if (srcSize != dstSize)
+					return false;
+				memcpy(pDst, pSrc, dstSize);
+				return true;
+
+			case CODEC_Deflate:
+				return tinfl_decompress_mem_to_mem(pDst, dstSize, pSrc, srcSize, 0) == dstSize;
+
+			case CODEC_LZ:
+				return LZDecompress(pSrc, srcSize, pDst, dstSize);
+
+			default:
+				ERR("Unexpected codec %d", codec);
+				return false;
+			}
+		}
+
+		// Name an asset goes by in the manifest: its source path with case and slashes folded,
+		// as in the pack's paths, so it doesn't matter how the source path was spelled.
+		std::string ManifestName(const char * pathSrc)
+		{
+			ASSERT_ERR(pathSrc);
+
+			std::string name = pathSrc;
+			makeLowercase(name);
+			replaceChars(name, '\\', '/');
+			return name;
+		}
+
+		// Add an asset to a manifest under construction.
+		void AppendToManifest(
+			const AssetCompileInfo * pACI,
+			std::string * pManifest)
+		{
+			ASSERT_ERR(pACI);
+			ASSERT_ERR(pManifest);
+
+			char ackStr[16];
+			sprintf_s(ackStr, " %d\n", int(pACI->m_ack));
+
+			*pManifest += ManifestName(pACI->m_pathSrc);
+			*pManifest += ackStr;
+		}
+
+		// Parse an asset pack manifest (newline-delimited list of names and kinds) into a map.
+		void ParseManifest(
+			const char * manifest,
+			int manifestSize,
+			const char * path,
+			std::unordered_map<std::string, ACK> * pManifestOut)
+		{
+			ASSERT_ERR(manifest);
+			ASSERT_ERR(manifestSize > 0);
+			ASSERT_ERR(pManifestOut);
+
+			// Make a copy so that we can parse destructively
+			std::vector<char> manifestCopy(manifestSize + 1);
+			memcpy(&manifestCopy[0], manifest, manifestSize);
+
+			TextParsingHelper tph(&manifestCopy[0], path);
+			while (tph.NextLine())
+			{
+				std::string name = tph.NextToken();
+				const char * pAck = tph.ExpectOneToken("asset kind");
+				tph.ExpectEOL();
+				if (!pAck)
+					continue;
+
+				int ack = atoi(pAck);
+				if (ack < 0 || ack >= ACK_Count)
+				{
+					WARN("%s: unknown asset kind %d for asset %s at line %d; ignoring", path, ack, name.c_str(), tph.m_iLine);
+					continue;
+				}
+
+				pManifestOut->insert(std::make_pair(name, ACK(ack)));
+			}
+		}
+
+		// Serialize an asset's list of dependencies, for storage in the pack
+		static void SerializeDependencies(
+			std::vector<AssetDependency> const & deps,
+			std::vector<byte> * pDataOut)
+		{
+			ASSERT_ERR(pDataOut);
+
+			SerializeHelper sh(pDataOut);
+			for (int i = 0, n = int(deps.size()); i < n; ++i)
+			{
+				sh.WriteString(deps[i].m_pathSrc);
+				sh.Write(int(deps[i].m_ack));
+				sh.Write(int(deps[i].m_alphaTested));
+			}
+		}
+
+		static bool DeserializeDependencies(
+			const byte * pData,
+			int dataSize,
+			std::vector<AssetDependency> * pDepsOut)
+		{
+			ASSERT_ERR(pDepsOut);
+
+			DeserializeHelper dh(pData, dataSize);
+			while (!dh.AtEOF())
+			{
+				const char * pathSrc;
+				int ack;
+				int alphaTested;
+				if (!dh.ReadString(&pathSrc) ||
+					!dh.Read(&ack) ||
+					!dh.Read(&alphaTested))
+				{
+					return false;
+				}
+
+				if (ack < 0 || ack >= ACK_Count)
+				{
+					WARN("Corrupt dependency list: invalid asset kind %d", ack);
+					return false;
+				}
+
+				AssetDependency dep = { std::string(pathSrc), ACK(ack), alphaTested != 0 };
+				pDepsOut->push_back(dep);
+			}
+
+			return true;
+		}
+
+		// Compiles a list of assets on the job system, each into its own in-memory .zip.
+		// The caller then streams the results into the real output in list order, so the
+		// layout of the pack doesn't depend on which compiles happen to finish first.
+		class ParallelAssetCompile
+		{
+		public:
+					ParallelAssetCompile(
+						const AssetCompileInfo * assets,
+						std::vector<int> const & assetIndices);
+					~ParallelAssetCompile();
+
+			// Block until the i-th asset in the list has finished compiling; returns whether it succeeded
+			bool	WaitForAsset(int i);
+
+			// Copy the i-th asset's compiled files to the output, and release its memory.
+			// Their paths are appended to pPathsWritten.
+			bool	WriteAssetToZip(int i, mz_zip_archive * pZipOut, std::vector<std::string> * pPathsWritten);
+
+		private:
+			struct Result
+			{
+				void *		m_pZipData;		// Finalized in-memory .zip, allocated by miniz
+				size_t		m_zipSize;
+				bool		m_success;
+				bool		m_done;
+			};
+
+			void	CompileAsset(int i);
+
+			const AssetCompileInfo *	m_assets;
+			std::vector<int>			m_assetIndices;
+			std::vector<Result>			m_results;
+			std::mutex					m_mutex;			// Protects m_results
+			std::condition_variable		m_cvAssetDone;
+			std::thread					m_thread;			// Runs the ParallelFor, so the caller can consume results as they arrive
+		};
+
+		ParallelAssetCompile::ParallelAssetCompile(
+			const AssetCompileInfo * assets,
+			std::vector<int> const & assetIndices)
+		:	m_assets(assets),
+			m_assetIndices(assetIndices)
+		{
+			ASSERT_ERR(assets);
+
+			Result resultEmpty = { nullptr, 0, false, false };
+			m_results.resize(m_assetIndices.size(), resultEmpty);
+
+			m_thread = std::thread([this]()
+			{
+				ParallelFor(int(m_assetIndices.size()), [this](int i) { CompileAsset(i); });
+			});
+		}
+
+		ParallelAssetCompile::~ParallelAssetCompile()
+		{
+			if (m_thread.joinable())
+				m_thread.join();
+
+			// Free any results the caller didn't consume
+			for (int i = 0, n = int(m_results.size()); i < n; ++i)
+			{
+				if (m_results[i].m_pZipData)
+					mz_free(m_results[i].m_pZipData);
+			}
 		}
 
-		// Check that filenames are printable-ASCII-only, lowercase, and there are no backslashes
-		// (this should really be generalized to allow UTF-8 printable chars)
-		bool NormalizePath(char * path)
+		void ParallelAssetCompile::CompileAsset(int i)
 		{
-			ASSERT_ERR(path);
+			const AssetCompileInfo * pACI = &m_assets[m_assetIndices[i]];
+			ACK ack = pACI->m_ack;
+			ASSERT_ERR(ack >= 0 && ack < ACK_Count);
 
-			for (char * pCh = path; *pCh; ++pCh)
+			LOG("[%d/%d] Compiling %s asset %s...", i+1, int(m_assetIndices.size()), s_ackNames[ack], pACI->m_pathSrc);
+			auto timeStart = std::chrono::steady_clock::now();
+
+			void * pZipData = nullptr;
+			size_t zipSize = 0;
+			bool success = false;
+
+			// Hash the source before compiling, so if it's modified during the compile,
+			// the record won't match and it'll be recompiled next time
+			SourceInfo srcInfo;
+			mz_zip_archive zip = {};
+			if (!MakeSourceInfo(pACI, &srcInfo))
 			{
-				if (*pCh < 32 || *pCh > 126)
-				{
-					WARN("Invalid character %c in path %s", *pCh, path);
-					return false;
-				}
-				else if (*pCh >= 'A' && *pCh <= 'Z')
+				WARN("Couldn't read source file for asset %s", pACI->m_pathSrc);
+			}
+			else if (!mz_zip_writer_init_heap(&zip, 0, 0))
+			{
+				WARN("Couldn't create in-memory archive for asset %s", pACI->m_pathSrc);
+			}
+			else
+			{
+				success = s_assetCompileFuncs[ack](pACI, &zip) &&
+						  WriteAssetDataToZip(pACI->m_pathSrc, s_suffixSourceInfo, &srcInfo, sizeof(srcInfo), &zip);
+
+				// Record the asset's dependencies
+				if (success && s_assetDepsFuncs[ack])
 				{
-					*pCh += 32;		// Convert to lowercase
+					std::vector<AssetDependency> deps;
+					std::vector<byte> serializedDeps;
+					success = s_assetDepsFuncs[ack](pACI, &deps);
+					SerializeDependencies(deps, &serializedDeps);
+					success = success &&
+							  WriteAssetDataToZip(pACI->m_pathSrc, s_suffixDependencies,
+								serializedDeps.empty() ? nullptr : &serializedDeps[0], serializedDeps.size(), &zip);
 				}
-				else if (*pCh == '\\')
+				if (success && !mz_zip_writer_finalize_heap_archive(&zip, &pZipData, &zipSize))
 				{
-					*pCh = '/';		// Normalize paths to forward slashes
+					WARN("Couldn't finalize in-memory archive for asset %s", pACI->m_pathSrc);
+					success = false;
 				}
+				mz_zip_writer_end(&zip);
 			}
 
-			return true;
+			if (!success && pZipData)
+			{
+				mz_free(pZipData);
+				pZipData = nullptr;
+			}
+
+			if (success)
+			{
+				float msCompile = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - timeStart).count();
+				LOG("[%d/%d] Compiled %s in %0.1fms - %dKB", i+1, int(m_assetIndices.size()), pACI->m_pathSrc, msCompile, int(zipSize / 1024));
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				Result * pResult = &m_results[i];
+				pResult->m_pZipData = pZipData;
+				pResult->m_zipSize = zipSize;
+				pResult->m_success = success;
+				pResult->m_done = true;
+			}
+			m_cvAssetDone.notify_all();
 		}
 
-		// Write a memory buffer out to an asset pack .zip file.
-		bool WriteAssetDataToZip(
-			const char * assetPath,
-			const char * assetSuffix,
-			const void * pData,
-			size_t sizeBytes,
-			mz_zip_archive * pZipOut)
+		bool ParallelAssetCompile::WaitForAsset(int i)
 		{
-			ASSERT_ERR(assetPath);
-			ASSERT_ERR(sizeBytes >= 0);
-			ASSERT_ERR(pData || sizeBytes == 0);
+			ASSERT_ERR(i >= 0 && i < int(m_results.size()));
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvAssetDone.wait(lock, [this, i]() { return m_results[i].m_done; });
+			return m_results[i].m_success;
+		}
+
+		bool ParallelAssetCompile::WriteAssetToZip(
+			int i,
+			mz_zip_archive * pZipOut,
+			std::vector<std::string> * pPathsWritten)
+		{
+			ASSERT_ERR(i >= 0 && i < int(m_results.size()));
 			ASSERT_ERR(pZipOut);
 
-			if (!assetSuffix)
-				assetSuffix = "";
+			// Safe to touch without the lock once the asset is done
+			Result * pResult = &m_results[i];
+			ASSERT_ERR(pResult->m_done && pResult->m_success);
+			const char * pathSrc = m_assets[m_assetIndices[i]].m_pathSrc;
 
-			// Compose the path, but detect if it's too long
-			char zipPath[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE + 1] = {};
-			if (_snprintf_s(zipPath, _TRUNCATE, "%s%s", assetPath, assetSuffix) < 0)
+			mz_zip_archive zip = {};
+			if (!mz_zip_reader_init_mem(&zip, pResult->m_pZipData, pResult->m_zipSize, 0))
 			{
-				WARN("File path %s%s is too long for .zip format", assetPath, assetSuffix);
+				WARN("Couldn't read in-memory archive for asset %s", pathSrc);
 				return false;
 			}
 
-			CHECK_WARN(NormalizePath(zipPath));
-
-			if (!mz_zip_writer_add_mem(pZipOut, zipPath, pData, sizeBytes, MZ_NO_COMPRESSION))
+			bool success = true;
+			for (int iFile = 0, numFiles = int(mz_zip_reader_get_num_files(&zip)); iFile < numFiles; ++iFile)
 			{
-				WARN("Couldn't add file %s to archive", zipPath);
-				return false;
+				char filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+				mz_zip_reader_get_filename(&zip, iFile, filename, sizeof(filename));
+				if (!mz_zip_writer_add_from_zip_reader(pZipOut, &zip, iFile))
+				{
+					WARN("Couldn't add file %s to archive", filename);
+					success = false;
+					break;
+				}
+				pPathsWritten->push_back(std::string(filename));
 			}
 
-			return true;
+			mz_zip_reader_end(&zip);
+			mz_free(pResult->m_pZipData);
+			pResult->m_pZipData = nullptr;
+
+			return success;
 		}
 
-		// Parse an asset pack manifest (newline-delimited list of names) into a set structure.
-		void ParseManifest(
-			const char * manifest,
-			int manifestSize,
+		// Make an empty temporary file in the same directory as the given path, so it can be
+		// written and then moved over that path with MoveFileOver.
+		static bool MakeTempFileNextTo(
 			const char * path,
-			std::unordered_set<std::string> * pManifestOut)
+			std::string * pTempPathOut)
 		{
-			ASSERT_ERR(manifest);
-			ASSERT_ERR(manifestSize > 0);
-			ASSERT_ERR(pManifestOut);
-
-			// Make a copy so that we can parse destructively
-			std::vector<char> manifestCopy(manifestSize + 1);
-			memcpy(&manifestCopy[0], manifest, manifestSize);
+			ASSERT_ERR(path);
+			ASSERT_ERR(pTempPathOut);
 
-			TextParsingHelper tph(&manifestCopy[0], path);
-			while (tph.NextLine())
+#if FRAMEWORK_HEADLESS
+			std::string tempPath = std::string(path) + ".XXXXXX";
+			int fd = mkstemp(&tempPath[0]);
+			if (fd < 0)
+				return false;
+			fchmod(fd, 0644);		// mkstemp makes it owner-only
+			close(fd);
+			*pTempPathOut = tempPath;
+#else
+			char outDir[MAX_PATH] = {};
+			if (const char * pLastSlash = max(strrchr(path, '/'), strrchr(path, '\\')))
 			{
-				pManifestOut->insert(std::string(tph.NextToken()));
-				tph.ExpectEOL();
+				ASSERT_ERR(pLastSlash - path < MAX_PATH);
+				memcpy(outDir, path, pLastSlash - path);
+			}
+			else
+			{
+				outDir[0] = '.';
 			}
+			char tempPath[MAX_PATH];
+			if (GetTempFileName(outDir, nullptr, 0, tempPath) == 0)
+				return false;
+			*pTempPathOut = tempPath;
+#endif
+			return true;
+		}
+
+		// Replace a file with another one in the same directory, in a single step
+		static bool MoveFileOver(
+			const char * pathSrc,
+			const char * pathDest)
+		{
+#if FRAMEWORK_HEADLESS
+			return rename(pathSrc, pathDest) == 0;
+#else
+			return MoveFileEx(pathSrc, pathDest, MOVEFILE_COPY_ALLOWED | MOVEFILE_REPLACE_EXISTING) != 0;
+#endif
 		}
 
 		// Compile an entire asset pack from scratch, to a .zip file on disk.
+		// It's written to a temporary file first, so an existing pack is only replaced on success.
 		bool CompileFullAssetPackToFile(
 			const char * packPath,
 			const AssetCompileInfo * assets,
@@ -380,10 +1694,12 @@ namespace Framework
 			ASSERT_ERR(assets);
 			ASSERT_ERR(numAssets > 0);
 
+			std::string tempPath;
 			mz_zip_archive zip = {};
-			if (!mz_zip_writer_init_file(&zip, packPath, 0))
+			if (!MakeTempFileNextTo(packPath, &tempPath) ||
+				!mz_zip_writer_init_file(&zip, tempPath.c_str(), 0))
 			{
-				WARN("Couldn't open %s for writing", packPath);
+				WARN("Couldn't open temporary file %s for writing", tempPath.c_str());
 				return false;
 			}
 
@@ -396,6 +1712,15 @@ namespace Framework
 			}
 
 			mz_zip_writer_end(&zip);
+
+			if (success && !MoveFileOver(tempPath.c_str(), packPath))
+			{
+				WARN("Couldn't rename temporary file %s to asset pack %s", tempPath.c_str(), packPath);
+				success = false;
+			}
+			if (!success)
+				remove(tempPath.c_str());
+
 			return success;
 		}
 
@@ -414,21 +1739,28 @@ namespace Framework
 
 			std::string manifest;
 
+			// Track the files written, in order, for the directory
+			std::vector<std::string> pathsWritten;
+
+			// Compile all the assets in parallel
+			std::vector<int> assetIndices(numAssets);
+			for (int i = 0; i < numAssets; ++i)
+				assetIndices[i] = i;
+			ParallelAssetCompile compile(assets, assetIndices);
+
+			// Stream them into the output in order, as they finish
 			int numErrors = 0;
 			for (int iAsset = 0; iAsset < numAssets; ++iAsset)
 			{
 				const AssetCompileInfo * pACI = &assets[iAsset];
-				ACK ack = pACI->m_ack;
-				ASSERT_ERR(ack >= 0 && ack < ACK_Count);
-			
-				LOG("[%d/%d] Compiling %s asset %s...", iAsset+1, numAssets, s_ackNames[ack], pACI->m_pathSrc);
 
-				// Compile the asset
-				if (s_assetCompileFuncs[ack](pACI, pZipOut))
+				if (compile.WaitForAsset(iAsset))
 				{
+					if (!compile.WriteAssetToZip(iAsset, pZipOut, &pathsWritten))
+						return false;
+
 					// Write asset name to the manifest
-					manifest += pACI->m_pathSrc;
-					manifest += '\n';
+					AppendToManifest(pACI, &manifest);
 				}
 				else
 				{
@@ -450,17 +1782,46 @@ namespace Framework
 				MTLVER_Current,
 				TEXVER_Current,
 			};
-			if (!WriteAssetDataToZip(s_pathVersionInfo, nullptr, &version, sizeof(version), pZipOut))
+			if (!WriteAssetDataToZip(s_pathVersionInfo, nullptr, &version, sizeof(version), pZipOut, CODEC_Stored, &pathsWritten))
 				return false;
 
 			// Write manifest
-			if (!WriteAssetDataToZip(s_pathManifest, nullptr, &manifest[0], manifest.length(), pZipOut))
+			if (!WriteAssetDataToZip(s_pathManifest, nullptr, &manifest[0], manifest.length(), pZipOut, CODEC_Stored, &pathsWritten))
+				return false;
+
+			// Write directory
+			if (!WriteDirectoryToZip(pathsWritten, pZipOut))
 				return false;
 
 			return (numErrors == 0);
 		}
 
-		// Check if any assets in a pack are out of date by version number or mod time,
+		// Read the source record for an asset from a pack, if it has one
+		static bool ReadSourceInfo(
+			mz_zip_archive * pZip,
+			const char * pathSrc,
+			SourceInfo * pInfoOut)
+		{
+			char zipPath[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE + 1] = {};
+			if (_snprintf_s(zipPath, _TRUNCATE, "%s%s", pathSrc, s_suffixSourceInfo) < 0 ||
+				!NormalizePath(zipPath))
+			{
+				return false;
+			}
+
+			int fileIndex = mz_zip_reader_locate_file(pZip, zipPath, nullptr, 0);
+			mz_zip_archive_file_stat fileStat;
+			if (fileIndex < 0 ||
+				!mz_zip_reader_file_stat(pZip, fileIndex, &fileStat) ||
+				fileStat.m_uncomp_size != sizeof(SourceInfo))
+			{
+				return false;
+			}
+
+			return mz_zip_reader_extract_to_mem(pZip, fileIndex, pInfoOut, sizeof(SourceInfo), 0) != 0;
+		}
+
+		// Check if any assets in a pack are out of date by version number or source contents,
 		// returning a list of ones that need updating.
 		bool FindOutOfDateAssets(
 			const char * packPath,
@@ -523,72 +1884,65 @@ namespace Framework
 				mz_zip_reader_end(&zip);
 				return false;
 			}
-			std::unordered_set<std::string> manifest;
+			std::unordered_map<std::string, ACK> manifest;
 			ParseManifest(pManifest, int(manifestSize), packPath, &manifest);
 			mz_free(pManifest);
 
-			mz_zip_reader_end(&zip);
-
-			// Get the mod date of the asset pack
-			struct _stat packStat;
-			CHECK_ERR(_stat(packPath, &packStat) == 0);
-
-			// Go through the assets and check their individual versions and mod dates
+			// Go through the assets and check their source records
 			for (int i = 0; i < numAssets; ++i)
 			{
-				// Check the appropriate version number for the asset type
 				const AssetCompileInfo * pACI = &assets[i];
-				switch (pACI->m_ack)
-				{
-				case ACK_OBJMesh:
-					if (ver.m_meshver != MESHVER_Current)
-					{
-						pAssetsToUpdateOut->push_back(i);
-						continue;
-					}
-					break;
-
-				case ACK_OBJMtlLib:
-					if (ver.m_mtlver != MTLVER_Current)
-					{
-						pAssetsToUpdateOut->push_back(i);
-						continue;
-					}
-					break;
 
-				case ACK_TextureRaw:
-				case ACK_TextureWithMips:
-					if (ver.m_texver != TEXVER_Current)
-					{
-						pAssetsToUpdateOut->push_back(i);
-						continue;
-					}
-					break;
+				// Check if the asset exists in the manifest.  If it doesn't, needs to be compiled.
+				if (manifest.find(ManifestName(pACI->m_pathSrc)) == manifest.end())
+				{
+					pAssetsToUpdateOut->push_back(i);
+					continue;
+				}
 
-				default:
-					ERR("Missing case for ACK %d", pACI->m_ack);
-					break;
+				// Find the record of what it was compiled from
+				SourceInfo srcInfoPack;
+				if (!ReadSourceInfo(&zip, pACI->m_pathSrc, &srcInfoPack))
+				{
+					pAssetsToUpdateOut->push_back(i);
+					continue;
 				}
 
-				// Check if the asset exists in the manifest.  If it doesn't, needs to be compiled.
-				if (manifest.find(std::string(pACI->m_pathSrc)) == manifest.end())
+				// Check the compiler version and settings
+				if (srcInfoPack.m_compilerVer != CompilerVersionForACK(pACI->m_ack) ||
+					srcInfoPack.m_settingsHash != HashCompileSettings(pACI))
 				{
 					pAssetsToUpdateOut->push_back(i);
 					continue;
 				}
 
-				// Check mod time of the source file against that of the pack
-				// If the source file doesn't exist, that's OK!  Asset packs can be
+				// Check the source file.  If it doesn't exist, that's OK!  Asset packs can be
 				// distributed in lieu of source files.
 				struct _stat srcStat;
-				if (_stat(pACI->m_pathSrc, &srcStat) == 0 &&
-					srcStat.st_mtime > packStat.st_mtime)
+				if (_stat(pACI->m_pathSrc, &srcStat) != 0)
+					continue;
+
+				// If the size and mod time match the record, assume the contents do too
+				if (i64(srcStat.st_size) == srcInfoPack.m_size &&
+					i64(srcStat.st_mtime) == srcInfoPack.m_mtime)
+				{
+					continue;
+				}
+
+				// Otherwise, hash the contents.  Note that if only the mod time changed (e.g. the
+				// file was touched by a checkout), the record keeps the old one, so we'll hash
+				// this file again on each check until the asset is next recompiled.
+				SourceInfo srcInfoCur;
+				if (!MakeSourceInfo(pACI, &srcInfoCur) ||
+					srcInfoCur.m_contentHash != srcInfoPack.m_contentHash ||
+					srcInfoCur.m_size != srcInfoPack.m_size)
 				{
 					pAssetsToUpdateOut->push_back(i);
 					continue;
 				}
 			}
 
+			mz_zip_reader_end(&zip);
 			return true;
 		}
 
@@ -613,25 +1967,27 @@ namespace Framework
 			}
 			int numSrcFiles = int(mz_zip_reader_get_num_files(&zipSrc));
 
-			// Generate a temporary filename for the new archive
-			char outDir[MAX_PATH] = {};
-			if (const char * pLastSlash = max(strrchr(packPath, '/'), strrchr(packPath, '\\')))
-			{
-				ASSERT_ERR(pLastSlash - packPath < MAX_PATH);
-				memcpy(outDir, packPath, pLastSlash - packPath);
-			}
-			else
+			// Group the files in the old pack by the asset they belong to (the part of the path
+			// before the last slash), in one pass over the directory
+			std::unordered_map<std::string, std::vector<int>> srcFilesByAsset;
+			for (int i = 0; i < numSrcFiles; ++i)
 			{
-				outDir[0] = '.';
+				char filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+				mz_zip_reader_get_filename(&zipSrc, i, filename, sizeof(filename));
+				if (char * pLastSlash = strrchr(filename, '/'))
+				{
+					*pLastSlash = 0;
+					srcFilesByAsset[std::string(filename)].push_back(i);
+				}
 			}
-			char tempPath[MAX_PATH];
-			CHECK_ERR(GetTempFileName(outDir, nullptr, 0, tempPath) != 0);
 
-			// Open the temporary file for writing
+			// Open a temporary file for the new archive
+			std::string tempPath;
 			mz_zip_archive zipDest = {};
-			if (!mz_zip_writer_init_file(&zipDest, tempPath, 0))
+			if (!MakeTempFileNextTo(packPath, &tempPath) ||
+				!mz_zip_writer_init_file(&zipDest, tempPath.c_str(), 0))
 			{
-				WARN("Couldn't open temporary file %s for writing", packPath);
+				WARN("Couldn't open temporary file %s for writing", tempPath.c_str());
 				mz_zip_reader_end(&zipSrc);
 				return false;
 			}
@@ -640,6 +1996,12 @@ namespace Framework
 			int numErrors = 0;
 			int numAssetsToUpdate = int(assetsToUpdate.size());
 
+			// Kick off compiling the assets that need it, in parallel
+			ParallelAssetCompile compile(assets, assetsToUpdate);
+
+			// Track the files written, in order, for the directory
+			std::vector<std::string> pathsWritten;
+
 			// Iterate over assets, tracking position in both original asset list and
 			// list of assets that need updates (a sorted subset of the original ones)
 			for (int iAsset = 0, iAssetToUpdate = 0; iAsset < numAssets; ++iAsset)
@@ -652,18 +2014,19 @@ namespace Framework
 
 				if (iAssetToUpdate < numAssetsToUpdate && assetsToUpdate[iAssetToUpdate] == iAsset)
 				{
-					ACK ack = pACI->m_ack;
-					ASSERT_ERR(ack >= 0 && ack < ACK_Count);
-			
-					LOG("[%d/%d] Compiling %s asset %s...",
-						iAssetToUpdate+1, numAssetsToUpdate, s_ackNames[ack], pACI->m_pathSrc);
-
-					// Compile the asset
-					if (s_assetCompileFuncs[ack](pACI, &zipDest))
+					// Wait for the asset to compile, and copy it in
+					if (compile.WaitForAsset(iAssetToUpdate))
 					{
+						if (!compile.WriteAssetToZip(iAssetToUpdate, &zipDest, &pathsWritten))
+						{
+							mz_zip_reader_end(&zipSrc);
+							mz_zip_writer_end(&zipDest);
+							remove(tempPath.c_str());
+							return false;
+						}
+
 						// Write asset name to the manifest
-						manifest += pACI->m_pathSrc;
-						manifest += '\n';
+						AppendToManifest(pACI, &manifest);
 					}
 					else
 					{
@@ -673,37 +2036,54 @@ namespace Framework
 				}
 				else
 				{
-					// Copy any files prefixed with the asset name from the old zip to the new one
-					// Note, this could be more efficient when there's a large number of files
-					for (int i = 0; i < numSrcFiles; ++i)
+					// Copy the asset's files from the old zip to the new one.  They're in directory
+					// order, which is also the order they sit in the file, so this reads sequentially.
+					char assetPath[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE + 1] = {};
+					if (_snprintf_s(assetPath, _TRUNCATE, "%s", pACI->m_pathSrc) < 0 ||
+						!NormalizePath(assetPath))
+					{
+						WARN("Invalid asset path %s", pACI->m_pathSrc);
+						mz_zip_reader_end(&zipSrc);
+						mz_zip_writer_end(&zipDest);
+						remove(tempPath.c_str());
+						return false;
+					}
+
+					auto iterFiles = srcFilesByAsset.find(std::string(assetPath));
+					if (iterFiles != srcFilesByAsset.end())
 					{
-						char filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
-						mz_zip_reader_get_filename(&zipSrc, i, filename, sizeof(filename));
-						if (_strnicmp(filename, pACI->m_pathSrc, strlen(pACI->m_pathSrc)) == 0)
+						std::vector<int> const & srcFiles = iterFiles->second;
+						for (int i = 0, n = int(srcFiles.size()); i < n; ++i)
 						{
-							if (!mz_zip_writer_add_from_zip_reader(&zipDest, &zipSrc, i))
+							char filename[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE];
+							mz_zip_reader_get_filename(&zipSrc, srcFiles[i], filename, sizeof(filename));
+							if (!mz_zip_writer_add_from_zip_reader(&zipDest, &zipSrc, srcFiles[i]))
 							{
 								WARN("Couldn't copy file %s from asset pack %s to temporary archive %s",
-									filename, packPath, tempPath);
+									filename, packPath, tempPath.c_str());
 								mz_zip_reader_end(&zipSrc);
 								mz_zip_writer_end(&zipDest);
-								DeleteFile(tempPath);
+								remove(tempPath.c_str());
 								return false;
 							}
+							pathsWritten.push_back(std::string(filename));
 						}
 					}
 
 					// Write asset name to the manifest
-					manifest += pACI->m_pathSrc;
-					manifest += '\n';
+					AppendToManifest(pACI, &manifest);
 				}
 			}
 
 			mz_zip_reader_end(&zipSrc);
 
+			// Leave the old asset pack alone rather than replace it with one that's missing assets
 			if (numErrors > 0)
 			{
 				WARN("Failed to compile %d of %d assets", numErrors, numAssetsToUpdate);
+				mz_zip_writer_end(&zipDest);
+				remove(tempPath.c_str());
+				return false;
 			}
 
 			// Write version info
@@ -714,39 +2094,261 @@ namespace Framework
 				MTLVER_Current,
 				TEXVER_Current,
 			};
-			if (!WriteAssetDataToZip(s_pathVersionInfo, nullptr, &version, sizeof(version), &zipDest))
+			if (!WriteAssetDataToZip(s_pathVersionInfo, nullptr, &version, sizeof(version), &zipDest, CODEC_Stored, &pathsWritten))
 			{
 				mz_zip_writer_end(&zipDest);
-				DeleteFile(tempPath);
+				remove(tempPath.c_str());
 				return false;
 			}
 
 			// Write manifest
-			if (!WriteAssetDataToZip(s_pathManifest, nullptr, &manifest[0], manifest.length(), &zipDest))
+			if (!WriteAssetDataToZip(s_pathManifest, nullptr, &manifest[0], manifest.length(), &zipDest, CODEC_Stored, &pathsWritten))
 			{
 				mz_zip_writer_end(&zipDest);
-				DeleteFile(tempPath);
+				remove(tempPath.c_str());
+				return false;
+			}
+
+			// Write directory
+			if (!WriteDirectoryToZip(pathsWritten, &zipDest))
+			{
+				mz_zip_writer_end(&zipDest);
+				remove(tempPath.c_str());
 				return false;
 			}
 
 			if (!mz_zip_writer_finalize_archive(&zipDest))
 			{
-				WARN("Couldn't finalize temporary archive %s", tempPath);
+				WARN("Couldn't finalize temporary archive %s", tempPath.c_str());
 				mz_zip_writer_end(&zipDest);
-				DeleteFile(tempPath);
+				remove(tempPath.c_str());
 				return false;
 			}
 
 			mz_zip_writer_end(&zipDest);
 
 			// Move the new version of the asset pack over the old one
-			if (!MoveFileEx(tempPath, packPath, MOVEFILE_COPY_ALLOWED | MOVEFILE_REPLACE_EXISTING))
+			if (!MoveFileOver(tempPath.c_str(), packPath))
 			{
-				WARN("Couldn't rename temporary file %s over asset pack %s", tempPath, packPath);
+				WARN("Couldn't rename temporary file %s over asset pack %s", tempPath.c_str(), packPath);
+				remove(tempPath.c_str());
 				return false;
 			}
 
-			return (numErrors == 0);
+			return true;
+		}
+
+		// Check whether a pack's records for an asset can be trusted in place of scanning the
+		// source: either the source is missing, or its size and mod time match the record
+		static bool CanUseRecordedDependencies(
+			mz_zip_archive * pZip,
+			const char * pathSrc,
+			std::vector<AssetDependency> * pDepsOut)
+		{
+			SourceInfo srcInfo;
+			if (!ReadSourceInfo(pZip, pathSrc, &srcInfo))
+				return false;
+
+			struct _stat srcStat;
+			if (_stat(pathSrc, &srcStat) == 0 &&
+				(i64(srcStat.st_size) != srcInfo.m_size ||
+				 i64(srcStat.st_mtime) != srcInfo.m_mtime))
+			{
+				return false;
+			}
+
+			char zipPath[MZ_ZIP_MAX_ARCHIVE_FILENAME_SIZE + 1] = {};
+			if (_snprintf_s(zipPath, _TRUNCATE, "%s%s", pathSrc, s_suffixDependencies) < 0 ||
+				!NormalizePath(zipPath))
+			{
+				return false;
+			}
+
+			int fileIndex = mz_zip_reader_locate_file(pZip, zipPath, nullptr, 0);
+			mz_zip_archive_file_stat fileStat;
+			if (fileIndex < 0 || !mz_zip_reader_file_stat(pZip, fileIndex, &fileStat))
+				return false;
+
+			// No dependencies
+			if (fileStat.m_uncomp_size == 0)
+				return true;
+
+			size_t depsSize;
+			byte * pDeps = (byte *)mz_zip_reader_extract_to_heap(pZip, fileIndex, &depsSize, 0);
+			if (!pDeps)
+				return false;
+
+			bool success = DeserializeDependencies(pDeps, int(depsSize), pDepsOut);
+			mz_free(pDeps);
+			return success;
+		}
+
+		bool BuildAssetGraph(
+			const char * packPath,
+			const AssetCompileInfo * roots,
+			int numRoots,
+			AssetGraph * pGraphOut)
+		{
+			ASSERT_ERR(roots);
+			ASSERT_ERR(numRoots > 0);
+			ASSERT_ERR(pGraphOut);
+
+			// Open the existing pack, if there is one and it's the current version, for its records
+			mz_zip_archive zip = {};
+			bool havePack = (packPath && mz_zip_reader_init_file(&zip, packPath, 0));
+			if (havePack)
+			{
+				VersionInfo ver;
+				int fileIndex = mz_zip_reader_locate_file(&zip, s_pathVersionInfo, nullptr, 0);
+				if (fileIndex < 0 ||
+					!mz_zip_reader_extract_to_mem(&zip, fileIndex, &ver, sizeof(ver), 0) ||
+					ver.m_packver != PACKVER_Current)
+				{
+					mz_zip_reader_end(&zip);
+					havePack = false;
+				}
+			}
+
+			struct Node
+			{
+				std::string			m_pathSrc;
+				AssetCompileInfo	m_aci;			// Kind and settings; its m_pathSrc isn't used
+				std::vector<int>	m_deps;
+			};
+			std::vector<Node> nodes;
+			std::unordered_map<std::string, int> nodeIndices;	// Keyed by normalized path
+
+			// Roots are added first, so their settings win over a plain reference as a dependency
+			auto addNode = [&](std::string const & pathSrc, const AssetCompileInfo & aci) -> int
+			{
+				ACK ack = aci.m_ack;
+				std::string key = pathSrc;
+				makeLowercase(key);
+				replaceChars(key, '\\', '/');
+
+				auto iterAndBool = nodeIndices.insert(std::make_pair(key, int(nodes.size())));
+				if (iterAndBool.second)
+				{
+					Node node = { pathSrc, aci };
+					nodes.push_back(node);
+				}
+				else if (nodes[iterAndBool.first->second].m_aci.m_ack != ack)
+				{
+					WARN("Asset %s is referenced as both %s and %s; using %s",
+						pathSrc.c_str(), s_ackNames[nodes[iterAndBool.first->second].m_aci.m_ack], s_ackNames[ack],
+						s_ackNames[nodes[iterAndBool.first->second].m_aci.m_ack]);
+				}
+				return iterAndBool.first->second;
+			};
+
+			for (int i = 0; i < numRoots; ++i)
+			{
+				ASSERT_ERR(roots[i].m_ack >= 0 && roots[i].m_ack < ACK_Count);
+				addNode(std::string(roots[i].m_pathSrc), roots[i]);
+			}
+
+			// Breadth-first walk; nodes get appended as they're discovered
+			for (int iNode = 0; iNode < int(nodes.size()); ++iNode)
+			{
+				std::string pathSrc = nodes[iNode].m_pathSrc;
+				ACK ack = nodes[iNode].m_aci.m_ack;
+				if (!s_assetDepsFuncs[ack])
+					continue;
+
+				std::vector<AssetDependency> deps;
+				if (!havePack || !CanUseRecordedDependencies(&zip, pathSrc.c_str(), &deps))
+				{
+					// Scan the source.  If that fails, carry on; compiling the asset will fail later
+					// and report the problem.
+					deps.clear();
+					AssetCompileInfo aci = nodes[iNode].m_aci;
+					aci.m_pathSrc = pathSrc.c_str();
+					if (!s_assetDepsFuncs[ack](&aci, &deps))
+						WARN("Couldn't scan %s asset %s for dependencies", s_ackNames[ack], pathSrc.c_str());
+				}
+
+				for (int i = 0, n = int(deps.size()); i < n; ++i)
+				{
+					// Dependencies are encoded like the first asset found referencing them, so opting
+					// a mesh into compression covers its materials' textures too
+					AssetCompileInfo aciDep = { nullptr, deps[i].m_ack };
+					aciDep.m_codec = nodes[iNode].m_aci.m_codec;
+					int iDep = addNode(deps[i].m_pathSrc, aciDep);
+					nodes[iNode].m_deps.push_back(iDep);
+
+					// A texture is alpha-tested if any material that uses it is, unless it's a root,
+					// whose settings are given explicitly
+					if (deps[i].m_alphaTested && iDep >= numRoots)
+						nodes[iDep].m_aci.m_preserveAlphaCoverage = true;
+				}
+			}
+
+			if (havePack)
+				mz_zip_reader_end(&zip);
+
+			// Sort into dependency order by depth-first search, emitting each node after its dependencies
+			int numNodes = int(nodes.size());
+			std::vector<int> order;
+			order.reserve(numNodes);
+			std::vector<int> states(numNodes, 0);		// 0 = unvisited, 1 = on the stack, 2 = emitted
+			std::vector<std::pair<int, int>> stack;		// Node index and next dependency to visit
+			for (int iRoot = 0; iRoot < numNodes; ++iRoot)
+			{
+				if (states[iRoot] != 0)
+					continue;
+
+				states[iRoot] = 1;
+				stack.push_back(std::make_pair(iRoot, 0));
+				while (!stack.empty())
+				{
+					int iNode = stack.back().first;
+					int iNext = stack.back().second++;
+					if (iNext < int(nodes[iNode].m_deps.size()))
+					{
+						int iDep = nodes[iNode].m_deps[iNext];
+						if (states[iDep] == 0)
+						{
+							states[iDep] = 1;
+							stack.push_back(std::make_pair(iDep, 0));
+						}
+						else if (states[iDep] == 1)
+						{
+							WARN("Dependency cycle between assets %s and %s; ignoring",
+								nodes[iNode].m_pathSrc.c_str(), nodes[iDep].m_pathSrc.c_str());
+						}
+					}
+					else
+					{
+						states[iNode] = 2;
+						order.push_back(iNode);
+						stack.pop_back();
+					}
+				}
+			}
+
+			// Build the output in sorted order
+			std::vector<int> remap(numNodes);
+			for (int i = 0; i < numNodes; ++i)
+				remap[order[i]] = i;
+
+			pGraphOut->m_paths.clear();
+			pGraphOut->m_assets.resize(numNodes);
+			pGraphOut->m_deps.resize(numNodes);
+			for (int i = 0; i < numNodes; ++i)
+			{
+				const Node & node = nodes[order[i]];
+				pGraphOut->m_paths.push_back(node.m_pathSrc);
+				pGraphOut->m_assets[i] = node.m_aci;
+				pGraphOut->m_assets[i].m_pathSrc = pGraphOut->m_paths.back().c_str();
+
+				pGraphOut->m_deps[i].clear();
+				for (int j = 0, n = int(node.m_deps.size()); j < n; ++j)
+					pGraphOut->m_deps[i].push_back(remap[node.m_deps[j]]);
+			}
+
+			LOG("Found %d assets from %d roots", numNodes, numRoots);
+
+			return true;
 		}
 	}
 }
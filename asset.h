@@ -1,55 +1,166 @@
 #pragma once
 
+struct mz_zip_archive_tag;
+
 namespace Framework
 {
+	enum APFLAG						// Asset pack load flags
+	{
+		APFLAG_MemoryMap	= 0x01,		// Map the .zip into memory and point stored entries straight at it, instead of copying
+		APFLAG_Lazy			= 0x02,		// Only read the directory up front; extract each file the first time it's looked up
+
+		APFLAG_Default		= 0x00,
+	};
+
+	enum ACK					// Asset Compile Kind
+	{
+		ACK_OBJMesh,			// .obj mesh, compiled to vtx/idx buffers and mtl map
+		ACK_OBJMtlLib,			// .mtl material library that goes alongside an .obj
+		ACK_TextureRaw,			// Single RGBA8 image
+		ACK_TextureWithMips,	// RGBA8 image, resampled up to pow2 and mips generated
+
+		ACK_Count
+	};
+
+	enum CODEC					// How a file's data is encoded in the pack
+	{
+		CODEC_Stored,			// Raw bytes; can be referenced in place when memory-mapped (the default)
+		CODEC_Deflate,			// Zip deflate: best ratio, slowest to decode
+		CODEC_LZ,				// LZ4-style block (see lz.h): decodes near memory speed, but always into a copy
+
+		CODEC_Count
+	};
+
+	enum VCOPT					// Triangle order optimizer for the post-transform vertex cache
+	{
+		VCOPT_Forsyth,			// Tom Forsyth's linear-speed optimizer: best cache efficiency
+		VCOPT_Tipsify,			// Sander et al.'s Tipsify: several times faster, slightly less efficient
+		VCOPT_None,				// Keep the source order
+
+		VCOPT_Count
+	};
+
 	class AssetPack : public RefCount
 	{
 	public:
 		struct FileInfo
 		{
 			std::string		m_path;			// Archive internal path
-			int				m_offset;		// Starting offset into m_data
-			int				m_size;			// Size in bytes
+			size_t			m_offset;		// Starting offset into m_data, or into m_pMappedView if m_mapped
+			int				m_size;			// Size in bytes, after decoding
+			int				m_sizeEncoded;	// Size in bytes in the .zip
+			CODEC			m_codec;
+			bool			m_mapped;		// Data lives in the memory-mapped .zip rather than in m_data
+			bool			m_lazy;			// Data is extracted to m_extractedData on first lookup
 		};
 
-		std::vector<byte>						m_data;				// Entire uncompressed archive
+		struct DirectorySlot
+		{
+			u64				m_pathHash;		// HashPath of the file in this slot, to reject paths not in the pack
+			u32				m_fileIndex;	// Index into m_files
+			u32				m_padding;
+		};
+
+		std::vector<byte>						m_data;				// Uncompressed data for all files that aren't mapped
 		std::vector<FileInfo>					m_files;			// List of files in the archive
-		std::unordered_map<std::string, int>	m_directory;		// Mapping from internal path to index in m_files
-		std::unordered_set<std::string>			m_manifest;			// List of asset names in the pack
+		std::unordered_map<std::string, ACK>	m_manifest;			// Names of the assets in the pack, and their kinds
 		std::string								m_path;				// File path where the asset pack was loaded from
 
+		// Read-only view of the whole .zip file, if loaded with APFLAG_MemoryMap.
+		// Pages are brought in by the OS on demand, so unused assets cost no memory.
+		const byte *							m_pMappedView;
+		size_t									m_mappedSize;
+#if !FRAMEWORK_HEADLESS
+		HANDLE									m_hFile;
+		HANDLE									m_hMapping;
+#endif
+
+		// Zip reader kept open for on-demand extraction, if loaded with APFLAG_Lazy.
+		// Lookups may come from multiple threads.  The zip reader isn't thread-safe, so reads
+		// from it are serialized by m_lazyMutex, but decoding happens outside the lock.  Each
+		// file is extracted by the first thread to ask for it; others wait on m_cvExtracted.
+		mz_zip_archive_tag *					m_pZip;
+		std::vector<std::vector<byte>>			m_extractedData;	// Per file, filled in as files are looked up
+		std::vector<std::atomic<int>>			m_extractState;		// Per file, EXTRACT_*
+		std::mutex								m_lazyMutex;		// Guards m_pZip, and m_extractState changes
+		std::condition_variable					m_cvExtracted;
+
+		enum EXTRACT
+		{
+			EXTRACT_NotStarted,
+			EXTRACT_InProgress,
+			EXTRACT_Done,
+		};
+
+		// Minimal perfect hash from path hashes to indices in m_files.  Points into the pack's
+		// directory file if it has one, otherwise into m_directoryBuilt, made at load time.
+		const DirectorySlot *					m_pDirSlots;
+		const u32 *								m_pDirDisplacements;	// Per bucket
+		int										m_dirNumSlots;
+		int										m_dirNumBuckets;
+		u64										m_dirSeed;
+		std::vector<byte>						m_directoryBuilt;
+
 		AssetPack();
-		bool LookupFile(const char * path, const char * suffix, void ** pDataOut, int * pSizeOut);
+		~AssetPack();
+
+		// Data returned from lookups is owned by the pack, and read-only: with APFLAG_MemoryMap
+		// it can point straight into the mapped .zip, which is mapped without write access.
+		bool LookupFile(const char * path, const char * suffix, const void ** pDataOut, int * pSizeOut);
+		bool LookupFile(u64 pathHash, const void ** pDataOut, int * pSizeOut);		// For callers that cache HashPath
+		int FindFile(u64 pathHash) const;
+		bool GetFileData(int iFile, const void ** pDataOut, int * pSizeOut);
+		bool ExtractFile(int iFile);		// For APFLAG_Lazy: fill in m_extractedData[iFile], if no one has yet
 		bool HasAsset(const char * path);
 		void Reset();
-	};
 
-	enum ACK					// Asset Compile Kind
-	{
-		ACK_OBJMesh,			// .obj mesh, compiled to vtx/idx buffers and mtl map
-		ACK_OBJMtlLib,			// .mtl material library that goes alongside an .obj
-		ACK_TextureRaw,			// Single RGBA8 image
-		ACK_TextureWithMips,	// RGBA8 image, resampled up to pow2 and mips generated
-
-		ACK_Count
+		// Hash of a normalized internal path (lowercase, forward slashes), with optional suffix
+		static u64 HashPath(const char * path, const char * suffix = nullptr);
 	};
 
+	// Per-asset compile settings.  Settings not given in a brace initializer are zero, which
+	// means the defaults.  Changing any of them recompiles the asset.
 	struct AssetCompileInfo
 	{
 		const char *	m_pathSrc;
 		ACK				m_ack;
+		float			m_weldEpsilon;		// ACK_OBJMesh: merge verts whose positions round to the same point on a grid this size (0 = exact matches only)
+		VCOPT			m_vcopt;			// ACK_OBJMesh: triangle order optimizer
+		int				m_vertexCacheSize;	// ACK_OBJMesh: vertex cache size to optimize for (0 = 32)
+		bool			m_optimizeOverdraw;	// ACK_OBJMesh: after optimizing for the vertex cache, sort clusters of triangles to cut overdraw
+		VTXFMT			m_vtxfmt;			// ACK_OBJMesh: vertex layout to compile to
+		bool			m_splitFor16BitIndices;	// ACK_OBJMesh: split meshes with over 64K verts into blocks, so they can use 16-bit indices
+		int				m_lodCount;			// ACK_OBJMesh: number of simplified LODs to generate after the full-detail one
+		float			m_lodRatio;			// ACK_OBJMesh: fraction of triangles each LOD keeps from the one before (0 = 0.5)
+		TEXFMT			m_texfmt;			// ACK_TextureRaw/WithMips: pixel format to compile to (0 = by the source's channels)
+		bool			m_preserveAlphaCoverage;	// ACK_TextureWithMips: scale alpha in each mip so as much passes the alpha test as in the base level
+		float			m_alphaCutoff;		// ACK_TextureWithMips: alpha-test threshold for m_preserveAlphaCoverage (0 = 0.5)
+		CODEC			m_codec;			// Codec for bulk vertex, index and pixel data (0 = stored, so memory-mapped packs use it in place)
 	};
 
-	// Load an asset pack file, checking that all its assets are present and up to date,
-	// and compiling any that aren't.
+	// Check that all the assets in an asset pack file are present and up to date, and compile
+	// any that aren't, without loading the pack.  Assets referenced by the given ones (such as
+	// an .obj's material library and the textures it uses) are included automatically, so it's
+	// enough to list the roots.  The pack file is replaced atomically, so a failed or
+	// interrupted compile leaves the old one intact.
+	bool CompileAssetPackIfOutOfDate(
+		const char * packPath,
+		const AssetCompileInfo * assets,
+		int numAssets);
+
+	// Load an asset pack file, after bringing it up to date as CompileAssetPackIfOutOfDate does.
 	bool LoadAssetPackOrCompileIfOutOfDate(
 		const char * packPath,
 		const AssetCompileInfo * assets,
 		int numAssets,
-		AssetPack * pPackOut);
+		AssetPack * pPackOut,
+		int flags = APFLAG_Default);
 
 	// Just load an asset pack file.
+	// With APFLAG_MemoryMap, data pointers returned from the pack point into read-only memory.
+	// With APFLAG_Lazy, the file stays open and load cost scales with what's actually looked up.
 	bool LoadAssetPack(
 		const char * packPath,
-		AssetPack * pPackOut);
+		AssetPack * pPackOut,
+		int flags = APFLAG_Default);
 }
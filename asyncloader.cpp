@@ -0,0 +1,322 @@
+#include "framework.h"
+#include <algorithm>
+
+namespace Framework
+{
+	enum ALSTATE
+	{
+		ALSTATE_Queued,
+		ALSTATE_Loading,
+		ALSTATE_Completed,
+	};
+
+	struct AsyncLoader::Request
+	{
+		int					m_id;
+		int					m_priority;
+		ALK					m_alk;
+		ALSTATE				m_state;
+		bool				m_cancelled;		// Cancelled while loading; the thread will delete it
+		bool				m_success;
+		comptr<AssetPack>	m_pPack;
+		std::string			m_path;
+		void *				m_pLibIn;			// MaterialLib for ALK_Mesh, TextureLib for ALK_MaterialLib
+		void *				m_pObjOut;			// Caller's object
+		Callback			m_callback;
+
+		// Staging objects, loaded into on the I/O thread
+		Mesh				m_mesh;
+		MaterialLib			m_mtlLib;
+		Texture2D			m_tex;
+	};
+
+
+
+	// AsyncLoader implementation
+
+	AsyncLoader::AsyncLoader()
+	:	m_nextId(1),
+		m_shutdown(false)
+	{
+	}
+
+	AsyncLoader::~AsyncLoader()
+	{
+		Reset();
+	}
+
+	void AsyncLoader::Init(int numThreads /* = 0 */)
+	{
+		ASSERT_ERR(numThreads >= 0);
+		ASSERT_ERR(m_threads.empty());
+
+		// Loads are mostly waiting on disk, so a couple of threads is enough to keep it busy
+		if (numThreads == 0)
+			numThreads = min(2, GetNumWorkerThreads());
+
+		m_shutdown = false;
+		for (int i = 0; i < numThreads; ++i)
+			m_threads.push_back(std::thread([this]() { WorkerThread(); }));
+	}
+
+	void AsyncLoader::Reset()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_shutdown = true;
+		}
+		m_cvWork.notify_all();
+
+		// Threads finish the loads they're on, then exit
+		for (int i = 0, n = int(m_threads.size()); i < n; ++i)
+			m_threads[i].join();
+		m_threads.clear();
+
+		for (auto iter = m_requests.begin(), iterEnd = m_requests.end(); iter != iterEnd; ++iter)
+			delete iter->second;
+		m_queue.clear();
+		m_requests.clear();
+		m_completed.clear();
+	}
+
+	int AsyncLoader::RequestMesh(
+		AssetPack * pPack,
+		const char * path,
+		MaterialLib * pMtlLib,
+		Mesh * pMeshOut,
+		int priority /* = 0 */,
+		Callback const & callback /* = Callback() */)
+	{
+		ASSERT_ERR(pPack);
+		ASSERT_ERR(path);
+		ASSERT_ERR(pMtlLib);
+		ASSERT_ERR(pMeshOut);
+
+		Request * pRequest = new Request;
+		pRequest->m_alk = ALK_Mesh;
+		pRequest->m_priority = priority;
+		pRequest->m_pPack = pPack;
+		pRequest->m_path = path;
+		pRequest->m_pLibIn = pMtlLib;
+		pRequest->m_pObjOut = pMeshOut;
+		pRequest->m_callback = callback;
+		return AddRequest(pRequest);
+	}
+
+	int AsyncLoader::RequestMaterialLib(
+		AssetPack * pPack,
+		const char * path,
+		TextureLib * pTexLib,
+		MaterialLib * pMtlLibOut,
+		int priority /* = 0 */,
+		Callback const & callback /* = Callback() */)
+	{
+		ASSERT_ERR(pPack);
+		ASSERT_ERR(path);
+		ASSERT_ERR(pTexLib);
+		ASSERT_ERR(pMtlLibOut);
+
+		Request * pRequest = new Request;
+		pRequest->m_alk = ALK_MaterialLib;
+		pRequest->m_priority = priority;
+		pRequest->m_pPack = pPack;
+		pRequest->m_path = path;
+		pRequest->m_pLibIn = pTexLib;
+		pRequest->m_pObjOut = pMtlLibOut;
+		pRequest->m_callback = callback;
+		return AddRequest(pRequest);
+	}
+
+	int AsyncLoader::RequestTexture2D(
+		AssetPack * pPack,
+		const char * path,
+		Texture2D * pTexOut,
+		int priority /* = 0 */,
+		Callback const & callback /* = Callback() */)
+	{
+		ASSERT_ERR(pPack);
+		ASSERT_ERR(path);
+		ASSERT_ERR(pTexOut);
+
+		Request * pRequest = new Request;
+		pRequest->m_alk = ALK_Texture2D;
+		pRequest->m_priority = priority;
+		pRequest->m_pPack = pPack;
+		pRequest->m_path = path;
+		pRequest->m_pLibIn = nullptr;
+		pRequest->m_pObjOut = pTexOut;
+		pRequest->m_callback = callback;
+		return AddRequest(pRequest);
+	}
+
+	int AsyncLoader::AddRequest(Request * pRequest)
+	{
+		ASSERT_ERR(pRequest);
+		ASSERT_ERR_MSG(!m_threads.empty(), "AsyncLoader used without calling Init()");
+
+		pRequest->m_state = ALSTATE_Queued;
+		pRequest->m_cancelled = false;
+		pRequest->m_success = false;
+
+		int id;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			id = m_nextId++;
+			pRequest->m_id = id;
+			m_requests[id] = pRequest;
+			m_queue[QueueKey(-pRequest->m_priority, id)] = pRequest;
+		}
+		m_cvWork.notify_one();
+
+		return id;
+	}
+
+	bool AsyncLoader::Cancel(int request)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto iter = m_requests.find(request);
+		if (iter == m_requests.end())
+			return false;
+
+		Request * pRequest = iter->second;
+		switch (pRequest->m_state)
+		{
+		case ALSTATE_Queued:
+			m_queue.erase(QueueKey(-pRequest->m_priority, request));
+			delete pRequest;
+			break;
+
+		case ALSTATE_Loading:
+			// Can't interrupt the load; the thread discards it when done
+			pRequest->m_cancelled = true;
+			break;
+
+		case ALSTATE_Completed:
+			m_completed.erase(std::find(m_completed.begin(), m_completed.end(), pRequest));
+			delete pRequest;
+			break;
+		}
+
+		m_requests.erase(iter);
+		return true;
+	}
+
+	bool AsyncLoader::SetPriority(int request, int priority)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto iter = m_requests.find(request);
+		if (iter == m_requests.end())
+			return false;
+
+		// Only matters if it's still waiting in the queue
+		Request * pRequest = iter->second;
+		if (pRequest->m_state == ALSTATE_Queued)
+		{
+			m_queue.erase(QueueKey(-pRequest->m_priority, request));
+			m_queue[QueueKey(-priority, request)] = pRequest;
+		}
+		pRequest->m_priority = priority;
+		return true;
+	}
+
+	int AsyncLoader::Update()
+	{
+		std::vector<Request *> completed;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			completed.swap(m_completed);
+			for (int i = 0, n = int(completed.size()); i < n; ++i)
+				m_requests.erase(completed[i]->m_id);
+		}
+
+		// Hand over the results and run callbacks outside the lock, so callbacks can make new requests
+		for (int i = 0, n = int(completed.size()); i < n; ++i)
+		{
+			Request * pRequest = completed[i];
+			if (pRequest->m_success)
+			{
+				switch (pRequest->m_alk)
+				{
+				case ALK_Mesh:			*(Mesh *)pRequest->m_pObjOut = pRequest->m_mesh;			break;
+				case ALK_MaterialLib:	*(MaterialLib *)pRequest->m_pObjOut = pRequest->m_mtlLib;	break;
+				case ALK_Texture2D:		*(Texture2D *)pRequest->m_pObjOut = pRequest->m_tex;		break;
+				default:
+					ERR("Unexpected ALK %d", pRequest->m_alk);
+					break;
+				}
+			}
+
+			if (pRequest->m_callback)
+				pRequest->m_callback(pRequest->m_success);
+
+			delete pRequest;
+		}
+
+		return int(completed.size());
+	}
+
+	int AsyncLoader::NumOutstanding()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return int(m_requests.size());
+	}
+
+	void AsyncLoader::WorkerThread()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			m_cvWork.wait(lock, [this]() { return m_shutdown || !m_queue.empty(); });
+			if (m_shutdown)
+				return;
+
+			// Take the highest-priority request
+			Request * pRequest = m_queue.begin()->second;
+			m_queue.erase(m_queue.begin());
+			pRequest->m_state = ALSTATE_Loading;
+
+			lock.unlock();
+
+			const char * path = pRequest->m_path.c_str();
+			switch (pRequest->m_alk)
+			{
+			case ALK_Mesh:
+				pRequest->m_success = LoadMeshFromAssetPack(
+										pRequest->m_pPack, path,
+										(MaterialLib *)pRequest->m_pLibIn,
+										&pRequest->m_mesh);
+				break;
+
+			case ALK_MaterialLib:
+				pRequest->m_success = LoadMaterialLibFromAssetPack(
+										pRequest->m_pPack, path,
+										(TextureLib *)pRequest->m_pLibIn,
+										&pRequest->m_mtlLib);
+				break;
+
+			case ALK_Texture2D:
+				pRequest->m_success = LoadTexture2DFromAssetPack(
+										pRequest->m_pPack, path,
+										&pRequest->m_tex);
+				break;
+
+			default:
+				ERR("Unexpected ALK %d", pRequest->m_alk);
+				break;
+			}
+
+			lock.lock();
+
+			if (pRequest->m_cancelled)
+			{
+				delete pRequest;
+				continue;
+			}
+
+			pRequest->m_state = ALSTATE_Completed;
+			m_completed.push_back(pRequest);
+		}
+	}
+}
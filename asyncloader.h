@@ -0,0 +1,100 @@
+#pragma once
+
+namespace Framework
+{
+	class Mesh;
+	class MaterialLib;
+	class Texture2D;
+	class TextureLib;
+
+	enum ALK					// Async Load Kind
+	{
+		ALK_Mesh,
+		ALK_MaterialLib,
+		ALK_Texture2D,
+
+		ALK_Count
+	};
+
+	// Background loader for assets in asset packs, so the main loop never blocks on disk.
+	//
+	//  * Requests are queued with a priority and serviced by a small pool of I/O threads,
+	//      highest priority first, then in the order they were made.  With an APFLAG_Lazy pack,
+	//      the file reads and decoding happen on those threads too.
+	//
+	//  * Each request loads into its own staging object.  Results are handed over to the
+	//      caller's object, and completion callbacks run, only in Update() - so the caller's
+	//      objects are never touched from another thread, and can be used freely meanwhile.
+	//
+	//  * A request can be cancelled or reprioritized at any time before it's delivered.
+	//      Cancelled requests never write to the caller's object or run their callback.
+	//
+	//  * The pack, and any material/texture libraries used to resolve references, must stay
+	//      alive and unmodified while requests on them are outstanding.
+	//
+	//  * Only CPU data is loaded; call UploadToGPU from the callback as needed.
+
+	class AsyncLoader
+	{
+	public:
+		typedef std::function<void (bool success)> Callback;
+
+				AsyncLoader();
+				~AsyncLoader();
+
+		// numThreads = 0 picks a default suited to I/O-bound work
+		void	Init(int numThreads = 0);
+
+		// Cancels all outstanding requests and shuts down the threads
+		void	Reset();
+
+		// Queue a load.  Higher priority is loaded sooner.  Returns an id for the request.
+		int		RequestMesh(
+					AssetPack * pPack,
+					const char * path,
+					MaterialLib * pMtlLib,
+					Mesh * pMeshOut,
+					int priority = 0,
+					Callback const & callback = Callback());
+		int		RequestMaterialLib(
+					AssetPack * pPack,
+					const char * path,
+					TextureLib * pTexLib,
+					MaterialLib * pMtlLibOut,
+					int priority = 0,
+					Callback const & callback = Callback());
+		int		RequestTexture2D(
+					AssetPack * pPack,
+					const char * path,
+					Texture2D * pTexOut,
+					int priority = 0,
+					Callback const & callback = Callback());
+
+		// Both return false if the request is unknown or already delivered
+		bool	Cancel(int request);
+		bool	SetPriority(int request, int priority);
+
+		// Call once per frame from the main thread: delivers finished loads into the
+		// caller's objects and runs their callbacks.  Returns the number delivered.
+		int		Update();
+
+		// Number of requests not yet delivered
+		int		NumOutstanding();
+
+	private:
+		struct Request;
+		typedef std::pair<int, int> QueueKey;		// (-priority, id), so the map's first element is next up
+
+		int		AddRequest(Request * pRequest);
+		void	WorkerThread();
+
+		std::vector<std::thread>				m_threads;
+		std::mutex								m_mutex;			// Protects everything below
+		std::condition_variable					m_cvWork;
+		std::map<QueueKey, Request *>			m_queue;			// Requests waiting for a thread
+		std::unordered_map<int, Request *>		m_requests;			// All outstanding requests, by id
+		std::vector<Request *>					m_completed;		// Loaded and waiting for Update()
+		int										m_nextId;
+		bool									m_shutdown;
+	};
+}
@@ -0,0 +1,1064 @@
+#include "framework.h"
+
+namespace Framework
+{
+	// Pixels of one block, as floats in [0, 255], in row-major order
+	typedef float BlockPoints[16][4];
+
+	// Encode in one thread if an image has fewer blocks than this
+	static const int s_blocksMinForThreads = 256;
+
+	// Iterations to find the principal axis of a block's colors
+	static const int s_powerIterations = 4;
+
+	static const int s_allPixels[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+	// Expand an n-bit endpoint value to 8 bits by replicating its high bits into the low ones
+	static inline int ExpandBits(int value, int bits)
+	{
+		return (value << (8 - bits)) | (value >> (2 * bits - 8));
+	}
+
+	// Writes the fields of a block, least significant bit first
+	struct BlockBitWriter
+	{
+		byte *	m_pBlock;
+		int		m_bitPos;
+
+		BlockBitWriter(byte * pBlock, int sizeBytes)
+		:	m_pBlock(pBlock),
+			m_bitPos(0)
+		{
+			memset(pBlock, 0, sizeBytes);
+		}
+
+		void Write(u32 value, int bits)
+		{
+			for (int i = 0; i < bits; ++i, ++m_bitPos)
+				m_pBlock[m_bitPos >> 3] |= byte(((value >> i) & 1) << (m_bitPos & 7));
+		}
+	};
+
+	// Find the direction a set of points varies most along, by power iteration on their
+	// covariance matrix (given as sums, not divided by the count).  Returns the sum of squared
+	// distances of the points from that line, which is how far they are from being encodable
+	// with no error.
+	static float FindPrincipalAxis(
+		float (*cov)[4],
+		int channels,
+		float * axisOut)
+	{
+		// Start from the channel with the most variance
+		float trace = 0.0f;
+		int cMax = 0;
+		for (int a = 0; a < channels; ++a)
+		{
+			for (int b = 0; b < a; ++b)
+				cov[a][b] = cov[b][a];
+			trace += cov[a][a];
+			if (cov[a][a] > cov[cMax][cMax])
+				cMax = a;
+		}
+
+		float axis[4] = {};
+		if (cov[cMax][cMax] > 1e-6f)
+		{
+			for (int c = 0; c < channels; ++c)
+				axis[c] = cov[cMax][c];
+
+			// Rescale by the largest component as we go, and to unit length at the end
+			for (int iter = 0; iter < s_powerIterations; ++iter)
+			{
+				float next[4] = {};
+				float largest = 0.0f;
+				for (int a = 0; a < channels; ++a)
+				{
+					for (int b = 0; b < channels; ++b)
+						next[a] += cov[a][b] * axis[b];
+					largest = max(largest, fabsf(next[a]));
+				}
+				float scale = 1.0f / largest;
+				for (int c = 0; c < channels; ++c)
+					axis[c] = next[c] * scale;
+			}
+
+			float lengthSq = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				lengthSq += axis[c] * axis[c];
+			float scale = 1.0f / sqrtf(lengthSq);
+			for (int c = 0; c < channels; ++c)
+				axis[c] *= scale;
+		}
+
+		// Variance along the axis is the largest eigenvalue; the rest is off the line
+		float varianceAxis = 0.0f;
+		for (int a = 0; a < channels; ++a)
+		{
+			for (int b = 0; b < channels; ++b)
+				varianceAxis += axis[a] * cov[a][b] * axis[b];
+		}
+
+		for (int c = 0; c < 4; ++c)
+			axisOut[c] = axis[c];
+		return max(trace - varianceAxis, 0.0f);
+	}
+
+	// Mean and principal axis of a subset of a block's pixels
+	static float FindPrincipalAxis(
+		const BlockPoints & points,
+		const int * pixels,
+		int count,
+		int channels,
+		float * meanOut,
+		float * axisOut)
+	{
+		float mean[4] = {};
+		for (int i = 0; i < count; ++i)
+		{
+			for (int c = 0; c < channels; ++c)
+				mean[c] += points[pixels[i]][c];
+		}
+		for (int c = 0; c < 4; ++c)
+			meanOut[c] = mean[c] / float(count);
+
+		float cov[4][4] = {};
+		for (int i = 0; i < count; ++i)
+		{
+			float d[4];
+			for (int c = 0; c < channels; ++c)
+				d[c] = points[pixels[i]][c] - meanOut[c];
+			for (int a = 0; a < channels; ++a)
+			{
+				for (int b = a; b < channels; ++b)
+					cov[a][b] += d[a] * d[b];
+			}
+		}
+
+		return FindPrincipalAxis(cov, channels, axisOut);
+	}
+
+	// Endpoints at the extremes of the points' projections onto the axis
+	static void FindEndpointsOnAxis(
+		const BlockPoints & points,
+		const int * pixels,
+		int count,
+		int channels,
+		const float * mean,
+		const float * axis,
+		float * e0Out,
+		float * e1Out)
+	{
+		float tMin = FLT_MAX, tMax = -FLT_MAX;
+		for (int i = 0; i < count; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (points[pixels[i]][c] - mean[c]) * axis[c];
+			tMin = min(tMin, t);
+			tMax = max(tMax, t);
+		}
+
+		for (int c = 0; c < channels; ++c)
+		{
+			e0Out[c] = clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+			e1Out[c] = clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+		}
+	}
+
+	// Least-squares fit of a pair of endpoints to the points, given how much of each point's
+	// interpolated value comes from endpoint 0.  Returns false if all the weights are the same,
+	// so there's no unique solution.
+	static bool FitEndpoints(
+		const BlockPoints & points,
+		const int * pixels,
+		int count,
+		int channels,
+		const float * weights0,
+		float * e0Out,
+		float * e1Out)
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < count; ++i)
+		{
+			float a = weights0[i];
+			float b = 1.0f - a;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channels; ++c)
+			{
+				ax[c] += a * points[pixels[i]][c];
+				bx[c] += b * points[pixels[i]][c];
+			}
+		}
+
+		float det = aa * bb - ab * ab;
+		if (det < 1e-4f)
+			return false;
+
+		float detInv = 1.0f / det;
+		for (int c = 0; c < channels; ++c)
+		{
+			e0Out[c] = clamp((ax[c] * bb - bx[c] * ab) * detInv, 0.0f, 255.0f);
+			e1Out[c] = clamp((bx[c] * aa - ax[c] * ab) * detInv, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+
+
+	// BC1 color blocks, also used for the color half of BC3
+
+	// For each 8-bit value, the pair of 5-bit or 6-bit endpoints whose one-third blend comes
+	// closest to it, for encoding blocks of a single color
+	struct BC1SingleColorTable
+	{
+		byte	m_endpoints5[256][2];
+		byte	m_endpoints6[256][2];
+
+		BC1SingleColorTable()
+		{
+			Build(5, m_endpoints5);
+			Build(6, m_endpoints6);
+		}
+
+		static void Build(int bits, byte (*endpointsOut)[2])
+		{
+			int count = 1 << bits;
+			for (int value = 0; value < 256; ++value)
+			{
+				// Palette entry 2 is (2 * c0 + c1) / 3; compare in thirds to stay in integers
+				int errBest = 3 * 256;
+				for (int a = 0; a < count; ++a)
+				{
+					for (int b = 0; b < count; ++b)
+					{
+						int err = abs(2 * ExpandBits(a, bits) + ExpandBits(b, bits) - 3 * value);
+						if (err < errBest)
+						{
+							errBest = err;
+							endpointsOut[value][0] = byte(a);
+							endpointsOut[value][1] = byte(b);
+						}
+					}
+				}
+			}
+		}
+	};
+
+	static const BC1SingleColorTable & GetBC1SingleColorTable()
+	{
+		static const BC1SingleColorTable s_table;
+		return s_table;
+	}
+
+	static u16 QuantizeBC1Endpoint(const float * color)
+	{
+		int r = clamp(int(color[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+		int g = clamp(int(color[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+		int b = clamp(int(color[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+		return u16((r << 11) | (g << 5) | b);
+	}
+
+	// Pick the nearest 4-color mode palette entry for each pixel; returns the squared error
+	static float FindBC1Indices(
+		const BlockPoints & points,
+		u16 c0,
+		u16 c1,
+		u32 * pIndicesOut)
+	{
+		int e0[3] = { ExpandBits(c0 >> 11, 5), ExpandBits((c0 >> 5) & 63, 6), ExpandBits(c0 & 31, 5) };
+		int e1[3] = { ExpandBits(c1 >> 11, 5), ExpandBits((c1 >> 5) & 63, 6), ExpandBits(c1 & 31, 5) };
+		float palette[4][3];
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[0][c] = float(e0[c]);
+			palette[1][c] = float(e1[c]);
+			palette[2][c] = float(2 * e0[c] + e1[c]) * (1.0f / 3.0f);
+			palette[3][c] = float(e0[c] + 2 * e1[c]) * (1.0f / 3.0f);
+		}
+
+		float errTotal = 0.0f;
+		u32 indices = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			float errBest = FLT_MAX;
+			int iBest = 0;
+			for (int j = 0; j < 4; ++j)
+			{
+				float err = square(points[i][0] - palette[j][0]) +
+							square(points[i][1] - palette[j][1]) +
+							square(points[i][2] - palette[j][2]);
+				if (err < errBest)
+				{
+					errBest = err;
+					iBest = j;
+				}
+			}
+			indices |= u32(iBest) << (2 * i);
+			errTotal += errBest;
+		}
+
+		*pIndicesOut = indices;
+		return errTotal;
+	}
+
+	static void EncodeBC1ColorBlock(
+		const BlockPoints & points,
+		byte * pBlockOut)
+	{
+		bool solid = true;
+		for (int i = 1; i < 16 && solid; ++i)
+		{
+			solid = (points[i][0] == points[0][0] &&
+					 points[i][1] == points[0][1] &&
+					 points[i][2] == points[0][2]);
+		}
+
+		u16 c0, c1;
+		u32 indices;
+		if (solid)
+		{
+			const BC1SingleColorTable & table = GetBC1SingleColorTable();
+			int r = int(points[0][0]), g = int(points[0][1]), b = int(points[0][2]);
+			c0 = u16((table.m_endpoints5[r][0] << 11) | (table.m_endpoints6[g][0] << 5) | table.m_endpoints5[b][0]);
+			c1 = u16((table.m_endpoints5[r][1] << 11) | (table.m_endpoints6[g][1] << 5) | table.m_endpoints5[b][1]);
+			indices = 0xaaaaaaaa;		// All palette entry 2
+		}
+		else
+		{
+			float mean[4], axis[4], e0[4], e1[4];
+			FindPrincipalAxis(points, s_allPixels, 16, 3, mean, axis);
+			FindEndpointsOnAxis(points, s_allPixels, 16, 3, mean, axis, e0, e1);
+			c0 = QuantizeBC1Endpoint(e0);
+			c1 = QuantizeBC1Endpoint(e1);
+			float err = FindBC1Indices(points, c0, c1, &indices);
+
+			// Refit the endpoints to the chosen indices, as long as that keeps helping
+			static const float s_weights0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			for (int iter = 0; iter < 2 && err > 0.0f; ++iter)
+			{
+				float weights0[16];
+				for (int i = 0; i < 16; ++i)
+					weights0[i] = s_weights0[(indices >> (2 * i)) & 3];
+				if (!FitEndpoints(points, s_allPixels, 16, 3, weights0, e0, e1))
+					break;
+
+				u16 c0New = QuantizeBC1Endpoint(e0);
+				u16 c1New = QuantizeBC1Endpoint(e1);
+				u32 indicesNew;
+				float errNew = FindBC1Indices(points, c0New, c1New, &indicesNew);
+				if (errNew >= err)
+					break;
+
+				c0 = c0New;
+				c1 = c1New;
+				indices = indicesNew;
+				err = errNew;
+			}
+		}
+
+		// 4-color mode needs c0 > c1; swapping the endpoints swaps palette entries 0/1 and 2/3
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+			indices ^= 0x55555555;
+		}
+		else if (c0 == c1)
+		{
+			indices = 0;
+		}
+
+		pBlockOut[0] = byte(c0);
+		pBlockOut[1] = byte(c0 >> 8);
+		pBlockOut[2] = byte(c1);
+		pBlockOut[3] = byte(c1 >> 8);
+		for (int i = 0; i < 4; ++i)
+			pBlockOut[4 + i] = byte(indices >> (8 * i));
+	}
+
+
+
+	// BC4 blocks, also used for each channel of BC5 and the alpha half of BC3
+
+	// Pick the nearest palette entry for each value; returns the squared error.  The palette
+	// is 8 interpolated values if a0 > a1, otherwise 6 plus exact 0 and 255.
+	static float FindBC4Indices(
+		const BlockPoints & values,
+		int a0,
+		int a1,
+		u64 * pIndicesOut)
+	{
+		float palette[8] = { float(a0), float(a1) };
+		if (a0 > a1)
+		{
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = float((7 - i) * a0 + i * a1) * (1.0f / 7.0f);
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				palette[i + 1] = float((5 - i) * a0 + i * a1) * (1.0f / 5.0f);
+			palette[6] = 0.0f;
+			palette[7] = 255.0f;
+		}
+
+		float errTotal = 0.0f;
+		u64 indices = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			float errBest = FLT_MAX;
+			int iBest = 0;
+			for (int j = 0; j < 8; ++j)
+			{
+				float err = square(values[i][0] - palette[j]);
+				if (err < errBest)
+				{
+					errBest = err;
+					iBest = j;
+				}
+			}
+			indices |= u64(iBest) << (3 * i);
+			errTotal += errBest;
+		}
+
+		*pIndicesOut = indices;
+		return errTotal;
+	}
+
+	static void EncodeBC4Block(
+		const BlockPoints & points,
+		int channel,
+		byte * pBlockOut)
+	{
+		// Work on the one channel, moved to the front
+		BlockPoints values;
+		float vMin = 255.0f, vMax = 0.0f;
+		float vMinInner = 255.0f, vMaxInner = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			float v = points[i][channel];
+			values[i][0] = v;
+			vMin = min(vMin, v);
+			vMax = max(vMax, v);
+			if (v > 0.0f && v < 255.0f)
+			{
+				vMinInner = min(vMinInner, v);
+				vMaxInner = max(vMaxInner, v);
+			}
+		}
+
+		int a0, a1;
+		u64 indices;
+		if (vMin == vMax)
+		{
+			a0 = a1 = int(vMin);
+			indices = 0;
+		}
+		else
+		{
+			// 8-value mode, with the endpoints at the extremes, then refit to the chosen indices
+			a0 = int(vMax);
+			a1 = int(vMin);
+			float err = FindBC4Indices(values, a0, a1, &indices);
+
+			static const float s_weights0[8] = { 1.0f, 0.0f, 6.0f / 7.0f, 5.0f / 7.0f, 4.0f / 7.0f, 3.0f / 7.0f, 2.0f / 7.0f, 1.0f / 7.0f };
+			float weights0[16];
+			for (int i = 0; i < 16; ++i)
+				weights0[i] = s_weights0[(indices >> (3 * i)) & 7];
+			float e0, e1;
+			if (err > 0.0f && FitEndpoints(values, s_allPixels, 16, 1, weights0, &e0, &e1))
+			{
+				int a0New = int(e0 + 0.5f);
+				int a1New = int(e1 + 0.5f);
+				u64 indicesNew;
+				if (a0New > a1New)
+				{
+					float errNew = FindBC4Indices(values, a0New, a1New, &indicesNew);
+					if (errNew < err)
+					{
+						a0 = a0New;
+						a1 = a1New;
+						indices = indicesNew;
+						err = errNew;
+					}
+				}
+			}
+
+			// 6-value mode, spanning just the values between 0 and 255, which it has exactly
+			if (err > 0.0f)
+			{
+				int b0 = (vMinInner <= vMaxInner) ? int(vMinInner) : 0;
+				int b1 = (vMinInner <= vMaxInner) ? int(vMaxInner) : 0;
+				u64 indices6;
+				if (FindBC4Indices(values, b0, b1, &indices6) < err)
+				{
+					a0 = b0;
+					a1 = b1;
+					indices = indices6;
+				}
+			}
+		}
+
+		pBlockOut[0] = byte(a0);
+		pBlockOut[1] = byte(a1);
+		for (int i = 0; i < 6; ++i)
+			pBlockOut[2 + i] = byte(indices >> (8 * i));
+	}
+
+
+
+	// BC7 blocks: modes 1, 4, 5, and 6 only
+
+	static const int s_bc7Weights2[4] = { 0, 21, 43, 64 };
+	static const int s_bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+	static const int s_bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Two-subset partitions: bit i is set if pixel i is in subset 1
+	static const u16 s_bc7Partitions2[64] =
+	{
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+	};
+
+	// Anchor pixel of subset 1 in each partition; subset 0's is always pixel 0
+	static const byte s_bc7Anchors2[64] =
+	{
+		15, 15, 15, 15, 15, 15, 15, 15,
+		15, 15, 15, 15, 15, 15, 15, 15,
+		15,  2,  8,  2,  2,  8,  8, 15,
+		 2,  8,  2,  2,  8,  8,  2,  2,
+		15, 15,  6,  8,  2,  8, 15, 15,
+		 2,  8,  2,  2,  2, 15, 15,  6,
+		 6,  2,  6,  8, 15, 15,  2,  2,
+		15, 15, 15, 15, 15,  2,  2, 15,
+	};
+
+	enum BC7PBITS				// How a mode's endpoints get their p-bits (extra shared low bit)
+	{
+		BC7PBITS_None,
+		BC7PBITS_Shared,		// One for both endpoints of a subset
+		BC7PBITS_PerEndpoint,
+	};
+
+	// How one subset of a block is encoded in a given mode
+	struct BC7SubsetMode
+	{
+		int				m_channels;
+		int				m_endpointBits;		// Including the p-bit, if any
+		BC7PBITS		m_pbits;
+		const int *		m_weights;
+		int				m_numWeights;
+	};
+
+	static const BC7SubsetMode s_bc7Mode1 = { 3, 7, BC7PBITS_Shared, s_bc7Weights3, 8 };
+	static const BC7SubsetMode s_bc7Mode4Color2 = { 3, 5, BC7PBITS_None, s_bc7Weights2, 4 };
+	static const BC7SubsetMode s_bc7Mode4Color3 = { 3, 5, BC7PBITS_None, s_bc7Weights3, 8 };
+	static const BC7SubsetMode s_bc7Mode4Alpha2 = { 1, 6, BC7PBITS_None, s_bc7Weights2, 4 };
+	static const BC7SubsetMode s_bc7Mode4Alpha3 = { 1, 6, BC7PBITS_None, s_bc7Weights3, 8 };
+	static const BC7SubsetMode s_bc7Mode5Color = { 3, 7, BC7PBITS_None, s_bc7Weights2, 4 };
+	static const BC7SubsetMode s_bc7Mode5Alpha = { 1, 8, BC7PBITS_None, s_bc7Weights2, 4 };
+	static const BC7SubsetMode s_bc7Mode6 = { 4, 8, BC7PBITS_PerEndpoint, s_bc7Weights4, 16 };
+
+	// Quantize an endpoint value to the given bits, with the given low bit if pbit >= 0, and
+	// expand it back to 8 bits as the decoder will
+	static int QuantizeBC7Endpoint(float value, int bits, int pbit)
+	{
+		float scaled = value * float((1 << bits) - 1) * (1.0f / 255.0f);
+		int quantized;
+		if (pbit < 0)
+			quantized = clamp(int(scaled + 0.5f), 0, (1 << bits) - 1);
+		else
+			quantized = (clamp(int(floorf((scaled - float(pbit)) * 0.5f + 0.5f)), 0, (1 << (bits - 1)) - 1) << 1) | pbit;
+		return ExpandBits(quantized, bits);
+	}
+
+	// Pick the nearest palette entry for each of a subset's pixels.  The palette is evenly
+	// spaced along the endpoint line, up to rounding, so it's enough to check the entries
+	// either side of each pixel's projection.  Returns the squared error.
+	static float FindBC7Indices(
+		const BlockPoints & points,
+		const int * pixels,
+		int count,
+		const BC7SubsetMode & mode,
+		const int * e0,
+		const int * e1,
+		int * indicesOut)
+	{
+		int channels = mode.m_channels;
+		int numWeights = mode.m_numWeights;
+
+		int palette[16][4];
+		for (int j = 0; j < numWeights; ++j)
+		{
+			int weight = mode.m_weights[j];
+			for (int c = 0; c < channels; ++c)
+				palette[j][c] = ((64 - weight) * e0[c] + weight * e1[c] + 32) >> 6;
+		}
+
+		float dir[4];
+		float dirLengthSq = 0.0f;
+		for (int c = 0; c < channels; ++c)
+		{
+			dir[c] = float(e1[c] - e0[c]);
+			dirLengthSq += dir[c] * dir[c];
+		}
+		float projScale = (dirLengthSq > 0.0f) ? float(numWeights - 1) / dirLengthSq : 0.0f;
+
+		float errTotal = 0.0f;
+		for (int i = 0; i < count; ++i)
+		{
+			const float * point = points[pixels[i]];
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (point[c] - float(e0[c])) * dir[c];
+			int jGuess = clamp(int(t * projScale + 0.5f), 0, numWeights - 1);
+
+			float errBest = FLT_MAX;
+			int jBest = jGuess;
+			for (int j = max(jGuess - 1, 0), jEnd = min(jGuess + 1, numWeights - 1); j <= jEnd; ++j)
+			{
+				float err = 0.0f;
+				for (int c = 0; c < channels; ++c)
+					err += square(point[c] - float(palette[j][c]));
+				if (err < errBest)
+				{
+					errBest = err;
+					jBest = j;
+				}
+			}
+
+			indicesOut[pixels[i]] = jBest;
+			errTotal += errBest;
+		}
+
+		return errTotal;
+	}
+
+	// Encode one subset of a block: fit a line, try each allowed combination of p-bits, and
+	// refit the endpoints to the chosen indices by least squares.  The endpoints come out
+	// expanded to 8 bits; indices are stored by pixel.  Returns the squared error.
+	static float EncodeBC7Subset(
+		const BlockPoints & points,
+		const int * pixels,
+		int count,
+		const BC7SubsetMode & mode,
+		int * e0Out,
+		int * e1Out,
+		int * indicesOut)
+	{
+		int channels = mode.m_channels;
+		float mean[4], axis[4], e0f[4], e1f[4];
+		FindPrincipalAxis(points, pixels, count, channels, mean, axis);
+		FindEndpointsOnAxis(points, pixels, count, channels, mean, axis, e0f, e1f);
+
+		int numCombos = (mode.m_pbits == BC7PBITS_PerEndpoint) ? 4 : (mode.m_pbits == BC7PBITS_Shared) ? 2 : 1;
+		int indicesBest[16];
+		float errBest = FLT_MAX;
+		for (int iter = 0; iter < 3; ++iter)
+		{
+			for (int combo = 0; combo < numCombos; ++combo)
+			{
+				int pbit0 = (mode.m_pbits == BC7PBITS_None) ? -1 : (combo & 1);
+				int pbit1 = (mode.m_pbits == BC7PBITS_PerEndpoint) ? (combo >> 1) : pbit0;
+				int e0[4], e1[4], indices[16];
+				for (int c = 0; c < channels; ++c)
+				{
+					e0[c] = QuantizeBC7Endpoint(e0f[c], mode.m_endpointBits, pbit0);
+					e1[c] = QuantizeBC7Endpoint(e1f[c], mode.m_endpointBits, pbit1);
+				}
+				float err = FindBC7Indices(points, pixels, count, mode, e0, e1, indices);
+				if (err < errBest)
+				{
+					errBest = err;
+					memcpy(e0Out, e0, channels * sizeof(int));
+					memcpy(e1Out, e1, channels * sizeof(int));
+					memcpy(indicesBest, indices, sizeof(indices));
+				}
+			}
+
+			if (errBest == 0.0f || iter == 2)
+				break;
+			float weights0[16];
+			for (int i = 0; i < count; ++i)
+				weights0[i] = float(64 - mode.m_weights[indicesBest[pixels[i]]]) * (1.0f / 64.0f);
+			if (!FitEndpoints(points, pixels, count, channels, weights0, e0f, e1f))
+				break;
+		}
+
+		for (int i = 0; i < count; ++i)
+			indicesOut[pixels[i]] = indicesBest[pixels[i]];
+		return errBest;
+	}
+
+	// Each subset's anchor pixel has an implicit 0 high bit in its index.  If it's set, swap
+	// the subset's endpoints and flip its indices.
+	static void FixBC7Anchor(
+		const int * pixels,
+		int count,
+		int anchor,
+		int channels,
+		int numWeights,
+		int * e0,
+		int * e1,
+		int * indices)
+	{
+		if (indices[anchor] < numWeights / 2)
+			return;
+		for (int c = 0; c < channels; ++c)
+			std::swap(e0[c], e1[c]);
+		for (int i = 0; i < count; ++i)
+			indices[pixels[i]] = numWeights - 1 - indices[pixels[i]];
+	}
+
+	// Mode 6: one RGBA subset, 7-bit endpoints with a p-bit each, 4-bit indices.
+	// Returns the squared error.
+	static float EncodeBC7Mode6(
+		const BlockPoints & points,
+		byte * pBlockOut)
+	{
+		int e0[4], e1[4], indices[16];
+		float err = EncodeBC7Subset(points, s_allPixels, 16, s_bc7Mode6, e0, e1, indices);
+		FixBC7Anchor(s_allPixels, 16, 0, 4, 16, e0, e1, indices);
+
+		BlockBitWriter bits(pBlockOut, 16);
+		bits.Write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			bits.Write(e0[c] >> 1, 7);
+			bits.Write(e1[c] >> 1, 7);
+		}
+		bits.Write(e0[0] & 1, 1);
+		bits.Write(e1[0] & 1, 1);
+		for (int i = 0; i < 16; ++i)
+			bits.Write(indices[i], (i == 0) ? 3 : 4);
+
+		return err;
+	}
+
+	// Modes 4 and 5: RGB and alpha fit separately, each with its own indices, for alpha that
+	// doesn't follow the color.  Mode 4 has 5-bit color and 6-bit alpha endpoints, and 2-bit
+	// indices for one and 3-bit for the other, per indexMode; mode 5 has 7-bit color and
+	// 8-bit alpha endpoints, and 2-bit indices for both.  (The channel rotation they allow
+	// isn't used.)  Returns the squared error.
+	static float EncodeBC7SeparateAlpha(
+		const BlockPoints & points,
+		int blockMode,
+		int indexMode,
+		byte * pBlockOut)
+	{
+		ASSERT_ERR(blockMode == 4 || blockMode == 5);
+
+		const BC7SubsetMode & modeColor = (blockMode == 5) ? s_bc7Mode5Color : indexMode ? s_bc7Mode4Color3 : s_bc7Mode4Color2;
+		const BC7SubsetMode & modeAlpha = (blockMode == 5) ? s_bc7Mode5Alpha : indexMode ? s_bc7Mode4Alpha2 : s_bc7Mode4Alpha3;
+
+		BlockPoints alphas;
+		for (int i = 0; i < 16; ++i)
+			alphas[i][0] = points[i][3];
+
+		int e0[4], e1[4], a0[4], a1[4], indicesColor[16], indicesAlpha[16];
+		float err = EncodeBC7Subset(points, s_allPixels, 16, modeColor, e0, e1, indicesColor) +
+					EncodeBC7Subset(alphas, s_allPixels, 16, modeAlpha, a0, a1, indicesAlpha);
+		FixBC7Anchor(s_allPixels, 16, 0, 3, modeColor.m_numWeights, e0, e1, indicesColor);
+		FixBC7Anchor(s_allPixels, 16, 0, 1, modeAlpha.m_numWeights, a0, a1, indicesAlpha);
+
+		BlockBitWriter bits(pBlockOut, 16);
+		bits.Write(1 << blockMode, blockMode + 1);
+		bits.Write(0, 2);		// Rotation
+		if (blockMode == 4)
+			bits.Write(indexMode, 1);
+		for (int c = 0; c < 3; ++c)
+		{
+			bits.Write(e0[c] >> (8 - modeColor.m_endpointBits), modeColor.m_endpointBits);
+			bits.Write(e1[c] >> (8 - modeColor.m_endpointBits), modeColor.m_endpointBits);
+		}
+		bits.Write(a0[0] >> (8 - modeAlpha.m_endpointBits), modeAlpha.m_endpointBits);
+		bits.Write(a1[0] >> (8 - modeAlpha.m_endpointBits), modeAlpha.m_endpointBits);
+
+		// The set of 2-bit indices comes first
+		bool colorFirst = (modeColor.m_numWeights <= modeAlpha.m_numWeights);
+		const int * indicesSets[2] = { colorFirst ? indicesColor : indicesAlpha, colorFirst ? indicesAlpha : indicesColor };
+		int indexBits[2] = { log2_floor(colorFirst ? modeColor.m_numWeights : modeAlpha.m_numWeights),
+							 log2_floor(colorFirst ? modeAlpha.m_numWeights : modeColor.m_numWeights) };
+		for (int set = 0; set < 2; ++set)
+		{
+			for (int i = 0; i < 16; ++i)
+				bits.Write(indicesSets[set][i], (i == 0) ? indexBits[set] - 1 : indexBits[set]);
+		}
+
+		return err;
+	}
+
+	// Split a block into the two subsets of a partition
+	static void SplitBC7Partition(
+		int partition,
+		int (*pixelsOut)[16],
+		int * countsOut)
+	{
+		countsOut[0] = countsOut[1] = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int subset = (s_bc7Partitions2[partition] >> i) & 1;
+			pixelsOut[subset][countsOut[subset]++] = i;
+		}
+	}
+
+	// Mode 1: two RGB subsets, 6-bit endpoints with a shared p-bit per subset, 3-bit indices.
+	// Returns the squared error.
+	static float EncodeBC7Mode1(
+		const BlockPoints & points,
+		byte * pBlockOut)
+	{
+		// Rank the partitions by how well a line fits each subset, before quantization.  The
+		// covariances come from sums of the pixels and their products, which are quick to
+		// split: sum subset 1's, and subtract them from the whole block's for subset 0.
+		float sums[16][3], products[16][6];
+		float sumsBlock[3] = {}, productsBlock[6] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			const float * p = points[i];
+			float values[9] =
+			{
+				p[0], p[1], p[2],
+				p[0] * p[0], p[0] * p[1], p[0] * p[2], p[1] * p[1], p[1] * p[2], p[2] * p[2],
+			};
+			for (int j = 0; j < 3; ++j)
+				sumsBlock[j] += (sums[i][j] = values[j]);
+			for (int j = 0; j < 6; ++j)
+				productsBlock[j] += (products[i][j] = values[3 + j]);
+		}
+
+		int partitionsTry[2] = {};
+		float fitsTry[2] = { FLT_MAX, FLT_MAX };
+		for (int partition = 0; partition < 64; ++partition)
+		{
+			float sumsSubset[2][3] = {}, productsSubset[2][6] = {};
+			int count1 = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				if ((s_bc7Partitions2[partition] >> i) & 1)
+				{
+					for (int j = 0; j < 3; ++j)
+						sumsSubset[1][j] += sums[i][j];
+					for (int j = 0; j < 6; ++j)
+						productsSubset[1][j] += products[i][j];
+					++count1;
+				}
+			}
+			for (int j = 0; j < 3; ++j)
+				sumsSubset[0][j] = sumsBlock[j] - sumsSubset[1][j];
+			for (int j = 0; j < 6; ++j)
+				productsSubset[0][j] = productsBlock[j] - productsSubset[1][j];
+
+			float fit = 0.0f;
+			for (int subset = 0; subset < 2; ++subset)
+			{
+				const float * s = sumsSubset[subset];
+				const float * pr = productsSubset[subset];
+				float countInv = 1.0f / float(subset ? count1 : 16 - count1);
+				float cov[4][4] = {};
+				cov[0][0] = pr[0] - s[0] * s[0] * countInv;
+				cov[0][1] = pr[1] - s[0] * s[1] * countInv;
+				cov[0][2] = pr[2] - s[0] * s[2] * countInv;
+				cov[1][1] = pr[3] - s[1] * s[1] * countInv;
+				cov[1][2] = pr[4] - s[1] * s[2] * countInv;
+				cov[2][2] = pr[5] - s[2] * s[2] * countInv;
+				float axis[4];
+				fit += FindPrincipalAxis(cov, 3, axis);
+			}
+
+			if (fit < fitsTry[1])
+			{
+				int slot = (fit < fitsTry[0]) ? 0 : 1;
+				if (slot == 0)
+				{
+					partitionsTry[1] = partitionsTry[0];
+					fitsTry[1] = fitsTry[0];
+				}
+				partitionsTry[slot] = partition;
+				fitsTry[slot] = fit;
+			}
+		}
+
+		// Fully encode the two most promising
+		int partitionBest = 0;
+		int e0Best[2][4], e1Best[2][4], indicesBest[16];
+		float errBest = FLT_MAX;
+		for (int iTry = 0; iTry < 2; ++iTry)
+		{
+			int pixels[2][16], counts[2];
+			SplitBC7Partition(partitionsTry[iTry], pixels, counts);
+
+			int e0[2][4], e1[2][4], indices[16];
+			float err = EncodeBC7Subset(points, pixels[0], counts[0], s_bc7Mode1, e0[0], e1[0], indices) +
+						EncodeBC7Subset(points, pixels[1], counts[1], s_bc7Mode1, e0[1], e1[1], indices);
+			if (err < errBest)
+			{
+				errBest = err;
+				partitionBest = partitionsTry[iTry];
+				memcpy(e0Best, e0, sizeof(e0));
+				memcpy(e1Best, e1, sizeof(e1));
+				memcpy(indicesBest, indices, sizeof(indices));
+			}
+		}
+
+		int pixels[2][16], counts[2];
+		SplitBC7Partition(partitionBest, pixels, counts);
+		int anchors[2] = { 0, s_bc7Anchors2[partitionBest] };
+		for (int subset = 0; subset < 2; ++subset)
+			FixBC7Anchor(pixels[subset], counts[subset], anchors[subset], 3, 8, e0Best[subset], e1Best[subset], indicesBest);
+
+		// Stored endpoints are the top 6 of the 7 bits; the 7th is the p-bit
+		BlockBitWriter bits(pBlockOut, 16);
+		bits.Write(1 << 1, 2);
+		bits.Write(partitionBest, 6);
+		for (int c = 0; c < 3; ++c)
+		{
+			for (int subset = 0; subset < 2; ++subset)
+			{
+				bits.Write(e0Best[subset][c] >> 2, 6);
+				bits.Write(e1Best[subset][c] >> 2, 6);
+			}
+		}
+		bits.Write((e0Best[0][0] >> 1) & 1, 1);
+		bits.Write((e0Best[1][0] >> 1) & 1, 1);
+		for (int i = 0; i < 16; ++i)
+			bits.Write(indicesBest[i], (i == anchors[0] || i == anchors[1]) ? 2 : 3);
+
+		return errBest;
+	}
+
+	static void EncodeBC7Block(
+		const BlockPoints & points,
+		byte * pBlockOut)
+	{
+		float err = EncodeBC7Mode6(points, pBlockOut);
+		if (err == 0.0f)
+			return;
+
+		// Mode 1 splits the colors better, but has no alpha; modes 4 and 5 keep alpha separate
+		bool opaque = true;
+		for (int i = 0; i < 16 && opaque; ++i)
+			opaque = (points[i][3] == 255.0f);
+
+		byte blockOther[16];
+		if (opaque)
+		{
+			if (EncodeBC7Mode1(points, blockOther) < err)
+				memcpy(pBlockOut, blockOther, sizeof(blockOther));
+			return;
+		}
+
+		static const int s_separateAlphaModes[][2] = { { 5, 0 }, { 4, 0 }, { 4, 1 } };
+		for (int i = 0; i < dim(s_separateAlphaModes); ++i)
+		{
+			float errOther = EncodeBC7SeparateAlpha(points, s_separateAlphaModes[i][0], s_separateAlphaModes[i][1], blockOther);
+			if (errOther < err)
+			{
+				err = errOther;
+				memcpy(pBlockOut, blockOther, sizeof(blockOther));
+			}
+		}
+	}
+
+
+
+	// Image encoding entry points
+
+	int BCBlockSizeInBytes(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_UNORM:
+			return 8;
+
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_UNORM:
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return 16;
+
+		default:
+			return 0;
+		}
+	}
+
+	void EncodeBCImage(
+		DXGI_FORMAT format,
+		const byte4 * pPixels,
+		int2 dims,
+		std::vector<byte> * pDataOut)
+	{
+		ASSERT_ERR(pPixels);
+		ASSERT_ERR(all(dims > 0));
+		ASSERT_ERR(pDataOut);
+
+		int blockSize = BCBlockSizeInBytes(format);
+		ASSERT_ERR_MSG(blockSize > 0, "Unsupported format %d for BCn encoding", format);
+
+		int2 dimsBlocks = { (dims.x + 3) / 4, (dims.y + 3) / 4 };
+		pDataOut->resize(dimsBlocks.x * dimsBlocks.y * blockSize);
+		byte * pData = &(*pDataOut)[0];
+
+		ParallelFor(dimsBlocks.y, [&](int yBlock)
+		{
+			for (int xBlock = 0; xBlock < dimsBlocks.x; ++xBlock)
+			{
+				// Gather the block's pixels, repeating the last row and column past the edges
+				BlockPoints points;
+				for (int i = 0; i < 16; ++i)
+				{
+					int x = min(xBlock * 4 + (i & 3), dims.x - 1);
+					int y = min(yBlock * 4 + (i >> 2), dims.y - 1);
+					byte4 pixel = pPixels[y * dims.x + x];
+					points[i][0] = float(pixel.x);
+					points[i][1] = float(pixel.y);
+					points[i][2] = float(pixel.z);
+					points[i][3] = float(pixel.w);
+				}
+
+				byte * pBlock = pData + (yBlock * dimsBlocks.x + xBlock) * blockSize;
+				switch (format)
+				{
+				case DXGI_FORMAT_BC1_UNORM:
+				case DXGI_FORMAT_BC1_UNORM_SRGB:
+					EncodeBC1ColorBlock(points, pBlock);
+					break;
+
+				case DXGI_FORMAT_BC3_UNORM:
+				case DXGI_FORMAT_BC3_UNORM_SRGB:
+					EncodeBC4Block(points, 3, pBlock);
+					EncodeBC1ColorBlock(points, pBlock + 8);
+					break;
+
+				case DXGI_FORMAT_BC4_UNORM:
+					EncodeBC4Block(points, 0, pBlock);
+					break;
+
+				case DXGI_FORMAT_BC5_UNORM:
+					EncodeBC4Block(points, 0, pBlock);
+					EncodeBC4Block(points, 1, pBlock + 8);
+					break;
+
+				case DXGI_FORMAT_BC7_UNORM:
+				case DXGI_FORMAT_BC7_UNORM_SRGB:
+					EncodeBC7Block(points, pBlock);
+					break;
+
+				default:
+					break;
+				}
+			}
+		}, (dimsBlocks.x * dimsBlocks.y >= s_blocksMinForThreads) ? 0 : 1);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+namespace Framework
+{
+	// CPU encoders for the BCn block-compressed texture formats, used by the texture compiler.
+	// Images are split into 4x4 blocks, and partial blocks at the right and bottom edges are
+	// filled out by repeating the last column and row.
+	//
+	//  * BC1, and the color half of BC3, fit a line through the block's colors by principal
+	//      component analysis, then refine the endpoints by least squares.  Always in 4-color
+	//      mode; blocks of a single color get endpoints from a table that matches it best.
+	//
+	//  * BC4, BC5, and the alpha half of BC3 try both the 8-value mode and the 6-value mode
+	//      with exact 0 and 255, keeping whichever has less error.
+	//
+	//  * BC7 tries mode 6 (one RGBA subset, 4-bit indices).  Opaque blocks also try mode 1 (two
+	//      RGB subsets, with the partition picked by line-fit error), and blocks with alpha try
+	//      modes 5 and 4, which fit alpha separately from color.  The other modes aren't
+	//      searched, so it's short of a dedicated BC7 encoder, but well ahead of BC1/BC3.
+	//
+	// Pixels are encoded as given, so pass sRGB-encoded data for the sRGB formats.  BC4 takes
+	// the red channel, and BC5 red and green.
+
+	// Size in bytes of one 4x4 block, or 0 for formats the encoder doesn't support
+	int BCBlockSizeInBytes(DXGI_FORMAT format);
+
+	// Compress an image, splitting the rows of blocks across the job system
+	void EncodeBCImage(
+		DXGI_FORMAT format,
+		const byte4 * pPixels,
+		int2 dims,
+		std::vector<byte> * pDataOut);
+}
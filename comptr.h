@@ -36,10 +36,11 @@ namespace Framework
 
 
 
-	// Reference counting mixin functionality that's interface-compatible with COM
+	// Reference counting mixin functionality that's interface-compatible with COM.
+	// The count is atomic, so references can be taken and dropped from multiple threads.
 	struct RefCount
 	{
-		int		m_cRef;
+		std::atomic<int>	m_cRef;
 
 		RefCount(): m_cRef(0) {}
 		virtual ~RefCount() { ASSERT_ERR(m_cRef == 0); }
@@ -51,8 +52,7 @@ namespace Framework
 		
 		void Release()
 		{
-			--m_cRef;
-			if (m_cRef == 0)
+			if (--m_cRef == 0)
 				delete this;
 		}
 	};
@@ -0,0 +1,305 @@
+// Command-line asset cooker.  On Windows it links with framework.lib as usual; elsewhere,
+// build it with FRAMEWORK_HEADLESS=1 (see framework.h) to run it on a build server.
+//
+// Usage: cooker [-j <threads>] <manifest> <pack path>
+//
+// The manifest lists one root asset per line, as "<kind> <source path> [settings]", where kind
+// is one of the names in s_kinds below.  Assets that roots refer to (material libraries,
+// textures) are picked up automatically.  Source paths are relative to the working directory.
+//
+// Settings are name=value pairs, filling in the corresponding AssetCompileInfo fields:
+//   weld=<epsilon>     obj: weld verts whose positions round to the same point on a grid this size
+//   vcache=<name>      obj: vertex cache optimizer, one of the names in s_vcopts (default forsyth)
+//   vcache_size=<n>    obj: vertex cache size to optimize for (default 32)
+//   overdraw=<0|1>     obj: also sort clusters of triangles to cut overdraw
+//   vtxfmt=<name>      obj: vertex layout, one of the names in s_vtxfmts (default float)
+//   split16=<0|1>      obj: split meshes with over 64K verts into blocks that can use 16-bit indices
+//   lods=<n>           obj: number of simplified LODs to generate (default 0)
+//   lod_ratio=<r>      obj: fraction of triangles each LOD keeps from the one before (default 0.5)
+//   texfmt=<name>      texture, texture_raw: pixel format, one of the names in s_texfmts (default auto)
+//   alpha_coverage=<0|1>  texture: scale alpha in each mip to keep the base level's alpha-test coverage
+//                      (on by default for diffuse textures of alpha-tested materials that aren't roots)
+//   alpha_cutoff=<c>   texture: alpha-test threshold for alpha_coverage (default 0.5)
+//   codec=<name>       any: codec for bulk vertex, index and pixel data, one of the names in s_codecs
+//                      (default stored; assets this one refers to that aren't roots get the same)
+
+#include <framework.h>
+
+using namespace util;
+using namespace Framework;
+
+static const struct
+{
+	const char *	m_name;
+	ACK				m_ack;
+} s_kinds[] =
+{
+	{ "obj",			ACK_OBJMesh, },
+	{ "mtllib",			ACK_OBJMtlLib, },
+	{ "texture",		ACK_TextureWithMips, },
+	{ "texture_raw",	ACK_TextureRaw, },
+};
+
+static const struct
+{
+	const char *	m_name;
+	VCOPT			m_vcopt;
+} s_vcopts[] =
+{
+	{ "forsyth",		VCOPT_Forsyth, },
+	{ "tipsify",		VCOPT_Tipsify, },
+	{ "none",			VCOPT_None, },
+};
+
+static const struct
+{
+	const char *	m_name;
+	VTXFMT			m_vtxfmt;
+} s_vtxfmts[] =
+{
+	{ "float",			VTXFMT_Float, },
+	{ "compact",		VTXFMT_Compact, },
+};
+
+static const struct
+{
+	const char *	m_name;
+	TEXFMT			m_texfmt;
+} s_texfmts[] =
+{
+	{ "auto",			TEXFMT_Auto, },
+	{ "rgba8",			TEXFMT_RGBA8, },
+	{ "bc1or3",			TEXFMT_BC1or3, },
+	{ "bc4",			TEXFMT_BC4, },
+	{ "bc5",			TEXFMT_BC5, },
+	{ "bc7",			TEXFMT_BC7, },
+	{ "r8",				TEXFMT_R8, },
+	{ "rg8",			TEXFMT_RG8, },
+	{ "rgba16f",		TEXFMT_RGBA16F, },
+	{ "r11g11b10f",		TEXFMT_R11G11B10F, },
+};
+
+static const struct
+{
+	const char *	m_name;
+	CODEC			m_codec;
+} s_codecs[] =
+{
+	{ "stored",			CODEC_Stored, },
+	{ "deflate",		CODEC_Deflate, },
+	{ "lz",				CODEC_LZ, },
+};
+
+static bool ParseCookerManifest(
+	const char * path,
+	std::deque<std::string> * pPathsOut,
+	std::vector<AssetCompileInfo> * pAssetsOut)
+{
+	ASSERT_ERR(path);
+	ASSERT_ERR(pPathsOut);
+	ASSERT_ERR(pAssetsOut);
+
+	std::vector<byte> data;
+	if (!LoadFile(path, &data, LFK_Text))
+	{
+		WARN("Couldn't load manifest %s", path);
+		return false;
+	}
+
+	TextParsingHelper tph((char *)&data[0], path);
+	while (tph.NextLine())
+	{
+		char * pKind = tph.NextToken();
+		if (!pKind)
+			continue;
+
+		int iKind = 0;
+		while (iKind < dim(s_kinds) && _stricmp(pKind, s_kinds[iKind].m_name) != 0)
+			++iKind;
+		if (iKind == dim(s_kinds))
+		{
+			WARN("%s: unknown asset kind \"%s\" at line %d", path, pKind, tph.m_iLine);
+			return false;
+		}
+
+		// Deque, so the c_str() pointers stay put as paths are added
+		pPathsOut->push_back(tph.ExpectOneToken("source path"));
+		AssetCompileInfo aci = { pPathsOut->back().c_str(), s_kinds[iKind].m_ack };
+
+		// Optional settings follow, as name=value
+		while (char * pSetting = tph.NextToken())
+		{
+			char * pValue = strchr(pSetting, '=');
+			if (pValue)
+				*pValue++ = 0;
+
+			bool valid = false;
+			if (_stricmp(pSetting, "codec") == 0 && pValue)
+			{
+				for (int i = 0; i < dim(s_codecs); ++i)
+				{
+					if (_stricmp(pValue, s_codecs[i].m_name) == 0)
+					{
+						aci.m_codec = s_codecs[i].m_codec;
+						valid = true;
+					}
+				}
+			}
+			else if (aci.m_ack == ACK_OBJMesh && pValue)
+			{
+				if (_stricmp(pSetting, "weld") == 0)
+				{
+					aci.m_weldEpsilon = float(atof(pValue));
+					valid = (aci.m_weldEpsilon >= 0.0f);
+				}
+				else if (_stricmp(pSetting, "vcache") == 0)
+				{
+					for (int i = 0; i < dim(s_vcopts); ++i)
+					{
+						if (_stricmp(pValue, s_vcopts[i].m_name) == 0)
+						{
+							aci.m_vcopt = s_vcopts[i].m_vcopt;
+							valid = true;
+						}
+					}
+				}
+				else if (_stricmp(pSetting, "vcache_size") == 0)
+				{
+					aci.m_vertexCacheSize = atoi(pValue);
+					valid = (aci.m_vertexCacheSize >= 4);
+				}
+				else if (_stricmp(pSetting, "overdraw") == 0)
+				{
+					aci.m_optimizeOverdraw = (atoi(pValue) != 0);
+					valid = true;
+				}
+				else if (_stricmp(pSetting, "split16") == 0)
+				{
+					aci.m_splitFor16BitIndices = (atoi(pValue) != 0);
+					valid = true;
+				}
+				else if (_stricmp(pSetting, "lods") == 0)
+				{
+					aci.m_lodCount = atoi(pValue);
+					valid = (aci.m_lodCount >= 0 && aci.m_lodCount <= 16);
+				}
+				else if (_stricmp(pSetting, "lod_ratio") == 0)
+				{
+					aci.m_lodRatio = float(atof(pValue));
+					valid = (aci.m_lodRatio > 0.0f && aci.m_lodRatio < 1.0f);
+				}
+				else if (_stricmp(pSetting, "vtxfmt") == 0)
+				{
+					for (int i = 0; i < dim(s_vtxfmts); ++i)
+					{
+						if (_stricmp(pValue, s_vtxfmts[i].m_name) == 0)
+						{
+							aci.m_vtxfmt = s_vtxfmts[i].m_vtxfmt;
+							valid = true;
+						}
+					}
+				}
+			}
+			else if ((aci.m_ack == ACK_TextureRaw || aci.m_ack == ACK_TextureWithMips) && pValue)
+			{
+				if (_stricmp(pSetting, "texfmt") == 0)
+				{
+					for (int i = 0; i < dim(s_texfmts); ++i)
+					{
+						if (_stricmp(pValue, s_texfmts[i].m_name) == 0)
+						{
+							aci.m_texfmt = s_texfmts[i].m_texfmt;
+							valid = true;
+						}
+					}
+				}
+				else if (_stricmp(pSetting, "alpha_coverage") == 0 && aci.m_ack == ACK_TextureWithMips)
+				{
+					aci.m_preserveAlphaCoverage = (atoi(pValue) != 0);
+					valid = true;
+				}
+				else if (_stricmp(pSetting, "alpha_cutoff") == 0 && aci.m_ack == ACK_TextureWithMips)
+				{
+					aci.m_alphaCutoff = float(atof(pValue));
+					valid = (aci.m_alphaCutoff > 0.0f && aci.m_alphaCutoff <= 1.0f);
+				}
+			}
+
+			if (!valid)
+			{
+				WARN("%s: bad setting \"%s%s%s\" for %s at line %d",
+					path, pSetting, pValue ? "=" : "", pValue ? pValue : "", s_kinds[iKind].m_name, tph.m_iLine);
+				return false;
+			}
+		}
+
+		pAssetsOut->push_back(aci);
+	}
+
+	return true;
+}
+
+static void PrintUsage()
+{
+	LOG("Usage: cooker [-j <threads>] <manifest> <pack path>");
+	LOG("    -j <threads>    Number of worker threads to compile with (default: one per core)");
+}
+
+int main(int argc, char ** argv)
+{
+	int numThreads = 0;
+	const char * manifestPath = nullptr;
+	const char * packPath = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			numThreads = atoi(argv[++i]);
+			if (numThreads <= 0)
+			{
+				WARN("Bad thread count %s", argv[i]);
+				return 1;
+			}
+		}
+		else if (!manifestPath)
+			manifestPath = argv[i];
+		else if (!packPath)
+			packPath = argv[i];
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (!manifestPath || !packPath)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::deque<std::string> paths;
+	std::vector<AssetCompileInfo> assets;
+	if (!ParseCookerManifest(manifestPath, &paths, &assets))
+		return 1;
+	if (assets.empty())
+	{
+		WARN("Manifest %s lists no assets", manifestPath);
+		return 1;
+	}
+
+	SetNumWorkerThreads(numThreads);
+
+	auto timeStart = std::chrono::steady_clock::now();
+	bool success = CompileAssetPackIfOutOfDate(packPath, &assets[0], int(assets.size()));
+	auto timeEnd = std::chrono::steady_clock::now();
+
+	LOG("%s %s in %0.2f sec with %d threads",
+		success ? "Cooked" : "Failed to cook",
+		packPath,
+		std::chrono::duration<float>(timeEnd - timeStart).count(),
+		GetNumWorkerThreads());
+
+	return success ? 0 : 1;
+}
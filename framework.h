@@ -1,15 +1,34 @@
 #pragma once
 
+// Define FRAMEWORK_HEADLESS to 1 to build just the asset compiler and asset pack loader,
+// with no Windows or D3D11 dependencies - e.g. for the command-line cooker on a build server.
+#ifndef FRAMEWORK_HEADLESS
+#define FRAMEWORK_HEADLESS 0
+#endif
+
 #include <util.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#if FRAMEWORK_HEADLESS
+#include "headless.h"
+#else
 #define NOMINMAX
 #include <windows.h>
 #include <d3d11.h>
+#endif
 
 namespace Framework
 {
@@ -19,6 +38,7 @@ namespace Framework
 	class AssetPack;
 }
 
+#if !FRAMEWORK_HEADLESS
 #define CHECK_D3D(f) \
 		{ \
 			HRESULT hr##__LINE__ = f; \
@@ -30,18 +50,28 @@ namespace Framework
 			HRESULT hr##__LINE__  = f; \
 			CHECK_WARN_MSG(SUCCEEDED(hr##__LINE__), "D3D call failed with error code: 0x%08x\nFailed call: %s", hr##__LINE__, #f); \
 		}
+#endif
 
 #include "comptr.h"
 
+// These work headless, minus the GPU parts of mesh.h and texture.h
+#include "bcn.h"
+#include "jobs.h"
+#include "lz.h"
+#include "material.h"
+#include "mesh.h"
+#include "srgb.h"
+#include "texture.h"
+
+#if !FRAMEWORK_HEADLESS
+#include "asyncloader.h"
 #include "camera.h"
 #include "cbuffer.h"
 #include "d3d11-window.h"
 #include "gpuprofiler.h"
-#include "material.h"
-#include "mesh.h"
 #include "rendertarget.h"
 #include "shadow.h"
-#include "texture.h"
 #include "timer.h"
+#endif
 
 #include "asset.h"
@@ -0,0 +1,58 @@
+#pragma once
+
+// Stand-ins for the Windows and MSVC CRT definitions that the asset compiler uses, in terms of
+// POSIX, for FRAMEWORK_HEADLESS builds.
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#define MAX_PATH	PATH_MAX
+#define _TRUNCATE	size_t(-1)
+
+#define _stat		stat
+#define _stricmp	strcasecmp
+#define _strnicmp	strncasecmp
+
+template <size_t N>
+inline int sprintf_s(char (&buffer)[N], const char * format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int result = vsnprintf(buffer, N, format, args);
+	va_end(args);
+	return result;
+}
+
+// Only the _TRUNCATE form is supported.  Returns -1 if the output didn't fit, like MSVC's.
+template <size_t N>
+inline int _snprintf_s(char (&buffer)[N], size_t count, const char * format, ...)
+{
+	(void)count;
+	va_list args;
+	va_start(args, format);
+	int result = vsnprintf(buffer, N, format, args);
+	va_end(args);
+	return (result < 0 || size_t(result) >= N) ? -1 : result;
+}
+
+// Pixel formats that can appear in asset packs, with the same values as dxgiformat.h
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN					= 0,
+	DXGI_FORMAT_R16G16B16A16_FLOAT		= 10,
+	DXGI_FORMAT_R11G11B10_FLOAT			= 26,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB		= 29,
+	DXGI_FORMAT_R8G8_UNORM				= 49,
+	DXGI_FORMAT_R8_UNORM				= 61,
+	DXGI_FORMAT_BC1_UNORM				= 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB			= 72,
+	DXGI_FORMAT_BC3_UNORM				= 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB			= 78,
+	DXGI_FORMAT_BC4_UNORM				= 80,
+	DXGI_FORMAT_BC5_UNORM				= 83,
+	DXGI_FORMAT_BC7_UNORM				= 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB			= 99,
+};
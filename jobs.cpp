@@ -0,0 +1,250 @@
+#include "framework.h"
+
+namespace Framework
+{
+	// One ParallelFor call.  Shared by the calling thread and the helper tasks it queues,
+	// which may outlive the call; they find no indices left, and just drop their reference.
+	struct JobBatch
+	{
+		std::function<void (int)> const *	m_pFunc;		// Only called while indices remain, so the caller is still waiting
+		int									m_count;
+		std::atomic<int>					m_iNext;		// Next index to claim
+		std::atomic<int>					m_numDone;
+		std::mutex							m_mutex;
+		std::condition_variable				m_cvDone;
+	};
+
+	// Per-thread queue of helper tasks.  The owner pushes and pops at the back; others steal
+	// from the front, so they take the oldest, typically biggest, work.
+	struct JobQueue
+	{
+		std::deque<std::shared_ptr<JobBatch>>	m_tasks;
+		std::mutex								m_mutex;
+	};
+
+	// Persistent worker threads, started on first use.  Queue 0 is shared by threads outside
+	// the pool; queue i belongs to worker i.
+	struct JobPool
+	{
+		std::vector<std::thread>		m_threads;
+		std::unique_ptr<JobQueue[]>		m_queues;
+		int								m_numQueues;
+		std::atomic<int>				m_numTasksQueued;
+		bool							m_shutdown;
+		std::mutex						m_mutex;		// Protects m_shutdown; workers sleep on it when there's no work
+		std::condition_variable			m_cvWork;
+
+		JobPool();
+		~JobPool();
+	};
+
+	static std::atomic<int> s_numWorkerThreadsOverride(0);		// Set by SetNumWorkerThreads
+	static thread_local int s_iWorkerCur = 0;					// Index of the pool worker on this thread, or 0 if not one
+
+	// Prototype various helper functions
+	static JobPool * GetJobPool();
+	static void WorkerThread(JobPool * pPool, int iWorker);
+	static void PushTasks(JobPool * pPool, int iQueue, std::shared_ptr<JobBatch> const & pBatch, int numTasks);
+	static bool TakeTask(JobPool * pPool, int iQueue, std::shared_ptr<JobBatch> * pBatchOut);
+	static void RunBatch(JobBatch * pBatch);
+
+
+
+	int GetNumWorkerThreads()
+	{
+		if (int numThreads = s_numWorkerThreadsOverride)
+			return numThreads;
+
+		return max(1, int(std::thread::hardware_concurrency()));
+	}
+
+	void SetNumWorkerThreads(int numThreads)
+	{
+		ASSERT_ERR(numThreads >= 0);
+		s_numWorkerThreadsOverride = numThreads;
+	}
+
+	void ParallelFor(
+		int count,
+		std::function<void (int)> const & func,
+		int numThreads /* = 0 */)
+	{
+		ASSERT_ERR(count >= 0);
+		ASSERT_ERR(numThreads >= 0);
+
+		if (numThreads == 0)
+			numThreads = GetNumWorkerThreads();
+		numThreads = min(numThreads, count);
+
+		// Not worth involving other threads for this
+		if (numThreads <= 1)
+		{
+			for (int i = 0; i < count; ++i)
+				func(i);
+			return;
+		}
+
+		JobPool * pPool = GetJobPool();
+
+		auto pBatch = std::make_shared<JobBatch>();
+		pBatch->m_pFunc = &func;
+		pBatch->m_count = count;
+		pBatch->m_iNext = 0;
+		pBatch->m_numDone = 0;
+
+		// Queue a helper task for each other thread that can join in, then get to work
+		// ourselves.  Whichever threads are free pick the helpers up.
+		int iQueue = s_iWorkerCur;
+		PushTasks(pPool, iQueue, pBatch, numThreads - 1);
+
+		RunBatch(pBatch.get());
+
+		// All indices are claimed; help with other work until the ones still running finish.
+		// Taking from our own queue first also retires our helpers that no one got to.
+		std::shared_ptr<JobBatch> pTask;
+		while (pBatch->m_numDone < count)
+		{
+			if (TakeTask(pPool, iQueue, &pTask))
+			{
+				RunBatch(pTask.get());
+				pTask.reset();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(pBatch->m_mutex);
+			pBatch->m_cvDone.wait(lock, [&]() { return pBatch->m_numDone >= count; });
+		}
+	}
+
+
+
+	// Helper function implementations
+
+	JobPool::JobPool()
+	:	m_numQueues(0),
+		m_numTasksQueued(0),
+		m_shutdown(false)
+	{
+		// Start enough threads for the machine, or the override if it's bigger.  Threads past
+		// the current GetNumWorkerThreads() stay asleep, so it can be lowered at any time.
+		int numThreads = max(GetNumWorkerThreads(), int(std::thread::hardware_concurrency()));
+		m_numQueues = max(1, numThreads);
+		m_queues.reset(new JobQueue[m_numQueues]);
+
+		for (int i = 1; i < m_numQueues; ++i)
+			m_threads.push_back(std::thread(WorkerThread, this, i));
+	}
+
+	JobPool::~JobPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_shutdown = true;
+		}
+		m_cvWork.notify_all();
+
+		for (int i = 0, n = int(m_threads.size()); i < n; ++i)
+			m_threads[i].join();
+	}
+
+	static JobPool * GetJobPool()
+	{
+		static JobPool s_pool;
+		return &s_pool;
+	}
+
+	static void WorkerThread(JobPool * pPool, int iWorker)
+	{
+		s_iWorkerCur = iWorker;
+
+		std::shared_ptr<JobBatch> pTask;
+		for (;;)
+		{
+			// The calling thread counts as one, so worker i is active if there are more than i
+			if (iWorker < GetNumWorkerThreads() && TakeTask(pPool, iWorker, &pTask))
+			{
+				RunBatch(pTask.get());
+				pTask.reset();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(pPool->m_mutex);
+			pPool->m_cvWork.wait(lock, [&]()
+			{
+				return pPool->m_shutdown ||
+					   (pPool->m_numTasksQueued > 0 && iWorker < GetNumWorkerThreads());
+			});
+			if (pPool->m_shutdown)
+				return;
+		}
+	}
+
+	static void PushTasks(JobPool * pPool, int iQueue, std::shared_ptr<JobBatch> const & pBatch, int numTasks)
+	{
+		JobQueue * pQueue = &pPool->m_queues[iQueue];
+		{
+			std::lock_guard<std::mutex> lock(pQueue->m_mutex);
+			for (int i = 0; i < numTasks; ++i)
+				pQueue->m_tasks.push_back(pBatch);
+		}
+
+		// Count them under the pool lock, so a worker can't check for work and go to sleep in
+		// between.  Wake everyone, since some sleeping workers may be ones that aren't active.
+		{
+			std::lock_guard<std::mutex> lock(pPool->m_mutex);
+			pPool->m_numTasksQueued += numTasks;
+		}
+		pPool->m_cvWork.notify_all();
+	}
+
+	static bool TakeTask(JobPool * pPool, int iQueue, std::shared_ptr<JobBatch> * pBatchOut)
+	{
+		// Try our own queue first, newest task first
+		{
+			JobQueue * pQueue = &pPool->m_queues[iQueue];
+			std::lock_guard<std::mutex> lock(pQueue->m_mutex);
+			if (!pQueue->m_tasks.empty())
+			{
+				*pBatchOut = std::move(pQueue->m_tasks.back());
+				pQueue->m_tasks.pop_back();
+				--pPool->m_numTasksQueued;
+				return true;
+			}
+		}
+
+		// Out of work; try to steal the oldest task from the others, starting with our neighbor
+		for (int i = 1; i < pPool->m_numQueues; ++i)
+		{
+			JobQueue * pQueue = &pPool->m_queues[(iQueue + i) % pPool->m_numQueues];
+			std::lock_guard<std::mutex> lock(pQueue->m_mutex);
+			if (!pQueue->m_tasks.empty())
+			{
+				*pBatchOut = std::move(pQueue->m_tasks.front());
+				pQueue->m_tasks.pop_front();
+				--pPool->m_numTasksQueued;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	static void RunBatch(JobBatch * pBatch)
+	{
+		// Claim indices in order, so overall progress runs roughly in index order
+		for (;;)
+		{
+			int i = pBatch->m_iNext++;
+			if (i >= pBatch->m_count)
+				break;
+
+			(*pBatch->m_pFunc)(i);
+
+			if (++pBatch->m_numDone == pBatch->m_count)
+			{
+				std::lock_guard<std::mutex> lock(pBatch->m_mutex);
+				pBatch->m_cvDone.notify_all();
+			}
+		}
+	}
+}
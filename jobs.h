@@ -0,0 +1,38 @@
+#pragma once
+
+namespace Framework
+{
+	// Simple work-stealing job system, for splitting up bulk work like asset compilation
+	// across all the cores.
+	//
+	//  * A pool of worker threads is started on first use and kept for the life of the program.
+	//
+	//  * ParallelFor queues a helper task for each other thread that may join in, then works on
+	//      the indices itself.  Each thread that picks up a helper claims indices one at a time,
+	//      in order, until none are left, so overall progress runs roughly in index order.
+	//
+	//  * Each thread has its own task queue.  It takes its newest task first; a thread whose
+	//      queue runs dry steals the oldest task from the others'.
+	//
+	//  * ParallelFor can be called from inside another ParallelFor's function.  The nested
+	//      helpers go on the same queues, and a call waiting for its last indices to finish
+	//      helps with other queued work meanwhile.  So nesting never adds threads: the work is
+	//      done by GetNumWorkerThreads() - 1 pool workers, plus the thread that called in.
+	//
+	//  * The function must be safe to call concurrently for different indices.
+
+	// Number of worker threads used by default: one per hardware thread, unless overridden.
+	int GetNumWorkerThreads();
+
+	// Override the default number of worker threads, e.g. to share a build machine.  0 restores it.
+	// It can be lowered at any time, but it can only go past the hardware thread count if it's
+	// set before the first ParallelFor, which starts the pool.
+	void SetNumWorkerThreads(int numThreads);
+
+	// Call func(i) for all i in [0, count), in parallel.  Returns when all calls have finished.
+	// numThreads = 0 uses GetNumWorkerThreads(); 1 runs everything on the calling thread.
+	void ParallelFor(
+		int count,
+		std::function<void (int)> const & func,
+		int numThreads = 0);
+}
@@ -0,0 +1,205 @@
+#include "framework.h"
+
+namespace Framework
+{
+	// Constants from the LZ4 block format
+	static const int s_lzMinMatch = 4;
+	static const int s_lzMaxOffset = 65535;
+	static const int s_lzLastLiterals = 5;		// The last 5 bytes are always literals
+	static const int s_lzMatchSafeEnd = 12;		// No match may start within 12 bytes of the end
+
+	static const int s_lzHashBits = 14;
+
+	static inline u32 LZRead32(const byte * p)
+	{
+		u32 x;
+		memcpy(&x, p, sizeof(x));
+		return x;
+	}
+
+	static inline u32 LZHash(u32 x)
+	{
+		return (x * 2654435761U) >> (32 - s_lzHashBits);
+	}
+
+	// Write a length continuation (the part that didn't fit in the token's 4 bits)
+	static inline byte * LZWriteLength(byte * pDst, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			*pDst++ = 255;
+		*pDst++ = byte(length);
+		return pDst;
+	}
+
+
+
+	size_t LZCompressBound(size_t srcSize)
+	{
+		return srcSize + srcSize / 255 + 16;
+	}
+
+	size_t LZCompress(
+		const void * pSrc,
+		size_t srcSize,
+		void * pDst,
+		size_t dstCapacity)
+	{
+		ASSERT_ERR(pSrc || srcSize == 0);
+		ASSERT_ERR(pDst);
+
+		if (dstCapacity < LZCompressBound(srcSize))
+			return 0;
+
+		const byte * pIn = (const byte *)pSrc;
+		const byte * pInEnd = pIn + srcSize;
+		const byte * pLiteralStart = pIn;
+		byte * pOut = (byte *)pDst;
+
+		// Greedy matching against a hash table of the most recent position of each 4-byte sequence
+		if (srcSize > size_t(s_lzMatchSafeEnd))
+		{
+			std::vector<u32> hashTable(size_t(1) << s_lzHashBits, 0);
+			const byte * pMatchLimit = pInEnd - s_lzMatchSafeEnd;
+			const byte * pCur = pIn + 1;
+
+			while (pCur < pMatchLimit)
+			{
+				u32 seq = LZRead32(pCur);
+				u32 h = LZHash(seq);
+				const byte * pRef = pIn + hashTable[h];
+				hashTable[h] = u32(pCur - pIn);
+
+				if (pCur - pRef > s_lzMaxOffset || pRef >= pCur || LZRead32(pRef) != seq)
+				{
+					++pCur;
+					continue;
+				}
+
+				// Extend the match forward, stopping short of the trailing literals
+				const byte * pMatchEnd = pCur + s_lzMinMatch;
+				const byte * pRefEnd = pRef + s_lzMinMatch;
+				const byte * pExtendLimit = pInEnd - s_lzLastLiterals;
+				while (pMatchEnd < pExtendLimit && *pMatchEnd == *pRefEnd)
+				{
+					++pMatchEnd;
+					++pRefEnd;
+				}
+
+				// Emit the sequence: token, literals, offset, match length
+				size_t literalLength = size_t(pCur - pLiteralStart);
+				size_t matchLength = size_t(pMatchEnd - pCur) - s_lzMinMatch;
+				byte * pToken = pOut++;
+				*pToken = byte((min(literalLength, size_t(15)) << 4) | min(matchLength, size_t(15)));
+				if (literalLength >= 15)
+					pOut = LZWriteLength(pOut, literalLength - 15);
+				memcpy(pOut, pLiteralStart, literalLength);
+				pOut += literalLength;
+
+				u32 offset = u32(pCur - pRef);
+				*pOut++ = byte(offset);
+				*pOut++ = byte(offset >> 8);
+
+				if (matchLength >= 15)
+					pOut = LZWriteLength(pOut, matchLength - 15);
+
+				pCur = pMatchEnd;
+				pLiteralStart = pCur;
+			}
+		}
+
+		// Final sequence, literals only
+		size_t literalLength = size_t(pInEnd - pLiteralStart);
+		*pOut++ = byte(min(literalLength, size_t(15)) << 4);
+		if (literalLength >= 15)
+			pOut = LZWriteLength(pOut, literalLength - 15);
+		if (literalLength > 0)
+			memcpy(pOut, pLiteralStart, literalLength);
+		pOut += literalLength;
+
+		return size_t(pOut - (byte *)pDst);
+	}
+
+	bool LZDecompress(
+		const void * pSrc,
+		size_t srcSize,
+		void * pDst,
+		size_t dstSize)
+	{
+		ASSERT_ERR(pSrc || srcSize == 0);
+		ASSERT_ERR(pDst || dstSize == 0);
+
+		const byte * pIn = (const byte *)pSrc;
+		const byte * pInEnd = pIn + srcSize;
+		byte * pOut = (byte *)pDst;
+		byte * pOutEnd = pOut + dstSize;
+
+		while (pIn < pInEnd)
+		{
+			byte token = *pIn++;
+
+			// Literals
+			size_t literalLength = token >> 4;
+			if (literalLength == 15)
+			{
+				byte b;
+				do
+				{
+					if (pIn >= pInEnd)
+						return false;
+					b = *pIn++;
+					literalLength += b;
+				}
+				while (b == 255);
+			}
+			if (literalLength > size_t(pInEnd - pIn) || literalLength > size_t(pOutEnd - pOut))
+				return false;
+			memcpy(pOut, pIn, literalLength);
+			pIn += literalLength;
+			pOut += literalLength;
+
+			// The last sequence has no match
+			if (pIn == pInEnd)
+				break;
+
+			// Match
+			if (pInEnd - pIn < 2)
+				return false;
+			size_t offset = size_t(pIn[0]) | (size_t(pIn[1]) << 8);
+			pIn += 2;
+			if (offset == 0 || offset > size_t(pOut - (byte *)pDst))
+				return false;
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15)
+			{
+				byte b;
+				do
+				{
+					if (pIn >= pInEnd)
+						return false;
+					b = *pIn++;
+					matchLength += b;
+				}
+				while (b == 255);
+			}
+			matchLength += s_lzMinMatch;
+			if (matchLength > size_t(pOutEnd - pOut))
+				return false;
+
+			// Overlapping matches (offset < length) repeat a pattern, so must copy forward bytewise
+			const byte * pRef = pOut - offset;
+			if (offset >= matchLength)
+			{
+				memcpy(pOut, pRef, matchLength);
+				pOut += matchLength;
+			}
+			else
+			{
+				for (size_t i = 0; i < matchLength; ++i)
+					*pOut++ = *pRef++;
+			}
+		}
+
+		return (pOut == pOutEnd);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace Framework
+{
+	// Fast LZ77 compression, using the LZ4 block format: byte-aligned tokens and no entropy
+	// coding, so decompression runs close to memory speed.  Ratios are worse than deflate, but
+	// it's several times faster to decode.
+
+	// Worst-case compressed size for a given input size
+	size_t LZCompressBound(size_t srcSize);
+
+	// Compress a block of memory.  Returns the compressed size, or 0 if it didn't fit in dstCapacity.
+	size_t LZCompress(
+		const void * pSrc,
+		size_t srcSize,
+		void * pDst,
+		size_t dstCapacity);
+
+	// Decompress a block, which must decode to exactly dstSize bytes.  Bounds-checked, so
+	// corrupt input fails rather than overrunning.
+	bool LZDecompress(
+		const void * pSrc,
+		size_t srcSize,
+		void * pDst,
+		size_t dstSize);
+}
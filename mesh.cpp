@@ -7,35 +7,145 @@ namespace Framework
 		m_pIndices(nullptr),
 		m_vertCount(0),
 		m_indexCount(0),
+		m_indexSizeBytes(0),
+		m_pMeshlets(nullptr),
+		m_meshletCount(0),
+		m_pPosVerts(nullptr),
+		m_pPosIndices(nullptr),
+		m_posVertCount(0),
+		m_posIndexSizeBytes(0),
+		m_posStrideBytes(0),
+		m_split(false),
+		m_vtxFormat(),
 		m_vtxStrideBytes(0),
 		m_primtopo(D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED),
 		m_bounds(empty)
 	{
 	}
 
-	void Mesh::Draw(ID3D11DeviceContext * pCtx)
+	void Mesh::Draw(ID3D11DeviceContext * pCtx, int iLod /*= 0*/)
 	{
 		ASSERT_ERR(pCtx);
+		ASSERT_ERR(iLod >= 0 && iLod <= int(m_lods.size()));
+
+		const std::vector<MtlRange> & mtlRanges = (iLod == 0) ? m_mtlRanges : m_lods[iLod - 1].m_mtlRanges;
+		if (mtlRanges.empty())
+			return;
+
+		UINT zero = 0;
+		pCtx->IASetVertexBuffers(0, 1, &m_pVtxBuffer, (UINT *)&m_vtxStrideBytes, &zero);
+		pCtx->IASetIndexBuffer(m_pIdxBuffer, IndexFormat(), 0);
+		pCtx->IASetPrimitiveTopology(m_primtopo);
+
+		if (m_split)
+		{
+			for (int i = 0, c = int(mtlRanges.size()); i < c; ++i)
+			{
+				const MtlRange * pRange = &mtlRanges[i];
+				pCtx->DrawIndexed(pRange->m_indexCount, pRange->m_indexStart, pRange->m_baseVertex);
+			}
+		}
+		else
+		{
+			// Each LOD's ranges are contiguous in the index buffer
+			int indexStart = mtlRanges.front().m_indexStart;
+			int indexEnd = mtlRanges.back().m_indexStart + mtlRanges.back().m_indexCount;
+			pCtx->DrawIndexed(indexEnd - indexStart, indexStart, 0);
+		}
+	}
+
+	void Mesh::DrawMtlRange(ID3D11DeviceContext * pCtx, int iMtlRange, int iLod /*= 0*/)
+	{
+		ASSERT_ERR(pCtx);
+		ASSERT_ERR(iMtlRange >= 0 && iMtlRange < int(m_mtlRanges.size()));
+		ASSERT_ERR(iLod >= 0 && iLod <= int(m_lods.size()));
+
+		const MtlRange * pRange = (iLod == 0) ? &m_mtlRanges[iMtlRange] : &m_lods[iLod - 1].m_mtlRanges[iMtlRange];
 
 		UINT zero = 0;
 		pCtx->IASetVertexBuffers(0, 1, &m_pVtxBuffer, (UINT *)&m_vtxStrideBytes, &zero);
-		pCtx->IASetIndexBuffer(m_pIdxBuffer, DXGI_FORMAT_R32_UINT, 0);
+		pCtx->IASetIndexBuffer(m_pIdxBuffer, IndexFormat(), 0);
+		pCtx->IASetPrimitiveTopology(m_primtopo);
+		pCtx->DrawIndexed(pRange->m_indexCount, pRange->m_indexStart, pRange->m_baseVertex);
+	}
+
+	void Mesh::DrawPositions(ID3D11DeviceContext * pCtx, int iLod /*= 0*/)
+	{
+		ASSERT_ERR(pCtx);
+		ASSERT_ERR(iLod >= 0 && iLod <= int(m_lods.size()));
+
+		const std::vector<MtlRange> & mtlRanges = (iLod == 0) ? m_mtlRanges : m_lods[iLod - 1].m_mtlRanges;
+		if (mtlRanges.empty())
+			return;
+
+		UINT zero = 0;
+		pCtx->IASetVertexBuffers(0, 1, &m_pPosVtxBuffer, (UINT *)&m_posStrideBytes, &zero);
+		pCtx->IASetIndexBuffer(m_pPosIdxBuffer, (m_posIndexSizeBytes == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
 		pCtx->IASetPrimitiveTopology(m_primtopo);
-		pCtx->DrawIndexed(m_indexCount, 0, 0);
+
+		if (m_split)
+		{
+			for (int i = 0, c = int(mtlRanges.size()); i < c; ++i)
+			{
+				const MtlRange * pRange = &mtlRanges[i];
+				pCtx->DrawIndexed(pRange->m_indexCount, pRange->m_indexStart, pRange->m_posBaseVertex);
+			}
+		}
+		else
+		{
+			int indexStart = mtlRanges.front().m_indexStart;
+			int indexEnd = mtlRanges.back().m_indexStart + mtlRanges.back().m_indexCount;
+			pCtx->DrawIndexed(indexEnd - indexStart, indexStart, 0);
+		}
 	}
 
-	void Mesh::DrawMtlRange(ID3D11DeviceContext * pCtx, int iMtlRange)
+	void Mesh::DrawPositionsMtlRange(ID3D11DeviceContext * pCtx, int iMtlRange, int iLod /*= 0*/)
 	{
 		ASSERT_ERR(pCtx);
 		ASSERT_ERR(iMtlRange >= 0 && iMtlRange < int(m_mtlRanges.size()));
+		ASSERT_ERR(iLod >= 0 && iLod <= int(m_lods.size()));
+
+		const MtlRange * pRange = (iLod == 0) ? &m_mtlRanges[iMtlRange] : &m_lods[iLod - 1].m_mtlRanges[iMtlRange];
+
+		UINT zero = 0;
+		pCtx->IASetVertexBuffers(0, 1, &m_pPosVtxBuffer, (UINT *)&m_posStrideBytes, &zero);
+		pCtx->IASetIndexBuffer(m_pPosIdxBuffer, (m_posIndexSizeBytes == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
+		pCtx->IASetPrimitiveTopology(m_primtopo);
+		pCtx->DrawIndexed(pRange->m_indexCount, pRange->m_indexStart, pRange->m_posBaseVertex);
+	}
 
-		const MtlRange * pRange = &m_mtlRanges[iMtlRange];
+	void Mesh::DrawMeshlets(ID3D11DeviceContext * pCtx, const int * pMeshlets, int numMeshlets)
+	{
+		ASSERT_ERR(pCtx);
+		ASSERT_ERR(pMeshlets || numMeshlets == 0);
 
 		UINT zero = 0;
 		pCtx->IASetVertexBuffers(0, 1, &m_pVtxBuffer, (UINT *)&m_vtxStrideBytes, &zero);
-		pCtx->IASetIndexBuffer(m_pIdxBuffer, DXGI_FORMAT_R32_UINT, 0);
+		pCtx->IASetIndexBuffer(m_pIdxBuffer, IndexFormat(), 0);
 		pCtx->IASetPrimitiveTopology(m_primtopo);
-		pCtx->DrawIndexed(pRange->m_indexCount, pRange->m_indexStart, 0);
+
+		// Meshlets that follow on from each other in the index buffer, in the same range,
+		// are drawn together
+		for (int i = 0; i < numMeshlets;)
+		{
+			ASSERT_ERR(pMeshlets[i] >= 0 && pMeshlets[i] < m_meshletCount);
+			const Meshlet * pFirst = &m_pMeshlets[pMeshlets[i]];
+			int indexEnd = pFirst->m_indexStart + pFirst->m_indexCount;
+
+			for (++i; i < numMeshlets; ++i)
+			{
+				ASSERT_ERR(pMeshlets[i] >= 0 && pMeshlets[i] < m_meshletCount);
+				const Meshlet * pNext = &m_pMeshlets[pMeshlets[i]];
+				if (pNext->m_indexStart != indexEnd || pNext->m_iMtlRange != pFirst->m_iMtlRange)
+					break;
+				indexEnd += pNext->m_indexCount;
+			}
+
+			pCtx->DrawIndexed(
+				indexEnd - pFirst->m_indexStart,
+				pFirst->m_indexStart,
+				m_mtlRanges[pFirst->m_iMtlRange].m_baseVertex);
+		}
 	}
 
 	void Mesh::Reset()
@@ -45,8 +155,21 @@ namespace Framework
 		m_pIndices = nullptr;
 		m_vertCount = 0;
 		m_indexCount = 0;
+		m_indexSizeBytes = 0;
+		m_pMeshlets = nullptr;
+		m_meshletCount = 0;
+		m_pPosVerts = nullptr;
+		m_pPosIndices = nullptr;
+		m_posVertCount = 0;
+		m_posIndexSizeBytes = 0;
+		m_posStrideBytes = 0;
+		m_split = false;
+		m_lods.clear();
 		m_pVtxBuffer.release();
 		m_pIdxBuffer.release();
+		m_pPosVtxBuffer.release();
+		m_pPosIdxBuffer.release();
+		m_vtxFormat = VertexFormat();
 		m_vtxStrideBytes = 0;
 		m_primtopo = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
 		m_bounds = box3(empty);
@@ -55,13 +178,15 @@ namespace Framework
 	void Mesh::UploadToGPU(ID3D11Device * pDevice)
 	{
 		ASSERT_ERR(pDevice);
+		ASSERT_ERR(m_vtxFormat.m_strideBytes > 0);
+		ASSERT_ERR(m_indexSizeBytes == 2 || m_indexSizeBytes == 4);
 
 		m_pVtxBuffer.release();
 		m_pIdxBuffer.release();
 
 		D3D11_BUFFER_DESC vtxBufferDesc =
 		{
-			sizeof(Vertex) * m_vertCount,
+			UINT(m_vtxFormat.m_strideBytes * m_vertCount),
 			D3D11_USAGE_IMMUTABLE,
 			D3D11_BIND_VERTEX_BUFFER,
 			0,	// no cpu access
@@ -73,7 +198,7 @@ namespace Framework
 
 		D3D11_BUFFER_DESC idxBufferDesc =
 		{
-			sizeof(int) * m_indexCount,
+			UINT(m_indexSizeBytes * m_indexCount),
 			D3D11_USAGE_IMMUTABLE,
 			D3D11_BIND_INDEX_BUFFER,
 			0,	// no cpu access
@@ -83,7 +208,153 @@ namespace Framework
 		D3D11_SUBRESOURCE_DATA idxBufferData = { m_pIndices, 0, 0 };
 		CHECK_D3D(pDevice->CreateBuffer(&idxBufferDesc, &idxBufferData, &m_pIdxBuffer));
 
-		m_vtxStrideBytes = sizeof(Vertex);
+		m_pPosVtxBuffer.release();
+		m_pPosIdxBuffer.release();
+
+		if (m_pPosVerts)
+		{
+			ASSERT_ERR(m_posStrideBytes > 0);
+			ASSERT_ERR(m_posIndexSizeBytes == 2 || m_posIndexSizeBytes == 4);
+
+			vtxBufferDesc.ByteWidth = UINT(m_posStrideBytes * m_posVertCount);
+			vtxBufferData.pSysMem = m_pPosVerts;
+			CHECK_D3D(pDevice->CreateBuffer(&vtxBufferDesc, &vtxBufferData, &m_pPosVtxBuffer));
+
+			idxBufferDesc.ByteWidth = UINT(m_posIndexSizeBytes * m_indexCount);
+			idxBufferData.pSysMem = m_pPosIndices;
+			CHECK_D3D(pDevice->CreateBuffer(&idxBufferDesc, &idxBufferData, &m_pPosIdxBuffer));
+		}
+
+		m_vtxStrideBytes = m_vtxFormat.m_strideBytes;
 		m_primtopo = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	}
+
+	int Mesh::CullMeshlets(
+		float4x4 const & matLocalToClip,
+		float3 posCameraLocal,
+		int iMeshletStart,
+		int numMeshlets,
+		int * pMeshletsOut) const
+	{
+		ASSERT_ERR(iMeshletStart >= 0 && numMeshlets >= 0);
+		ASSERT_ERR(iMeshletStart + numMeshlets <= m_meshletCount);
+		ASSERT_ERR(pMeshletsOut || numMeshlets == 0);
+
+		// Extract the frustum planes from the matrix's columns (Gribb and Hartmann), facing
+		// inward.  Clip space is -w <= x, y <= w and 0 <= z <= w, as usual for D3D.
+		float4 cols[4];
+		for (int i = 0; i < 4; ++i)
+			cols[i] = float4(matLocalToClip[0][i], matLocalToClip[1][i], matLocalToClip[2][i], matLocalToClip[3][i]);
+		float4 planes[] =
+		{
+			cols[3] + cols[0],
+			cols[3] - cols[0],
+			cols[3] + cols[1],
+			cols[3] - cols[1],
+			cols[2],
+			cols[3] - cols[2],
+		};
+		for (int i = 0; i < dim(planes); ++i)
+			planes[i] = planes[i] * (1.0f / max(length(planes[i].xyz), 1e-20f));
+
+		int numVisible = 0;
+		for (int iMeshlet = iMeshletStart, iMeshletEnd = iMeshletStart + numMeshlets; iMeshlet < iMeshletEnd; ++iMeshlet)
+		{
+			const Meshlet & meshlet = m_pMeshlets[iMeshlet];
+
+			bool outside = false;
+			for (int i = 0; i < dim(planes) && !outside; ++i)
+				outside = (dot(planes[i].xyz, meshlet.m_center) + planes[i].w < -meshlet.m_radius);
+			if (outside)
+				continue;
+
+			if (dot(normalize(meshlet.m_coneApex - posCameraLocal), meshlet.m_coneAxis) >= meshlet.m_coneCutoff)
+				continue;
+
+			pMeshletsOut[numVisible++] = iMeshlet;
+		}
+
+		return numVisible;
+	}
+
+	int Mesh::SelectLod(float3 posCameraLocal, float pixelsPerUnit, float errorPixelsMax) const
+	{
+		ASSERT_ERR(pixelsPerUnit > 0.0f);
+
+		// Inside the bounds, the distance is zero and only LOD 0 will do
+		float dist = length(posCameraLocal - clamp(posCameraLocal, m_bounds.mins, m_bounds.maxs));
+
+		// LOD errors only grow along the chain, so take LODs until one projects too big
+		int iLod = 0;
+		while (iLod < int(m_lods.size()) && m_lods[iLod].m_error * pixelsPerUnit <= errorPixelsMax * dist)
+			++iLod;
+		return iLod;
+	}
+
+	DXGI_FORMAT Mesh::IndexFormat() const
+	{
+		return (m_indexSizeBytes == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	}
+
+	static const char * s_semantics[] =
+	{
+		"POSITION",
+		"NORMAL",
+		"UV",
+		"TANGENT",
+	};
+	cassert(dim(s_semantics) == VATTR_Count);
+
+	static const DXGI_FORMAT s_formats[] =
+	{
+		DXGI_FORMAT_UNKNOWN,				// None
+		DXGI_FORMAT_R32G32_FLOAT,			// Float2
+		DXGI_FORMAT_R32G32B32_FLOAT,		// Float3
+		DXGI_FORMAT_R16G16_FLOAT,			// Half2
+		DXGI_FORMAT_R16G16B16A16_UNORM,		// Unorm16x4
+		DXGI_FORMAT_R16G16_SNORM,			// Oct16
+	};
+	cassert(dim(s_formats) == VENC_Count);
+
+	int Mesh::GetInputElementDescs(D3D11_INPUT_ELEMENT_DESC * pDescsOut) const
+	{
+		ASSERT_ERR(pDescsOut);
+
+		int numDescs = 0;
+		for (int i = 0; i < VATTR_Count; ++i)
+		{
+			int venc = m_vtxFormat.m_encodings[i];
+			ASSERT_ERR(venc >= 0 && venc < VENC_Count);
+			if (venc == VENC_None)
+				continue;
+
+			D3D11_INPUT_ELEMENT_DESC desc =
+			{
+				s_semantics[i], 0,
+				s_formats[venc],
+				0, m_vtxFormat.m_offsets[i],
+				D3D11_INPUT_PER_VERTEX_DATA, 0,
+			};
+			pDescsOut[numDescs++] = desc;
+		}
+
+		return numDescs;
+	}
+
+	void Mesh::GetPositionInputElementDesc(D3D11_INPUT_ELEMENT_DESC * pDescOut) const
+	{
+		ASSERT_ERR(pDescOut);
+
+		int venc = m_vtxFormat.m_encodings[VATTR_Pos];
+		ASSERT_ERR(venc >= 0 && venc < VENC_Count);
+
+		D3D11_INPUT_ELEMENT_DESC desc =
+		{
+			s_semantics[VATTR_Pos], 0,
+			s_formats[venc],
+			0, 0,
+			D3D11_INPUT_PER_VERTEX_DATA, 0,
+		};
+		*pDescOut = desc;
+	}
 }
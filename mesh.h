@@ -8,7 +8,7 @@ namespace Framework
 	struct Material;
 	class MaterialLib;
 
-	// Hard-coded vertex struct for now
+	// Vertex struct the mesh compiler works in, and the layout of VTXFMT_Float
 	struct Vertex
 	{
 		float3	m_pos;
@@ -19,42 +19,181 @@ namespace Framework
 #endif
 	};
 
+	enum VATTR					// Vertex attribute
+	{
+		VATTR_Pos,
+		VATTR_Normal,
+		VATTR_UV,
+		VATTR_Tangent,
+
+		VATTR_Count
+	};
+
+	enum VENC					// How a vertex attribute is encoded
+	{
+		VENC_None,				// Attribute not present
+		VENC_Float2,
+		VENC_Float3,
+		VENC_Half2,				// 16-bit floats
+		VENC_Unorm16x4,			// Position as 16-bit unorm fraction of the mesh's bounding box; w is always 1
+		VENC_Oct16,				// Unit vector, octahedral-encoded in 2x16-bit snorm
+
+		VENC_Count
+	};
+
+	enum VTXFMT					// Vertex layout a mesh is compiled to
+	{
+		VTXFMT_Float,			// Float attributes, as in struct Vertex: 32 bytes
+		VTXFMT_Compact,			// 16-bit unorm positions, octahedral normals and tangents, half UVs: 16 bytes
+
+		VTXFMT_Count
+	};
+
+	// Layout of a compiled mesh's vertex data
+	struct VertexFormat
+	{
+		byte	m_encodings[VATTR_Count];	// VENC for each attribute
+		byte	m_offsets[VATTR_Count];		// Byte offset of each attribute within a vertex
+		int		m_strideBytes;
+	};
+
+	// Decoding helpers, matching the encodings the mesh compiler writes.
+	// Octahedral vectors come in as snorm, in [-1, 1]; the result is normalized.
+	inline float3 DequantizePos(float3 unorm, const box3 & bounds)
+	{
+		return bounds.mins + unorm * (bounds.maxs - bounds.mins);
+	}
+
+	inline float3 DecodeOctahedral(float2 oct)
+	{
+		float3 v = float3(oct.x, oct.y, 1.0f - fabsf(oct.x) - fabsf(oct.y));
+		if (v.z < 0.0f)
+		{
+			v.x = (1.0f - fabsf(oct.y)) * (oct.x >= 0.0f ? 1.0f : -1.0f);
+			v.y = (1.0f - fabsf(oct.x)) * (oct.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return normalize(v);
+	}
+
+	// Small cluster of neighboring triangles, with bounds for culling.  Each is a run of the
+	// mesh's index buffer within one material range; bounds are in the mesh's local space.
+	struct Meshlet
+	{
+		float3	m_center;			// Bounding sphere
+		float	m_radius;
+		box3	m_bounds;
+		float3	m_coneApex;			// Normal cone: all the triangles face away from any viewpoint p
+		float3	m_coneAxis;			//   with dot(normalize(m_coneApex - p), m_coneAxis) >= m_coneCutoff
+		float	m_coneCutoff;		// Over 1 if the triangles face too many ways to ever cull
+		int		m_indexStart;
+		int		m_indexCount;
+		int		m_iMtlRange;
+	};
+
+#if !FRAMEWORK_HEADLESS
 	class Mesh
 	{
 	public:
 		// Asset pack that this mesh's data is sourced from
 		comptr<AssetPack>			m_pPack;
 
-		// Pointers to vertex and index data in the asset pack
-		Vertex *					m_pVerts;
-		int *						m_pIndices;
+		// Pointers to vertex and index data in the asset pack.
+		// Vertices are laid out as described by m_vtxFormat.
+		const byte *				m_pVerts;
+		const byte *				m_pIndices;
 		int							m_vertCount;
 		int							m_indexCount;
+		int							m_indexSizeBytes;	// 2 or 4
+		const Meshlet *				m_pMeshlets;		// In index buffer order
+		int							m_meshletCount;
+
+		// Position-only stream for depth-only passes, with verts that differ only in their other
+		// attributes welded together.  Positions are encoded as in the main stream.  Its index
+		// buffer parallels the main one, so index runs from material ranges and LODs apply to
+		// it as well, with m_posBaseVertex in place of m_baseVertex.
+		const byte *				m_pPosVerts;
+		const byte *				m_pPosIndices;
+		int							m_posVertCount;
+		int							m_posIndexSizeBytes;	// 2 or 4
+		int							m_posStrideBytes;
 
 		// Material map
 		struct MtlRange
 		{
 			Material *	m_pMtl;
 			int			m_indexStart, m_indexCount;
+			int			m_baseVertex;
+			int			m_posBaseVertex;
+			int			m_meshletStart, m_meshletCount;
 		};
 		std::vector<MtlRange>		m_mtlRanges;
+		bool						m_split;			// Ranges have different base vertices, so they're drawn separately
+
+		// Simplified LODs, with their own runs of the index buffer but sharing the vertex buffer.
+		// Each has the same material ranges as the full mesh, in the same order.  LOD 0 is the
+		// full mesh itself, so m_lods[0] is LOD 1.  Meshlets are only built for LOD 0.  The
+		// error is an average; the largest distance is typically two or three times that.
+		struct Lod
+		{
+			float					m_error;		// Estimated RMS distance from the full mesh's surface, in local space
+			std::vector<MtlRange>	m_mtlRanges;
+		};
+		std::vector<Lod>			m_lods;
 
 		// GPU resources
 		comptr<ID3D11Buffer>		m_pVtxBuffer;
 		comptr<ID3D11Buffer>		m_pIdxBuffer;
+		comptr<ID3D11Buffer>		m_pPosVtxBuffer;
+		comptr<ID3D11Buffer>		m_pPosIdxBuffer;
 
 		// Rendering info
+		VertexFormat				m_vtxFormat;
 		int							m_vtxStrideBytes;
 		D3D11_PRIMITIVE_TOPOLOGY	m_primtopo;
-		box3						m_bounds;			// Bounding box in local space
+		box3						m_bounds;			// Bounding box in local space; VENC_Unorm16x4 positions are relative to it
 
 				Mesh();
-		void	Draw(ID3D11DeviceContext * pCtx);
-		void	DrawMtlRange(ID3D11DeviceContext * pCtx, int iMtlRange);
+		void	Draw(ID3D11DeviceContext * pCtx, int iLod = 0);
+		void	DrawMtlRange(ID3D11DeviceContext * pCtx, int iMtlRange, int iLod = 0);
+		void	DrawMeshlets(ID3D11DeviceContext * pCtx, const int * pMeshlets, int numMeshlets);
+
+		// Same as Draw and DrawMtlRange, but from the position-only stream, for depth-only passes
+		// that don't need any other attributes (alpha-tested materials still need UVs)
+		void	DrawPositions(ID3D11DeviceContext * pCtx, int iLod = 0);
+		void	DrawPositionsMtlRange(ID3D11DeviceContext * pCtx, int iMtlRange, int iLod = 0);
 		void	Reset();
 
-		// Creates the vertex and index buffers on the GPU from m_pVerts and m_pIndices
+		// Creates the vertex and index buffers on the GPU from m_pVerts and m_pIndices, and
+		// likewise for the position-only stream
 		void	UploadToGPU(ID3D11Device * pDevice);
+
+		// Find the meshlets in [iMeshletStart, iMeshletStart + numMeshlets) that may be visible:
+		// ones not outside the frustum of matLocalToClip, and not facing entirely away from
+		// posCameraLocal.  Writes their indices, in order, to pMeshletsOut, and returns how many.
+		// Draw them with DrawMeshlets, which merges runs of consecutive ones into one draw call.
+		int		CullMeshlets(
+					float4x4 const & matLocalToClip,
+					float3 posCameraLocal,
+					int iMeshletStart,
+					int numMeshlets,
+					int * pMeshletsOut) const;
+
+		// Pick the coarsest LOD whose error, projected to the screen at the distance from
+		// posCameraLocal to m_bounds, is at most errorPixelsMax.  pixelsPerUnit is the size in
+		// pixels of one local space unit at distance 1, i.e. viewport height / (2 tan(vFOV/2))
+		// for a perspective projection, times any scale from local to view space.
+		int		SelectLod(float3 posCameraLocal, float pixelsPerUnit, float errorPixelsMax) const;
+
+		// DXGI format of m_pIdxBuffer, from m_indexSizeBytes
+		DXGI_FORMAT	IndexFormat() const;
+
+		// Fills out input element descs for m_vtxFormat, with semantics POSITION, NORMAL, UV
+		// and TANGENT, for creating an input layout.  Returns the number of elements written.
+		int		GetInputElementDescs(D3D11_INPUT_ELEMENT_DESC * pDescsOut) const;
+
+		// Fills out the single input element desc for the position-only stream, with semantic
+		// POSITION, for creating an input layout for depth-only passes
+		void	GetPositionInputElementDesc(D3D11_INPUT_ELEMENT_DESC * pDescOut) const;
 	};
 
 	// Load a mesh from an asset pack and resolve material references
@@ -70,4 +209,5 @@ namespace Framework
 	bool LoadOBJMesh(
 		const char * path,
 		Mesh * pMeshOut);
+#endif // !FRAMEWORK_HEADLESS
 }
@@ -0,0 +1,373 @@
+#include "framework.h"
+
+// Instruction set for the kernels: 2 = AVX2, 1 = SSE2, 0 = scalar only.  Defaults to the
+// best one the compiler is targeting; define it to something else to override.
+#ifndef SRGB_SIMD
+#if defined(__AVX2__)
+#define SRGB_SIMD 2
+#elif defined(_M_X64) || defined(__SSE2__)
+#define SRGB_SIMD 1
+#else
+#define SRGB_SIMD 0
+#endif
+#endif
+
+#if SRGB_SIMD >= 2
+#include <immintrin.h>
+#elif SRGB_SIMD >= 1
+#include <emmintrin.h>
+#endif
+
+namespace Framework
+{
+	// Table for sRGB8 to linear.  The first 256 entries decode sRGB, and the second 256 are
+	// just i / 255, for alpha, so one gather can do a whole pixel.
+	struct SRGBToLinearTable
+	{
+		float	m_values[512];
+
+		SRGBToLinearTable()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				double c = double(i) / 255.0;
+				m_values[i] = float((c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+				m_values[256 + i] = float(c);
+			}
+		}
+	};
+
+	static const float * GetSRGBToLinearTable()
+	{
+		static SRGBToLinearTable s_table;
+		return s_table.m_values;
+	}
+
+	// Table for linear to sRGB8, from stb_image_resize.  Indexed by the exponent and top 3
+	// mantissa bits of a float in [2^-13, 1); each entry holds a bias in its top 16 bits and
+	// a scale in its low 16, for linear interpolation on the next 8 mantissa bits.
+	static const u32 s_linearToSRGB8Table[104] =
+	{
+		0x0073000d, 0x007a000d, 0x0080000d, 0x0087000d, 0x008d000d, 0x0094000d, 0x009a000d, 0x00a1000d,
+		0x00a7001a, 0x00b4001a, 0x00c1001a, 0x00ce001a, 0x00da001a, 0x00e7001a, 0x00f4001a, 0x0101001a,
+		0x010e0033, 0x01280033, 0x01410033, 0x015b0033, 0x01750033, 0x018f0033, 0x01a80033, 0x01c20033,
+		0x01dc0067, 0x020f0067, 0x02430067, 0x02760067, 0x02aa0067, 0x02dd0067, 0x03110067, 0x03440067,
+		0x037800ce, 0x03df00ce, 0x044600ce, 0x04ad00ce, 0x051400ce, 0x057b00c5, 0x05dd00bc, 0x063b00b5,
+		0x06970158, 0x07420142, 0x07e30130, 0x087b0120, 0x090b0112, 0x09940106, 0x0a1700fc, 0x0a9500f2,
+		0x0b0f01cb, 0x0bf401ae, 0x0ccb0195, 0x0d950180, 0x0e56016e, 0x0f0d015e, 0x0fbc0150, 0x10630143,
+		0x11070264, 0x1238023e, 0x1357021d, 0x14660201, 0x156601e9, 0x165a01d3, 0x174401c0, 0x182401af,
+		0x18fe0331, 0x1a9602fe, 0x1c1502d2, 0x1d7e02ad, 0x1ed4028d, 0x201a0270, 0x21520256, 0x227d0240,
+		0x239f0443, 0x25c003fe, 0x27bf03c4, 0x29a10392, 0x2b6a0367, 0x2d1d0341, 0x2ebe031f, 0x304d0300,
+		0x31d105b0, 0x34a80555, 0x37520507, 0x39d504c5, 0x3c37048b, 0x3e7c0458, 0x40a8042a, 0x42bd0401,
+		0x44c20798, 0x488e071e, 0x4c1c06b6, 0x4f76065d, 0x52a50610, 0x55ac05cc, 0x5892058f, 0x5b590559,
+		0x5e0c0a23, 0x631c0980, 0x67db08f6, 0x6c55087f, 0x70940818, 0x74a007bd, 0x787d076c, 0x7c330723,
+	};
+	static const u32 s_linearToSRGB8Min = (127 - 13) << 23;		// 2^-13; this and below map to 0
+	static const u32 s_linearToSRGB8AlmostOne = 0x3f7fffff;		// 1 - epsilon; this and above map to 255
+
+	static inline float FloatFromBits(u32 bits)
+	{
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	static inline byte LinearToSRGB8(float x)
+	{
+		// Written so that NaNs go to the minimum
+		float minVal = FloatFromBits(s_linearToSRGB8Min);
+		float almostOne = FloatFromBits(s_linearToSRGB8AlmostOne);
+		if (!(x > minVal))
+			x = minVal;
+		if (x > almostOne)
+			x = almostOne;
+
+		u32 bits;
+		memcpy(&bits, &x, sizeof(bits));
+		u32 tab = s_linearToSRGB8Table[(bits - s_linearToSRGB8Min) >> 20];
+		u32 bias = (tab >> 16) << 9;
+		u32 scale = tab & 0xffff;
+		u32 t = (bits >> 12) & 0xff;
+		return byte((bias + scale * t) >> 16);
+	}
+
+	static inline byte LinearToUNorm8(float x)
+	{
+		if (!(x > 0.0f))
+			x = 0.0f;
+		if (x > 1.0f)
+			x = 1.0f;
+		return byte(x * 255.0f + 0.5f);
+	}
+
+#if SRGB_SIMD >= 2
+	// Two pixels at a time; returns the result for each channel in a 32-bit lane
+	static inline __m256i LinearToSRGB8AVX2(__m256 x)
+	{
+		// max_ps returns its second operand if either is NaN, so NaNs go to the minimum
+		__m256 clamped = _mm256_min_ps(
+							_mm256_max_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(s_linearToSRGB8Min))),
+							_mm256_castsi256_ps(_mm256_set1_epi32(s_linearToSRGB8AlmostOne)));
+		__m256i bits = _mm256_castps_si256(clamped);
+		__m256i index = _mm256_srli_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32(s_linearToSRGB8Min)), 20);
+		__m256i tab = _mm256_i32gather_epi32((const int *)s_linearToSRGB8Table, index, 4);
+		__m256i bias = _mm256_slli_epi32(_mm256_srli_epi32(tab, 16), 9);
+		__m256i scale = _mm256_and_si256(tab, _mm256_set1_epi32(0xffff));
+		__m256i t = _mm256_and_si256(_mm256_srli_epi32(bits, 12), _mm256_set1_epi32(0xff));
+
+		// Scale and t both fit in 15 bits, so a 16-bit multiply-add gives their 32-bit product
+		__m256i srgb = _mm256_srli_epi32(_mm256_add_epi32(bias, _mm256_madd_epi16(scale, t)), 16);
+
+		// Alpha is linear
+		__m256 alphaClamped = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+		__m256i alpha = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(alphaClamped, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+		return _mm256_blend_epi32(srgb, alpha, 0x88);
+	}
+#elif SRGB_SIMD >= 1
+	// One pixel at a time; returns the result for each channel in a 32-bit lane
+	static inline __m128i LinearToSRGB8SSE2(__m128 x)
+	{
+		// max_ps returns its second operand if either is NaN, so NaNs go to the minimum
+		__m128 clamped = _mm_min_ps(
+							_mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(s_linearToSRGB8Min))),
+							_mm_castsi128_ps(_mm_set1_epi32(s_linearToSRGB8AlmostOne)));
+		__m128i bits = _mm_castps_si128(clamped);
+		__m128i index = _mm_srli_epi32(_mm_sub_epi32(bits, _mm_set1_epi32(s_linearToSRGB8Min)), 20);
+
+		// No gather in SSE2; the indices are under 104, so pull them out as 16-bit lanes
+		__m128i tab = _mm_setr_epi32(
+							s_linearToSRGB8Table[_mm_extract_epi16(index, 0)],
+							s_linearToSRGB8Table[_mm_extract_epi16(index, 2)],
+							s_linearToSRGB8Table[_mm_extract_epi16(index, 4)],
+							s_linearToSRGB8Table[_mm_extract_epi16(index, 6)]);
+		__m128i bias = _mm_slli_epi32(_mm_srli_epi32(tab, 16), 9);
+		__m128i scale = _mm_and_si128(tab, _mm_set1_epi32(0xffff));
+		__m128i t = _mm_and_si128(_mm_srli_epi32(bits, 12), _mm_set1_epi32(0xff));
+
+		// Scale and t both fit in 15 bits, so a 16-bit multiply-add gives their 32-bit product
+		__m128i srgb = _mm_srli_epi32(_mm_add_epi32(bias, _mm_madd_epi16(scale, t)), 16);
+
+		// Alpha is linear
+		__m128 alphaClamped = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		__m128i alpha = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(alphaClamped, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+		__m128i maskAlpha = _mm_setr_epi32(0, 0, 0, -1);
+		return _mm_or_si128(_mm_andnot_si128(maskAlpha, srgb), _mm_and_si128(maskAlpha, alpha));
+	}
+#endif
+
+	void ConvertSRGB8ToLinear(
+		const byte4 * pPixels,
+		int count,
+		float4 * pLinearOut)
+	{
+		ASSERT_ERR(count >= 0);
+		ASSERT_ERR(pPixels || count == 0);
+		ASSERT_ERR(pLinearOut || count == 0);
+
+		const float * pTable = GetSRGBToLinearTable();
+		int i = 0;
+
+#if SRGB_SIMD >= 2
+		// Four pixels at a time: widen the bytes to table indices, pointing alpha at the
+		// second half of the table, and gather.  SSE2 has no gather, so it uses the scalar loop.
+		__m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i bytes = _mm_loadu_si128((const __m128i *)&pPixels[i]);
+			__m256i indices0 = _mm256_add_epi32(_mm256_cvtepu8_epi32(bytes), alphaOffset);
+			__m256i indices1 = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)), alphaOffset);
+			_mm256_storeu_ps((float *)&pLinearOut[i], _mm256_i32gather_ps(pTable, indices0, 4));
+			_mm256_storeu_ps((float *)&pLinearOut[i + 2], _mm256_i32gather_ps(pTable, indices1, 4));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			byte4 pixel = pPixels[i];
+			pLinearOut[i] = float4(pTable[pixel.x], pTable[pixel.y], pTable[pixel.z], pTable[256 + pixel.w]);
+		}
+	}
+
+	void ConvertLinearToSRGB8(
+		const float4 * pLinear,
+		int count,
+		byte4 * pPixelsOut)
+	{
+		ASSERT_ERR(count >= 0);
+		ASSERT_ERR(pLinear || count == 0);
+		ASSERT_ERR(pPixelsOut || count == 0);
+
+		int i = 0;
+
+#if SRGB_SIMD >= 2
+		// Four pixels at a time.  The packs work within 128-bit halves, leaving the pixels
+		// in the order 0, 2, 1, 3, so put them back in order before storing.
+		__m256i order = _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0);
+		for (; i + 4 <= count; i += 4)
+		{
+			const float * pSrc = (const float *)&pLinear[i];
+			__m256i c01 = LinearToSRGB8AVX2(_mm256_loadu_ps(pSrc));
+			__m256i c23 = LinearToSRGB8AVX2(_mm256_loadu_ps(pSrc + 8));
+			__m256i packed16 = _mm256_packs_epi32(c01, c23);
+			__m256i packed8 = _mm256_packus_epi16(packed16, packed16);
+			__m256i ordered = _mm256_permutevar8x32_epi32(packed8, order);
+			_mm_storeu_si128((__m128i *)&pPixelsOut[i], _mm256_castsi256_si128(ordered));
+		}
+#elif SRGB_SIMD >= 1
+		for (; i + 4 <= count; i += 4)
+		{
+			const float * pSrc = (const float *)&pLinear[i];
+			__m128i c0 = LinearToSRGB8SSE2(_mm_loadu_ps(pSrc));
+			__m128i c1 = LinearToSRGB8SSE2(_mm_loadu_ps(pSrc + 4));
+			__m128i c2 = LinearToSRGB8SSE2(_mm_loadu_ps(pSrc + 8));
+			__m128i c3 = LinearToSRGB8SSE2(_mm_loadu_ps(pSrc + 12));
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+			_mm_storeu_si128((__m128i *)&pPixelsOut[i], packed);
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			float4 linear = pLinear[i];
+			pPixelsOut[i] = byte4(
+								LinearToSRGB8(linear.x),
+								LinearToSRGB8(linear.y),
+								LinearToSRGB8(linear.z),
+								LinearToUNorm8(linear.w));
+		}
+	}
+
+	void PremultiplyAlpha(
+		float4 * pLinear,
+		int count,
+		float alphaBias /* = 0.0f */)
+	{
+		ASSERT_ERR(count >= 0);
+		ASSERT_ERR(pLinear || count == 0);
+
+		int i = 0;
+
+#if SRGB_SIMD >= 2
+		__m256 bias = _mm256_set1_ps(alphaBias);
+		for (; i + 2 <= count; i += 2)
+		{
+			float * pData = (float *)&pLinear[i];
+			__m256 pixels = _mm256_loadu_ps(pData);
+			__m256 weight = _mm256_add_ps(_mm256_permute_ps(pixels, _MM_SHUFFLE(3, 3, 3, 3)), bias);
+			_mm256_storeu_ps(pData, _mm256_blend_ps(_mm256_mul_ps(pixels, weight), weight, 0x88));
+		}
+#elif SRGB_SIMD >= 1
+		__m128 bias = _mm_set1_ps(alphaBias);
+		__m128 maskAlpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+		for (; i < count; ++i)
+		{
+			float * pData = (float *)&pLinear[i];
+			__m128 pixel = _mm_loadu_ps(pData);
+			__m128 weight = _mm_add_ps(_mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3)), bias);
+			__m128 result = _mm_or_ps(_mm_andnot_ps(maskAlpha, _mm_mul_ps(pixel, weight)), _mm_and_ps(maskAlpha, weight));
+			_mm_storeu_ps(pData, result);
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			float4 pixel = pLinear[i];
+			float weight = pixel.w + alphaBias;
+			pLinear[i] = float4(pixel.x * weight, pixel.y * weight, pixel.z * weight, weight);
+		}
+	}
+
+	void UnpremultiplyAlpha(
+		float4 * pLinear,
+		int count,
+		float alphaBias /* = 0.0f */)
+	{
+		ASSERT_ERR(count >= 0);
+		ASSERT_ERR(pLinear || count == 0);
+
+		int i = 0;
+
+#if SRGB_SIMD >= 2
+		__m256 bias = _mm256_set1_ps(alphaBias);
+		__m256 one = _mm256_set1_ps(1.0f);
+		for (; i + 2 <= count; i += 2)
+		{
+			float * pData = (float *)&pLinear[i];
+			__m256 pixels = _mm256_loadu_ps(pData);
+			__m256 weight = _mm256_permute_ps(pixels, _MM_SHUFFLE(3, 3, 3, 3));
+			__m256 weightInv = _mm256_and_ps(
+									_mm256_cmp_ps(weight, _mm256_setzero_ps(), _CMP_GT_OQ),
+									_mm256_div_ps(one, weight));
+			__m256 alpha = _mm256_sub_ps(weight, bias);
+			_mm256_storeu_ps(pData, _mm256_blend_ps(_mm256_mul_ps(pixels, weightInv), alpha, 0x88));
+		}
+#elif SRGB_SIMD >= 1
+		__m128 bias = _mm_set1_ps(alphaBias);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 maskAlpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+		for (; i < count; ++i)
+		{
+			float * pData = (float *)&pLinear[i];
+			__m128 pixel = _mm_loadu_ps(pData);
+			__m128 weight = _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3));
+			__m128 weightInv = _mm_and_ps(_mm_cmpgt_ps(weight, _mm_setzero_ps()), _mm_div_ps(one, weight));
+			__m128 alpha = _mm_sub_ps(weight, bias);
+			__m128 result = _mm_or_ps(_mm_andnot_ps(maskAlpha, _mm_mul_ps(pixel, weightInv)), _mm_and_ps(maskAlpha, alpha));
+			_mm_storeu_ps(pData, result);
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			float4 pixel = pLinear[i];
+			float weightInv = (pixel.w > 0.0f) ? 1.0f / pixel.w : 0.0f;
+			pLinear[i] = float4(pixel.x * weightInv, pixel.y * weightInv, pixel.z * weightInv, pixel.w - alphaBias);
+		}
+	}
+
+
+
+	// Benchmark
+
+	void BenchmarkSRGBKernels(int count /* = 1 << 20 */)
+	{
+		ASSERT_ERR(count > 0);
+
+		static const char * s_isaNames[] = { "scalar", "SSE2", "AVX2" };
+		static const int s_repeats = 5;
+
+		// Random pixels, from a simple LCG
+		std::vector<byte4> pixels(count);
+		std::vector<float4> linear(count);
+		u32 seed = 1;
+		for (int i = 0; i < count; ++i)
+		{
+			seed = seed * 1664525 + 1013904223;
+			memcpy(&pixels[i], &seed, sizeof(byte4));
+		}
+		ConvertSRGB8ToLinear(&pixels[0], count, &linear[0]);
+
+		// Best time of several runs, in pixels per second
+		auto measure = [count](std::function<void ()> const & func)
+		{
+			float secondsBest = FLT_MAX;
+			for (int i = 0; i < s_repeats; ++i)
+			{
+				auto timeStart = std::chrono::steady_clock::now();
+				func();
+				float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - timeStart).count();
+				secondsBest = min(secondsBest, seconds);
+			}
+			return float(count) / max(secondsBest, 1e-9f);
+		};
+
+		float rateToLinear = measure([&]() { ConvertSRGB8ToLinear(&pixels[0], count, &linear[0]); });
+		float rateToSRGB8 = measure([&]() { ConvertLinearToSRGB8(&linear[0], count, &pixels[0]); });
+		float ratePremultiply = measure([&]() { PremultiplyAlpha(&linear[0], count); });
+		float rateUnpremultiply = measure([&]() { UnpremultiplyAlpha(&linear[0], count); });
+
+		LOG("sRGB kernels (%s), %d pixels: sRGB8 to linear %0.0f Mpix/s, linear to sRGB8 %0.0f Mpix/s, premultiply %0.0f Mpix/s, unpremultiply %0.0f Mpix/s",
+			s_isaNames[SRGB_SIMD], count,
+			rateToLinear * 1e-6f, rateToSRGB8 * 1e-6f, ratePremultiply * 1e-6f, rateUnpremultiply * 1e-6f);
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+namespace Framework
+{
+	// Bulk pixel conversions between sRGB8 and linear float, and alpha premultiplication.
+	// Shared by the texture compiler and by CPU-side processing of texture readbacks.
+	//
+	//  * Vectorized with AVX2 when the compiler targets it (/arch:AVX2), otherwise SSE2,
+	//      with a scalar fallback for other platforms.  See SRGB_SIMD in srgb.cpp.
+	//
+	//  * sRGB8 to linear is a table lookup.  Linear to sRGB8 interpolates a small table indexed
+	//      by the float's exponent and top mantissa bits (the stb_image_resize method); it's
+	//      within 0.544 of the exact value in 8-bit units, so it occasionally rounds the other
+	//      way right at a boundary.  Values outside [0, 1] are clamped, and NaNs go to 0.
+	//
+	//  * Alpha is linear on both sides, and just scaled by 255.
+
+	void ConvertSRGB8ToLinear(
+		const byte4 * pPixels,
+		int count,
+		float4 * pLinearOut);
+
+	void ConvertLinearToSRGB8(
+		const float4 * pLinear,
+		int count,
+		byte4 * pPixelsOut);
+
+	// Multiply color by alpha + alphaBias, and store alpha + alphaBias in alpha.  A small bias
+	// keeps the color of fully transparent pixels from being lost when filtering premultiplied
+	// data.  Unpremultiply reverses it, with the same bias; color with zero alpha stays zero.
+	void PremultiplyAlpha(
+		float4 * pLinear,
+		int count,
+		float alphaBias = 0.0f);
+
+	void UnpremultiplyAlpha(
+		float4 * pLinear,
+		int count,
+		float alphaBias = 0.0f);
+
+	// Time each of the above on a buffer of random pixels, and log their throughput
+	void BenchmarkSRGBKernels(int count = 1 << 20);
+}
@@ -191,75 +191,21 @@ bool TestWindow::Init(HINSTANCE hInstance)
 {
 	super::Init("TestWindow", "Test", hInstance);
 
-	// Ensure the asset pack is up to date
+	// Ensure the asset pack is up to date.  The material library and textures
+	// are found by following references from the mesh.
 	static const AssetCompileInfo s_assets[] =
 	{
 		{ "crytek-sponza/sponza.obj",								ACK_OBJMesh, },
-		{ "crytek-sponza/sponza.mtl",								ACK_OBJMtlLib, },
-		{ "crytek-sponza/textures/background.tga",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/backgroundbgr.tga",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/background_bump.png",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/chain_texture.tga",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/chain_texture_bump.png",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/chain_texture_mask.png",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/gi_flag.tga",						ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/lion.tga",						ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/lion2_bump.png",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/lion_bump.png",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/spnza_bricks_a_bump.png",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/spnza_bricks_a_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/spnza_bricks_a_spec.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_arch_bump.png",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_arch_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_arch_spec.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_ceiling_a_diff.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_ceiling_a_spec.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_a_bump.png",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_a_diff.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_a_spec.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_b_bump.png",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_b_diff.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_b_spec.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_c_bump.png",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_c_diff.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_column_c_spec.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_curtain_blue_diff.tga",	ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_curtain_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_curtain_green_diff.tga",	ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_details_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_details_spec.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_fabric_blue_diff.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_fabric_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_fabric_green_diff.tga",	ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_fabric_spec.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_flagpole_diff.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_flagpole_spec.tga",		ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_floor_a_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_floor_a_spec.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_roof_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_thorn_bump.png",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_thorn_diff.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_thorn_mask.png",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/sponza_thorn_spec.tga",			ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_bump.png",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_dif.tga",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_hanging.tga",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_plant.tga",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_plant_mask.png",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_plant_spec.tga",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_round.tga",					ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_round_bump.png",				ACK_TextureWithMips, },
-		{ "crytek-sponza/textures/vase_round_spec.tga",				ACK_TextureWithMips, },
 	};
 	comptr<AssetPack> pPack = new AssetPack;
-	if (!LoadAssetPackOrCompileIfOutOfDate("crytek-sponza-assets.zip", s_assets, dim(s_assets), pPack))
+	if (!LoadAssetPackOrCompileIfOutOfDate("crytek-sponza-assets.zip", s_assets, dim(s_assets), pPack, APFLAG_MemoryMap | APFLAG_Lazy))
 	{
 		ERR("Couldn't load or compile Sponza asset pack");
 		return false;
 	}
 
 	// Load assets
-	if (!LoadTextureLibFromAssetPack(pPack, s_assets, dim(s_assets), &m_texLibSponza))
+	if (!LoadTextureLibFromAssetPack(pPack, &m_texLibSponza))
 	{
 		ERR("Couldn't load Sponza texture library");
 		return false;
@@ -275,18 +221,7 @@ bool TestWindow::Init(HINSTANCE hInstance)
 		return false;
 	}
 
-	// Hardcode a list of alpha-tested materials, for now
-	static const char * s_aMtlAlphaTest[] =
-	{
-		"leaf",
-		"material__57",
-		"chain",
-	};
-	for (int i = 0; i < dim(s_aMtlAlphaTest); ++i)
-	{
-		if (Material * pMtl = m_mtlLibSponza.Lookup(s_aMtlAlphaTest[i]))
-			pMtl->m_alphaTest = true;
-	}
+	// Alpha-tested materials (leaf, material__57, chain) are marked by map_d in the .mtl
 
 	// Upload all assets to GPU
 	m_meshSponza.UploadToGPU(m_pDevice);
@@ -302,16 +237,14 @@ bool TestWindow::Init(HINSTANCE hInstance)
 	CHECK_D3D(m_pDevice->CreatePixelShader(shadow_alphatest_ps_bytecode, dim(shadow_alphatest_ps_bytecode), nullptr, &m_pPsShadowAlphaTest));
 	CHECK_D3D(m_pDevice->CreatePixelShader(tonemap_ps_bytecode, dim(tonemap_ps_bytecode), nullptr, &m_pPsTonemap));
 
-	// Initialize the input layout, and validate it against all the vertex shaders
+	// Initialize the input layout from the mesh's vertex format, and validate it against
+	// all the vertex shaders.  The shaders take float attributes, so the mesh is compiled
+	// with the default VTXFMT_Float.
 
-	D3D11_INPUT_ELEMENT_DESC aInputDescs[] =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, UINT(offsetof(Vertex, m_pos)), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, UINT(offsetof(Vertex, m_normal)), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "UV", 0, DXGI_FORMAT_R32G32_FLOAT, 0, UINT(offsetof(Vertex, m_uv)), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};
+	D3D11_INPUT_ELEMENT_DESC aInputDescs[VATTR_Count];
+	int numInputDescs = m_meshSponza.GetInputElementDescs(aInputDescs);
 	CHECK_D3D(m_pDevice->CreateInputLayout(
-							aInputDescs, dim(aInputDescs),
+							aInputDescs, numInputDescs,
 							world_vs_bytecode, dim(world_vs_bytecode),
 							&m_pInputLayout));
 
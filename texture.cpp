@@ -102,7 +102,7 @@ namespace Framework
 		{
 			D3D11_SUBRESOURCE_DATA * pInitialData = &aInitialData[i];
 			pInitialData->pSysMem = m_apPixels[i];
-			pInitialData->SysMemPitch = CalculateMipDims(m_dims.x, i) * BitsPerPixel(m_format) / 8;
+			pInitialData->SysMemPitch = CalculateRowPitch(CalculateMipDims(m_dims.x, i), m_format);
 			pInitialData->SysMemSlicePitch = 0;
 		}
 
@@ -156,9 +156,9 @@ namespace Framework
 		CHECK_D3D(pCtx->Map(pTexStaging, 0, D3D11_MAP_READ, 0, &mapped));
 
 		// Copy the data out row by row, in case the pitch is different
-		int rowSize = mipDims.x * BitsPerPixel(m_format) / 8;
+		int rowSize = CalculateRowPitch(mipDims.x, m_format);
 		ASSERT_ERR(mapped.RowPitch >= UINT(rowSize));
-		for (int y = 0; y < mipDims.y; ++y)
+		for (int y = 0, rowCount = CalculateRowCount(mipDims.y, m_format); y < rowCount; ++y)
 		{
 			memcpy(
 				offsetPtr(pDataOut, y * rowSize),
@@ -169,6 +169,28 @@ namespace Framework
 		pCtx->Unmap(pTexStaging, 0);
 	}
 
+	void Texture2D::ReadbackLinear(
+		ID3D11DeviceContext * pCtx,
+		int level,
+		float4 * pDataOut)
+	{
+		ASSERT_ERR(pDataOut);
+		ASSERT_ERR_MSG(
+			m_format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB || m_format == DXGI_FORMAT_R32G32B32A32_FLOAT,
+			"Can't read back texture of format %s as linear", NameOfFormat(m_format));
+
+		if (m_format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+		{
+			Readback(pCtx, level, pDataOut);
+			return;
+		}
+
+		int2 mipDims = CalculateMipDims(m_dims, level);
+		std::vector<byte4> pixels(mipDims.x * mipDims.y);
+		Readback(pCtx, level, &pixels[0]);
+		ConvertSRGB8ToLinear(&pixels[0], int(pixels.size()), pDataOut);
+	}
+
 
 
 	// TextureCube implementation
@@ -276,7 +298,7 @@ namespace Framework
 			{
 				D3D11_SUBRESOURCE_DATA * pInitialData = &aInitialData[face * m_mipLevels + level];
 				pInitialData->pSysMem = m_apPixels[face * m_mipLevels + level];
-				pInitialData->SysMemPitch = CalculateMipDims(m_cubeSize, level) * BitsPerPixel(m_format) / 8;
+				pInitialData->SysMemPitch = CalculateRowPitch(CalculateMipDims(m_cubeSize, level), m_format);
 				pInitialData->SysMemSlicePitch = 0;
 			}
 		}
@@ -334,9 +356,9 @@ namespace Framework
 		CHECK_D3D(pCtx->Map(pTexStaging, 0, D3D11_MAP_READ, 0, &mapped));
 
 		// Copy the data out row by row, in case the pitch is different
-		int rowSize = mipDim * BitsPerPixel(m_format) / 8;
+		int rowSize = CalculateRowPitch(mipDim, m_format);
 		ASSERT_ERR(mapped.RowPitch >= UINT(rowSize));
-		for (int y = 0; y < mipDim; ++y)
+		for (int y = 0, rowCount = CalculateRowCount(mipDim, m_format); y < rowCount; ++y)
 		{
 			memcpy(
 				offsetPtr(pDataOut, y * rowSize),
@@ -448,8 +470,8 @@ namespace Framework
 			int3 mipDims = CalculateMipDims(m_dims, i);
 			D3D11_SUBRESOURCE_DATA * pInitialData = &aInitialData[i];
 			pInitialData->pSysMem = m_apPixels[i];
-			pInitialData->SysMemPitch = mipDims.x * BitsPerPixel(m_format) / 8;
-			pInitialData->SysMemSlicePitch = pInitialData->SysMemPitch * mipDims.y;
+			pInitialData->SysMemPitch = CalculateRowPitch(mipDims.x, m_format);
+			pInitialData->SysMemSlicePitch = pInitialData->SysMemPitch * CalculateRowCount(mipDims.y, m_format);
 		}
 
 		CHECK_D3D(pDevice->CreateTexture3D(&texDesc, &aInitialData[0], &m_pTex));
@@ -502,13 +524,14 @@ namespace Framework
 		CHECK_D3D(pCtx->Map(pTexStaging, 0, D3D11_MAP_READ, 0, &mapped));
 
 		// Copy the data out slice by slice and row by row, in case the pitches are different
-		int rowSize = mipDims.x * BitsPerPixel(m_format) / 8;
-		int sliceSize = mipDims.y * rowSize;
+		int rowSize = CalculateRowPitch(mipDims.x, m_format);
+		int rowCount = CalculateRowCount(mipDims.y, m_format);
+		int sliceSize = rowCount * rowSize;
 		ASSERT_ERR(mapped.RowPitch >= UINT(rowSize));
 		ASSERT_ERR(mapped.DepthPitch >= UINT(sliceSize));
 		for (int z = 0; z < mipDims.z; ++z)
 		{
-			for (int y = 0; y < mipDims.y; ++y)
+			for (int y = 0; y < rowCount; ++y)
 			{
 				memcpy(
 					offsetPtr(pDataOut, z * sliceSize + y * rowSize),
@@ -652,7 +675,7 @@ namespace Framework
 			0, 0,
 		};
 
-		D3D11_SUBRESOURCE_DATA initialData = { pPixels, UINT(dims.x * BitsPerPixel(format) / 8) };
+		D3D11_SUBRESOURCE_DATA initialData = { pPixels, UINT(CalculateRowPitch(dims.x, format)) };
 		comptr<ID3D11Texture2D> pTex;
 		CHECK_D3D(pDevice->CreateTexture2D(&texDesc, &initialData, &pTex));
 
@@ -1105,6 +1128,12 @@ namespace Framework
 		return s_typelessFormat[format];
 	}
 
+	bool IsBlockCompressed(DXGI_FORMAT format)
+	{
+		return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+			   (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	}
+
 
 
 	// Helper functions for saving out screenshots of textures
@@ -1185,12 +1214,24 @@ namespace Framework
 		ASSERT_ERR(level >= 0 && level < pTex->m_mipLevels);
 		ASSERT_ERR(path);
 
-		// Currently the texture must be in RGBA8 format
-		ASSERT_ERR(pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM || pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+		// Currently the texture must be in RGBA8 format, or float RGBA, which is converted to sRGB
+		ASSERT_ERR(
+			pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM ||
+			pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB ||
+			pTex->m_format == DXGI_FORMAT_R32G32B32A32_FLOAT);
 
 		int2 mipDims = CalculateMipDims(pTex->m_dims, level);
 		std::vector<byte4> pixels(mipDims.x * mipDims.y);
-		pTex->Readback(pCtx, level, &pixels[0]);
+		if (pTex->m_format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+		{
+			std::vector<float4> linear(pixels.size());
+			pTex->Readback(pCtx, level, &linear[0]);
+			ConvertLinearToSRGB8(&linear[0], int(linear.size()), &pixels[0]);
+		}
+		else
+		{
+			pTex->Readback(pCtx, level, &pixels[0]);
+		}
 
 		return WriteBMPToFile(&pixels[0], mipDims, path);
 	}
@@ -1209,12 +1250,24 @@ namespace Framework
 		ASSERT_ERR(level >= 0 && level < pTex->m_mipLevels);
 		ASSERT_ERR(path);
 
-		// Currently the texture must be in RGBA8 format
-		ASSERT_ERR(pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM || pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+		// Currently the texture must be in RGBA8 format, or float RGBA, which is converted to sRGB
+		ASSERT_ERR(
+			pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM ||
+			pTex->m_format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB ||
+			pTex->m_format == DXGI_FORMAT_R32G32B32A32_FLOAT);
 
 		int mipDim = CalculateMipDims(pTex->m_cubeSize, level);
 		std::vector<byte4> pixels(mipDim * mipDim);
-		pTex->Readback(pCtx, face, level, &pixels[0]);
+		if (pTex->m_format == DXGI_FORMAT_R32G32B32A32_FLOAT)
+		{
+			std::vector<float4> linear(pixels.size());
+			pTex->Readback(pCtx, face, level, &linear[0]);
+			ConvertLinearToSRGB8(&linear[0], int(linear.size()), &pixels[0]);
+		}
+		else
+		{
+			pTex->Readback(pCtx, face, level, &pixels[0]);
+		}
 
 		return WriteBMPToFile(&pixels[0], int2(mipDim), path);
 	}
@@ -7,8 +7,23 @@ namespace Framework
 	int BitsPerPixel(DXGI_FORMAT format);
 	DXGI_FORMAT FindTypelessFormat(DXGI_FORMAT format);
 
+	// Block-compressed formats are stored as 4x4 blocks; BitsPerPixel gives their average rate,
+	// and a mip smaller than a block still takes up a whole one
+	bool IsBlockCompressed(DXGI_FORMAT format);
+
+	// Bytes per row of pixels, or per row of blocks for block-compressed formats
+	inline int CalculateRowPitch(int width, DXGI_FORMAT format)
+	{
+		if (IsBlockCompressed(format))
+			return ((width + 3) / 4) * BitsPerPixel(format) * 2;
+		return width * BitsPerPixel(format) / 8;
+	}
+
+	// Number of rows of pixels, or of blocks for block-compressed formats
+	inline int CalculateRowCount(int height, DXGI_FORMAT format)
+		{ return IsBlockCompressed(format) ? (height + 3) / 4 : height; }
+
 	// Utility functions for counting mips
-	// Note: these don't take into account minimum block sizes for compressed formats.
 
 	inline int CalculateMipCount(int size)
 		{ return log2_floor(size) + 1; }
@@ -25,11 +40,11 @@ namespace Framework
 		{ return max(int3(baseDims.x >> level, baseDims.y >> level, baseDims.z >> level), int3(1)); }
 
 	inline int CalculateMipSizeInBytes(int baseDim, int level, DXGI_FORMAT format)
-		{ return square(CalculateMipDims(baseDim, level)) * BitsPerPixel(format); }
+		{ int mipDim = CalculateMipDims(baseDim, level); return CalculateRowPitch(mipDim, format) * CalculateRowCount(mipDim, format); }
 	inline int CalculateMipSizeInBytes(int2 baseDims, int level, DXGI_FORMAT format)
-		{ int2 mipDims = CalculateMipDims(baseDims, level); return mipDims.x * mipDims.y * BitsPerPixel(format); }
+		{ int2 mipDims = CalculateMipDims(baseDims, level); return CalculateRowPitch(mipDims.x, format) * CalculateRowCount(mipDims.y, format); }
 	inline int CalculateMipSizeInBytes(int3 baseDims, int level, DXGI_FORMAT format)
-		{ int3 mipDims = CalculateMipDims(baseDims, level); return mipDims.x * mipDims.y * mipDims.z * BitsPerPixel(format); }
+		{ int3 mipDims = CalculateMipDims(baseDims, level); return CalculateRowPitch(mipDims.x, format) * CalculateRowCount(mipDims.y, format) * mipDims.z; }
 
 	inline int CalculateMipPyramidSizeInBytes(int baseDim, DXGI_FORMAT format, int mipLevels = -1)
 	{
@@ -59,8 +74,25 @@ namespace Framework
 		return total;
 	}
 
+	enum TEXFMT					// Pixel format a texture is compiled to
+	{
+		TEXFMT_Auto,			// By the source: R8 or RG8 for one or two channels, R11G11B10F or RGBA16F for HDR, else RGBA8
+		TEXFMT_RGBA8,			// Uncompressed sRGB color
+		TEXFMT_BC1or3,			// sRGB color: BC1 if the alpha is all opaque, else BC3
+		TEXFMT_BC4,				// Linear single channel (red), e.g. bump or height maps
+		TEXFMT_BC5,				// Linear two channels (red and green), e.g. tangent-space normal maps
+		TEXFMT_BC7,				// sRGB color and alpha, at the same size as BC3 but higher quality
+		TEXFMT_R8,				// Uncompressed linear single channel, e.g. masks
+		TEXFMT_RG8,				// Uncompressed linear two channels; grey + alpha sources give (grey, alpha)
+		TEXFMT_RGBA16F,			// HDR linear color and alpha, as half floats
+		TEXFMT_R11G11B10F,		// HDR linear color with no alpha, at half the size of RGBA16F
+
+		TEXFMT_Count
+	};
+
 
 
+#if !FRAMEWORK_HEADLESS
 	enum TEXFLAG
 	{
 		TEXFLAG_Mipmaps		= 0x01,
@@ -76,7 +108,7 @@ namespace Framework
 		comptr<AssetPack>			m_pPack;
 
 		// Pointers to pixel data in the asset pack, for each mip level
-		std::vector<void *>			m_apPixels;
+		std::vector<const void *>	m_apPixels;
 		int2						m_dims;
 		int							m_mipLevels;
 		DXGI_FORMAT					m_format;
@@ -109,6 +141,12 @@ namespace Framework
 					ID3D11DeviceContext * pCtx,
 					int level,
 					void * pDataOut);
+
+		// Read back as linear float RGBA, converting from sRGB8 if necessary
+		void	ReadbackLinear(
+					ID3D11DeviceContext * pCtx,
+					int level,
+					float4 * pDataOut);
 	};
 
 	class TextureCube
@@ -118,7 +156,7 @@ namespace Framework
 		comptr<AssetPack>			m_pPack;
 
 		// Pointers to pixel data in the asset pack, for each mip level and cube face
-		std::vector<void *>			m_apPixels;
+		std::vector<const void *>	m_apPixels;
 		int							m_cubeSize;
 		int							m_mipLevels;
 		DXGI_FORMAT					m_format;
@@ -159,7 +197,7 @@ namespace Framework
 		comptr<AssetPack>			m_pPack;
 
 		// Pointers to pixel data in the asset pack, for each mip level
-		std::vector<void *>			m_apPixels;
+		std::vector<const void *>	m_apPixels;
 		int3						m_dims;
 		int							m_mipLevels;
 		DXGI_FORMAT					m_format;
@@ -251,6 +289,11 @@ namespace Framework
 	};
 
 	// Create a library of all the textures in an asset pack
+	bool LoadTextureLibFromAssetPack(
+		AssetPack * pPack,
+		TextureLib * pTexLibOut);
+
+	// Create a library of the textures in an asset pack from a given list of assets
 	struct AssetCompileInfo;
 	bool LoadTextureLibFromAssetPack(
 		AssetPack * pPack,
@@ -280,4 +323,5 @@ namespace Framework
 		int face,
 		int level,
 		const char * path);
+#endif // !FRAMEWORK_HEADLESS
 }